@@ -0,0 +1,447 @@
+/**
+   @file bench.c
+   @author Michael Warstler (mwwarstl)
+   Benchmark for the database functions. Generates synthetic data for all eleven tables in
+   database.h at a chosen scale, then runs a few mixed workloads of point selects, foreign key
+   selects, inserts, updates, deletes, and write_file against it, calling the database functions
+   directly. Each operation is timed on the monotonic clock, and the throughput and p50, p99, and
+   p999 latency of every operation in every workload are printed as JSON.
+
+   usage: bench [--rows <count>] [--ops <count>] [--dir <path>] [--seed <number>]
+   Rows is the size of the largest tables (checkout and notification, 1000 to 10000000); the
+   other tables are scaled from it. Ops is the number of operations per workload. The tables are
+   written to <path>/tables, which is ./bench_data/tables by default.
+*/
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "database.h"
+#include "scan.h"
+#include "sink.h"
+
+/** Fewest rows the largest tables may be generated with */
+#define MIN_ROWS 1000
+/** Most rows the largest tables may be generated with */
+#define MAX_ROWS 10000000
+/** Number of categories, which does not grow with the scale */
+#define CATEGORIES 40
+/** Fewest rows any scaled table is generated with */
+#define MIN_TABLE_ROWS 10
+
+/** Kinds of operation a workload runs */
+typedef enum {
+    POINT_SELECT,
+    FK_SELECT,
+    INSERT_ROW,
+    UPDATE_ROW,
+    DELETE_ROW,
+    WRITE_FILE_OP,
+    OPERATION_COUNT
+} Operation;
+
+/** Names of the operations, as printed in the JSON */
+static const char *operation_names[OPERATION_COUNT] = {
+    "point_select", "fk_select", "insert", "update", "delete", "write_file"
+};
+
+/** A Workload is a name and how many of every thousand operations are of each kind. */
+typedef struct {
+    const char *name;
+    int weights[OPERATION_COUNT];
+} Workload;
+
+/** The workloads run, in order */
+static const Workload workloads[] = {
+    { "read_mostly", { 600, 300, 50, 50, 0, 0 } },
+    { "mixed", { 300, 200, 200, 150, 148, 2 } },
+    { "write_heavy", { 50, 50, 500, 200, 200, 0 } }
+};
+
+/** Number of rows in each table for one scale */
+typedef struct {
+    long checkout;
+    long notification;
+    long hold;
+    long book_copy;
+    long book;
+    long book_author;
+    long member_account;
+    long waitlist;
+    long author;
+    long publisher;
+    long category;
+} Scale;
+
+/** The latencies of one operation in one workload, in nanoseconds */
+typedef struct {
+    uint64_t *samples;
+    long count;
+    uint64_t total;
+} Timings;
+
+/** Words titles are made from */
+static const char *title_words[] = {
+    "Silent", "River", "Winter", "Garden", "Shadow", "Empire", "Glass", "Ocean", "Last", "Letter",
+    "Iron", "Crown", "Hidden", "City", "Secret", "Night", "Golden", "Road", "Broken", "Star",
+    "Northern", "Light", "Paper", "House", "Wild", "Orchard", "Distant", "Shore", "Lost", "Map"
+};
+/** First names of authors and members */
+static const char *first_names[] = {
+    "Ann", "Bob", "Carmen", "David", "Elena", "Farid", "Grace", "Hiro", "Ines", "Jonas",
+    "Keiko", "Liam", "Maya", "Noah", "Olga", "Priya", "Quinn", "Rosa", "Sam", "Tariq"
+};
+/** Last names of authors and members */
+static const char *last_names[] = {
+    "Smith", "Jones", "Garcia", "Chen", "Okafor", "Novak", "Silva", "Kim", "Larsen", "Patel",
+    "Rossi", "Muller", "Haddad", "Ito", "Walsh", "Moreau", "Ivanova", "Nguyen", "Costa", "Berg"
+};
+/** Messages notifications carry */
+static const char *messages[] = {
+    "Your book is due", "Hold ready", "Book overdue", "Waitlist position changed",
+    "Renewal confirmed", "Account updated"
+};
+
+/** Number of elements in an array */
+#define COUNT( array ) ( ( long )( sizeof( array ) / sizeof( ( array )[0] ) ) )
+
+/** State of the random number generator (xorshift64) */
+static uint64_t random_state = 88172645463325252ull;
+
+/** Returns a random number from 0 up to but not including limit. */
+static long random_below( long limit ) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return ( long )( random_state % ( uint64_t )limit );
+}
+
+/** Returns the time on the monotonic clock in nanoseconds. */
+static uint64_t now_ns( void ) {
+    struct timespec time;
+    clock_gettime( CLOCK_MONOTONIC, &time );
+    return ( uint64_t )time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+/** Returns a table's size at a scale, never fewer than MIN_TABLE_ROWS rows. */
+static long scaled( long rows, long divisor ) {
+    return rows / divisor > MIN_TABLE_ROWS ? rows / divisor : MIN_TABLE_ROWS;
+}
+
+/** Works out every table's size from the size of the largest. */
+static Scale make_scale( long rows ) {
+    Scale scale = { rows, rows, scaled( rows, 4 ), scaled( rows, 4 ), scaled( rows, 8 ),
+                    scaled( rows, 8 ), scaled( rows, 20 ), scaled( rows, 20 ), scaled( rows, 40 ),
+                    scaled( rows, 1000 ), CATEGORIES };
+    return scale;
+}
+
+/** Opens a table file for writing generated rows, exiting if it cannot be created. */
+static FILE *create_table_data( const char *table_name ) {
+    char path[MAX_STR_LENGTH];
+    snprintf( path, sizeof( path ), "%s/%s", folder, table_name );
+    FILE *file = fopen( path, "w" );
+    if ( file == NULL ) {
+        fprintf( stderr, "Unable to create %s\n", path );
+        exit( EXIT_FAILURE );
+    }
+    return file;
+}
+
+/** Writes a random date between 2015 and 2024, and the date two weeks later, to a row. */
+static void print_dates( FILE *file ) {
+    int day = 1 + random_below( 14 ), month = 1 + random_below( 12 );
+    int year = 2015 + random_below( 10 );
+    fprintf( file, "%02d-%02d-%4d %02d-%02d-%4d", day, month, year, day + 14, month, year );
+}
+
+/** Writes a random title of two or three words to a row. */
+static void print_title( FILE *file ) {
+    fprintf( file, "\"%s %s", title_words[ random_below( COUNT( title_words ) ) ],
+             title_words[ random_below( COUNT( title_words ) ) ] );
+    if ( random_below( 2 ) == 0 ) {
+        fprintf( file, " %s", title_words[ random_below( COUNT( title_words ) ) ] );
+    }
+    fputc( '"', file );
+}
+
+/** Generates every table at a scale, each row formatted as the table's schema stores it. */
+static void generate_tables( const Scale *scale ) {
+    FILE *file = create_table_data( "category" );
+    for ( long id = 1; id <= scale->category; id++ ) {
+        fprintf( file, "%ld \"%s\"\n", id, title_words[ ( id - 1 ) % COUNT( title_words ) ] );
+    }
+    fclose( file );
+
+    file = create_table_data( "author" );
+    for ( long id = 1; id <= scale->author; id++ ) {
+        fprintf( file, "%ld \"%s %s\"\n", id, first_names[ random_below( COUNT( first_names ) ) ],
+                 last_names[ random_below( COUNT( last_names ) ) ] );
+    }
+    fclose( file );
+
+    file = create_table_data( "publisher" );
+    for ( long id = 1; id <= scale->publisher; id++ ) {
+        fprintf( file, "%ld \"%s House %ld\"\n", id,
+                 last_names[ random_below( COUNT( last_names ) ) ], id );
+    }
+    fclose( file );
+
+    file = create_table_data( "book" );
+    for ( long id = 1; id <= scale->book; id++ ) {
+        fprintf( file, "%ld ", id );
+        print_title( file );
+        fprintf( file, " %ld\n", 1 + random_below( scale->category ) );
+    }
+    fclose( file );
+
+    file = create_table_data( "book_author" );
+    for ( long row = 0; row < scale->book_author; row++ ) {
+        fprintf( file, "%ld %ld\n", 1 + row % scale->book, 1 + random_below( scale->author ) );
+    }
+    fclose( file );
+
+    file = create_table_data( "book_copy" );
+    for ( long id = 1; id <= scale->book_copy; id++ ) {
+        fprintf( file, "%ld %ld %ld %ld\n", id, 1 + random_below( scale->book ),
+                 1 + random_below( scale->publisher ), 1950 + random_below( 75 ) );
+    }
+    fclose( file );
+
+    file = create_table_data( "member_account" );
+    for ( long id = 1; id <= scale->member_account; id++ ) {
+        const char *first = first_names[ random_below( COUNT( first_names ) ) ];
+        const char *last = last_names[ random_below( COUNT( last_names ) ) ];
+        fprintf( file, "%ld \"%s\" \"%s\" \"%s.%s%ld@example.org\"\n", id, first, last, first,
+                 last, id );
+    }
+    fclose( file );
+
+    // Most checkouts have been returned; holds and notifications belong to random members.
+    file = create_table_data( "checkout" );
+    for ( long id = 1; id <= scale->checkout; id++ ) {
+        fprintf( file, "%ld ", id );
+        print_dates( file );
+        fprintf( file, " %ld %ld %d\n", 1 + random_below( scale->book_copy ),
+                 1 + random_below( scale->member_account ), random_below( 5 ) != 0 );
+    }
+    fclose( file );
+
+    file = create_table_data( "hold" );
+    for ( long id = 1; id <= scale->hold; id++ ) {
+        fprintf( file, "%ld ", id );
+        print_dates( file );
+        fprintf( file, " %ld %ld\n", 1 + random_below( scale->book_copy ),
+                 1 + random_below( scale->member_account ) );
+    }
+    fclose( file );
+
+    file = create_table_data( "waitlist" );
+    for ( long row = 0; row < scale->waitlist; row++ ) {
+        fprintf( file, "%ld %ld\n", 1 + random_below( scale->book ),
+                 1 + random_below( scale->member_account ) );
+    }
+    fclose( file );
+
+    file = create_table_data( "notification" );
+    for ( long id = 1; id <= scale->notification; id++ ) {
+        int day = 1 + random_below( 28 ), month = 1 + random_below( 12 );
+        fprintf( file, "%ld %02d-%02d-%4ld %ld \"%s\"\n", id, day, month, 2015 + random_below( 10 ),
+                 1 + random_below( scale->member_account ),
+                 messages[ random_below( COUNT( messages ) ) ] );
+    }
+    fclose( file );
+}
+
+/** Picks an operation by the workload's weights. */
+static Operation pick_operation( const Workload *workload ) {
+    long pick = random_below( 1000 );
+    for ( int operation = 0; operation < OPERATION_COUNT; operation++ ) {
+        pick -= workload->weights[operation];
+        if ( pick < 0 ) {
+            return ( Operation )operation;
+        }
+    }
+    return POINT_SELECT;
+}
+
+/** Runs one operation with random arguments. Its output goes to the discarded output sink. */
+static void run_operation( Operation operation, const Scale *scale, long *next_checkout ) {
+    char value[32];
+    char row[MAX_STR_LENGTH];
+    switch ( operation ) {
+        case POINT_SELECT:
+            snprintf( value, sizeof( value ), "%ld", 1 + random_below( scale->book ) );
+            select_from_table( "book", "", "id", "==", value );
+            break;
+
+        case FK_SELECT:
+            snprintf( value, sizeof( value ), "%ld", 1 + random_below( scale->member_account ) );
+            select_from_table( "checkout", "", "member_id", "==", value );
+            break;
+
+        case INSERT_ROW:
+            snprintf( row, sizeof( row ), "%ld 02-01-2025 16-01-2025 %ld %ld 0", ( *next_checkout )++,
+                      1 + random_below( scale->book_copy ),
+                      1 + random_below( scale->member_account ) );
+            insert_into_table( "checkout", row );
+            break;
+
+        case UPDATE_ROW: {
+            long id = 1 + random_below( scale->member_account );
+            const char *first = first_names[ random_below( COUNT( first_names ) ) ];
+            const char *last = last_names[ random_below( COUNT( last_names ) ) ];
+            snprintf( value, sizeof( value ), "%ld", id );
+            snprintf( row, sizeof( row ), "\"%s\" \"%s\" \"%s.%s%ld@example.net\"", first, last,
+                      first, last, id );
+            update( "member_account", value, row );
+            break;
+        }
+
+        case DELETE_ROW:
+            snprintf( value, sizeof( value ), "%ld", 1 + random_below( scale->notification ) );
+            delete_row( "notification", value );
+            break;
+
+        case WRITE_FILE_OP:
+            write_database_file( "bench_dump" );
+            break;
+
+        default:
+            break;
+    }
+}
+
+/** Orders latencies from fastest to slowest. */
+static int compare_samples( const void *first, const void *second ) {
+    uint64_t a = *( const uint64_t * )first, b = *( const uint64_t * )second;
+    return ( a > b ) - ( a < b );
+}
+
+/** Returns a percentile of sorted latencies, in microseconds. */
+static double percentile( const Timings *timings, double fraction ) {
+    long rank = ( long )( fraction * timings->count + 0.999999 ) - 1;
+    rank = rank < 0 ? 0 : rank >= timings->count ? timings->count - 1 : rank;
+    return timings->samples[rank] / 1000.0;
+}
+
+/** Runs a workload, timing every operation, and prints its results as a JSON object. */
+static void run_workload( const Workload *workload, const Scale *scale, long operations,
+                          long *next_checkout, Sink *discard, bool first ) {
+    Timings timings[OPERATION_COUNT] = { { NULL, 0, 0 } };
+    for ( int operation = 0; operation < OPERATION_COUNT; operation++ ) {
+        timings[operation].samples = ( uint64_t * )malloc( operations * sizeof( uint64_t ) );
+        if ( timings[operation].samples == NULL ) {
+            fprintf( stderr, "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    uint64_t start = now_ns();
+    for ( long i = 0; i < operations; i++ ) {
+        Operation operation = pick_operation( workload );
+        uint64_t begin = now_ns();
+        run_operation( operation, scale, next_checkout );
+        uint64_t elapsed = now_ns() - begin;
+        discard->length = 0;
+
+        Timings *timing = &timings[operation];
+        timing->samples[ timing->count++ ] = elapsed;
+        timing->total += elapsed;
+    }
+    double seconds = ( now_ns() - start ) / 1e9;
+
+    printf( "%s    {\n      \"name\": \"%s\",\n      \"ops\": %ld,\n      \"seconds\": %.6f,\n"
+            "      \"ops_per_second\": %.1f,\n      \"operations\": {", first ? "" : ",\n",
+            workload->name, operations, seconds, seconds > 0 ? operations / seconds : 0.0 );
+    bool listed = false;
+    for ( int operation = 0; operation < OPERATION_COUNT; operation++ ) {
+        Timings *timing = &timings[operation];
+        if ( timing->count > 0 ) {
+            qsort( timing->samples, timing->count, sizeof( uint64_t ), compare_samples );
+            printf( "%s\n        \"%s\": { \"count\": %ld, \"ops_per_second\": %.1f, "
+                    "\"p50_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f }", listed ? "," : "",
+                    operation_names[operation], timing->count,
+                    timing->total > 0 ? timing->count / ( timing->total / 1e9 ) : 0.0,
+                    percentile( timing, 0.50 ), percentile( timing, 0.99 ),
+                    percentile( timing, 0.999 ) );
+            listed = true;
+        }
+        free( timing->samples );
+    }
+    printf( "\n      }\n    }" );
+}
+
+/**
+   Parses the options, generates the tables, and runs every workload.
+   @param argc is number of command line arguments.
+   @param argv is the command line arguments.
+   @return is exit status.
+*/
+int main( int argc, char *argv[] ) {
+    long rows = 100000;
+    long operations = 1000;
+    const char *directory = "./bench_data";
+    unsigned long long seed = 1;
+    for ( int i = 1; i < argc; i++ ) {
+        if ( strcmp( argv[i], "--rows" ) == 0 && i + 1 < argc ) {
+            rows = atol( argv[++i] );
+        }
+        else if ( strcmp( argv[i], "--ops" ) == 0 && i + 1 < argc ) {
+            operations = atol( argv[++i] );
+        }
+        else if ( strcmp( argv[i], "--dir" ) == 0 && i + 1 < argc ) {
+            directory = argv[++i];
+        }
+        else if ( strcmp( argv[i], "--seed" ) == 0 && i + 1 < argc ) {
+            seed = strtoull( argv[++i], NULL, 10 );
+        }
+        else {
+            rows = -1;
+            break;
+        }
+    }
+    if ( rows < MIN_ROWS || rows > MAX_ROWS || operations < 1 ) {
+        fprintf( stderr, "usage: %s [--rows <%d-%d>] [--ops <count>] [--dir <path>] "
+                 "[--seed <number>]\n", argv[0], MIN_ROWS, MAX_ROWS );
+        return EXIT_FAILURE;
+    }
+    random_state ^= seed * 0x9E3779B97F4A7C15ull;
+
+    // The tables go in their own folder under the benchmark directory.
+    static char tables[MAX_STR_LENGTH];
+    snprintf( tables, sizeof( tables ), "%s/tables", directory );
+    if ( ( mkdir( directory, 0777 ) != 0 && errno != EEXIST ) ||
+         ( mkdir( tables, 0777 ) != 0 && errno != EEXIST ) ) {
+        fprintf( stderr, "Unable to create %s\n", tables );
+        return EXIT_FAILURE;
+    }
+    folder = tables;
+
+    Scale scale = make_scale( rows );
+    uint64_t start = now_ns();
+    generate_tables( &scale );
+    double load_seconds = ( now_ns() - start ) / 1e9;
+
+    // Query output is collected in a memory sink and thrown away after every operation.
+    Sink discard;
+    if ( sink_open_memory( &discard, SINK_BUFFER_SIZE ) != EXIT_SUCCESS ) {
+        fprintf( stderr, "Memory allocation error\n" );
+        return EXIT_FAILURE;
+    }
+    set_scan_options( 0, true );
+
+    printf( "{\n  \"rows\": %ld,\n  \"ops_per_workload\": %ld,\n  \"seed\": %llu,\n"
+            "  \"scan_threads\": %d,\n  \"load_seconds\": %.6f,\n  \"workloads\": [\n", rows,
+            operations, seed, scan_threads(), load_seconds );
+    long next_checkout = scale.checkout + 1;
+    for ( int i = 0; i < ( int )COUNT( workloads ); i++ ) {
+        set_output_sink( &discard );
+        run_workload( &workloads[i], &scale, operations, &next_checkout, &discard, i == 0 );
+        set_output_sink( NULL );
+        fflush( stdout );
+    }
+    printf( "\n  ]\n}\n" );
+    free( discard.buffer );
+    return EXIT_SUCCESS;
+}
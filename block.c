@@ -0,0 +1,657 @@
+/**
+   @file block.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for compressed tables. Streams and stdio files over a compressed table
+   decode it one block at a time; stdio files use fopencookie so the code that rewrites a table a
+   line at a time works the same on both kinds. Plain tables get stdio files over storage the
+   same way, so storage counts the bytes of both. The block cache is a fixed table of slots, each
+   holding one decoded block under its file id and offset. A slot is replaced when another block
+   hashes to it, and the least recently used blocks are dropped when the cache is full; blocks in
+   use by a scan are never dropped.
+*/
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include "block.h"
+#include "database.h"
+#include "lz.h"
+#include "sink.h"
+#include "trace.h"
+
+/** Number of slots in the block cache */
+#define CACHE_SLOTS 4096
+
+/** A CachedBlock is a decoded block in the cache and the number of readers using it. */
+struct CachedBlock {
+    uint64_t file_id;
+    off_t offset;
+    char *data;
+    size_t length;
+    int users;
+    unsigned long used;
+};
+
+/** The block cache. */
+static struct {
+    pthread_mutex_t lock;
+    CachedBlock slots[CACHE_SLOTS];
+    size_t bytes;
+    unsigned long clock;
+    unsigned long hits;         // blocks taken from the cache
+    unsigned long misses;       // blocks decoded
+    unsigned long evictions;    // blocks dropped to make room
+} cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/** Allocates memory, exiting if there is none. */
+static void *allocate( size_t size ) {
+    void *memory = malloc( size );
+    if ( memory == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    return memory;
+}
+
+/** Reads a block header. Returns false if the lengths are not ones a block can have. */
+static bool block_lengths( const char *header, size_t *text, size_t *stored ) {
+    uint32_t lengths[2];
+    memcpy( lengths, header, sizeof( lengths ) );
+    *text = lengths[0];
+    *stored = lengths[1];
+    return *text > 0 && *text <= MAX_BLOCK_SIZE && *stored > 0 && *stored <= *text;
+}
+
+/** Returns whether a table file is compressed. */
+bool table_compressed( int fd ) {
+    char magic[BLOCK_MAGIC_LENGTH];
+    return storage_read_at( fd, magic, sizeof( magic ), 0 ) == sizeof( magic ) &&
+           memcmp( magic, BLOCK_MAGIC, sizeof( magic ) ) == 0;
+}
+
+/** Returns the id of a compressed table file. */
+uint64_t block_file_id( const char *data ) {
+    uint64_t id;
+    memcpy( &id, data + BLOCK_MAGIC_LENGTH, sizeof( id ) );
+    return id;
+}
+
+/** Returns the cache slot of a block. */
+static unsigned cache_slot( uint64_t file_id, off_t offset ) {
+    uint64_t key = file_id ^ ( uint64_t )offset * 0x9E3779B97F4A7C15ull;
+    return ( unsigned )( ( key ^ key >> 29 ) % CACHE_SLOTS );
+}
+
+/** Drops a block from the cache. Called with the cache locked. */
+static void drop_entry( CachedBlock *entry ) {
+    free( entry->data );
+    cache.bytes -= entry->length;
+    cache.evictions++;
+    entry->data = NULL;
+    entry->length = 0;
+}
+
+/**
+   Drops the least recently used blocks nobody is using until bytes more fit. Called with the
+   cache locked. Returns false if they cannot be made to fit.
+*/
+static bool make_room( size_t bytes ) {
+    while ( cache.bytes + bytes > BLOCK_CACHE_SIZE ) {
+        CachedBlock *oldest = NULL;
+        for ( int i = 0; i < CACHE_SLOTS; i++ ) {
+            CachedBlock *entry = &cache.slots[i];
+            if ( entry->data != NULL && entry->users == 0 &&
+                 ( oldest == NULL || entry->used < oldest->used ) ) {
+                oldest = entry;
+            }
+        }
+        if ( oldest == NULL ) {
+            return false;
+        }
+        drop_entry( oldest );
+    }
+    return true;
+}
+
+/** Takes a block from the cache if it is there. Called with the cache locked. */
+static bool cache_hit( CachedBlock *entry, uint64_t file_id, off_t offset, DecodedBlock *decoded ) {
+    if ( entry->data == NULL || entry->file_id != file_id || entry->offset != offset ) {
+        return false;
+    }
+    entry->users++;
+    entry->used = ++cache.clock;
+    decoded->data = entry->data;
+    decoded->entry = entry;
+    return true;
+}
+
+/** Decodes a block through the cache. */
+int decode_block( uint64_t file_id, off_t offset, const char *block, size_t available,
+                  DecodedBlock *decoded ) {
+    size_t text, stored;
+    if ( available < BLOCK_HEADER_SIZE || !block_lengths( block, &text, &stored ) ||
+         available - BLOCK_HEADER_SIZE < stored ) {
+        return EXIT_FAILURE;
+    }
+    *decoded = ( DecodedBlock ){ block + BLOCK_HEADER_SIZE, text, NULL, NULL };
+    if ( stored == text ) {
+        return EXIT_SUCCESS;    // Stored as it is.
+    }
+
+    CachedBlock *entry = &cache.slots[ cache_slot( file_id, offset ) ];
+    pthread_mutex_lock( &cache.lock );
+    bool hit = cache_hit( entry, file_id, offset, decoded );
+    if ( hit ) {
+        cache.hits++;
+    }
+    else {
+        cache.misses++;
+    }
+    pthread_mutex_unlock( &cache.lock );
+    if ( hit ) {
+        return EXIT_SUCCESS;
+    }
+
+    // Decode outside the lock, so other threads can decode other blocks at the same time.
+    char *data = ( char * )allocate( text );
+    trace_begin( "decode" );
+    long decoded_length = lz_decompress( block + BLOCK_HEADER_SIZE, stored, data, text );
+    trace_end( "decode" );
+    if ( decoded_length != ( long )text ) {
+        free( data );
+        return EXIT_FAILURE;
+    }
+    decoded->data = data;
+
+    // Cache the block, unless another thread did first or its slot holds a block in use.
+    pthread_mutex_lock( &cache.lock );
+    if ( cache_hit( entry, file_id, offset, decoded ) ) {
+        pthread_mutex_unlock( &cache.lock );
+        free( data );
+        return EXIT_SUCCESS;
+    }
+    if ( entry->users == 0 ) {
+        if ( entry->data != NULL ) {
+            drop_entry( entry );
+        }
+        if ( make_room( text ) ) {
+            *entry = ( CachedBlock ){ file_id, offset, data, text, 1, ++cache.clock };
+            cache.bytes += text;
+            decoded->entry = entry;
+            pthread_mutex_unlock( &cache.lock );
+            return EXIT_SUCCESS;
+        }
+    }
+    pthread_mutex_unlock( &cache.lock );
+    decoded->owned = data;
+    return EXIT_SUCCESS;
+}
+
+/** Releases a decoded block. */
+void release_block( DecodedBlock *decoded ) {
+    if ( decoded->entry != NULL ) {
+        pthread_mutex_lock( &cache.lock );
+        decoded->entry->users--;
+        pthread_mutex_unlock( &cache.lock );
+    }
+    free( decoded->owned );
+    *decoded = ( DecodedBlock ){ NULL, 0, NULL, NULL };
+}
+
+/** Counts a file's cached blocks. */
+int cached_blocks( uint64_t file_id ) {
+    int count = 0;
+    pthread_mutex_lock( &cache.lock );
+    for ( int i = 0; i < CACHE_SLOTS; i++ ) {
+        if ( cache.slots[i].data != NULL && cache.slots[i].file_id == file_id ) {
+            count++;
+        }
+    }
+    pthread_mutex_unlock( &cache.lock );
+    return count;
+}
+
+/** Prints the block cache counters. */
+void print_block_cache_stats( void ) {
+    pthread_mutex_lock( &cache.lock );
+    unsigned long lookups = cache.hits + cache.misses;
+    out_printf( "%-16s %10s %10s %10s %12s %10s\n", "block cache", "hits", "misses", "evictions",
+                "cached_kb", "hit_rate" );
+    out_printf( "%-16s %10lu %10lu %10lu %12zu %9.2f%%\n", "", cache.hits, cache.misses,
+                cache.evictions, cache.bytes / 1024,
+                lookups > 0 ? 100.0 * cache.hits / lookups : 0.0 );
+    pthread_mutex_unlock( &cache.lock );
+}
+
+/** Clears the block cache counters. */
+void reset_block_cache_stats( void ) {
+    pthread_mutex_lock( &cache.lock );
+    cache.hits = 0;
+    cache.misses = 0;
+    cache.evictions = 0;
+    pthread_mutex_unlock( &cache.lock );
+}
+
+/**
+   A BlockStream turns the chunks of a compressed table into blocks. A piece of the file (the file
+   header or a block) that is split between chunks is put back together in buffer.
+*/
+typedef struct {
+    ChunkConsumer consume;
+    void *context;
+    uint64_t file_id;
+    bool started;
+    bool failed;
+    off_t offset;
+    char *buffer;
+    size_t length;
+    size_t capacity;
+} BlockStream;
+
+/**
+   Returns the size of the next piece of the file, or 0 if not enough of it is at data to tell.
+   Marks the stream failed if the piece is damaged.
+*/
+static size_t piece_size( BlockStream *stream, const char *data, size_t length ) {
+    if ( !stream->started ) {
+        return FILE_HEADER_SIZE;
+    }
+    size_t text, stored;
+    if ( length < BLOCK_HEADER_SIZE ) {
+        return 0;
+    }
+    if ( !block_lengths( data, &text, &stored ) ) {
+        stream->failed = true;
+        return 0;
+    }
+    return BLOCK_HEADER_SIZE + stored;
+}
+
+/** Handles one whole piece of the file, giving a block's text to the consumer. */
+static void take_piece( BlockStream *stream, const char *piece, size_t size ) {
+    if ( !stream->started ) {
+        stream->failed = memcmp( piece, BLOCK_MAGIC, BLOCK_MAGIC_LENGTH ) != 0;
+        stream->file_id = block_file_id( piece );
+        stream->started = true;
+    }
+    else {
+        DecodedBlock block;
+        if ( decode_block( stream->file_id, stream->offset, piece, size, &block ) != EXIT_SUCCESS ) {
+            stream->failed = true;
+            return;
+        }
+        stream->consume( stream->context, block.data, block.length );
+        release_block( &block );
+    }
+    stream->offset += size;
+}
+
+/** Adds bytes to the piece held over in a stream's buffer. */
+static void hold_bytes( BlockStream *stream, const char *data, size_t length ) {
+    if ( stream->length + length > stream->capacity ) {
+        stream->capacity = stream->length + length;
+        stream->buffer = ( char * )realloc( stream->buffer, stream->capacity );
+        if ( stream->buffer == NULL ) {
+            err_printf( "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+    memcpy( stream->buffer + stream->length, data, length );
+    stream->length += length;
+}
+
+/** Splits a chunk of a compressed table into pieces, holding over a piece the chunk splits. */
+static void stream_blocks( void *context, const char *data, size_t length ) {
+    BlockStream *stream = ( BlockStream * )context;
+    while ( length > 0 && !stream->failed ) {
+        // Pieces wholly inside the chunk are used where they are.
+        if ( stream->length == 0 ) {
+            size_t size = piece_size( stream, data, length );
+            if ( size > 0 && size <= length ) {
+                take_piece( stream, data, size );
+                data += size;
+                length -= size;
+                continue;
+            }
+        }
+
+        // Hold bytes over until the piece is whole: first its header, then the rest.
+        size_t size = piece_size( stream, stream->buffer, stream->length );
+        size_t want = ( size > 0 ? size : BLOCK_HEADER_SIZE ) - stream->length;
+        size_t take = want < length ? want : length;
+        hold_bytes( stream, data, take );
+        data += take;
+        length -= take;
+        size = piece_size( stream, stream->buffer, stream->length );
+        if ( size > 0 && stream->length == size ) {
+            take_piece( stream, stream->buffer, size );
+            stream->length = 0;
+        }
+    }
+}
+
+/** Streams the text of a table, decoding it if it is compressed. */
+int table_stream( int fd, off_t length, ChunkConsumer consume, void *context ) {
+    if ( !table_compressed( fd ) ) {
+        return storage_stream( fd, length, consume, context );
+    }
+    BlockStream stream = { .consume = consume, .context = context };
+    int status = storage_stream( fd, length, stream_blocks, &stream );
+    free( stream.buffer );
+    return stream.failed || stream.length > 0 ? EXIT_FAILURE : status;
+}
+
+/** Adds up the text lengths in the block headers of a table. */
+off_t table_text_length( int fd, off_t length ) {
+    if ( !table_compressed( fd ) ) {
+        return length;
+    }
+    off_t total = 0;
+    for ( off_t offset = FILE_HEADER_SIZE; offset < length; ) {
+        char header[BLOCK_HEADER_SIZE];
+        size_t text, stored;
+        if ( storage_read_at( fd, header, sizeof( header ), offset ) != sizeof( header ) ||
+             !block_lengths( header, &text, &stored ) ) {
+            return -1;
+        }
+        total += text;
+        offset += BLOCK_HEADER_SIZE + stored;
+    }
+    return total;
+}
+
+/** Finds every block in a compressed table held in memory. */
+int index_blocks( const char *data, size_t length, size_t **offsets, int *count ) {
+    *offsets = NULL;
+    *count = 0;
+    if ( length < FILE_HEADER_SIZE || memcmp( data, BLOCK_MAGIC, BLOCK_MAGIC_LENGTH ) != 0 ) {
+        return EXIT_FAILURE;
+    }
+    int capacity = 0;
+    for ( size_t offset = FILE_HEADER_SIZE; offset < length; ) {
+        size_t text, stored;
+        if ( length - offset < BLOCK_HEADER_SIZE || !block_lengths( data + offset, &text, &stored ) ||
+             length - offset - BLOCK_HEADER_SIZE < stored ) {
+            free( *offsets );
+            *offsets = NULL;
+            return EXIT_FAILURE;
+        }
+        if ( *count == capacity ) {
+            capacity = capacity > 0 ? capacity * 2 : 64;
+            *offsets = ( size_t * )realloc( *offsets, capacity * sizeof( size_t ) );
+            if ( *offsets == NULL ) {
+                return EXIT_FAILURE;
+            }
+        }
+        ( *offsets )[ ( *count )++ ] = offset;
+        offset += BLOCK_HEADER_SIZE + stored;
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Returns a new file id, different for every compressed file written. */
+static uint64_t new_file_id( void ) {
+    static atomic_uint_fast64_t counter;
+    struct timespec now;
+    clock_gettime( CLOCK_REALTIME, &now );
+    uint64_t id = ( uint64_t )now.tv_sec * 1000000000u + now.tv_nsec;
+    id ^= ( uint64_t )getpid() << 40 ^ atomic_fetch_add( &counter, 1 ) * 0x9E3779B97F4A7C15ull;
+    id = ( id ^ id >> 30 ) * 0xBF58476D1CE4E5B9ull;
+    id = ( id ^ id >> 27 ) * 0x94D049BB133111EBull;
+    return id ^ id >> 31;
+}
+
+/** Writes text as one block, compressed unless that does not make it smaller. */
+static int write_block( int fd, const char *text, size_t length ) {
+    char *block = ( char * )allocate( BLOCK_HEADER_SIZE + length );
+    size_t stored = lz_compress( text, length, block + BLOCK_HEADER_SIZE, length - 1 );
+    if ( stored == 0 ) {
+        memcpy( block + BLOCK_HEADER_SIZE, text, length );
+        stored = length;
+    }
+    uint32_t lengths[2] = { ( uint32_t )length, ( uint32_t )stored };
+    memcpy( block, lengths, sizeof( lengths ) );
+    struct iovec whole = { block, BLOCK_HEADER_SIZE + stored };
+    int status = storage_write( fd, &whole, 1 );
+    free( block );
+    return status;
+}
+
+/** Appends rows to a compressed table as one block. */
+int append_block( int fd, const struct iovec *parts, int count ) {
+    size_t length = 0;
+    for ( int i = 0; i < count; i++ ) {
+        length += parts[i].iov_len;
+    }
+    char *text = ( char * )allocate( length );
+    for ( size_t at = 0, i = 0; i < ( size_t )count; at += parts[i++].iov_len ) {
+        memcpy( text + at, parts[i].iov_base, parts[i].iov_len );
+    }
+    int status = length > 0 ? write_block( fd, text, length ) : EXIT_SUCCESS;
+    free( text );
+    return status;
+}
+
+/** A BlockWriter gathers text written to a compressed table into blocks. */
+typedef struct {
+    int fd;
+    char *pending;
+    size_t length;
+    size_t capacity;
+} BlockWriter;
+
+/** Writes out every full block of pending text, cut after the last line that fits. */
+static ssize_t write_blocks( void *cookie, const char *data, size_t length ) {
+    BlockWriter *writer = ( BlockWriter * )cookie;
+    if ( writer->length + length > writer->capacity ) {
+        writer->capacity = ( writer->length + length ) * 2;
+        writer->pending = ( char * )realloc( writer->pending, writer->capacity );
+        if ( writer->pending == NULL ) {
+            return -1;
+        }
+    }
+    memcpy( writer->pending + writer->length, data, length );
+    writer->length += length;
+
+    while ( writer->length >= BLOCK_SIZE ) {
+        const char *text = writer->pending;
+        const char *newline = ( const char * )memrchr( text, '\n', BLOCK_SIZE );
+        if ( newline == NULL ) {
+            newline = ( const char * )memchr( text + BLOCK_SIZE, '\n', writer->length - BLOCK_SIZE );
+        }
+        size_t cut = newline != NULL ? ( size_t )( newline + 1 - text )
+                                     : writer->length >= MAX_BLOCK_SIZE ? MAX_BLOCK_SIZE : 0;
+        if ( cut == 0 ) {
+            break;
+        }
+        if ( write_block( writer->fd, text, cut ) != EXIT_SUCCESS ) {
+            return -1;
+        }
+        writer->length -= cut;
+        memmove( writer->pending, writer->pending + cut, writer->length );
+    }
+    return length;
+}
+
+/** Writes the last block and closes a compressed table. */
+static int close_writer( void *cookie ) {
+    BlockWriter *writer = ( BlockWriter * )cookie;
+    int status = EXIT_SUCCESS;
+    if ( writer->length > 0 ) {
+        status = write_block( writer->fd, writer->pending, writer->length );
+    }
+    if ( close( writer->fd ) != 0 ) {
+        status = EXIT_FAILURE;
+    }
+    free( writer->pending );
+    free( writer );
+    return status == EXIT_SUCCESS ? 0 : EOF;
+}
+
+/** A PlainFile is a plain text table read or written through storage, and the read position. */
+typedef struct {
+    int fd;
+    off_t offset;
+} PlainFile;
+
+/** Reads the text of a plain table from where the last read ended. */
+static ssize_t read_plain( void *cookie, char *buffer, size_t size ) {
+    PlainFile *plain = ( PlainFile * )cookie;
+    ssize_t got = storage_read_at( plain->fd, buffer, size, plain->offset );
+    if ( got > 0 ) {
+        plain->offset += got;
+    }
+    return got;
+}
+
+/** Adds text to the end of a plain table. */
+static ssize_t write_plain( void *cookie, const char *data, size_t size ) {
+    PlainFile *plain = ( PlainFile * )cookie;
+    struct iovec part = { ( void * )data, size };
+    return storage_write( plain->fd, &part, 1 ) == EXIT_SUCCESS ? ( ssize_t )size : -1;
+}
+
+/** Closes a plain table. */
+static int close_plain( void *cookie ) {
+    PlainFile *plain = ( PlainFile * )cookie;
+    int status = close( plain->fd );
+    free( plain );
+    return status == 0 ? 0 : EOF;
+}
+
+/**
+   Opens a stdio file over a plain table, so its reads and writes go through storage and are
+   counted there like those of compressed tables. Closes fd if it cannot.
+*/
+static FILE *open_plain( int fd, const char *mode ) {
+    PlainFile *plain = ( PlainFile * )allocate( sizeof( PlainFile ) );
+    *plain = ( PlainFile ){ fd, 0 };
+    cookie_io_functions_t functions = { .read = read_plain, .write = write_plain,
+                                        .close = close_plain };
+    FILE *file = fopencookie( plain, mode, functions );
+    if ( file == NULL ) {
+        close( fd );
+        free( plain );
+        return NULL;
+    }
+    setvbuf( file, NULL, _IOFBF, IO_CHUNK_SIZE );
+    return file;
+}
+
+/** Creates a table file for writing text. */
+FILE *create_table_file( const char *path, bool compressed ) {
+    int fd = open( path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0666 );
+    if ( fd < 0 ) {
+        return NULL;
+    }
+    if ( !compressed ) {
+        return open_plain( fd, "w" );
+    }
+    char header[FILE_HEADER_SIZE];
+    uint64_t id = new_file_id();
+    memcpy( header, BLOCK_MAGIC, BLOCK_MAGIC_LENGTH );
+    memcpy( header + BLOCK_MAGIC_LENGTH, &id, sizeof( id ) );
+    struct iovec whole = { header, sizeof( header ) };
+    if ( storage_write( fd, &whole, 1 ) != EXIT_SUCCESS ) {
+        close( fd );
+        return NULL;
+    }
+
+    BlockWriter *writer = ( BlockWriter * )allocate( sizeof( BlockWriter ) );
+    *writer = ( BlockWriter ){ .fd = fd };
+    cookie_io_functions_t functions = { .write = write_blocks, .close = close_writer };
+    FILE *file = fopencookie( writer, "w", functions );
+    if ( file == NULL ) {
+        close( fd );
+        free( writer );
+    }
+    return file;
+}
+
+/** A BlockReader reads the text of a compressed table a block at a time. */
+typedef struct {
+    int fd;
+    uint64_t file_id;
+    off_t offset;
+    char *stored;
+    size_t capacity;
+    DecodedBlock block;
+    size_t position;
+} BlockReader;
+
+/** Copies text out of the current block, reading and decoding the next when it runs out. */
+static ssize_t read_blocks( void *cookie, char *buffer, size_t size ) {
+    BlockReader *reader = ( BlockReader * )cookie;
+    while ( reader->position == reader->block.length ) {
+        release_block( &reader->block );
+        reader->position = 0;
+        char header[BLOCK_HEADER_SIZE];
+        ssize_t got = storage_read_at( reader->fd, header, sizeof( header ), reader->offset );
+        size_t text, stored;
+        if ( got == 0 ) {
+            return 0;   // End of the table.
+        }
+        if ( got != sizeof( header ) || !block_lengths( header, &text, &stored ) ) {
+            return -1;
+        }
+        if ( BLOCK_HEADER_SIZE + stored > reader->capacity ) {
+            reader->capacity = BLOCK_HEADER_SIZE + stored;
+            reader->stored = ( char * )realloc( reader->stored, reader->capacity );
+            if ( reader->stored == NULL ) {
+                return -1;
+            }
+        }
+        memcpy( reader->stored, header, sizeof( header ) );
+        if ( storage_read_at( reader->fd, reader->stored + BLOCK_HEADER_SIZE, stored,
+                              reader->offset + BLOCK_HEADER_SIZE ) != ( ssize_t )stored ||
+             decode_block( reader->file_id, reader->offset, reader->stored,
+                           BLOCK_HEADER_SIZE + stored, &reader->block ) != EXIT_SUCCESS ) {
+            return -1;
+        }
+        reader->offset += BLOCK_HEADER_SIZE + stored;
+    }
+    size_t count = reader->block.length - reader->position;
+    if ( count > size ) {
+        count = size;
+    }
+    memcpy( buffer, reader->block.data + reader->position, count );
+    reader->position += count;
+    return count;
+}
+
+/** Closes a compressed table opened for reading. */
+static int close_reader( void *cookie ) {
+    BlockReader *reader = ( BlockReader * )cookie;
+    release_block( &reader->block );
+    int status = close( reader->fd );
+    free( reader->stored );
+    free( reader );
+    return status;
+}
+
+/** Opens a table file for reading its text. */
+FILE *open_table_file( const char *path, bool *compressed ) {
+    int fd = open( path, O_RDONLY );
+    if ( fd < 0 ) {
+        return NULL;
+    }
+    char header[FILE_HEADER_SIZE];
+    *compressed = table_compressed( fd ) &&
+                  storage_read_at( fd, header, sizeof( header ), 0 ) == sizeof( header );
+    if ( !*compressed ) {
+        return open_plain( fd, "r" );
+    }
+
+    BlockReader *reader = ( BlockReader * )allocate( sizeof( BlockReader ) );
+    *reader = ( BlockReader ){ .fd = fd, .file_id = block_file_id( header ),
+                               .offset = FILE_HEADER_SIZE };
+    cookie_io_functions_t functions = { .read = read_blocks, .close = close_reader };
+    FILE *file = fopencookie( reader, "r", functions );
+    if ( file == NULL ) {
+        close( fd );
+        free( reader );
+    }
+    return file;
+}
@@ -0,0 +1,157 @@
+/**
+   @file block.h
+   @author Michael Warstler (mwwarstl)
+   Header file for compressed tables. A table can be stored as plain text, one row per line, or
+   compressed: a file header holding BLOCK_MAGIC and a file id, then blocks that each hold whole
+   rows. A block is its decoded length and stored length, then its bytes compressed with the LZ
+   codec (or left as they are, when the stored length equals the decoded length). Rows inserted
+   into a compressed table are appended as a block of their own. Blocks are decoded when a scan
+   reaches them, and decoded blocks are kept in a cache shared by all threads so repeated scans of
+   a table skip decoding. Everything that reads a table goes through this file, which hands back
+   the decoded text whichever way the table is stored.
+*/
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "storage.h"
+
+/** First bytes of a compressed table */
+#define BLOCK_MAGIC "\211LZBLK\r\n"
+/** Number of bytes in BLOCK_MAGIC */
+#define BLOCK_MAGIC_LENGTH 8
+/** Number of bytes in the file header: the magic and a 64-bit file id */
+#define FILE_HEADER_SIZE 16
+/** Number of bytes in a block header: 32-bit decoded and stored lengths */
+#define BLOCK_HEADER_SIZE 8
+/** Number of decoded bytes a block is filled to before it is written */
+#define BLOCK_SIZE ( 64 * 1024 )
+/** Largest decoded block accepted when reading */
+#define MAX_BLOCK_SIZE ( 16 * 1024 * 1024 )
+/** Number of decoded bytes the block cache holds */
+#define BLOCK_CACHE_SIZE ( 64 * 1024 * 1024 )
+
+/** A cache entry, opaque outside block.c */
+typedef struct CachedBlock CachedBlock;
+
+/**
+   A DecodedBlock is the text of one block, which may be held in the cache, in a buffer of its own,
+   or in the file's own bytes if the block was not compressed. It must be released after use.
+*/
+typedef struct {
+    const char *data;
+    size_t length;
+    CachedBlock *entry;
+    char *owned;
+} DecodedBlock;
+
+/**
+   Returns whether a table file is compressed.
+   @param fd is the table file, open for reading.
+   @return is true if the file starts with BLOCK_MAGIC.
+*/
+bool table_compressed( int fd );
+
+/**
+   Reads the first length bytes of a table file and gives its text to a consumer in order, as
+   storage_stream does. A compressed table is decoded a block at a time, so every chunk given to
+   the consumer is whole rows.
+   @param fd is the table file.
+   @param length is the number of bytes of the file to read.
+   @param consume is the function each chunk of text is given to.
+   @param context is passed to consume.
+   @return is EXIT_FAILURE if a read failed or a block is damaged, otherwise EXIT_SUCCESS
+*/
+int table_stream( int fd, off_t length, ChunkConsumer consume, void *context );
+
+/**
+   Returns the number of bytes of text in the first length bytes of a table file.
+   @param fd is the table file.
+   @param length is the number of bytes of the file to count.
+   @return is the number of bytes of text, or -1 if the file could not be read.
+*/
+off_t table_text_length( int fd, off_t length );
+
+/**
+   Opens a table file for reading its text with stdio, decoding it if it is compressed.
+   @param path is the table file.
+   @param compressed is set to whether the table is compressed.
+   @return is the open file, or NULL if it could not be opened.
+*/
+FILE *open_table_file( const char *path, bool *compressed );
+
+/**
+   Creates (or empties) a table file for writing text with stdio. Text written to a compressed
+   file is gathered into blocks of whole lines; the last block is written when the file is closed.
+   @param path is the table file.
+   @param compressed is true to store the table compressed.
+   @return is the open file, or NULL if it could not be created.
+*/
+FILE *create_table_file( const char *path, bool compressed );
+
+/**
+   Appends rows to a compressed table as one block, in one write.
+   @param fd is the table file, opened with O_APPEND.
+   @param parts is the text of the rows, ending with a newline.
+   @param count is the number of buffers in parts.
+   @return is EXIT_FAILURE if the write failed, otherwise EXIT_SUCCESS
+*/
+int append_block( int fd, const struct iovec *parts, int count );
+
+/**
+   Finds every block in a compressed table held in memory.
+   @param data is the table file's contents.
+   @param length is the number of bytes in data.
+   @param offsets is set to a new array holding the offset of each block, which the caller frees.
+   @param count is set to the number of blocks.
+   @return is EXIT_FAILURE if the file is damaged or memory ran out, otherwise EXIT_SUCCESS
+*/
+int index_blocks( const char *data, size_t length, size_t **offsets, int *count );
+
+/**
+   Returns the id of a compressed table file, which blocks are cached under.
+   @param data is the file header.
+   @return is the file id.
+*/
+uint64_t block_file_id( const char *data );
+
+/**
+   Decodes a block, taking it from the cache if it is there and adding it if it is not.
+   @param file_id is the id of the table file.
+   @param offset is the offset of the block in the file.
+   @param block is the block, starting with its header.
+   @param available is the number of bytes at block, which must hold the whole block.
+   @param decoded is set to the block's text.
+   @return is EXIT_FAILURE if the block is damaged, otherwise EXIT_SUCCESS
+*/
+int decode_block( uint64_t file_id, off_t offset, const char *block, size_t available,
+                  DecodedBlock *decoded );
+
+/**
+   Releases a decoded block so the cache may drop it.
+   @param decoded is the block to release.
+*/
+void release_block( DecodedBlock *decoded );
+
+/**
+   Returns how many of a table file's blocks are in the cache.
+   @param file_id is the id of the table file.
+   @return is the number of its blocks cached.
+*/
+int cached_blocks( uint64_t file_id );
+
+/**
+   Prints the block cache's hits, misses, and evictions to the current output sink.
+*/
+void print_block_cache_stats( void );
+
+/**
+   Clears the block cache's hit, miss, and eviction counters.
+*/
+void reset_block_cache_stats( void );
+
+#endif //BLOCK_H
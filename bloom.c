@@ -0,0 +1,299 @@
+/**
+   @file bloom.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for per-table Bloom filters. A filter file is a FilterHeader followed by the
+   filter's bits. An id is hashed once with FNV-1a and its BLOOM_HASHES bits are found by double
+   hashing, so a lookup or an insert reads or writes only the header and those few bytes. Inserts
+   write the bits before the header, so a filter cut short by a crash still describes the old
+   table and is ignored.
+*/
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "bloom.h"
+#include "database.h"
+#include "sink.h"
+#include "storage.h"
+
+/** First bytes of a filter file */
+#define FILTER_MAGIC "BLOOMv1\n"
+
+/** A FilterHeader describes a filter and the table file it was made for. */
+typedef struct {
+    char magic[8];
+    uint64_t bits;
+    uint64_t ids;
+    uint64_t capacity;
+    int64_t table_size;
+    int64_t table_inode;
+    int64_t table_mtime_sec;
+    int64_t table_mtime_nsec;
+} FilterHeader;
+
+/** A FilterStats holds a table's lookup counters, chained in a list. */
+typedef struct FilterStats {
+    char name[MAX_STR_LENGTH];
+    unsigned long lookups;          // ids checked against the filter
+    unsigned long rejected;         // ids the filter said were absent
+    unsigned long false_positives;  // ids the filter let through that were not in the table
+    unsigned long unknown;          // lookups with no usable filter
+    struct FilterStats *next;
+} FilterStats;
+
+/** Every table's counters */
+static FilterStats *stats;
+/** Guards stats */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Finds a table's counters, making them the first time. Called with stats_lock held. */
+static FilterStats *table_stats( const char *table_name ) {
+    FilterStats *table = stats;
+    while ( table != NULL && strcmp( table->name, table_name ) != 0 ) {
+        table = table->next;
+    }
+    if ( table == NULL ) {
+        table = ( FilterStats * )calloc( 1, sizeof( FilterStats ) );
+        if ( table == NULL ) {
+            pthread_mutex_unlock( &stats_lock );
+            err_printf( "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+        strncpy( table->name, table_name, sizeof( table->name ) - 1 );
+        table->next = stats;
+        stats = table;
+    }
+    return table;
+}
+
+/** Builds the path of a table's filter file. */
+static void filter_path( char *path, size_t size, const char *table_name ) {
+    snprintf( path, size, "%s/.%s.bloom", folder, table_name );
+}
+
+/** Hashes an id (FNV-1a). */
+static uint64_t hash_id( const char *id, size_t length ) {
+    uint64_t hash = 14695981039346656037ull;
+    for ( size_t i = 0; i < length; i++ ) {
+        hash = ( hash ^ ( unsigned char )id[i] ) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/** Returns the i-th bit an id's hash sets in a filter of the given size. */
+static uint64_t filter_bit( uint64_t hash, int i, uint64_t bits ) {
+    uint64_t step = ( ( hash >> 32 | hash << 32 ) * 0x9E3779B97F4A7C15ull ) | 1;
+    return ( hash + i * step ) % bits;
+}
+
+/** Returns whether a filter was made for a table file as it is now. */
+static bool describes( const FilterHeader *header, const struct stat *table ) {
+    return memcmp( header->magic, FILTER_MAGIC, sizeof( header->magic ) ) == 0 &&
+           header->bits > 0 && header->table_size == table->st_size &&
+           header->table_inode == ( int64_t )table->st_ino &&
+           header->table_mtime_sec == table->st_mtim.tv_sec &&
+           header->table_mtime_nsec == table->st_mtim.tv_nsec;
+}
+
+/** Records a table file's status in a filter header. */
+static void set_table( FilterHeader *header, const struct stat *table ) {
+    header->table_size = table->st_size;
+    header->table_inode = table->st_ino;
+    header->table_mtime_sec = table->st_mtim.tv_sec;
+    header->table_mtime_nsec = table->st_mtim.tv_nsec;
+}
+
+/** Opens a table's filter and reads its header. Returns the file, or -1 if it does not match. */
+static int open_filter( const char *table_name, int flags, const struct stat *table,
+                        FilterHeader *header ) {
+    char path[MAX_STR_LENGTH];
+    filter_path( path, sizeof( path ), table_name );
+    int fd = open( path, flags );
+    if ( fd < 0 ) {
+        return -1;
+    }
+    if ( storage_read_at( fd, ( char * )header, sizeof( *header ), 0 ) != sizeof( *header ) ||
+         !describes( header, table ) ) {
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+/** Checks a table's filter for an id. */
+BloomResult bloom_check( const char *table_name, const char *id, const struct stat *table ) {
+    FilterHeader header;
+    BloomResult result = BLOOM_UNKNOWN;
+    int fd = open_filter( table_name, O_RDONLY, table, &header );
+    if ( fd >= 0 ) {
+        uint64_t hash = hash_id( id, strlen( id ) );
+        result = BLOOM_MAYBE;
+        for ( int i = 0; i < BLOOM_HASHES && result == BLOOM_MAYBE; i++ ) {
+            uint64_t bit = filter_bit( hash, i, header.bits );
+            unsigned char byte;
+            if ( storage_read_at( fd, ( char * )&byte, 1, sizeof( header ) + bit / 8 ) != 1 ) {
+                result = BLOOM_UNKNOWN;
+            }
+            else if ( !( byte & 1 << bit % 8 ) ) {
+                result = BLOOM_ABSENT;
+            }
+        }
+        close( fd );
+    }
+
+    pthread_mutex_lock( &stats_lock );
+    FilterStats *counters = table_stats( table_name );
+    counters->lookups++;
+    counters->rejected += result == BLOOM_ABSENT;
+    counters->unknown += result == BLOOM_UNKNOWN;
+    pthread_mutex_unlock( &stats_lock );
+    return result;
+}
+
+/** Counts a lookup the filter let through that did not find its id. */
+void bloom_false_positive( const char *table_name ) {
+    pthread_mutex_lock( &stats_lock );
+    table_stats( table_name )->false_positives++;
+    pthread_mutex_unlock( &stats_lock );
+}
+
+/** Adds inserted rows' ids to a table's filter. */
+void bloom_add( const char *table_name, const char *const *rows, int count,
+                const struct stat *before, const struct stat *after ) {
+    FilterHeader header;
+    int fd = open_filter( table_name, O_RDWR, before, &header );
+    if ( fd < 0 ) {
+        return;
+    }
+
+    // A row without an id, or a filter far past its size, is left for the next rewrite to fix.
+    bool updated = header.ids + count <= header.capacity * 2;
+    for ( int row = 0; row < count && updated; row++ ) {
+        size_t length = strspn( rows[row], "0123456789" );
+        uint64_t hash = hash_id( rows[row], length );
+        updated = length > 0;
+        for ( int i = 0; i < BLOOM_HASHES && updated; i++ ) {
+            uint64_t bit = filter_bit( hash, i, header.bits );
+            off_t offset = sizeof( header ) + bit / 8;
+            unsigned char byte;
+            updated = storage_read_at( fd, ( char * )&byte, 1, offset ) == 1;
+            byte |= 1 << bit % 8;
+            updated = updated && storage_write_at( fd, ( char * )&byte, 1, offset ) == EXIT_SUCCESS;
+        }
+    }
+    if ( updated ) {
+        header.ids += count;
+        set_table( &header, after );
+        updated = storage_write_at( fd, ( char * )&header, sizeof( header ), 0 ) == EXIT_SUCCESS;
+    }
+    close( fd );
+    if ( !updated ) {
+        bloom_remove( table_name );
+    }
+}
+
+/** Adds an id to a filter being built. */
+void bloom_builder_add( BloomBuilder *builder, const char *id ) {
+    if ( builder->count == builder->capacity ) {
+        builder->capacity = builder->capacity > 0 ? builder->capacity * 2 : BLOOM_MIN_IDS;
+        builder->hashes = ( uint64_t * )realloc( builder->hashes,
+                                                 builder->capacity * sizeof( uint64_t ) );
+        if ( builder->hashes == NULL ) {
+            err_printf( "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+    builder->hashes[ builder->count++ ] = hash_id( id, strlen( id ) );
+}
+
+/**
+   Writes a table's filter from the ids collected by a builder. The filter is sized for twice as
+   many ids as the table holds, leaving room for inserts, and written to a temp file first so a
+   half-written filter is never seen.
+*/
+void bloom_build( const char *table_name, BloomBuilder *builder, const struct stat *table ) {
+    FilterHeader header = { .ids = builder->count };
+    memcpy( header.magic, FILTER_MAGIC, sizeof( header.magic ) );
+    header.capacity = builder->count * 2 > BLOOM_MIN_IDS ? builder->count * 2 : BLOOM_MIN_IDS;
+    header.bits = ( header.capacity * BLOOM_BITS_PER_ID + 63 ) / 64 * 64;
+    set_table( &header, table );
+
+    unsigned char *bits = ( unsigned char * )calloc( header.bits / 8, 1 );
+    if ( bits == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    for ( size_t i = 0; i < builder->count; i++ ) {
+        for ( int j = 0; j < BLOOM_HASHES; j++ ) {
+            uint64_t bit = filter_bit( builder->hashes[i], j, header.bits );
+            bits[bit / 8] |= 1 << bit % 8;
+        }
+    }
+    free( builder->hashes );
+    *builder = ( BloomBuilder ){ NULL, 0, 0 };
+
+    char path[MAX_STR_LENGTH], tempPath[MAX_STR_LENGTH];
+    filter_path( path, sizeof( path ), table_name );
+    snprintf( tempPath, sizeof( tempPath ), "%s/.%s.bloom.tmp", folder, table_name );
+    int fd = open( tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+    bool written = fd >= 0 &&
+                   storage_write_at( fd, ( char * )&header, sizeof( header ), 0 ) == EXIT_SUCCESS &&
+                   storage_write_at( fd, ( char * )bits, header.bits / 8,
+                                     sizeof( header ) ) == EXIT_SUCCESS;
+    if ( fd >= 0 && close( fd ) != 0 ) {
+        written = false;
+    }
+    if ( written ) {
+        rename( tempPath, path );
+    }
+    else {
+        remove( tempPath );
+        remove( path );
+    }
+    free( bits );
+}
+
+/** Moves a table's filter to a new copy of the same rows. */
+void bloom_retarget( const char *table_name, const struct stat *before, const struct stat *after ) {
+    FilterHeader header;
+    int fd = open_filter( table_name, O_RDWR, before, &header );
+    if ( fd < 0 ) {
+        return;
+    }
+    set_table( &header, after );
+    storage_write_at( fd, ( char * )&header, sizeof( header ), 0 );
+    close( fd );
+}
+
+/** Removes a table's filter. */
+void bloom_remove( const char *table_name ) {
+    char path[MAX_STR_LENGTH];
+    filter_path( path, sizeof( path ), table_name );
+    remove( path );
+}
+
+/** Prints every table's filter counters. */
+void print_bloom_stats( void ) {
+    pthread_mutex_lock( &stats_lock );
+    out_printf( "%-16s %10s %10s %10s %10s %10s\n", "table", "lookups", "rejected", "no_filter",
+                "false_pos", "fp_rate" );
+    for ( FilterStats *table = stats; table != NULL; table = table->next ) {
+        // The false-positive rate is the share of absent ids the filter let through.
+        unsigned long absent = table->rejected + table->false_positives;
+        out_printf( "%-16s %10lu %10lu %10lu %10lu %9.2f%%\n", table->name, table->lookups,
+                    table->rejected, table->unknown, table->false_positives,
+                    absent > 0 ? 100.0 * table->false_positives / absent : 0.0 );
+    }
+    pthread_mutex_unlock( &stats_lock );
+}
+
+/** Clears every table's filter counters. */
+void reset_bloom_stats( void ) {
+    pthread_mutex_lock( &stats_lock );
+    for ( FilterStats *table = stats; table != NULL; table = table->next ) {
+        table->lookups = 0;
+        table->rejected = 0;
+        table->false_positives = 0;
+        table->unknown = 0;
+    }
+    pthread_mutex_unlock( &stats_lock );
+}
@@ -0,0 +1,109 @@
+/**
+   @file bloom.h
+   @author Michael Warstler (mwwarstl)
+   Header file for per-table Bloom filters on row ids (the leading digits of each row, which update
+   and delete match on). A table's filter is kept next to it as folder/.<name>.bloom and says
+   whether an id is definitely absent, so update and delete can reject such ids without reading the
+   table. The filter records the size, inode, and modification time of the table it describes and
+   is ignored if the table no longer matches, so a filter that missed a change is never trusted.
+   Inserts set the new id's bits in place; update and delete build a new filter from the ids they
+   write. Every function is called with the table's write lock held.
+*/
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/** Number of filter bits per id the filter is sized for */
+#define BLOOM_BITS_PER_ID 10
+/** Number of bits set for each id */
+#define BLOOM_HASHES 7
+/** Fewest ids a filter is sized for */
+#define BLOOM_MIN_IDS 1024
+
+/** What a table's filter says about an id. */
+typedef enum {
+    BLOOM_ABSENT,
+    BLOOM_MAYBE,
+    BLOOM_UNKNOWN
+} BloomResult;
+
+/** A BloomBuilder collects the hashes of the ids in a table being rewritten. */
+typedef struct {
+    uint64_t *hashes;
+    size_t count;
+    size_t capacity;
+} BloomBuilder;
+
+/**
+   Checks a table's filter for an id, counting the lookup in the table's stats.
+   @param table_name is string name of the table.
+   @param id is the id to look for.
+   @param table is the table file's status.
+   @return is BLOOM_ABSENT if the id is not in the table, BLOOM_MAYBE if it may be, or
+           BLOOM_UNKNOWN if the table has no filter that matches it.
+*/
+BloomResult bloom_check( const char *table_name, const char *id, const struct stat *table );
+
+/**
+   Counts a lookup the filter let through that did not find its id.
+   @param table_name is string name of the table.
+*/
+void bloom_false_positive( const char *table_name );
+
+/**
+   Adds the ids of inserted rows to a table's filter, if the filter matched the table before the
+   insert. A filter holding far more ids than it was sized for is removed instead, so the next
+   rewrite of the table builds one of the right size.
+   @param table_name is string name of the table.
+   @param rows is the inserted rows.
+   @param count is the number of rows.
+   @param before is the table file's status before the insert.
+   @param after is the table file's status after the insert.
+*/
+void bloom_add( const char *table_name, const char *const *rows, int count,
+                const struct stat *before, const struct stat *after );
+
+/**
+   Adds an id to a filter being built.
+   @param builder is the filter being built.
+   @param id is the id of a row.
+*/
+void bloom_builder_add( BloomBuilder *builder, const char *id );
+
+/**
+   Writes a table's filter from the ids collected by a builder, and frees the builder.
+   @param table_name is string name of the table.
+   @param builder is the ids of every row of the table.
+   @param table is the table file's status.
+*/
+void bloom_build( const char *table_name, BloomBuilder *builder, const struct stat *table );
+
+/**
+   Moves a table's filter to a new copy of the table holding the same rows, if the filter matched
+   the old copy.
+   @param table_name is string name of the table.
+   @param before is the old table file's status.
+   @param after is the new table file's status.
+*/
+void bloom_retarget( const char *table_name, const struct stat *before, const struct stat *after );
+
+/**
+   Removes a table's filter.
+   @param table_name is string name of the table.
+*/
+void bloom_remove( const char *table_name );
+
+/**
+   Prints every table's filter lookups and false-positive rate to the current output sink.
+*/
+void print_bloom_stats( void );
+
+/**
+   Clears every table's filter counters.
+*/
+void reset_bloom_stats( void );
+
+#endif //BLOOM_H
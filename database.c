@@ -7,37 +7,328 @@
    writing a database to a file, updating a line in a table, deleting a line in a table, and 
    dropping/removing an entire table.
 */
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "block.h"
+#include "bloom.h"
 #include "database.h"
+#include "due.h"
+#include "foreign.h"
+#include "lock.h"
+#include "partition.h"
+#include "scan.h"
+#include "storage.h"
+#include "schema.h"
+#include "sink.h"
+#include "stats.h"
+#include "trace.h"
+#include "view.h"
+#include "waitlist.h"
 
 /** Number of databases defined in database.h */
 #define DATABASE_SIZE 11
 
+/** Number of bytes at the start of a table explain samples to estimate its rows */
+#define EXPLAIN_SAMPLE_SIZE ( 64 * 1024 )
+
+/** Snapshot length of a table whose size is unknown, which reads to the end of the file */
+#define WHOLE_FILE ( ( off_t )1 << 62 )
+
 /** The path for a tables folder */
 char *folder = "./tables"; 
 
+/**
+   Reports rows added to a table, or to one of its partitions, to the table's views, due-date
+   index, and id index.
+*/
+static void rows_inserted( const char *name, const char *const *rows, int count ) {
+    char table_name[MAX_TABLE_NAME_LENGTH];
+    table_of_partition( name, table_name, sizeof( table_name ) );
+    view_rows_inserted( table_name, rows, count );
+    due_rows_inserted( table_name, rows, count );
+    foreign_rows_inserted( table_name, rows, count );
+}
+
+/** Reports an updated or deleted row to its table's views, due-date index, and id index. */
+static void row_changed( const char *name, const char *old_row, const char *new_row ) {
+    char table_name[MAX_TABLE_NAME_LENGTH];
+    table_of_partition( name, table_name, sizeof( table_name ) );
+    view_row_changed( table_name, old_row, new_row );
+    due_row_changed( table_name, old_row, new_row );
+    foreign_row_changed( table_name, old_row, new_row );
+}
+
+/** Has a table's views and indexes built again, for a change they could not follow. */
+static void table_replaced( const char *name ) {
+    char table_name[MAX_TABLE_NAME_LENGTH];
+    table_of_partition( name, table_name, sizeof( table_name ) );
+    invalidate_views( table_name );
+    invalidate_due_index( table_name );
+    invalidate_foreign_index( table_name );
+}
+
+/**
+   Takes the snapshot of a table opened for reading. Rows appended after this are not read.
+   Returns the number of bytes to read, which is the rest of the file if its size is unknown.
+*/
+static off_t snapshot_length( const char *table_name, FILE *file ) {
+    off_t length = snapshot_table( table_name, fileno( file ) );
+    return length < 0 ? WHOLE_FILE : length;
+}
+
+/** Where decoded text is written in an output file. */
+typedef struct {
+    int fd;
+    off_t offset;
+    int status;
+} OutputCursor;
+
+/** Writes a chunk of a table's text at an output file's cursor. */
+static void write_at_cursor( void *context, const char *data, size_t length ) {
+    OutputCursor *cursor = ( OutputCursor * )context;
+    if ( cursor->status == EXIT_SUCCESS ) {
+        cursor->status = storage_write_at( cursor->fd, data, length, cursor->offset );
+    }
+    cursor->offset += length;
+}
+
+/** Copies a chunk of a table to a sink. */
+static void copy_to_sink( void *context, const char *data, size_t length ) {
+    sink_write( ( Sink * )context, data, length );
+}
+
+/**
+   A LineReader splits the chunks of a table into lines for a scan. A line that is split between
+   two chunks is put back together in carry.
+*/
+typedef struct {
+    const ScanQuery *query;
+    Sink *sink;
+    char *carry;
+    size_t length;
+    size_t capacity;
+} LineReader;
+
+/** Adds bytes to the end of a reader's carried line. */
+static void carry_bytes( LineReader *reader, const char *data, size_t length ) {
+    if ( length == 0 ) {
+        return;
+    }
+    if ( reader->length + length > reader->capacity ) {
+        size_t capacity = reader->capacity > 0 ? reader->capacity : MAX_STR_LENGTH;
+        while ( capacity < reader->length + length ) {
+            capacity *= 2;
+        }
+        reader->carry = ( char * )realloc( reader->carry, capacity );
+        if ( reader->carry == NULL ) {
+            err_printf( "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+        reader->capacity = capacity;
+    }
+    memcpy( reader->carry + reader->length, data, length );
+    reader->length += length;
+}
+
+/** Scans the whole lines in a chunk of a table, carrying a partial last line to the next. */
+static void scan_chunk( void *context, const char *data, size_t length ) {
+    LineReader *reader = ( LineReader * )context;
+    const char *end = data + length;
+
+    // Finish the line carried over from the last chunk.
+    if ( reader->length > 0 ) {
+        const char *newline = ( const char * )memchr( data, '\n', length );
+        const char *stop = newline != NULL ? newline + 1 : end;
+        carry_bytes( reader, data, stop - data );
+        if ( newline == NULL ) {
+            return;
+        }
+        scan_lines( reader->query, reader->carry, reader->carry + reader->length, reader->sink );
+        reader->length = 0;
+        data = stop;
+    }
+
+    // Scan up to the last newline and carry the rest.
+    const char *whole = end;
+    while ( whole > data && whole[-1] != '\n' ) {
+        whole--;
+    }
+    scan_lines( reader->query, data, whole, reader->sink );
+    carry_bytes( reader, whole, end - whole );
+}
+
 /** Creates a table. */
 int create_table( const char *table_name ){
 	char filepath[MAX_STR_LENGTH];                                                                  
     snprintf( filepath, sizeof(filepath), "%s/%s", folder, table_name );
 
     // Check if the file exists, return EXIT_FAILURE if exists 
+    TableLock *lock = write_lock_table( table_name );
     if ( access(filepath, F_OK) != -1 ) {
-    	printf( "Table '%s' already exists.\n", table_name );
+    	out_printf( "Table '%s' already exists.\n", table_name );
+        write_unlock_table( lock );
         return EXIT_FAILURE; 
     } 
     else {
     	FILE *file = fopen( filepath, "w" );
         if ( file != NULL ) {
-            printf( "Table '%s' created successfully.\n", table_name );
+            out_printf( "Table '%s' created successfully.\n", table_name );
             fclose(file);
+            table_replaced( table_name );
+
+            // Start the table's id filter empty.
+            struct stat table;
+            BloomBuilder ids = { NULL, 0, 0 };
+            if ( stat( filepath, &table ) == 0 ) {
+                bloom_build( table_name, &ids, &table );
+            }
         } else {
-            printf( "Failed to create '%s' table.\n", table_name );
+            out_printf( "Failed to create '%s' table.\n", table_name );
         }
+        write_unlock_table( lock );
         return EXIT_SUCCESS; 
     }
 }
 
+/** Creates a table split into partitions by date. */
+int create_partitioned_table( const char *table_name, const char *partitioning ) {
+    char filepath[MAX_STR_LENGTH];
+    snprintf( filepath, sizeof(filepath), "%s/%s", folder, table_name );
+    TableLock *lock = write_lock_table( table_name );
+    if ( access( filepath, F_OK ) != -1 ) {
+        out_printf( "Table '%s' already exists.\n", table_name );
+        write_unlock_table( lock );
+        return EXIT_FAILURE;
+    }
+    int status = define_partitioning( table_name, partitioning );
+    write_unlock_table( lock );
+    if ( status != EXIT_SUCCESS ) {
+        return EXIT_FAILURE;
+    }
+    return create_table( table_name );
+}
+
+/**
+   Rewrites a table compressed, or as plain text, and reports the change in size unless quiet.
+   Failures are always reported.
+*/
+static int compress_file( const char *table_name, bool compressed, bool quiet ) {
+    char filepath[MAX_STR_LENGTH];
+    snprintf( filepath, sizeof(filepath), "%s/%s", folder, table_name );
+
+    // The table is rewritten into its temp file under the write lock, then renamed over the table.
+    TableLock *lock = write_lock_table( table_name );
+    char tempPath[MAX_STR_LENGTH];
+    temp_table_path( tempPath, sizeof( tempPath ), table_name );
+    bool wasCompressed;
+    FILE *fileIn = open_table_file( filepath, &wasCompressed );
+    if ( fileIn == NULL ) {
+        write_unlock_table( lock );
+        out_printf( "Table %s not found!\n", table_name );
+        return EXIT_FAILURE;
+    }
+    FILE *temp = create_table_file( tempPath, compressed );
+
+    // Copy the table's text a block at a time.
+    char buffer[BLOCK_SIZE];
+    bool failed = temp == NULL;
+    size_t got;
+    while ( !failed && ( got = fread( buffer, 1, sizeof( buffer ), fileIn ) ) > 0 ) {
+        failed = fwrite( buffer, 1, got, temp ) != got;
+    }
+    failed = failed || ferror( fileIn );
+    fclose( fileIn );
+    if ( temp != NULL && fclose( temp ) != 0 ) {
+        failed = true;
+    }
+    if ( failed ) {
+        remove( tempPath );
+        write_unlock_table( lock );
+        out_printf( "Unable to rewrite table %s\n", table_name );
+        return EXIT_FAILURE;
+    }
+
+    // Report the change in size if asked, then rename the temp file over the table. The rows are
+    // the same, so the table's id filter moves to the new file.
+    struct stat before, after;
+    stat( filepath, &before );
+    stat( tempPath, &after );
+    rename( tempPath, filepath );
+    bloom_retarget( table_name, &before, &after );
+    if ( !quiet ) {
+        out_printf( "Table %s %s: %lld bytes to %lld bytes\n", table_name,
+                    compressed ? "compressed" : "decompressed", ( long long )before.st_size,
+                    ( long long )after.st_size );
+    }
+    write_unlock_table( lock );
+    return EXIT_SUCCESS;
+}
+
+/**
+   Creates the file of a partition if it does not exist, removes the partitions its table no
+   longer retains, and compresses those that have just become archives. The table's write lock is
+   held.
+*/
+static int open_partition( const char *name ) {
+    char filepath[MAX_STR_LENGTH];
+    snprintf( filepath, sizeof(filepath), "%s/%s", folder, name );
+    if ( access( filepath, F_OK ) != -1 ) {
+        return EXIT_SUCCESS;
+    }
+    TableLock *lock = write_lock_table( name );
+    FILE *file = fopen( filepath, "w" );
+    if ( file == NULL ) {
+        write_unlock_table( lock );
+        return EXIT_FAILURE;
+    }
+    fclose( file );
+    struct stat table;
+    BloomBuilder ids = { NULL, 0, 0 };
+    if ( stat( filepath, &table ) == 0 ) {
+        bloom_build( name, &ids, &table );
+    }
+    write_unlock_table( lock );
+
+    // Each expired partition is dropped whole.
+    PartitionList expired, archived;
+    add_partition( name, &expired, &archived );
+    for ( int i = 0; i < expired.count; i++ ) {
+        lock = write_lock_table( expired.names[i] );
+        snprintf( filepath, sizeof(filepath), "%s/%s", folder, expired.names[i] );
+        remove( filepath );
+        bloom_remove( expired.names[i] );
+        write_unlock_table( lock );
+    }
+    if ( expired.count > 0 ) {
+        table_replaced( name );
+    }
+    free_partition_list( &expired );
+    for ( int i = 0; i < archived.count; i++ ) {
+        compress_file( archived.names[i], true, true );
+    }
+    free_partition_list( &archived );
+    return EXIT_SUCCESS;
+}
+
+/**
+   Write locks a file of a partitioned table whose own lock is held. The table's own file, which
+   holds the rows whose dates cannot be read, shares the table's lock.
+*/
+static TableLock *lock_partition( TableLock *lock, const char *table_name, const char *name ) {
+    return strcmp( name, table_name ) == 0 ? lock : write_lock_table( name );
+}
+
+/** Releases a lock taken with lock_partition. */
+static void unlock_partition( TableLock *lock, TableLock *partition ) {
+    if ( partition != lock ) {
+        write_unlock_table( partition );
+    }
+}
+
 /** This function is defined to to check if a table is already exist. */
 int table_exist( const char *table_name ){
 	char filepath[MAX_STR_LENGTH];
@@ -48,1345 +339,617 @@ int table_exist( const char *table_name ){
         return EXIT_SUCCESS; 
     }
     else {
-        printf( "Table %s does not exist!\n", table_name );
-        printf( "Run: create_table %s", table_name );
+        out_printf( "Table %s does not exist!\n", table_name );
+        out_printf( "Run: create_table %s", table_name );
         return EXIT_FAILURE; 
     }
 }
 
 /** This function is defined to insert a record into a table. */
 int insert_into_table( const char *table_name, const char *table_row ){
+    return insert_rows( table_name, &table_row, 1 );
+}
+
+/** Prints a message once for each of a number of rows. */
+static void print_each_row( const char *message, int count ) {
+    for ( int i = 0; i < count; i++ ) {
+        out_printf( "%s", message );
+    }
+}
+
+/**
+   Adds rows, each ending with a newline, to the end of a table whose write lock is held. They go
+   in one write so a reader's snapshot never ends partway through a row. A compressed table gets
+   the rows as a block of their own. Prints nothing.
+*/
+static int append_rows( TableLock *lock, const char *table_name, const char *const *rows,
+                        int count ) {
+    char filepath[MAX_STR_LENGTH];
+    snprintf( filepath, sizeof(filepath), "%s/%s", folder, table_name );
+    uint64_t start = stats_clock();
+    int fd = open( filepath, O_RDWR | O_APPEND );
+    stats_add( SYSCALLS, 1 );
+    stats_phase( PHASE_OPEN, start );
+    if ( fd < 0 ) {
+        return EXIT_FAILURE;
+    }
+
+    size_t length = 0;
+    for ( int i = 0; i < count; i++ ) {
+        length += strlen( rows[i] ) + 1;
+    }
+    char *text = ( char * )malloc( length );
+    if ( text == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    for ( size_t at = 0, i = 0; i < ( size_t )count; i++ ) {
+        size_t row_length = strlen( rows[i] );
+        memcpy( text + at, rows[i], row_length );
+        text[at + row_length] = '\n';
+        at += row_length + 1;
+    }
+    struct iovec part = { text, length };
+    start = stats_clock();
+    bool compressed = table_compressed( fd );
+    struct stat before, after;
+    fstat( fd, &before );
+    begin_append( lock );
+    int written = compressed ? append_block( fd, &part, 1 ) : storage_write( fd, &part, 1 );
+    end_append( lock );
+    free( text );
+
+    // Add the rows' ids to the table's id filter.
+    if ( written == EXIT_SUCCESS && fstat( fd, &after ) == 0 ) {
+        bloom_add( table_name, rows, count, &before, &after );
+    }
+    if ( written == EXIT_SUCCESS ) {
+        rows_inserted( table_name, rows, count );
+    }
+    close( fd );    // close file when finished.
+    stats_phase( PHASE_WRITE, start );
+    return written;
+}
+
+/**
+   Inserts rows into a partitioned table. Each run of rows for the same partition is appended to
+   it with one write under the partition's lock, inside the table's lock.
+*/
+static int insert_partitioned( const char *table_name, const char *const *rows, int count ) {
+    TableLock *lock = write_lock_table( table_name );
+    if ( table_exist( table_name ) != EXIT_SUCCESS ) {
+        for ( int i = 1; i < count; i++ ) {
+            table_exist( table_name );
+        }
+        write_unlock_table( lock );
+        return EXIT_FAILURE;
+    }
+    int status = EXIT_SUCCESS;
+    char name[MAX_TABLE_NAME_LENGTH], next[MAX_TABLE_NAME_LENGTH];
+    for ( int first = 0, last; first < count; first = last ) {
+        partition_of_row( table_name, rows[first], name, sizeof( name ) );
+        for ( last = first + 1; last < count; last++ ) {
+            partition_of_row( table_name, rows[last], next, sizeof( next ) );
+            if ( strcmp( next, name ) != 0 ) {
+                break;
+            }
+        }
+        bool written = false;
+        if ( is_expired( name ) ) {
+            out_printf( "Partition %s is past its table's retention!\n", name );
+        }
+        else if ( is_archived( name ) ) {
+            out_printf( "Partition %s is archived and read-only!\n", name );
+        }
+        else if ( open_partition( name ) == EXIT_SUCCESS ) {
+            TableLock *partition = lock_partition( lock, table_name, name );
+            written = append_rows( partition, name, rows + first, last - first ) == EXIT_SUCCESS;
+            unlock_partition( lock, partition );
+        }
+        print_each_row( written ? "Data inserted successfully!\n" : "The data insertion failed!\n",
+                        last - first );
+        if ( !written ) {
+            status = EXIT_FAILURE;
+        }
+    }
+    write_unlock_table( lock );
+    return status;
+}
+
+/**
+   Inserts rows at the end of a table. Every row gets the message a single insert would print, so
+   a batch of inserts looks the same as the inserts run one at a time.
+*/
+static int store_rows( const char *table_name, const char *const *rows, int count ){
+    if ( is_partitioned( table_name ) ) {
+        return insert_partitioned( table_name, rows, count );
+    }
+    TableLock *lock = write_lock_table( table_name );
 	if ( table_exist(table_name) == EXIT_SUCCESS )
 	{
-		char filepath[MAX_STR_LENGTH];
-    	snprintf(filepath, sizeof(filepath), "%s/%s", folder, table_name);
-
-    	// Open file, handle file opening error, write file, print success or error message
-        FILE *fp = fopen( filepath, "a" );
-        if ( fp == NULL ) {
-            printf( "The data insertion failed!\n" ); 
+        // Write the rows, print success or error message
+        if ( append_rows( lock, table_name, rows, count ) != EXIT_SUCCESS ) {
+            print_each_row( "The data insertion failed!\n", count );
+            write_unlock_table( lock );
             return EXIT_FAILURE;
         }
-        else {
-            // Add contents of table_row to end of current table/file.
-            fprintf( fp, "%s\n", table_row );
-            printf( "Data inserted successfully!\n" );
-            fclose( fp );   // close file when finished.
-        }
+        print_each_row( "Data inserted successfully!\n", count );
 	}
+    else {
+        // The first row's message was printed by table_exist.
+        for ( int i = 1; i < count; i++ ) {
+            table_exist( table_name );
+        }
+    }
+    write_unlock_table( lock );
 	return EXIT_SUCCESS;
 }
 
-/** This function is defined to read a table. */
-int read_database_file( const char *table_name ) {
-    // Check for NULL error.
-    if ( table_name == NULL ) {
-        printf( "Table name missing!\n" );
-        return EXIT_FAILURE;
+/**
+   Inserts rows into a table. Rows whose foreign keys name no parent row are refused before the
+   table is locked, and each run of rows between them is stored together, so the messages stay in
+   the order of the rows. Deletes from parents wait until the rows checked are stored.
+*/
+int insert_rows( const char *table_name, const char *const *rows, int count ){
+    if ( !has_foreign_keys( table_name ) ) {
+        return store_rows( table_name, rows, count );
     }
-    
+    hold_foreign_keys( false );
+    int status = EXIT_SUCCESS;
+    int first = 0;
+    for ( int i = 0; i <= count; i++ ) {
+        if ( i < count && foreign_keys_met( table_name, rows[i], false ) ) {
+            continue;
+        }
+        if ( i > first && store_rows( table_name, rows + first, i - first ) != EXIT_SUCCESS ) {
+            status = EXIT_FAILURE;
+        }
+        if ( i < count ) {
+            foreign_keys_met( table_name, rows[i], true );
+            out_printf( "The data insertion failed!\n" );
+            status = EXIT_FAILURE;
+        }
+        first = i + 1;
+    }
+    release_foreign_keys();
+    return status;
+}
+
+/** Prints one file of a table. */
+static int read_table_file( const char *table_name ) {
     // Set up filepath to read from.
     char filepath[MAX_STR_LENGTH];
     snprintf( filepath, sizeof(filepath), "%s/%s", folder, table_name );
 
     // Check if the file exists and print error if it doesn't.
+    uint64_t start = stats_clock();
     FILE *file = fopen( filepath, "r" );
+    stats_add( SYSCALLS, 1 );
+    stats_phase( PHASE_OPEN, start );
     if ( file != NULL ) {
-        // read in table and print to console line by line.
-        char line[MAX_STR_LENGTH];
-        while ( fgets(line, sizeof(line), file) ) {
-            printf( line );
-        }
+        // read in the table's snapshot and print to console a chunk at a time.
+        start = stats_clock();
+        off_t length = snapshot_length( table_name, file );
+        int status = table_stream( fileno( file ), length, copy_to_sink, output_sink() );
         fclose( file );
-        return EXIT_SUCCESS; 
+        stats_phase( PHASE_SCAN, start );
+        return status; 
     }
     else {
-        printf( "Table %s not found!\n", table_name );
+        out_printf( "Table %s not found!\n", table_name );
         return EXIT_FAILURE; 
     }
 }
 
+/** This function is defined to read a table. */
+int read_database_file( const char *table_name ) {
+    // Check for NULL error.
+    if ( table_name == NULL ) {
+        out_printf( "Table name missing!\n" );
+        return EXIT_FAILURE;
+    }
+    if ( waitlist_queued( table_name ) ) {
+        sink_waitlist( output_sink() );
+        return EXIT_SUCCESS;
+    }
+    if ( !is_partitioned( table_name ) ) {
+        return read_table_file( table_name );
+    }
+
+    // A partitioned table is its own file, then each partition in date order.
+    PartitionList list;
+    list_partitions( table_name, "", "", "", &list );
+    int status = EXIT_SUCCESS;
+    for ( int i = 0; i < list.count && status == EXIT_SUCCESS; i++ ) {
+        status = read_table_file( list.names[i] );
+    }
+    free_partition_list( &list );
+    return status;
+}
+
 /**
-   This function is defined to find a row(s) based on a condition. Some database structs share 
-   similar fields and can be "selected" in the same logic branch.
+   A SelectPlan holds how a select is run: the table opened for reading, the columns printed, the
+   scan, the length of the table's snapshot, and whether it is large enough to scan in parallel.
+   The scan points at the plan's projection, so a plan is never copied.
 */
-int select_from_table( const char *table_name, const char *condition_var, const char *condition,
-                       const char *condition_val ) {
+typedef struct {
+    FILE *file;
+    Projection projection;
+    ScanQuery query;
+    off_t length;
+    bool parallel;
+} SelectPlan;
+
+/**
+   Opens a table for a select and works out how to run it. Each table's columns are described in
+   schema.c, so every table is decoded, compared, and printed by the same logic. Only the columns
+   that are printed or compared are decoded from each line. Prints why if the select is invalid.
+*/
+static int plan_select( SelectPlan *plan, const char *table_name, const char *columns,
+                        const char *condition_var, const char *condition,
+                        const char *condition_val ) {
     // Open the file for reading
     FILE *file;
     char filepath[MAX_STR_LENGTH];
     snprintf( filepath, sizeof( filepath ), "%s/%s", folder, table_name );
+    uint64_t start = stats_clock();
     file = fopen( filepath, "r" );
+    stats_add( SYSCALLS, 1 );
+    stats_phase( PHASE_OPEN, start );
     if ( file == NULL ) { 
-        perror("Table not exist!");
+        err_printf( "Table not exist!: %s\n", strerror( errno ) );
         return EXIT_FAILURE;
     }
-    
-    // Variables to hold data count and line string regardless of the database type.
-    int data_count = 0; 
-    char line[MAX_STR_LENGTH];
-    
-    // Check for database of type book.
-	if ( strcmp( table_name, "book" ) == 0 ) {
-		// Set up array of Book structs.
-        Book *book_data = ( Book * )malloc( MAX_RECORDS * sizeof( Book ) );
-		if ( book_data == NULL ) { 
-            printf( "Memory allocation failed\n" ); 
-            return EXIT_FAILURE; 
-        }
-
-        // Read and process each line. Insert to array of Books.
-	    while ( fgets(line, sizeof( line ), file) ) { 
-            // Remove newline character if present
-	        if ( line[strlen( line ) - 1] == '\n' ) { 
-                line[strlen( line ) - 1] = '\0';
-            }
-			// Process the line
-	        char *token = strtok(line, " ");
-	        book_data[data_count].id = atoi(token);
-	        token = strtok( NULL, "\"" );
-	        strcpy( book_data[data_count].title, token );
-	        token = strtok( NULL, " " );
-	        book_data[data_count].category_id = atoi( token );
-	        ++data_count;
-		}
-        
-        // If condition_var is "id"...
-		if ( strcmp( condition_var, "id" ) == 0 ) {
-			int value = atoi( condition_val );
-	        // If id matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( book_data[i].id == value ) { 
-                        printf( "%d %s %d\n", book_data[i].id, book_data[i].title,
-						                     book_data[i].category_id );
-					}
-				}
-			} 
-            // If id does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( book_data[i].id != value ) {
-						printf( "%d %s %d\n", book_data[i].id, book_data[i].title,
-						                     book_data[i].category_id );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        } 
-        // If condition_var is "title"...
-        else if ( strcmp( condition_var, "title" ) == 0 ) {
-			// If title matches, print it to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-                    if ( strcmp( book_data[i].title, condition_val ) == 0 ) {
-						printf( "%d %s %d\n", book_data[i].id, book_data[i].title,
-						                     book_data[i].category_id );
-					}
-				}
-			} 
-            // If title does not match, print it to console.
-            else if ( strcmp( condition, "!=" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( strcmp( book_data[i].title, condition_val) != 0 ) {
-						printf( "%d %s %d\n", book_data[i].id, book_data[i].title,
-						                     book_data[i].category_id );
-					}
-				}
-			}
-            else {
-                printf( "conditions invalid\n" );
-            }            
-		}
-        // If condition_var is category_id
-        else if ( strcmp( condition_var, "category_id" ) == 0 ) { 
-            int value = atoi( condition_val );
-            // If category_id matches, print it to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-                    if ( book_data[i].category_id == value ) {
-						printf( "%d %s %d\n", book_data[i].id, book_data[i].title,
-						                     book_data[i].category_id );
-					}
-				}
-			} 
-            // If category_id does not match, print it to console.
-            else if ( strcmp( condition, "!=" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( book_data[i].category_id != value ) {
-						printf( "%d %s %d\n", book_data[i].id, book_data[i].title,
-						                     book_data[i].category_id );
-					}
-				}
-			}
-            else {
-                printf( "conditions invalid\n" );
-            }            
-		}
-        // Invalid condition_var for a book.
-        else {
-			printf( "conditions invalid\n" );
-		}
-        free( book_data );
-	}
-    
-    // Table name of category, author, and publisher are all identified with just id and name. 
-    else if ( strcmp( table_name, "category" ) == 0 || strcmp( table_name, "author" ) == 0 ||
-              strcmp( table_name, "publisher" ) == 0 ) {
-                  
-		// Set up array of Category structs.(Technically same as author and publisher)
-        Category *category_data = ( Category * )malloc( MAX_RECORDS * sizeof( Category ) );
-		if ( category_data == NULL ) {
-            printf( "Memory allocation failed\n" );
-            return EXIT_FAILURE;
-        }
-        
-        // Read and process each line. Insert to array of categories.
-	    while ( fgets(line, sizeof( line ), file) ) { 
-            // Remove newline character if present
-	        if ( line[strlen( line ) - 1] == '\n' ) {
-                line[strlen( line ) - 1] = '\0';
-            }
-			// Process the line (here, just print it) 
-	        char *token = strtok(line, " ");
-	        category_data[data_count].id = atoi(token);
-	        token = strtok( NULL, "\"" );
-	        strcpy( category_data[data_count].name, token );
-	        ++data_count;
-		}
-        
-        // If condition_var is "id"...
-		if ( strcmp( condition_var, "id" ) == 0 ) {
-			int value = atoi( condition_val );
-	        // If id matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( category_data[i].id == value ) { 
-                        printf( "%d %s\n", category_data[i].id, category_data[i].name );
-					}
-				}
-			} 
-            // If id does not match, print to console.
-            else if (strcmp(condition, "!=" ) == 0) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( category_data[i].id != value ) {
-						printf( "%d %s\n", category_data[i].id, category_data[i].name );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        } 
-        // If condition_var is "name"...
-        else if ( strcmp( condition_var, "name" ) == 0 ) {
-			// If name matches, print it to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-                    if ( strcmp( category_data[i].name, condition_val ) == 0 ) {
-						printf( "%d %s\n", category_data[i].id, category_data[i].name );
-					}
-				}
-			} 
-            // If name does not match, print it to console.
-            else if ( strcmp( condition, "!=" ) == 0) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( strcmp( category_data[i].name, condition_val) != 0 ) {
-						printf( "%d %s\n", category_data[i].id, category_data[i].name );
-					}
-				}
-			}
-            else {
-                printf( "conditions invalid\n" );
-            }            
-		}
-        // Invalid condition_var for a category/author/publisher.
-        else {
-			printf( "conditions invalid\n" );
-		}
-        free( category_data );
-	}
-    
-    // Table is type book_author
-    else if ( strcmp( table_name, "book_author" ) == 0 ) {
-        // Set up array of book_author structs.
-        Book_author *book_author_data = ( Book_author * )malloc( MAX_RECORDS * sizeof( Book_author ) );
-		if ( book_author_data == NULL ) {
-            printf( "Memory allocation failed\n" );
-            return EXIT_FAILURE;
-        }
-        
-        // Read and process each line. Insert to array of Book_authors.
-	    while ( fgets(line, sizeof( line ), file) ) { 
-            // Remove newline character if present
-	        if ( line[strlen( line ) - 1] == '\n' ) { 
-                line[strlen( line ) - 1] = '\0';
-            }
-			// Process the line
-	        char *token = strtok(line, " ");
-	        book_author_data[data_count].book_id = atoi(token);
-	        token = strtok( NULL, " " );
-	        book_author_data[data_count].author_id = atoi( token );
-	        ++data_count;
-		}
-        
-        // If condition_var is "book_id"...
-		if ( strcmp( condition_var, "book_id" ) == 0 ) {
-			int value = atoi( condition_val );
-	        // If book_id matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( book_author_data[i].book_id == value ) { 
-                        printf( "%d %d\n", book_author_data[i].book_id, 
-						                   book_author_data[i].author_id );
-					}
-				}
-			} 
-            // If book_id does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( book_author_data[i].book_id != value ) {
-						printf( "%d %d\n", book_author_data[i].book_id,
-						                     book_author_data[i].author_id );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        }
-        // If condition_var is author_id
-        else if ( strcmp( condition_var, "author_id" ) == 0 ) { 
-            int value = atoi( condition_val );
-            // If category_id matches, print it to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-                    if ( book_author_data[i].author_id == value ) {
-						printf( "%d %d\n", book_author_data[i].book_id, 
-						                   book_author_data[i].author_id );
-					}
-				}
-			} 
-            // If author_id does not match, print it to console.
-            else if ( strcmp( condition, "!=" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( book_author_data[i].author_id != value ) {
-						printf( "%d %d\n", book_author_data[i].book_id,
-						                   book_author_data[i].author_id );
-					}
-				}
-			}
-            else {
-                printf( "conditions invalid\n" );
-            }            
-		}
-        // Invalid condition_var for a book_author.
-        else {
-			printf( "conditions invalid\n" );
-		}
-        free( book_author_data );
-    }
-    
-    // Table is type book_copy
-    else if ( strcmp( table_name, "book_copy" ) == 0 ) {
-        // Set up array of Book_copy structs.
-        Book_copy *book_copy_data = ( Book_copy * )malloc( MAX_RECORDS * sizeof( Book_copy ) );
-		if ( book_copy_data == NULL ) {
-            printf( "Memory allocation failed\n" );
-            return EXIT_FAILURE;
-        }
-        
-        // Read and process each line. Insert to array of book_copy_data.
-	    while ( fgets(line, sizeof( line ), file) ) { 
-            // Remove newline character if present
-	        if ( line[strlen( line ) - 1] == '\n' ) { 
-                line[strlen( line ) - 1] = '\0';
-            }
-			// Process the line
-	        char *token = strtok(line, " ");
-            book_copy_data[data_count].id = atoi( token );
-            token = strtok( NULL, " " );
-	        book_copy_data[data_count].book_id = atoi( token );
-	        token = strtok( NULL, " " );
-	        book_copy_data[data_count].publisher_id = atoi( token );
-            token = strtok( NULL, " " );
-	        book_copy_data[data_count].year_published = atoi( token );
-	        ++data_count;
-		}
-        
-        // If condition_var is "id"
-		if ( strcmp( condition_var, "id" ) == 0 ) {
-			int value = atoi( condition_val );
-	        // If id matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( book_copy_data[i].id == value ) { 
-                        printf( "%d %d %d %d\n", book_copy_data[i].id, book_copy_data[i].book_id,
-						        book_copy_data[i].publisher_id, book_copy_data[i].year_published );
-					}
-				}
-			} 
-            // If id does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( book_copy_data[i].id != value ) {
-                        printf( "%d %d %d %d\n", book_copy_data[i].id, book_copy_data[i].book_id,
-						        book_copy_data[i].publisher_id, book_copy_data[i].year_published );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        } 
-        // If condition_var is "book_id"...
-		else if ( strcmp( condition_var, "book_id" ) == 0 ) {
-			int value = atoi( condition_val );
-	        // If book_id matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( book_copy_data[i].book_id == value ) { 
-                        printf( "%d %d %d %d\n", book_copy_data[i].id, book_copy_data[i].book_id,
-						        book_copy_data[i].publisher_id, book_copy_data[i].year_published );
-					}
-				}
-			} 
-            // If book_id does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( book_copy_data[i].book_id != value ) {
-                        printf( "%d %d %d %d\n", book_copy_data[i].id, book_copy_data[i].book_id,
-						        book_copy_data[i].publisher_id, book_copy_data[i].year_published );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        }
-        // If condition_var is publisher_id
-        else if ( strcmp( condition_var, "publisher_id" ) == 0 ) { 
-            int value = atoi( condition_val );
-            // If publisher_id matches, print it to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-                    if ( book_copy_data[i].publisher_id == value ) {
-                        printf( "%d %d %d %d\n", book_copy_data[i].id, book_copy_data[i].book_id,
-						        book_copy_data[i].publisher_id, book_copy_data[i].year_published );
-					}
-				}
-			} 
-            // If publisher_id does not match, print it to console.
-            else if ( strcmp( condition, "!=" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( book_copy_data[i].publisher_id != value ) {
-                        printf( "%d %d %d %d\n", book_copy_data[i].id, book_copy_data[i].book_id,
-						        book_copy_data[i].publisher_id, book_copy_data[i].year_published );
-					}
-				}
-			}
-            else {
-                printf( "conditions invalid\n" );
-            }            
-		}
-        // If condition_var is year_published.
-        else if ( strcmp( condition_var, "year_published" ) == 0 ) { 
-            int value = atoi( condition_val );
-            // If year_published matches, print it to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-                    if ( book_copy_data[i].year_published == value ) {
-                        printf( "%d %d %d %d\n", book_copy_data[i].id, book_copy_data[i].book_id,
-						        book_copy_data[i].publisher_id, book_copy_data[i].year_published );
-					}
-				}
-			} 
-            // If year_published does not match, print it to console.
-            else if ( strcmp( condition, "!=" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( book_copy_data[i].year_published != value ) {
-                        printf( "%d %d %d %d\n", book_copy_data[i].id, book_copy_data[i].book_id,
-						        book_copy_data[i].publisher_id, book_copy_data[i].year_published );
-					}
-				}
-			}
-            else {
-                printf( "conditions invalid\n" );
-            }            
-		}
-        // Invalid condition_var for a book_copy.
-        else {
-			printf( "conditions invalid\n" );
-		}
-        free( book_copy_data );
-    }
-    
-    // Table is type member_account
-    else if ( strcmp( table_name, "member_account" ) == 0 ) {
-        // Set up array of Member_account structs.
-        Member_account *member_account_data = ( Member_account * )malloc( MAX_RECORDS * sizeof( Member_account ) );
-		if ( member_account_data == NULL ) { 
-            printf( "Memory allocation failed\n" ); 
-            return EXIT_FAILURE; 
-        }
-
-        // Read and process each line. Insert to array of member_accounts.
-	    while ( fgets(line, sizeof( line ), file) ) { 
-            // Remove newline character if present
-	        if ( line[strlen( line ) - 1] == '\n' ) { 
-                line[strlen( line ) - 1] = '\0';
-            }
-			// Process the line
-	        char *token = strtok(line, " ");
-	        member_account_data[data_count].id = atoi(token);
-	        token = strtok( NULL, "\"" );
-	        strcpy( member_account_data[data_count].first_name, token );
-	        token = strtok( NULL, "\" " );
-	        strcpy( member_account_data[data_count].last_name, token );
-            token = strtok( NULL, "\" " );
-	        strcpy( member_account_data[data_count].email, token );
-	        ++data_count;
-		}
-        
-        // If condition_var is "id"...
-		if ( strcmp( condition_var, "id" ) == 0 ) {
-			int value = atoi( condition_val );
-	        // If id matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( member_account_data[i].id == value ) { 
-                        printf( "%d %s %s %s\n", member_account_data[i].id, member_account_data[i].first_name,
-						         member_account_data[i].last_name, member_account_data[i].email );
-					}
-				}
-			} 
-            // If id does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( member_account_data[i].id != value ) {
-                        printf( "%d %s %s %s\n", member_account_data[i].id, member_account_data[i].first_name,
-						         member_account_data[i].last_name, member_account_data[i].email );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        } 
-        // If condition_var is "first_name"...
-        else if ( strcmp( condition_var, "first_name" ) == 0 ) {
-			// If first_name matches, print it to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-                    if ( strcmp( member_account_data[i].first_name, condition_val ) == 0 ) {
-                        printf( "%d %s %s %s\n", member_account_data[i].id, member_account_data[i].first_name,
-						         member_account_data[i].last_name, member_account_data[i].email );
-					}
-				}
-			} 
-            // If first_name does not match, print it to console.
-            else if ( strcmp( condition, "!=" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( strcmp( member_account_data[i].first_name, condition_val) != 0 ) {
-                        printf( "%d %s %s %s\n", member_account_data[i].id, member_account_data[i].first_name,
-						         member_account_data[i].last_name, member_account_data[i].email );
-					}
-				}
-			}
-            else {
-                printf( "conditions invalid\n" );
-            }            
-		}
-        // If condition_var is "last_name"...
-        else if ( strcmp( condition_var, "last_name" ) == 0 ) {
-			// If last_name matches, print it to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-                    if ( strcmp( member_account_data[i].last_name, condition_val ) == 0 ) {
-                        printf( "%d %s %s %s\n", member_account_data[i].id, member_account_data[i].first_name,
-						         member_account_data[i].last_name, member_account_data[i].email );
-					}
-				}
-			} 
-            // If last_name does not match, print it to console.
-            else if ( strcmp( condition, "!=" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( strcmp( member_account_data[i].last_name, condition_val) != 0 ) {
-                        printf( "%d %s %s %s\n", member_account_data[i].id, member_account_data[i].first_name,
-						         member_account_data[i].last_name, member_account_data[i].email );
-					}
-				}
-			}
-            else {
-                printf( "conditions invalid\n" );
-            }            
-		}
-        // If condition_var is "email"...
-        else if ( strcmp( condition_var, "email" ) == 0 ) {
-			// If email matches, print it to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-                    if ( strcmp( member_account_data[i].email, condition_val ) == 0 ) {
-                        printf( "%d %s %s %s\n", member_account_data[i].id, member_account_data[i].first_name,
-						         member_account_data[i].last_name, member_account_data[i].email );
-					}
-				}
-			} 
-            // If email does not match, print it to console.
-            else if ( strcmp( condition, "!=" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( strcmp( member_account_data[i].email, condition_val) != 0 ) {
-                        printf( "%d %s %s %s\n", member_account_data[i].id, member_account_data[i].first_name,
-						         member_account_data[i].last_name, member_account_data[i].email );
-					}
-				}
-			}
-            else {
-                printf( "conditions invalid\n" );
-            }            
-		}
-        // Invalid condition_var for a book.
-        else {
-			printf( "conditions invalid\n" );
-		}
-        free( member_account_data );
-    }
-    
-    // Table is type checkout
-    else if ( strcmp( table_name, "checkout" ) == 0 ) {
-        // Set up array of checkout structs.
-        Checkout *checkout_data = ( Checkout * )malloc( MAX_RECORDS * sizeof( Checkout ) );
-		if ( checkout_data == NULL ) {
-            printf( "Memory allocation failed\n" );
-            return EXIT_FAILURE;
-        }
-        
-        // Read and process each line. Insert to array of checkouts.
-	    while ( fgets(line, sizeof( line ), file) ) { 
-            // Remove newline character if present
-	        if ( line[strlen( line ) - 1] == '\n' ) { 
-                line[strlen( line ) - 1] = '\0';
-            }
-			
-			// Process the line
-	        char *token = strtok(line, " ");
-	        checkout_data[data_count].id = atoi(token);
-	        token = strtok( NULL, "-" );
-	        checkout_data[data_count].checkout_date.day = atoi( token );
-            token = strtok( NULL, "-" );
-            checkout_data[data_count].checkout_date.month = atoi( token );
-            token = strtok( NULL, " " );
-            checkout_data[data_count].checkout_date.year = atoi( token );
-            token = strtok( NULL, "-" );
-	        checkout_data[data_count].return_date.day = atoi( token );
-            token = strtok( NULL, "-" );
-            checkout_data[data_count].return_date.month = atoi( token );
-            token = strtok( NULL, " " );
-            checkout_data[data_count].return_date.year = atoi( token );
-            token = strtok( NULL, " " );
-            checkout_data[data_count].book_copy_id = atoi( token );
-            token = strtok( NULL, " " );
-            checkout_data[data_count].member_id = atoi( token );
-            token = strtok( NULL, " " );
-            checkout_data[data_count].is_returned = atoi( token );
-	        ++data_count;
-		}
-        
-        // If condition_var is "id"...
-		if ( strcmp( condition_var, "id" ) == 0 ) {
-			int value = atoi( condition_val );
-	        // If id matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( checkout_data[i].id == value ) { 
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d %d\n", checkout_data[i].id, checkout_data[i].checkout_date.day,
-						         checkout_data[i].checkout_date.month, checkout_data[i].checkout_date.year,
-                                 checkout_data[i].return_date.day, checkout_data[i].return_date.month,
-                                 checkout_data[i].return_date.year, checkout_data[i].book_copy_id,
-                                 checkout_data[i].member_id, checkout_data[i].is_returned );
-					}
-				}
-			} 
-            // If id does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( checkout_data[i].id != value ) {
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d %d\n", checkout_data[i].id, checkout_data[i].checkout_date.day,
-						         checkout_data[i].checkout_date.month, checkout_data[i].checkout_date.year,
-                                 checkout_data[i].return_date.day, checkout_data[i].return_date.month,
-                                 checkout_data[i].return_date.year, checkout_data[i].book_copy_id,
-                                 checkout_data[i].member_id, checkout_data[i].is_returned );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        }
-        // If condition_var is "checkout_date"
-		else if ( strcmp( condition_var, "checkout_date" ) == 0 ) {
-            // Tokenize the condition_val to get a day-month-year.
-            strcpy( line, condition_val );
-            char *token = strtok(line, "-");
-            int day = atoi( token );
-            token = strtok( NULL, "-" );
-            int month = atoi( token );
-            token = strtok( NULL, " " );
-            int year = atoi( token );
-
-	        // If checkout_date matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( checkout_data[i].checkout_date.day == day && 
-                         checkout_data[i].checkout_date.month == month &&
-                         checkout_data[i].checkout_date.year == year ) { 
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d %d\n", checkout_data[i].id, checkout_data[i].checkout_date.day,
-						         checkout_data[i].checkout_date.month, checkout_data[i].checkout_date.year,
-                                 checkout_data[i].return_date.day, checkout_data[i].return_date.month,
-                                 checkout_data[i].return_date.year, checkout_data[i].book_copy_id,
-                                 checkout_data[i].member_id, checkout_data[i].is_returned );
-					}
-				}
-			} 
-            // If checkout_date does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( checkout_data[i].checkout_date.day != day || 
-                         checkout_data[i].checkout_date.month != month ||
-                         checkout_data[i].checkout_date.year != year ) {
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d %d\n", checkout_data[i].id, checkout_data[i].checkout_date.day,
-						         checkout_data[i].checkout_date.month, checkout_data[i].checkout_date.year,
-                                 checkout_data[i].return_date.day, checkout_data[i].return_date.month,
-                                 checkout_data[i].return_date.year, checkout_data[i].book_copy_id,
-                                 checkout_data[i].member_id, checkout_data[i].is_returned );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        }
-        // If condition_var is "return_date"
-		else if ( strcmp( condition_var, "return_date" ) == 0 ) {
-            // Tokenize the condition_val to get a day-month-year.
-            strcpy( line, condition_val );
-            char *token = strtok(line, "-");
-            int day = atoi( token );
-            token = strtok( NULL, "-" );
-            int month = atoi( token );
-            token = strtok( NULL, " " );
-            int year = atoi( token );
-
-	        // If return_date matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( checkout_data[i].return_date.day == day && 
-                         checkout_data[i].return_date.month == month &&
-                         checkout_data[i].return_date.year == year ) { 
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d %d\n", checkout_data[i].id, checkout_data[i].checkout_date.day,
-						         checkout_data[i].checkout_date.month, checkout_data[i].checkout_date.year,
-                                 checkout_data[i].return_date.day, checkout_data[i].return_date.month,
-                                 checkout_data[i].return_date.year, checkout_data[i].book_copy_id,
-                                 checkout_data[i].member_id, checkout_data[i].is_returned );
-					}
-				}
-			} 
-            // If return_date does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( checkout_data[i].return_date.day != day || 
-                         checkout_data[i].return_date.month != month ||
-                         checkout_data[i].return_date.year != year ) {
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d %d\n", checkout_data[i].id, checkout_data[i].checkout_date.day,
-						         checkout_data[i].checkout_date.month, checkout_data[i].checkout_date.year,
-                                 checkout_data[i].return_date.day, checkout_data[i].return_date.month,
-                                 checkout_data[i].return_date.year, checkout_data[i].book_copy_id,
-                                 checkout_data[i].member_id, checkout_data[i].is_returned );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        }
-        // If condition_var is "book_copy_id"...
-		else if ( strcmp( condition_var, "book_copy_id" ) == 0 ) {
-			int value = atoi( condition_val );
-	        // If book_copy_id matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( checkout_data[i].book_copy_id == value ) { 
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d %d\n", checkout_data[i].id, checkout_data[i].checkout_date.day,
-						         checkout_data[i].checkout_date.month, checkout_data[i].checkout_date.year,
-                                 checkout_data[i].return_date.day, checkout_data[i].return_date.month,
-                                 checkout_data[i].return_date.year, checkout_data[i].book_copy_id,
-                                 checkout_data[i].member_id, checkout_data[i].is_returned );
-					}
-				}
-			} 
-            // If book_copy_id does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( checkout_data[i].book_copy_id != value ) {
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d %d\n", checkout_data[i].id, checkout_data[i].checkout_date.day,
-						         checkout_data[i].checkout_date.month, checkout_data[i].checkout_date.year,
-                                 checkout_data[i].return_date.day, checkout_data[i].return_date.month,
-                                 checkout_data[i].return_date.year, checkout_data[i].book_copy_id,
-                                 checkout_data[i].member_id, checkout_data[i].is_returned );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        }
-        // If condition_var is "member_id"...
-		else if ( strcmp( condition_var, "member_id" ) == 0 ) {
-			int value = atoi( condition_val );
-	        // If member_id matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( checkout_data[i].member_id == value ) { 
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d %d\n", checkout_data[i].id, checkout_data[i].checkout_date.day,
-						         checkout_data[i].checkout_date.month, checkout_data[i].checkout_date.year,
-                                 checkout_data[i].return_date.day, checkout_data[i].return_date.month,
-                                 checkout_data[i].return_date.year, checkout_data[i].book_copy_id,
-                                 checkout_data[i].member_id, checkout_data[i].is_returned );
-					}
-				}
-			} 
-            // If member_id does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( checkout_data[i].member_id != value ) {
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d %d\n", checkout_data[i].id, checkout_data[i].checkout_date.day,
-						         checkout_data[i].checkout_date.month, checkout_data[i].checkout_date.year,
-                                 checkout_data[i].return_date.day, checkout_data[i].return_date.month,
-                                 checkout_data[i].return_date.year, checkout_data[i].book_copy_id,
-                                 checkout_data[i].member_id, checkout_data[i].is_returned );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        }
-        // If condition_var is "is_returned"...
-		else if ( strcmp( condition_var, "is_returned" ) == 0 ) {
-			int value = atoi( condition_val );
-            // Convert to just 0 or 1 depending on user input
-            value = value > 0 ? 1 : 0;
-            
-	        // If is_returned matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( checkout_data[i].is_returned == value ) { 
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d %d\n", checkout_data[i].id, checkout_data[i].checkout_date.day,
-						         checkout_data[i].checkout_date.month, checkout_data[i].checkout_date.year,
-                                 checkout_data[i].return_date.day, checkout_data[i].return_date.month,
-                                 checkout_data[i].return_date.year, checkout_data[i].book_copy_id,
-                                 checkout_data[i].member_id, checkout_data[i].is_returned );
-					}
-				}
-			} 
-            // If is_returned does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( checkout_data[i].is_returned != value ) {
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d %d\n", checkout_data[i].id, checkout_data[i].checkout_date.day,
-						         checkout_data[i].checkout_date.month, checkout_data[i].checkout_date.year,
-                                 checkout_data[i].return_date.day, checkout_data[i].return_date.month,
-                                 checkout_data[i].return_date.year, checkout_data[i].book_copy_id,
-                                 checkout_data[i].member_id, checkout_data[i].is_returned );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        }
-        // Invalid condition_var for a checkout.
-        else {
-			printf( "conditions invalid\n" );
-		}
-        free( checkout_data );
+
+    // Table is not part of defined databases in database.h 
+    const TableSchema *schema = find_table( table_name );
+    if ( schema == NULL ) {
+        out_printf( "Defined databases for selction include book, category, author, book_author, "
+                 "publisher, book_copy, member_account, checkout, hold, waitlist, notification\n" );
+        fclose( file );
+        return EXIT_FAILURE;
     }
-    
-    // Table is type hold
-    else if ( strcmp( table_name, "hold" ) == 0 ) {
-        // Set up array of hold structs.
-        Hold *hold_data = ( Hold * )malloc( MAX_RECORDS * sizeof( Hold ) );
-		if ( hold_data == NULL ) {
-            printf( "Memory allocation failed\n" );
-            return EXIT_FAILURE;
-        }
-        
-        // Read and process each line. Insert to array of holds.
-	    while ( fgets(line, sizeof( line ), file) ) { 
-            // Remove newline character if present
-	        if ( line[strlen( line ) - 1] == '\n' ) { 
-                line[strlen( line ) - 1] = '\0';
-            }
-			
-			// Process the line
-	        char *token = strtok(line, " ");
-	        hold_data[data_count].id = atoi(token);
-	        token = strtok( NULL, "-" );
-	        hold_data[data_count].checkout_date.day = atoi( token );
-            token = strtok( NULL, "-" );
-            hold_data[data_count].checkout_date.month = atoi( token );
-            token = strtok( NULL, " " );
-            hold_data[data_count].checkout_date.year = atoi( token );
-            token = strtok( NULL, "-" );
-	        hold_data[data_count].return_date.day = atoi( token );
-            token = strtok( NULL, "-" );
-            hold_data[data_count].return_date.month = atoi( token );
-            token = strtok( NULL, " " );
-            hold_data[data_count].return_date.year = atoi( token );
-            token = strtok( NULL, " " );
-            hold_data[data_count].book_copy_id = atoi( token );
-            token = strtok( NULL, " " );
-            hold_data[data_count].member_id = atoi( token );
-	        ++data_count;
-		}
-        
-        // If condition_var is "id"...
-		if ( strcmp( condition_var, "id" ) == 0 ) {
-			int value = atoi( condition_val );
-	        // If id matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( hold_data[i].id == value ) { 
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d\n", hold_data[i].id, hold_data[i].checkout_date.day,
-						         hold_data[i].checkout_date.month, hold_data[i].checkout_date.year,
-                                 hold_data[i].return_date.day, hold_data[i].return_date.month,
-                                 hold_data[i].return_date.year, hold_data[i].book_copy_id,
-                                 hold_data[i].member_id );
-					}
-				}
-			} 
-            // If id does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( hold_data[i].id != value ) {
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d\n", hold_data[i].id, hold_data[i].checkout_date.day,
-						         hold_data[i].checkout_date.month, hold_data[i].checkout_date.year,
-                                 hold_data[i].return_date.day, hold_data[i].return_date.month,
-                                 hold_data[i].return_date.year, hold_data[i].book_copy_id,
-                                 hold_data[i].member_id );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        }
-        // If condition_var is "checkout_date"
-		else if ( strcmp( condition_var, "checkout_date" ) == 0 ) {
-            // Tokenize the condition_val to get a day-month-year.
-            strcpy( line, condition_val );
-            char *token = strtok(line, "-");
-            int day = atoi( token );
-            token = strtok( NULL, "-" );
-            int month = atoi( token );
-            token = strtok( NULL, " " );
-            int year = atoi( token );
-
-	        // If checkout_date matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( hold_data[i].checkout_date.day == day && 
-                         hold_data[i].checkout_date.month == month &&
-                         hold_data[i].checkout_date.year == year ) { 
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d\n", hold_data[i].id, hold_data[i].checkout_date.day,
-						         hold_data[i].checkout_date.month, hold_data[i].checkout_date.year,
-                                 hold_data[i].return_date.day, hold_data[i].return_date.month,
-                                 hold_data[i].return_date.year, hold_data[i].book_copy_id,
-                                 hold_data[i].member_id );
-					}
-				}
-			} 
-            // If checkout_date does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( hold_data[i].checkout_date.day != day || 
-                         hold_data[i].checkout_date.month != month ||
-                         hold_data[i].checkout_date.year != year ) {
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d\n", hold_data[i].id, hold_data[i].checkout_date.day,
-						         hold_data[i].checkout_date.month, hold_data[i].checkout_date.year,
-                                 hold_data[i].return_date.day, hold_data[i].return_date.month,
-                                 hold_data[i].return_date.year, hold_data[i].book_copy_id,
-                                 hold_data[i].member_id );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        }
-        // If condition_var is "return_date"
-		else if ( strcmp( condition_var, "return_date" ) == 0 ) {
-            // Tokenize the condition_val to get a day-month-year.
-            strcpy( line, condition_val );
-            char *token = strtok(line, "-");
-            int day = atoi( token );
-            token = strtok( NULL, "-" );
-            int month = atoi( token );
-            token = strtok( NULL, " " );
-            int year = atoi( token );
-
-	        // If return_date matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( hold_data[i].return_date.day == day && 
-                         hold_data[i].return_date.month == month &&
-                         hold_data[i].return_date.year == year ) { 
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d\n", hold_data[i].id, hold_data[i].checkout_date.day,
-						         hold_data[i].checkout_date.month, hold_data[i].checkout_date.year,
-                                 hold_data[i].return_date.day, hold_data[i].return_date.month,
-                                 hold_data[i].return_date.year, hold_data[i].book_copy_id,
-                                 hold_data[i].member_id );
-					}
-				}
-			} 
-            // If return_date does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( hold_data[i].return_date.day != day || 
-                         hold_data[i].return_date.month != month ||
-                         hold_data[i].return_date.year != year ) {
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d\n", hold_data[i].id, hold_data[i].checkout_date.day,
-						         hold_data[i].checkout_date.month, hold_data[i].checkout_date.year,
-                                 hold_data[i].return_date.day, hold_data[i].return_date.month,
-                                 hold_data[i].return_date.year, hold_data[i].book_copy_id,
-                                 hold_data[i].member_id );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        }
-        // If condition_var is "book_copy_id"...
-		else if ( strcmp( condition_var, "book_copy_id" ) == 0 ) {
-			int value = atoi( condition_val );
-	        // If book_copy_id matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( hold_data[i].book_copy_id == value ) { 
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d\n", hold_data[i].id, hold_data[i].checkout_date.day,
-						         hold_data[i].checkout_date.month, hold_data[i].checkout_date.year,
-                                 hold_data[i].return_date.day, hold_data[i].return_date.month,
-                                 hold_data[i].return_date.year, hold_data[i].book_copy_id,
-                                 hold_data[i].member_id );
-					}
-				}
-			} 
-            // If book_copy_id does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( hold_data[i].book_copy_id != value ) {
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d\n", hold_data[i].id, hold_data[i].checkout_date.day,
-						         hold_data[i].checkout_date.month, hold_data[i].checkout_date.year,
-                                 hold_data[i].return_date.day, hold_data[i].return_date.month,
-                                 hold_data[i].return_date.year, hold_data[i].book_copy_id,
-                                 hold_data[i].member_id );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        }
-        // If condition_var is "member_id"...
-		else if ( strcmp( condition_var, "member_id" ) == 0 ) {
-			int value = atoi( condition_val );
-	        // If member_id matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( hold_data[i].member_id == value ) { 
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d\n", hold_data[i].id, hold_data[i].checkout_date.day,
-						         hold_data[i].checkout_date.month, hold_data[i].checkout_date.year,
-                                 hold_data[i].return_date.day, hold_data[i].return_date.month,
-                                 hold_data[i].return_date.year, hold_data[i].book_copy_id,
-                                 hold_data[i].member_id );
-					}
-				}
-			} 
-            // If member_id does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( hold_data[i].member_id != value ) {
-                        printf( "%d %02d-%02d-%4d %02d-%02d-%4d %d %d\n", hold_data[i].id, hold_data[i].checkout_date.day,
-						         hold_data[i].checkout_date.month, hold_data[i].checkout_date.year,
-                                 hold_data[i].return_date.day, hold_data[i].return_date.month,
-                                 hold_data[i].return_date.year, hold_data[i].book_copy_id,
-                                 hold_data[i].member_id );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
-        }
-        // Invalid hold_data for a hold.
-        else {
-			printf( "conditions invalid\n" );
-		}
-        free( hold_data );   
+
+    // Find which columns to print.
+    if ( parse_columns( schema, columns, &plan->projection ) != EXIT_SUCCESS ) {
+        out_printf( "columns invalid\n" );
+        fclose( file );
+        return EXIT_FAILURE;
     }
-    
-    // Table is type waitlist
-    else if ( strcmp( table_name, "waitlist" ) == 0 ) {
-        // Set up array of waitlist structs.
-        Waitlist *waitlist_data = ( Waitlist * )malloc( MAX_RECORDS * sizeof( Waitlist ) );
-		if ( waitlist_data == NULL ) {
-            printf( "Memory allocation failed\n" );
+
+    // Find the column to compare and convert the condition value to that column's type. A select
+    // without a condition prints every row.
+    ScanQuery *query = &plan->query;
+    *query = ( ScanQuery ){ .schema = schema, .projection = &plan->projection,
+                            .condition_column = -1, .comparison = COMPARE_EQUAL };
+    if ( condition_var[0] != '\0' ) {
+        query->condition_column = find_column( schema, condition_var );
+        if ( query->condition_column < 0 ) {
+            out_printf( "conditions invalid\n" );
+            fclose( file );
             return EXIT_FAILURE;
         }
-        
-        // Read and process each line. Insert to array of waitlists.
-	    while ( fgets(line, sizeof( line ), file) ) { 
-            // Remove newline character if present
-	        if ( line[strlen( line ) - 1] == '\n' ) { 
-                line[strlen( line ) - 1] = '\0';
-            }
-			
-			// Process the line
-	        char *token = strtok(line, " ");
-	        waitlist_data[data_count].book_id = atoi(token);
-	        token = strtok( NULL, " " );
-	        waitlist_data[data_count].member_id = atoi( token );
-	        ++data_count;
-		}
-        
-        // If condition_var is "book_id"...
-		if ( strcmp( condition_var, "book_id" ) == 0 ) {
-			int value = atoi( condition_val );
-	        // If book_id matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( waitlist_data[i].book_id == value ) { 
-                        printf( "%d %d\n", waitlist_data[i].book_id, 
-						                   waitlist_data[i].member_id );
-					}
-				}
-			} 
-            // If book_id does not match, print to console.
-            else if ( strcmp( condition, "!=" ) == 0) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( waitlist_data[i].book_id != value ) {
-						printf( "%d %d\n", waitlist_data[i].book_id,
-						                   waitlist_data[i].member_id );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
+        if ( parse_comparison( condition, &query->comparison ) != EXIT_SUCCESS ) {
+            out_printf( "conditions invalid\n" );
+            fclose( file );
+            return EXIT_FAILURE;
         }
-        // If condition_var is member_id
-        else if ( strcmp( condition_var, "member_id" ) == 0 ) { 
-            int value = atoi( condition_val );
-            // If member_id matches, print it to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-                    if ( waitlist_data[i].member_id == value ) {
-						printf( "%d %d\n", waitlist_data[i].book_id, 
-						                   waitlist_data[i].member_id );
-					}
-				}
-			} 
-            // If member_id does not match, print it to console.
-            else if ( strcmp( condition, "!=" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( waitlist_data[i].member_id != value ) {
-						printf( "%d %d\n", waitlist_data[i].book_id,
-						                   waitlist_data[i].member_id );
-					}
-				}
-			}
-            else {
-                printf( "conditions invalid\n" );
-            }            
-		}
-        // Invalid condition_var for a waitlist.
-        else {
-			printf( "conditions invalid\n" );
-		}
-        free( waitlist_data );
+        parse_value( schema->columns[query->condition_column].type, condition_val,
+                     &query->value );
     }
     
-    // Table is type notification
-    else if ( strcmp( table_name, "notification" ) == 0 ) {
-        // Set up array of notification structs.
-        Notification *notification_data = ( Notification * )malloc( MAX_RECORDS * sizeof( Notification ) );
-		if ( notification_data == NULL ) {
-            printf( "Memory allocation failed\n" );
-            return EXIT_FAILURE;
-        }
-        
-        // Read and process each line. Insert to array of holds.
-	    while ( fgets(line, sizeof( line ), file) ) { 
-            // Remove newline character if present
-	        if ( line[strlen( line ) - 1] == '\n' ) { 
-                line[strlen( line ) - 1] = '\0';
-            }
-			
-			// Process the line
-	        char *token = strtok(line, " ");
-	        notification_data[data_count].id = atoi(token);
-	        token = strtok( NULL, "-" );
-	        notification_data[data_count].sent_at.day = atoi( token );
-            token = strtok( NULL, "-" );
-            notification_data[data_count].sent_at.month = atoi( token );
-            token = strtok( NULL, " " );
-            notification_data[data_count].sent_at.year = atoi( token );
-            token = strtok( NULL, " " );
-            notification_data[data_count].member_id = atoi( token );
-            token = strtok( NULL, "\"" );
-            strcpy( notification_data[data_count].message, token );
-	        ++data_count;
-		}
-        
-        // If condition_var is "id"...
-		if ( strcmp( condition_var, "id" ) == 0 ) {
-			int value = atoi( condition_val );
-	        // If id matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( notification_data[i].id == value ) { 
-                        printf( "%d %02d-%02d-%4d %d %s\n", notification_data[i].id, notification_data[i].sent_at.day,
-						         notification_data[i].sent_at.month, notification_data[i].sent_at.year,
-                                 notification_data[i].member_id, notification_data[i].message );
-					}
-				}
-			} 
-            // If id does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( notification_data[i].id != value ) {
-                        printf( "%d %02d-%02d-%4d %d %s\n", notification_data[i].id, notification_data[i].sent_at.day,
-						         notification_data[i].sent_at.month, notification_data[i].sent_at.year,
-                                 notification_data[i].member_id, notification_data[i].message );
-					}
-				}
+    // Columns that have to be decoded from each line.
+    query->needed = plan->projection.mask;
+    if ( query->condition_column >= 0 ) {
+        query->needed |= 1u << query->condition_column;
+    }
+
+    // Large tables are mapped into memory and scanned in parallel (a block at a time if
+    // compressed), others are read a line at a time.
+    plan->file = file;
+    plan->length = snapshot_length( table_name, file );
+    plan->parallel = plan->length >= PARALLEL_SCAN_THRESHOLD && plan->length != WHOLE_FILE &&
+                     scan_threads() > 1;
+    return EXIT_SUCCESS;
+}
+
+/** Prints the selected columns of rows in a planned select's snapshot, then closes the table. */
+static int run_select( SelectPlan *plan, Sink *sink ) {
+    FILE *file = plan->file;
+    off_t remaining = plan->length;
+    uint64_t start = stats_clock();
+    if ( plan->parallel ) {
+        void *data = storage_map( fileno( file ), remaining );
+        if ( data != NULL ) {
+            int status = EXIT_SUCCESS;
+            if ( table_compressed( fileno( file ) ) ) {
+                status = parallel_scan_blocks( &plan->query, ( const char * )data, remaining,
+                                               sink );
             }
             else {
-                printf( "conditions invalid\n" );
+                parallel_scan( &plan->query, ( const char * )data, remaining, sink );
             }
+            storage_unmap( data, remaining );
+            fclose( file );
+            stats_phase( PHASE_SCAN, start );
+            return status;
         }
-        // If condition_var is "sent_at"
-		else if ( strcmp( condition_var, "sent_at" ) == 0 ) {
-            // Tokenize the condition_val to get a day-month-year.
-            strcpy( line, condition_val );
-            char *token = strtok(line, "-");
-            int day = atoi( token );
-            token = strtok( NULL, "-" );
-            int month = atoi( token );
-            token = strtok( NULL, " " );
-            int year = atoi( token );
-
-	        // If sent_at matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( notification_data[i].sent_at.day == day && 
-                         notification_data[i].sent_at.month == month &&
-                         notification_data[i].sent_at.year == year ) { 
-                        printf( "%d %02d-%02d-%4d %d %s\n", notification_data[i].id, notification_data[i].sent_at.day,
-						         notification_data[i].sent_at.month, notification_data[i].sent_at.year,
-                                 notification_data[i].member_id, notification_data[i].message );
-					}
-				}
-			} 
-            // If sent_at does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( notification_data[i].sent_at.day != day || 
-                         notification_data[i].sent_at.month != month ||
-                         notification_data[i].sent_at.year != year ) {
-                        printf( "%d %02d-%02d-%4d %d %s\n", notification_data[i].id, notification_data[i].sent_at.day,
-						         notification_data[i].sent_at.month, notification_data[i].sent_at.year,
-                                 notification_data[i].member_id, notification_data[i].message );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
-            }
+    }
+    LineReader reader = { .query = &plan->query, .sink = sink };
+    int status = table_stream( fileno( file ), remaining, scan_chunk, &reader );
+    if ( reader.length > 0 ) {
+        scan_lines( &plan->query, reader.carry, reader.carry + reader.length, sink );
+    }
+    free( reader.carry );
+    fclose( file );
+    stats_phase( PHASE_SCAN, start );
+	return status;
+}
+
+/** This function is defined to find a row(s) based on a condition. */
+int select_from_table( const char *table_name, const char *columns, const char *condition_var,
+                       const char *condition, const char *condition_val ) {
+    TRACE_PROBE1( select_from_table__start, table_name );
+    if ( view_exists( table_name ) ) {
+        int status = select_view( table_name, columns, condition_var );
+        TRACE_PROBE2( select_from_table__done, table_name, status );
+        return status;
+    }
+
+    // Only the partitions of a partitioned table the condition can match are selected from.
+    PartitionList list;
+    list_partitions( table_name, condition_var, condition, condition_val, &list );
+    int status = EXIT_SUCCESS;
+    for ( int i = 0; i < list.count && status == EXIT_SUCCESS; i++ ) {
+        SelectPlan plan;
+        trace_begin( "plan" );
+        status = plan_select( &plan, list.names[i], columns, condition_var, condition,
+                              condition_val );
+        trace_end( "plan" );
+        if ( status == EXIT_SUCCESS ) {
+            status = run_select( &plan, output_sink() );
         }
-        // If condition_var is "member_id"...
-		else if ( strcmp( condition_var, "member_id" ) == 0 ) {
-			int value = atoi( condition_val );
-	        // If member_id matches, print to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( notification_data[i].member_id == value ) { 
-                        printf( "%d %02d-%02d-%4d %d %s\n", notification_data[i].id, notification_data[i].sent_at.day,
-						         notification_data[i].sent_at.month, notification_data[i].sent_at.year,
-                                 notification_data[i].member_id, notification_data[i].message );
-					}
-				}
-			} 
-            // If member_id does not match, print to console.
-            else if ( strcmp(condition, "!=" ) == 0 ) {     
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( notification_data[i].member_id != value ) {
-                        printf( "%d %02d-%02d-%4d %d %s\n", notification_data[i].id, notification_data[i].sent_at.day,
-						         notification_data[i].sent_at.month, notification_data[i].sent_at.year,
-                                 notification_data[i].member_id, notification_data[i].message );
-					}
-				}
-            }
-            else {
-                printf( "conditions invalid\n" );
+    }
+    free_partition_list( &list );
+    TRACE_PROBE2( select_from_table__done, table_name, status );
+    return status;
+}
+
+/**
+   Estimates a select's rows from a sample of its table's text: the table's rows from the average
+   length of the sampled rows, and the rows that meet the condition from the share that do.
+*/
+static void estimate_rows( const SelectPlan *plan, const char *sample, size_t length,
+                           off_t text_length, double *rows, double *matches ) {
+    // Only whole lines are sampled, unless the sample is the whole table.
+    if ( ( off_t )length < text_length ) {
+        while ( length > 0 && sample[length - 1] != '\n' ) {
+            length--;
+        }
+    }
+    ScanCounts counts = { 0 };
+    ScanQuery query = plan->query;
+    query.counts = &counts;
+    Sink discard;
+    if ( sink_open_memory( &discard, length + 1 ) != EXIT_SUCCESS ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    scan_lines( &query, sample, sample + length, &discard );
+    free( discard.buffer );
+
+    *rows = 0;
+    *matches = 0;
+    if ( counts.scanned > 0 ) {
+        *rows = ( double )text_length * counts.scanned / length;
+        *matches = *rows * counts.matched / counts.scanned;
+    }
+    // Row ids are unique, and an equality the sample missed is taken to match one row.
+    int column = plan->query.condition_column;
+    Comparison comparison = plan->query.comparison;
+    if ( column == 0 && *rows >= 1 && comparison <= COMPARE_NOT_EQUAL ) {
+        *matches = comparison == COMPARE_EQUAL ? 1 : *rows - 1;
+    }
+    else if ( column >= 0 && comparison == COMPARE_EQUAL && *rows >= 1 && *matches < 1 ) {
+        *matches = 1;
+    }
+}
+
+/** Prints the names of the columns set in a mask, or of the columns in a projection. */
+static void print_columns( const TableSchema *schema, unsigned mask, const Projection *projection ) {
+    int count = projection != NULL ? projection->count : schema->column_count;
+    bool first = true;
+    for ( int i = 0; i < count; i++ ) {
+        int column = projection != NULL ? projection->columns[i] : i;
+        if ( projection != NULL || mask & 1u << column ) {
+            out_printf( "%s%s", first ? "" : ", ", schema->columns[column].name );
+            first = false;
+        }
+    }
+    out_printf( "\n" );
+}
+
+/**
+   Prints how a select would read one file of a table. With analyze, runs it (discarding the rows)
+   and prints what it actually did.
+*/
+static int explain_file( const char *table_name, const char *columns, const char *condition_var,
+                         const char *condition, const char *condition_val, bool analyze ) {
+    uint64_t start = monotonic_ns();
+    SelectPlan plan;
+    trace_begin( "plan" );
+    int planned_status = plan_select( &plan, table_name, columns, condition_var, condition,
+                                      condition_val );
+    trace_end( "plan" );
+    if ( planned_status != EXIT_SUCCESS ) {
+        return EXIT_FAILURE;
+    }
+    uint64_t planned = monotonic_ns();
+    int fd = fileno( plan.file );
+    off_t length = plan.length;
+    if ( length == WHOLE_FILE ) {
+        struct stat status;
+        length = fstat( fd, &status ) == 0 ? status.st_size : 0;
+    }
+    const ScanQuery *query = &plan.query;
+    const TableSchema *schema = query->schema;
+
+    // Describe the table, and sample its first rows (the first block if it is compressed).
+    out_printf( "Select on %s\n", table_name );
+    double rows = 0, matches = 0;
+    int blocks = 0;
+    if ( table_compressed( fd ) ) {
+        void *data = length > 0 ? mmap( NULL, length, PROT_READ, MAP_PRIVATE, fd, 0 ) : MAP_FAILED;
+        size_t *offsets = NULL;
+        if ( data != MAP_FAILED &&
+             index_blocks( ( const char * )data, length, &offsets, &blocks ) == EXIT_SUCCESS ) {
+            uint64_t file_id = block_file_id( ( const char * )data );
+            out_printf( "  table: %lld bytes, compressed, %d blocks, %d in the block cache\n",
+                        ( long long )length, blocks, cached_blocks( file_id ) );
+            DecodedBlock block;
+            if ( blocks > 0 && decode_block( file_id, offsets[0], ( const char * )data + offsets[0],
+                                             length - offsets[0], &block ) == EXIT_SUCCESS ) {
+                estimate_rows( &plan, block.data, block.length, table_text_length( fd, length ),
+                               &rows, &matches );
+                release_block( &block );
             }
+            free( offsets );
         }
-        // If condition_var is "message"...
-        else if ( strcmp( condition_var, "message" ) == 0 ) {
-			// If message matches, print it to console.
-            if ( strcmp( condition, "==" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-                    if ( strcmp( notification_data[i].message, condition_val ) == 0 ) {
-                        printf( "%d %02d-%02d-%4d %d %s\n", notification_data[i].id, notification_data[i].sent_at.day,
-						         notification_data[i].sent_at.month, notification_data[i].sent_at.year,
-                                 notification_data[i].member_id, notification_data[i].message );
-					}
-				}
-			} 
-            // If message does not match, print it to console.
-            else if ( strcmp( condition, "!=" ) == 0 ) {
-                for ( int i = 0; i < data_count; ++i ) {
-					if ( strcmp( notification_data[i].message, condition_val) != 0 ) {
-                        printf( "%d %02d-%02d-%4d %d %s\n", notification_data[i].id, notification_data[i].sent_at.day,
-						         notification_data[i].sent_at.month, notification_data[i].sent_at.year,
-                                 notification_data[i].member_id, notification_data[i].message );
-					}
-				}
-			}
-            else {
-                printf( "conditions invalid\n" );
-            }            
-		}
-        // Invalid notification_data for a notification.
         else {
-			printf( "conditions invalid\n" );
-		}
-        free( notification_data );   
+            out_printf( "  table: %lld bytes, compressed, blocks unreadable\n",
+                        ( long long )length );
+        }
+        if ( data != MAP_FAILED ) {
+            munmap( data, length );
+        }
     }
-    
-    // Table is not part of defined databases in database.h 
     else {
-        printf( "Defined databases for selction include book, category, author, book_author, "
-                 "publisher, book_copy, member_account, checkout, hold, waitlist, notification\n" );
+        out_printf( "  table: %lld bytes, plain text\n", ( long long )length );
+        size_t size = length < EXPLAIN_SAMPLE_SIZE ? length : EXPLAIN_SAMPLE_SIZE;
+        char *sample = ( char * )malloc( size + 1 );
+        if ( sample == NULL ) {
+            err_printf( "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+        ssize_t got = storage_read_at( fd, sample, size, 0 );
+        if ( got > 0 ) {
+            estimate_rows( &plan, sample, got, length, &rows, &matches );
+        }
+        free( sample );
     }
-    
-	return EXIT_SUCCESS;
+
+    // The access path and the order rows are worked on.
+    if ( plan.parallel && blocks > 0 ) {
+        out_printf( "  access: parallel block scan, %d blocks on %d threads\n", blocks,
+                    scan_threads() );
+    }
+    else if ( plan.parallel ) {
+        out_printf( "  access: parallel morsel scan, %lld morsels of %d KiB on %d threads\n",
+                    ( long long )( ( length + MORSEL_SIZE - 1 ) / MORSEL_SIZE ),
+                    MORSEL_SIZE / 1024, scan_threads() );
+    }
+    else {
+        out_printf( "  access: sequential scan, %s\n", storage_backend() );
+    }
+    out_printf( "  decode: " );
+    print_columns( schema, query->needed, NULL );
+    if ( query->condition_column >= 0 ) {
+        out_printf( "  filter: %s %s %s\n", schema->columns[query->condition_column].name,
+                    comparison_name( query->comparison ), condition_val );
+    }
+    else {
+        out_printf( "  filter: none\n" );
+    }
+    out_printf( "  output: " );
+    print_columns( schema, 0, &plan.projection );
+    out_printf( "  estimated rows: %.0f of %.0f\n", matches, rows );
+    if ( !analyze ) {
+        fclose( plan.file );
+        return EXIT_SUCCESS;
+    }
+
+    // Run the select into a sink that throws the rows away, counting what the scan does.
+    ScanCounts counts = { 0 };
+    plan.query.counts = &counts;
+    int null_fd = open( "/dev/null", O_WRONLY | O_CLOEXEC );
+    Sink discard;
+    if ( null_fd < 0 || sink_open( &discard, null_fd ) != EXIT_SUCCESS ) {
+        out_printf( "Unable to run the select!\n" );
+        fclose( plan.file );
+        if ( null_fd >= 0 ) {
+            close( null_fd );
+        }
+        return EXIT_FAILURE;
+    }
+    uint64_t scan_start = monotonic_ns();
+    uint64_t read_before = stats_counter( BYTES_READ );
+    int status = run_select( &plan, &discard );
+    uint64_t bytes_read = stats_counter( BYTES_READ ) - read_before;
+    uint64_t scanned = monotonic_ns();
+    sink_close( &discard );
+    close( null_fd );
+    uint64_t finished = monotonic_ns();
+
+    out_printf( "  actual rows: %llu of %llu\n", ( unsigned long long )counts.matched,
+                ( unsigned long long )counts.scanned );
+    out_printf( "  bytes read: %llu\n", ( unsigned long long )bytes_read );
+    out_printf( "  time: plan %.3f ms, scan %.3f ms (of which format ~%.3f ms), output %.3f ms, "
+                "total %.3f ms\n", ( planned - start ) / 1e6, ( scanned - scan_start ) / 1e6,
+                counts.format_ns / 1e6, ( finished - scanned ) / 1e6, ( finished - start ) / 1e6 );
+    return status;
+}
+
+/** Prints how a select would be run, for each file of the table it reads. */
+int explain_select( const char *table_name, const char *columns, const char *condition_var,
+                    const char *condition, const char *condition_val, bool analyze ) {
+    if ( view_exists( table_name ) ) {
+        return explain_view( table_name );
+    }
+    if ( !is_partitioned( table_name ) ) {
+        return explain_file( table_name, columns, condition_var, condition, condition_val,
+                             analyze );
+    }
+    PartitionList list;
+    list_partitions( table_name, condition_var, condition, condition_val, &list );
+    out_printf( "Select on partitioned table %s: reads %d of %d partitions\n", table_name,
+                list.count - 1, list.total );
+    int status = EXIT_SUCCESS;
+    for ( int i = 0; i < list.count && status == EXIT_SUCCESS; i++ ) {
+        status = explain_file( list.names[i], columns, condition_var, condition, condition_val,
+                               analyze );
+    }
+    free_partition_list( &list );
+    return status;
+}
+
+/** Adds a range to a list of ranges, growing the list as needed. */
+static void add_range( CopyRange **ranges, int *count, int *capacity, CopyRange range ) {
+    if ( *count == *capacity ) {
+        *capacity = *capacity ? *capacity * 2 : DATABASE_SIZE;
+        *ranges = ( CopyRange * )realloc( *ranges, *capacity * sizeof( CopyRange ) );
+        if ( *ranges == NULL ) {
+            err_printf( "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+    ( *ranges )[( *count )++] = range;
+}
+
+/** Closes the tables of a list of ranges and frees it. */
+static void close_ranges( CopyRange *ranges, int count ) {
+    for ( int i = 0; i < count; i++ ) {
+        close( ranges[i].in_fd );
+    }
+    free( ranges );
 }
 
-/** This function is defined to write entire database into a file. */
+/**
+   This function is defined to write entire database into a file. Every table is opened and its
+   snapshot taken first, so the place of each table in the output is known before anything is
+   copied. The table bodies are then copied into their places inside the kernel, several at once.
+   Compressed tables are decoded into their places instead, after the copies. The section of a
+   partitioned table holds the rows of its own file, then those of each partition in date order.
+*/
 int write_database_file( const char *table_name ){
     // File to write to cannot match one of the database names.
     char *databases[] = { "book", "category", "author", "book_author", "publisher", "book_copy",
@@ -1397,118 +960,382 @@ int write_database_file( const char *table_name ){
     
     // Temporary File to write output to. Renamed to parameter if there are no errors in loop.
     // *** This method of saving a temp file, renaming, and removing was approved in piazza. ***
-    FILE *temp = fopen( "./tables/temp", "w" );
-    if ( temp == NULL ) {
-        printf( "Unable to create database file\n" );
+    TableLock *lock = write_lock_table( table_name );
+    char tempPath[MAX_STR_LENGTH];
+    temp_table_path( tempPath, sizeof( tempPath ), table_name );
+    int temp = open( tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+    if ( temp < 0 ) {
+        out_printf( "Unable to create database file\n" );
+        write_unlock_table( lock );
+        return EXIT_FAILURE;
     }
 
-    // Loop through possible tables and print contents to output file if possible (no errors).
-    for ( int i = 0; i < DATABASE_SIZE; i++ ) {
+    // Loop through possible tables and lay out each one that exists: its name and a blank line,
+    // the rows of each of its files, then a blank line. The name lines are written now, the rows
+    // are copied after. A decoded range's length is the bytes of the compressed file to read.
+    CopyRange *copies = NULL;
+    CopyRange *decodes = NULL;
+    int count = 0;
+    int decode_count = 0;
+    int copy_capacity = 0;
+    int decode_capacity = 0;
+    off_t offset = 0;
+    int status = EXIT_SUCCESS;
+    for ( int i = 0; i < DATABASE_SIZE && status == EXIT_SUCCESS; i++ ) {
         // Store pathnames in a variable.
 	    char filepath[MAX_STR_LENGTH];                                                                  
         snprintf( filepath, sizeof(filepath), "%s/%s", folder, databases[i] );
         
-        // Begin attempting to set up files to read in and print out.
-        FILE *input = fopen( filepath, "r" );
-        
-        // If able to read (table exists) check for same param name, otherwise write to temp.
-        if ( input != NULL ) {
-            if ( strcmp( table_name, databases[i] ) == 0 ) {
-                printf( "File already exist!\n" );
-                fclose( temp );
-                fclose( input );
-                remove( "./tables/temp" );
-                return EXIT_FAILURE;
+        // If able to read (table exists) check for same param name, otherwise lay it out.
+        int input = open( filepath, O_RDONLY );
+        if ( input < 0 ) {
+            continue;
+        }
+        if ( strcmp( table_name, databases[i] ) == 0 ) {
+            out_printf( "File already exist!\n" );
+            close( input );
+            close_ranges( copies, count );
+            close_ranges( decodes, decode_count );
+            close( temp );
+            remove( tempPath );
+            write_unlock_table( lock );
+            return EXIT_FAILURE;
+        }
+        tables_exist = true;
+
+        // Print current input file's name/header at the start of its part of the output file.
+        char header[MAX_STR_LENGTH];
+        int length = snprintf( header, sizeof( header ), "%s\n\n", databases[i] );
+        status = storage_write_at( temp, header, length, offset );
+        offset += length;
+
+        // The waitlist's rows are those in its queues once they are in use.
+        if ( waitlist_queued( databases[i] ) ) {
+            close( input );
+            Sink rows;
+            if ( sink_open_memory( &rows, 4096 ) != EXIT_SUCCESS ) {
+                err_printf( "Memory allocation error\n" );
+                exit( EXIT_FAILURE );
             }
-            else {
-                tables_exist = true;
-                // Print current input file's name/header at the start of database output file.
-                fprintf( temp, "%s\n\n", databases[i] ); 
-                
-                // write contents from current input into temp line by line.
-                char line[MAX_STR_LENGTH];
-                while ( fgets(line, sizeof(line), input) ) {
-                    fprintf( temp, line );
+            sink_waitlist( &rows );
+            sink_putc( &rows, '\n' );
+            if ( status == EXIT_SUCCESS ) {
+                status = storage_write_at( temp, rows.buffer, rows.length, offset );
+            }
+            offset += rows.length;
+            free( rows.buffer );
+            continue;
+        }
+
+        // A table that is not partitioned is its own only file.
+        PartitionList list = { 0 };
+        bool partitioned = is_partitioned( databases[i] );
+        if ( partitioned ) {
+            list_partitions( databases[i], "", "", "", &list );
+        }
+        int files = partitioned ? list.count : 1;
+        for ( int j = 0; j < files && status == EXIT_SUCCESS; j++ ) {
+            const char *name = partitioned ? list.names[j] : databases[i];
+            int file = input;
+            if ( strcmp( name, databases[i] ) != 0 ) {
+                snprintf( filepath, sizeof( filepath ), "%s/%s", folder, name );
+                if ( ( file = open( filepath, O_RDONLY ) ) < 0 ) {
+                    continue;
                 }
-                fprintf( temp, "\n" );
             }
-            // Close the current input file. 
-            fclose( input );
+            off_t rows = snapshot_table( name, file );
+            off_t text = rows >= 0 ? table_text_length( file, rows ) : -1;
+            if ( table_compressed( file ) ) {
+                add_range( &decodes, &decode_count, &decode_capacity,
+                           ( CopyRange ){ file, 0, temp, offset, rows } );
+            }
+            else {
+                add_range( &copies, &count, &copy_capacity,
+                           ( CopyRange ){ file, 0, temp, offset, rows } );
+            }
+            status = text >= 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+            offset += text;
+        }
+        if ( partitioned ) {
+            free_partition_list( &list );
+        }
+        if ( status == EXIT_SUCCESS ) {
+            status = storage_write_at( temp, "\n", 1, offset );
         }
+        offset += 1;
+    }
+
+    // Copy the rows of every table into place, then close the tables.
+    if ( status == EXIT_SUCCESS ) {
+        status = storage_copy( copies, count );
+    }
+    for ( int i = 0; i < decode_count && status == EXIT_SUCCESS; i++ ) {
+        OutputCursor cursor = { temp, decodes[i].out_offset, EXIT_SUCCESS };
+        status = table_stream( decodes[i].in_fd, decodes[i].length, write_at_cursor, &cursor );
+        if ( status == EXIT_SUCCESS ) {
+            status = cursor.status;
+        }
+    }
+    close_ranges( copies, count );
+    close_ranges( decodes, decode_count );
+    if ( close( temp ) != 0 || status != EXIT_SUCCESS ) {
+        out_printf( "Unable to create database file\n" );
+        remove( tempPath );
+        write_unlock_table( lock );
+        return EXIT_FAILURE;
     }
     
-    // Rename temp file to parameter table/file name. Close the stream.
+    // Rename temp file to parameter table/file name.
     char renamePath[MAX_STR_LENGTH];
     snprintf( renamePath, sizeof(renamePath), "%s/%s", folder, table_name );
-    rename( "./tables/temp", renamePath );
-    fclose( temp );
+    rename( tempPath, renamePath );
     
     // If no tables were previously written/found (output is empty), delete latest file, return fail.
     if ( !tables_exist ) {
-        printf( "No table found!" );
+        out_printf( "No table found!" );
         remove( renamePath );
+        write_unlock_table( lock );
         return EXIT_FAILURE;
     }
+    write_unlock_table( lock );
     return EXIT_SUCCESS;
 }
 
+/**
+   Finishes with a table's id filter after a scan that found no row to change. The filter let the
+   id through by mistake, or there was no filter, in which case one is built from the ids read.
+*/
+static void finish_filter( const char *table_name, BloomBuilder *ids, const struct stat *table,
+                           BloomResult filtered ) {
+    if ( filtered == BLOOM_MAYBE ) {
+        bloom_false_positive( table_name );
+    }
+    else if ( filtered == BLOOM_UNKNOWN ) {
+        bloom_build( table_name, ids, table );
+    }
+    free( ids->hashes );
+    ids->hashes = NULL;
+}
+
 /** Updates data on matching table-->row with attributes parameter. */
-int update( const char *table_name, const char *table_row, const char *attributes ) {
+static int update_row( const char *table_name, const char *table_row, const char *attributes ) {
     // Set up filepath to read from.
     char filepath[MAX_STR_LENGTH];
     snprintf( filepath, sizeof(filepath), "%s/%s", folder, table_name );
     
     // Check if the file exists and print error if it doesn't.
-    FILE *fileIn = fopen( filepath, "r" );
-    FILE *temp = fopen( "./tables/temp", "w" );
+    // The table is rewritten into its temp file under the write lock, then renamed over the table
+    // so readers of the old version are never disturbed. A compressed table stays compressed.
+    TableLock *lock = write_lock_table( table_name );
+
+    // An id the table's filter rules out is not looked for.
+    struct stat table;
+    BloomResult filtered = BLOOM_UNKNOWN;
+    if ( stat( filepath, &table ) == 0 ) {
+        filtered = bloom_check( table_name, table_row, &table );
+    }
+    if ( filtered == BLOOM_ABSENT ) {
+        out_printf( "Record not found!\n" );
+        write_unlock_table( lock );
+        return EXIT_FAILURE;
+    }
+
+    char tempPath[MAX_STR_LENGTH];
+    temp_table_path( tempPath, sizeof( tempPath ), table_name );
+    bool compressed;
+    uint64_t start = stats_clock();
+    FILE *fileIn = open_table_file( filepath, &compressed );
+    FILE *temp = fileIn != NULL ? create_table_file( tempPath, compressed ) : NULL;
+    stats_phase( PHASE_OPEN, start );
     if ( fileIn != NULL && temp != NULL && table_exist( table_name ) == EXIT_SUCCESS ) {
         // Read in each line of a table. Check if row param matches line row.
-        char idValue[ID_LENGTH];
+        char idValue[ID_LENGTH] = "";
         char line[MAX_STR_LENGTH];
         bool rowFound = false;
+        BloomBuilder ids = { NULL, 0, 0 };
+        uint64_t scanned = 0;
+        start = stats_clock();
         while ( fgets(line, sizeof(line), fileIn) ) {
+            scanned++;
             // Scan the line for the immediate id value.
-            sscanf( line, "%[0-9]", idValue );
+            idValue[0] = '\0';
+            bool hasId = sscanf( line, "%9[0-9]", idValue ) == 1;
             // Print out line from input to temp file if row/id does not match parameter.
             if ( strcmp( idValue, table_row ) != 0 ) {
-                fprintf( temp, line );
+                fputs( line, temp );
             }
             else {
                 // match was found. Print out line/row id to temp, then print updated attributes.
                 rowFound = true;
                 fprintf( temp, "%s %s\n", idValue, attributes );
+                char updated[MAX_STR_LENGTH];
+                snprintf( updated, sizeof( updated ), "%s %s", idValue, attributes );
+                row_changed( table_name, line, updated );
+            }
+            if ( hasId ) {
+                bloom_builder_add( &ids, idValue );
             }
         }
         
         // Close input file.
         fclose( fileIn );
+        stats_phase( PHASE_SCAN, start );
+        stats_add( ROWS_SCANNED, scanned );
+        stats_add( ROWS_MATCHED, rowFound );
         
         // If matching row not found, print error, close files, delete temp, and return failure.
         if ( !rowFound ) {
-            printf( "Record not found!\n" );
+            out_printf( "Record not found!\n" );
+            finish_filter( table_name, &ids, &table, filtered );
             fclose( temp );
-            remove( "./tables/temp" );
+            remove( tempPath );
+            write_unlock_table( lock );
             return EXIT_FAILURE;
         }
         
-        // Close previous file, delete it, rename temp file to original file name, close renamed file.
-        printf( "Record updated successfully!\n" );
-        remove ( filepath );
-        rename( "./tables/temp", filepath );
-        fclose( temp );
+        // Close temp file, then rename it over the original file in one step. The table's
+        // views and indexes already follow the change, so they are rebuilt if it is not made.
+        start = stats_clock();
+        if ( fclose( temp ) != 0 || rename( tempPath, filepath ) != 0 ) {
+            remove( tempPath );
+            free( ids.hashes );
+            table_replaced( table_name );
+            write_unlock_table( lock );
+            out_printf( "Unable to rewrite table %s\n", table_name );
+            return EXIT_FAILURE;
+        }
+        out_printf( "Record updated successfully!\n" );
+        if ( stat( filepath, &table ) == 0 ) {
+            bloom_build( table_name, &ids, &table );
+        }
+        stats_phase( PHASE_WRITE, start );
+        free( ids.hashes );
+        write_unlock_table( lock );
         return EXIT_SUCCESS; 
     }
     else {
-        printf( "Table %s not found!\n", table_name );
+        if ( fileIn != NULL ) {
+            fclose( fileIn );
+        }
+        if ( temp != NULL ) {
+            fclose( temp );
+            remove( tempPath );
+        }
+        write_unlock_table( lock );
+        out_printf( "Table %s not found!\n", table_name );
         return EXIT_FAILURE; 
     }
 }
 
+/**
+   Updates or deletes a row of a partitioned table, or deletes it if attributes is NULL. An updated
+   row whose date moves it to another partition is deleted from its old one and appended to its new
+   one, which is only created once the row is found, all under the table's lock.
+*/
+static int change_partitioned( const char *table_name, const char *table_row,
+                               const char *attributes ) {
+    TableLock *lock = write_lock_table( table_name );
+    if ( table_exist( table_name ) != EXIT_SUCCESS ) {
+        write_unlock_table( lock );
+        return EXIT_FAILURE;
+    }
+    char row[MAX_STR_LENGTH];
+    char target[MAX_TABLE_NAME_LENGTH] = "";
+    bool found = false;
+    if ( attributes != NULL ) {
+        snprintf( row, sizeof( row ), "%s %s", table_row, attributes );
+        partition_of_row( table_name, row, target, sizeof( target ) );
+        if ( is_expired( target ) ) {
+            write_unlock_table( lock );
+            out_printf( "Partition %s is past its table's retention!\n", target );
+            return EXIT_FAILURE;
+        }
+        if ( is_archived( target ) ) {
+            write_unlock_table( lock );
+            out_printf( "Partition %s is archived and read-only!\n", target );
+            return EXIT_FAILURE;
+        }
+        char filepath[MAX_STR_LENGTH];
+        snprintf( filepath, sizeof(filepath), "%s/%s", folder, target );
+        if ( access( filepath, F_OK ) != -1 ) {
+            Change change = { CHANGE_UPDATE, ( char * )table_name, ( char * )table_row,
+                              ( char * )attributes };
+            TableLock *partition = lock_partition( lock, table_name, target );
+            apply_changes( partition, target, ( const Change *const[] ){ &change }, 1, &found );
+            unlock_partition( lock, partition );
+        }
+    }
+
+    // Otherwise the row is looked for, and deleted, in every other partition but the archives.
+    bool moved = false;
+    PartitionList list;
+    list_partitions( table_name, "", "", "", &list );
+    for ( int i = 0; i < list.count && !found && !moved; i++ ) {
+        if ( strcmp( list.names[i], target ) != 0 && !is_archived( list.names[i] ) ) {
+            Change change = { CHANGE_DELETE, ( char * )table_name, ( char * )table_row, NULL };
+            TableLock *partition = lock_partition( lock, table_name, list.names[i] );
+            apply_changes( partition, list.names[i], ( const Change *const[] ){ &change }, 1,
+                           &moved );
+            unlock_partition( lock, partition );
+        }
+    }
+    free_partition_list( &list );
+    if ( moved && attributes != NULL ) {
+        // A partition that cannot be created leaves the row in the table's own file, which every
+        // select reads, rather than losing it.
+        const char *home = open_partition( target ) == EXIT_SUCCESS ? target : table_name;
+        TableLock *partition = lock_partition( lock, table_name, home );
+        found = append_rows( partition, home, ( const char *const[] ){ row }, 1 ) ==
+                EXIT_SUCCESS;
+        unlock_partition( lock, partition );
+    }
+    else {
+        found = found || moved;
+    }
+    write_unlock_table( lock );
+
+    if ( attributes != NULL ) {
+        out_printf( found ? "Record updated successfully!\n" : "Record not found!\n" );
+    }
+    else {
+        out_printf( found ? "Record deleted successfully!\n" : "Record id not found!\n" );
+    }
+    return found ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+   Updates a row, firing the update probes around it. Deletes from the parents of the table's
+   foreign keys wait until the row checked is written.
+*/
+int update( const char *table_name, const char *table_row, const char *attributes ) {
+    TRACE_PROBE2( update__start, table_name, table_row );
+    char row[MAX_STR_LENGTH];
+    snprintf( row, sizeof( row ), "%s %s", table_row, attributes );
+    bool checked = has_foreign_keys( table_name );
+    if ( checked ) {
+        hold_foreign_keys( false );
+    }
+    int status = EXIT_FAILURE;
+    if ( checked && !foreign_keys_met( table_name, row, true ) ) {
+        out_printf( "Record not updated!\n" );
+    }
+    else {
+        status = is_partitioned( table_name ) ?
+                 change_partitioned( table_name, table_row, attributes ) :
+                 update_row( table_name, table_row, attributes );
+    }
+    if ( checked ) {
+        release_foreign_keys();
+    }
+    TRACE_PROBE2( update__done, table_name, status );
+    return status;
+}
+
 /** Deletes a single row from a table if found. */
-int delete_row( const char *table_name, const char *table_row ) {
+static int remove_row( const char *table_name, const char *table_row ) {
     // Check for invalid row
     if ( table_row == NULL ) {
-        printf( "Record id not found!\n" );
+        out_printf( "Record id not found!\n" );
         return EXIT_FAILURE;
     }
     
@@ -1517,63 +1344,377 @@ int delete_row( const char *table_name, const char *table_row ) {
     snprintf( filepath, sizeof(filepath), "%s/%s", folder, table_name );
 
     // Check if the file exists and print error if it doesn't. Set up temporary output file.
-    FILE *fileIn = fopen( filepath, "r" );
-    FILE *temp = fopen( "./tables/temp", "w" );
+    // The table is rewritten into its temp file under the write lock, then renamed over the table
+    // so readers of the old version are never disturbed. A compressed table stays compressed.
+    TableLock *lock = write_lock_table( table_name );
+
+    // An id the table's filter rules out is not looked for.
+    struct stat table;
+    BloomResult filtered = BLOOM_UNKNOWN;
+    if ( stat( filepath, &table ) == 0 ) {
+        filtered = bloom_check( table_name, table_row, &table );
+    }
+    if ( filtered == BLOOM_ABSENT ) {
+        out_printf( "Record id not found!\n" );
+        write_unlock_table( lock );
+        return EXIT_FAILURE;
+    }
+
+    char tempPath[MAX_STR_LENGTH];
+    temp_table_path( tempPath, sizeof( tempPath ), table_name );
+    bool compressed;
+    uint64_t start = stats_clock();
+    FILE *fileIn = open_table_file( filepath, &compressed );
+    FILE *temp = fileIn != NULL ? create_table_file( tempPath, compressed ) : NULL;
+    stats_phase( PHASE_OPEN, start );
     if ( fileIn != NULL && temp != NULL && table_exist( table_name ) == EXIT_SUCCESS ) {
         // Read in each line of a table. Check if row param matches line row.
-        char idValue[ID_LENGTH];
+        char idValue[ID_LENGTH] = "";
         char line[MAX_STR_LENGTH];
         bool rowFound = false;
+        BloomBuilder ids = { NULL, 0, 0 };
+        uint64_t scanned = 0;
+        start = stats_clock();
         while ( fgets(line, sizeof(line), fileIn) ) {
+            scanned++;
             // Scan the line for the immediate id value.
-            sscanf( line, "%[0-9]", idValue );
+            idValue[0] = '\0';
+            bool hasId = sscanf( line, "%9[0-9]", idValue ) == 1;
             // Only print out line to temp file if row/id does not match parameter.
             if ( strcmp( idValue, table_row ) != 0 ) {
-                fprintf( temp, line );
+                fputs( line, temp );
+                if ( hasId ) {
+                    bloom_builder_add( &ids, idValue );
+                }
             }
             else {
                 rowFound = true;    // match was found, does not get printed to temp file.
+                row_changed( table_name, line, NULL );
             }
         }
         
         // Close input file.
         fclose( fileIn );
+        stats_phase( PHASE_SCAN, start );
+        stats_add( ROWS_SCANNED, scanned );
+        stats_add( ROWS_MATCHED, rowFound );
         
         // If matching row not found, print error, close files, delete temp, and return failure.
         if ( !rowFound ) {
-            printf( "Record id not found!\n" );
+            out_printf( "Record id not found!\n" );
+            finish_filter( table_name, &ids, &table, filtered );
             fclose( temp );
-            remove( "./tables/temp" );
+            remove( tempPath );
+            write_unlock_table( lock );
             return EXIT_FAILURE;
         }
         
-        // Close previous file, delete it, rename temp file to original file name, close renamed file.
-        printf( "Record deleted successfully!\n" );
-        remove ( filepath );
-        rename( "./tables/temp", filepath );
-        fclose( temp );
+        // Close temp file, then rename it over the original file in one step. The table's
+        // views and indexes already follow the change, so they are rebuilt if it is not made.
+        start = stats_clock();
+        if ( fclose( temp ) != 0 || rename( tempPath, filepath ) != 0 ) {
+            remove( tempPath );
+            free( ids.hashes );
+            table_replaced( table_name );
+            write_unlock_table( lock );
+            out_printf( "Unable to rewrite table %s\n", table_name );
+            return EXIT_FAILURE;
+        }
+        out_printf( "Record deleted successfully!\n" );
+        if ( stat( filepath, &table ) == 0 ) {
+            bloom_build( table_name, &ids, &table );
+        }
+        stats_phase( PHASE_WRITE, start );
+        free( ids.hashes );
+        write_unlock_table( lock );
         return EXIT_SUCCESS; 
     }
     else {
-        printf( "Table %s does not exist!\n", table_name );
+        if ( fileIn != NULL ) {
+            fclose( fileIn );
+        }
+        if ( temp != NULL ) {
+            fclose( temp );
+            remove( tempPath );
+        }
+        write_unlock_table( lock );
+        out_printf( "Table %s does not exist!\n", table_name );
         return EXIT_FAILURE; 
     }
 }
 
+/**
+   Deletes a row, firing the delete_row probes around it. A delete from the parent of a foreign
+   key waits until no checked row is being written.
+*/
+int delete_row( const char *table_name, const char *table_row ) {
+    TRACE_PROBE2( delete_row__start, table_name, table_row );
+    bool parent = is_foreign_parent( table_name );
+    if ( parent ) {
+        hold_foreign_keys( true );
+    }
+    int status = is_partitioned( table_name ) && table_row != NULL ?
+                 change_partitioned( table_name, table_row, NULL ) :
+                 remove_row( table_name, table_row );
+    if ( parent ) {
+        release_foreign_keys();
+    }
+    TRACE_PROBE2( delete_row__done, table_name, status );
+    return status;
+}
+
 /** Deletes an entire table matching the parameter name. */
 int drop_database_file( const char *table_name ) {
+    // A partitioned table's partitions go first, then the table itself.
+    if ( is_partitioned( table_name ) ) {
+        TableLock *lock = write_lock_table( table_name );
+        PartitionList list;
+        list_partition_files( table_name, &list );
+        for ( int i = 1; i < list.count; i++ ) {
+            TableLock *partition = write_lock_table( list.names[i] );
+            char filepath[MAX_STR_LENGTH];
+            snprintf( filepath, sizeof(filepath), "%s/%s", folder, list.names[i] );
+            remove( filepath );
+            bloom_remove( list.names[i] );
+            write_unlock_table( partition );
+        }
+        free_partition_list( &list );
+        drop_partitioning( table_name );
+        write_unlock_table( lock );
+    }
+
     char filepath[MAX_STR_LENGTH];
     snprintf( filepath, sizeof(filepath), "%s/%s", folder, table_name );
     
-    // Check if the file exists and print error if it doesn't.
+    // Check if the file exists and print error if it doesn't. Readers that already opened the
+    // table keep reading it until they close it.
+    TableLock *lock = write_lock_table( table_name );
     if ( access( filepath, F_OK ) != -1 ) {
-        // File exist at filepath, delete it.
+        // File exist at filepath, delete it and its id filter.
         remove( filepath );
-        printf( "Table dropped successfully!\n" );
+        bloom_remove( table_name );
+        table_replaced( table_name );
+        drop_foreign_keys( table_name );
+        out_printf( "Table dropped successfully!\n" );
+        write_unlock_table( lock );
         return EXIT_SUCCESS; 
     }
     else {
-        printf( "Table %s does not exist!!\n", table_name );
+        out_printf( "Table %s does not exist!!\n", table_name );
+        write_unlock_table( lock );
         return EXIT_FAILURE; 
     }
-}
\ No newline at end of file
+}
+
+/** Rewrites a table compressed, or as plain text, one file at a time if it is partitioned. */
+int compress_table( const char *table_name, bool compressed ) {
+    if ( !is_partitioned( table_name ) ) {
+        return compress_file( table_name, compressed, false );
+    }
+    PartitionList list;
+    list_partitions( table_name, "", "", "", &list );
+    int status = EXIT_SUCCESS;
+    for ( int i = 0; i < list.count; i++ ) {
+        if ( !compressed && is_archived( list.names[i] ) ) {
+            out_printf( "Partition %s is archived and stays compressed\n", list.names[i] );
+        }
+        else if ( compress_file( list.names[i], compressed, false ) != EXIT_SUCCESS ) {
+            status = EXIT_FAILURE;
+        }
+    }
+    free_partition_list( &list );
+    return status;
+}
+
+/** A ChangeKey is the id an update or delete matches and the change's place in the list. */
+typedef struct {
+    const char *id;
+    int index;
+} ChangeKey;
+
+/** Orders change keys by id, then by place in the list. */
+static int compare_keys( const void *first, const void *second ) {
+    const ChangeKey *a = ( const ChangeKey * )first;
+    const ChangeKey *b = ( const ChangeKey * )second;
+    int order = strcmp( a->id, b->id );
+    return order != 0 ? order : a->index - b->index;
+}
+
+/**
+   Writes a row to a table being rewritten, after the updates and deletes of its id that come
+   later in the list than the row itself. born is the place of the insert that added the row, or
+   -1 for a row that was already in the table. The table's views and due-date index follow the
+   row's changes.
+*/
+static void rewrite_row( const char *table_name, FILE *temp, const char *line, const char *ending,
+                         const char *id, int born, const ChangeKey *keys, int key_count,
+                         const Change *const *changes, bool *found, BloomBuilder *ids ) {
+    // Find the first key for this id after the row was born.
+    ChangeKey row = { id, born };
+    int low = 0, high = key_count;
+    while ( low < high ) {
+        int middle = ( low + high ) / 2;
+        if ( compare_keys( &keys[middle], &row ) <= 0 ) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    const Change *updated = NULL;
+    for ( int i = low; i < key_count && strcmp( keys[i].id, id ) == 0; i++ ) {
+        found[ keys[i].index ] = true;
+        if ( changes[ keys[i].index ]->type == CHANGE_DELETE ) {
+            if ( born < 0 ) {
+                row_changed( table_name, line, NULL );
+            }
+            return;
+        }
+        updated = changes[ keys[i].index ];
+    }
+    if ( updated != NULL ) {
+        char row[MAX_STR_LENGTH];
+        snprintf( row, sizeof( row ), "%s %s", id, updated->attributes );
+        fprintf( temp, "%s\n", row );
+        if ( born < 0 ) {
+            row_changed( table_name, line, row );
+        }
+        else {
+            rows_inserted( table_name, ( const char *const[] ){ row }, 1 );
+        }
+    }
+    else {
+        fputs( line, temp );
+        fputs( ending, temp );
+        if ( born >= 0 ) {
+            rows_inserted( table_name, &line, 1 );
+        }
+    }
+    bloom_builder_add( ids, id );
+}
+
+/**
+   Applies a list of changes to a table in one step: a single append if they are all inserts,
+   otherwise a single rewrite that applies every change as it passes each row.
+*/
+int apply_changes( TableLock *lock, const char *table_name, const Change *const *changes,
+                   int count, bool *found ) {
+    int inserts = 0;
+    for ( int i = 0; i < count; i++ ) {
+        found[i] = changes[i]->type == CHANGE_INSERT;
+        inserts += found[i];
+    }
+    if ( inserts == count ) {
+        const char **rows = ( const char ** )malloc( count * sizeof( const char * ) );
+        if ( rows == NULL ) {
+            err_printf( "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+        for ( int i = 0; i < count; i++ ) {
+            rows[i] = changes[i]->text;
+        }
+        int result = append_rows( lock, table_name, rows, count );
+        free( rows );
+        return result;
+    }
+
+    char filepath[MAX_STR_LENGTH];
+    snprintf( filepath, sizeof(filepath), "%s/%s", folder, table_name );
+    struct stat table;
+    if ( stat( filepath, &table ) != 0 ) {
+        return EXIT_FAILURE;
+    }
+
+    // Without inserts, a table whose filter rules out every id is left as it is.
+    BloomResult filtered = BLOOM_ABSENT;
+    for ( int i = 0; i < count && inserts == 0 && filtered != BLOOM_UNKNOWN; i++ ) {
+        BloomResult result = bloom_check( table_name, changes[i]->text, &table );
+        if ( result != BLOOM_ABSENT ) {
+            filtered = result;
+        }
+    }
+    if ( inserts == 0 && filtered == BLOOM_ABSENT ) {
+        return EXIT_SUCCESS;
+    }
+
+    // Updates and deletes are sorted by id, so each row finds the ones that match it quickly.
+    ChangeKey *keys = ( ChangeKey * )malloc( ( count - inserts ) * sizeof( ChangeKey ) );
+    if ( keys == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    int key_count = 0;
+    for ( int i = 0; i < count; i++ ) {
+        if ( changes[i]->type != CHANGE_INSERT ) {
+            keys[key_count++] = ( ChangeKey ){ changes[i]->text, i };
+        }
+    }
+    qsort( keys, key_count, sizeof( ChangeKey ), compare_keys );
+
+    char tempPath[MAX_STR_LENGTH];
+    temp_table_path( tempPath, sizeof( tempPath ), table_name );
+    bool compressed;
+    uint64_t start = stats_clock();
+    FILE *fileIn = open_table_file( filepath, &compressed );
+    FILE *temp = fileIn != NULL ? create_table_file( tempPath, compressed ) : NULL;
+    stats_phase( PHASE_OPEN, start );
+    if ( temp == NULL ) {
+        if ( fileIn != NULL ) {
+            fclose( fileIn );
+        }
+        free( keys );
+        return EXIT_FAILURE;
+    }
+
+    // Rows already in the table come first, then the inserted rows in the order they were added.
+    char idValue[ID_LENGTH] = "";
+    char line[MAX_STR_LENGTH];
+    BloomBuilder ids = { NULL, 0, 0 };
+    uint64_t scanned = 0;
+    start = stats_clock();
+    while ( fgets( line, sizeof( line ), fileIn ) ) {
+        sscanf( line, "%9[0-9]", idValue );
+        rewrite_row( table_name, temp, line, "", idValue, -1, keys, key_count, changes, found,
+                     &ids );
+        scanned++;
+    }
+    fclose( fileIn );
+    stats_phase( PHASE_SCAN, start );
+    stats_add( ROWS_SCANNED, scanned );
+    for ( int i = 0; i < count; i++ ) {
+        if ( changes[i]->type == CHANGE_INSERT ) {
+            sscanf( changes[i]->text, "%9[0-9]", idValue );
+            rewrite_row( table_name, temp, changes[i]->text, "\n", idValue, i, keys, key_count,
+                         changes, found, &ids );
+        }
+    }
+    free( keys );
+
+    // If nothing matched, the table is left as it is.
+    bool changed = inserts > 0;
+    for ( int i = 0; i < count; i++ ) {
+        changed = changed || found[i];
+    }
+    if ( !changed ) {
+        finish_filter( table_name, &ids, &table, filtered );
+        fclose( temp );
+        remove( tempPath );
+        return EXIT_SUCCESS;
+    }
+
+    // Close temp file, then rename it over the original file in one step.
+    start = stats_clock();
+    if ( fclose( temp ) != 0 || rename( tempPath, filepath ) != 0 ) {
+        remove( tempPath );
+        free( ids.hashes );
+        table_replaced( table_name );
+        return EXIT_FAILURE;
+    }
+    if ( stat( filepath, &table ) == 0 ) {
+        bloom_build( table_name, &ids, &table );
+    }
+    stats_phase( PHASE_WRITE, start );
+    free( ids.hashes );
+    return EXIT_SUCCESS;
+}
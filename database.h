@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include "lock.h"
 
 /** Max number of characters for a title */
 #define MAX_TITLE_LENGTH 255
@@ -30,6 +31,24 @@
 /** Max number of characters in a string */
 #define MAX_STR_LENGTH 2048
 
+/** Kinds of change a transaction can make to a table */
+typedef enum {
+    CHANGE_INSERT,
+    CHANGE_UPDATE,
+    CHANGE_DELETE
+} ChangeType;
+
+/**
+   A Change is one insert, update, or delete staged by a transaction. Text is the row for an
+   insert and the row id for an update or delete; attributes is the new values of an update.
+*/
+typedef struct {
+    ChangeType type;
+    char *table_name;
+    char *text;
+    char *attributes;
+} Change;
+
 /** This variable holds the location for database folder */
 extern char *folder;
 
@@ -132,6 +151,16 @@ typedef struct {
 */
 int create_table( const char *table_name );
 
+/**
+   Creates a table whose rows are kept in one file per day, month or year of a date column.
+   @param table_name is string representation of the table's name.
+   @param partitioning is "<unit>(<column>) [retain <count>] [archive <count>]", as described in
+                       partition.h.
+   @return is EXIT_FAILURE if a table already exist under param name or the partitioning is
+           invalid, otherwise returns EXIT_SUCCESS
+*/
+int create_partitioned_table( const char *table_name, const char *partitioning );
+
 /**
    Checks if a table/file already exist with parameter name.
    @param table_name is string representing table's name.
@@ -147,6 +176,16 @@ int table_exist( const char *table_name );
 */
 int insert_into_table( const char *table_name, const char *table_row );
 
+/**
+   Inserts rows to the end of a table as one write under one lock. Prints the same messages as
+   inserting each row with insert_into_table.
+   @param table_name is string name for table/file.
+   @param rows is the rows to insert, in order.
+   @param count is the number of rows.
+   @return is EXIT_FAILURE if table couldn't be opened or written, otherwise returns EXIT_SUCCESS.
+*/
+int insert_rows( const char *table_name, const char *const *rows, int count );
+
 /**
    Reads and prints an entire table matching the table_name parameter. If no table is found, then 
    error is printed and exits with failure. Otherwise, reads the records line by line.
@@ -167,16 +206,39 @@ int write_database_file ( const char *table_name );
 
 /**
    Command prints all table rows/records if conditions are met. Table_name parameter determines
-   which table to select from. The condition variable is how the user wants to sort selection
-   from (i.e sort by id, title, category_id, etc.). The condition is != or ==. The condition value
-   is whatever the user wishes to match, or not match, with the condition variable.  
+   which table to select from. The columns parameter is a comma separated list of which columns
+   to print (i.e "id,title"), only those columns are decoded and printed. An empty list or "*"
+   prints every column. The condition variable is how the user wants to sort selection
+   from (i.e sort by id, title, category_id, etc.). The condition is ==, !=, <, <=, > or >=,
+   comparing numbers as numbers and dates by date. The condition value is whatever the user
+   wishes to compare the condition variable with. An empty condition variable selects every row.
+   A partitioned table reads only the partitions the condition can match.
    @param table_name is string for which table to check.
+   @param columns is string list of the columns to print.
    @param condition_var is the specific variable in the table to select.
-   @param condition is the selection condition, either != or ==
+   @param condition is the selection condition, one of ==, !=, <, <=, > or >=
    @param condition_val is the value to check the condition with. 
    @return is EXIT_FAILURE if error occurs, otherwise EXIT_SUCCESS
 */
-int select_from_table( const char *table_name, const char *condition_var, const char *condition, const char *condition_val );
+int select_from_table( const char *table_name, const char *columns, const char *condition_var,
+                       const char *condition, const char *condition_val );
+
+/**
+   Explains a select: prints how the table is read (sequential, parallel morsel, or parallel
+   block scan), the columns decoded, the filter applied to them, the columns printed, and the
+   rows expected, estimated from a sample of the table. With analyze, also runs the select with
+   its rows thrown away and prints the rows actually scanned and matched, the bytes read, and the
+   time taken to plan, scan, format, and output.
+   @param table_name is string for which table to check.
+   @param columns is string list of the columns to print.
+   @param condition_var is the specific variable in the table to select.
+   @param condition is the selection condition, one of ==, !=, <, <=, > or >=
+   @param condition_val is the value to check the condition with.
+   @param analyze is true to run the select as well.
+   @return is EXIT_FAILURE if error occurs, otherwise EXIT_SUCCESS
+*/
+int explain_select( const char *table_name, const char *columns, const char *condition_var,
+                    const char *condition, const char *condition_val, bool analyze );
 
 /**
    Deletes the entire table matching parameter name.
@@ -185,6 +247,15 @@ int select_from_table( const char *table_name, const char *condition_var, const
 */
 int drop_database_file( const char *table_name );
 
+/**
+   Rewrites a table compressed into blocks, or back to plain text. Compressing a table that is
+   already compressed packs the rows inserted since into full blocks again.
+   @param table_name is string representing a table.
+   @param compressed is true to compress the table, false to store it as plain text.
+   @return is EXIT_FAILURE if the table could not be rewritten, otherwise EXIT_SUCCESS
+*/
+int compress_table( const char *table_name, bool compressed );
+
 /**
    Deletes a singular record from a table with a matching table_name and row id. If no record with 
    matching row id is found, prints an error message. Otherwise prints a success message.
@@ -205,4 +276,19 @@ int delete_row( const char *table_name, const char *table_row );
 */
 int update( const char *table_name, const char *table_row, const char *attributes );
 
+/**
+   Applies a transaction's changes to one table, in order, as a single append when they are all
+   inserts or otherwise as a single rewrite of the table. An update or delete matches every row
+   with its id at that point in the list, as if the changes were run one at a time. The caller
+   holds the table's write lock and prints the changes' messages.
+   @param lock is the table's write lock.
+   @param table_name is string representing a table/file.
+   @param changes is the changes to the table, in the order they were made.
+   @param count is the number of changes.
+   @param found is set, for each change, to whether it was an insert or matched a row.
+   @return is EXIT_FAILURE if the table could not be read or written, otherwise EXIT_SUCCESS
+*/
+int apply_changes( TableLock *lock, const char *table_name, const Change *const *changes,
+                   int count, bool *found );
+
 #endif //DATABASE_H
\ No newline at end of file
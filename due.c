@@ -0,0 +1,372 @@
+/**
+   @file due.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for the due-date index. Each index is an array of entries sorted by a
+   64-bit key: the is_returned flag in the top bit, the return date as year, month, and day in
+   the bits below it, then the id. A query binary searches for the start of its run and walks
+   forward to the end of it. Rows are inserted and removed by moving the entries after them,
+   which is cheap for the usual checkout, whose return date is later than most.
+*/
+#include <pthread.h>
+#include <time.h>
+#include "block.h"
+#include "database.h"
+#include "due.h"
+#include "lock.h"
+#include "partition.h"
+#include "schema.h"
+#include "sink.h"
+#include "stats.h"
+
+/** Entries an index starts with room for */
+#define DUE_CAPACITY 256
+
+/** Key bit set for a returned checkout */
+#define RETURNED_BIT ( ( uint64_t )1 << 63 )
+
+/** A DueEntry is a row of an index and the key it is ordered by. row has no newline. */
+typedef struct {
+    uint64_t key;
+    char *row;
+} DueEntry;
+
+/**
+   A DueIndex is the index of one table. returned_name is the column that takes a row out of the
+   unreturned run, or NULL if the table has none. The columns are found when the index is built.
+*/
+typedef struct {
+    const char *table_name;
+    const char *returned_name;
+    pthread_mutex_t lock;
+    bool built;
+    const TableSchema *schema;
+    int id_column;
+    int date_column;
+    int returned_column;
+    DueEntry *entries;
+    int count;
+    int capacity;
+} DueIndex;
+
+/** The tables that have an index */
+static DueIndex indexes[] = {
+    { "checkout", "is_returned", PTHREAD_MUTEX_INITIALIZER },
+    { "hold", NULL, PTHREAD_MUTEX_INITIALIZER }
+};
+
+/** Number of indexes */
+#define INDEX_COUNT ( ( int )( sizeof( indexes ) / sizeof( indexes[0] ) ) )
+
+/** Finds a table's index, or NULL if it has none. */
+static DueIndex *find_index( const char *table_name ) {
+    for ( int i = 0; i < INDEX_COUNT; i++ ) {
+        if ( strcmp( indexes[i].table_name, table_name ) == 0 ) {
+            return &indexes[i];
+        }
+    }
+    return NULL;
+}
+
+/** Orders a date as one number: later dates are larger. */
+static uint64_t date_order( const Date *date ) {
+    return ( uint64_t )( ( date->year & 0xFFFFF ) * 512 + ( date->month & 15 ) * 32 +
+                         ( date->day & 31 ) );
+}
+
+/** Orders entries by key. */
+static int compare_entries( const void *first, const void *second ) {
+    uint64_t a = ( ( const DueEntry * )first )->key;
+    uint64_t b = ( ( const DueEntry * )second )->key;
+    return ( a > b ) - ( a < b );
+}
+
+/**
+   Finds a row's key. Returns false if the row cannot be decoded.
+   @param length is the length of the row without its newline.
+*/
+static bool row_key( const DueIndex *index, const char *row, size_t length, uint64_t *key ) {
+    Value values[MAX_COLUMNS];
+    unsigned needed = 1u << index->id_column | 1u << index->date_column;
+    if ( index->returned_column >= 0 ) {
+        needed |= 1u << index->returned_column;
+    }
+    if ( decode_row( index->schema, row, row + length, values, needed ) != EXIT_SUCCESS ) {
+        return false;
+    }
+    *key = date_order( &values[index->date_column].date ) << 32 |
+           ( uint32_t )values[index->id_column].number;
+    if ( index->returned_column >= 0 && values[index->returned_column].number != 0 ) {
+        *key |= RETURNED_BIT;
+    }
+    return true;
+}
+
+/** Finds the first entry whose key is at least key. */
+static int lower_bound( const DueIndex *index, uint64_t key ) {
+    int low = 0, high = index->count;
+    while ( low < high ) {
+        int middle = ( low + high ) / 2;
+        if ( index->entries[middle].key < key ) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/** Makes room for one more entry. */
+static void reserve_entry( DueIndex *index ) {
+    if ( index->count == index->capacity ) {
+        index->capacity = index->capacity > 0 ? index->capacity * 2 : DUE_CAPACITY;
+        index->entries = ( DueEntry * )realloc( index->entries,
+                                                index->capacity * sizeof( DueEntry ) );
+        if ( index->entries == NULL ) {
+            err_printf( "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+}
+
+/** Copies a row without its newline. */
+static char *copy_row( const char *row, size_t length ) {
+    char *copy = strndup( row, length );
+    if ( copy == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    return copy;
+}
+
+/** Adds a row to a built index, after the rows with the same key. */
+static void add_entry( DueIndex *index, const char *row ) {
+    size_t length = strcspn( row, "\r\n" );
+    uint64_t key;
+    if ( !row_key( index, row, length, &key ) ) {
+        return;
+    }
+    reserve_entry( index );
+    int at = key < UINT64_MAX ? lower_bound( index, key + 1 ) : index->count;
+    memmove( &index->entries[at + 1], &index->entries[at],
+             ( index->count - at ) * sizeof( DueEntry ) );
+    index->entries[at] = ( DueEntry ){ key, copy_row( row, length ) };
+    index->count++;
+}
+
+/** Removes a row from a built index. */
+static void remove_entry( DueIndex *index, const char *row ) {
+    size_t length = strcspn( row, "\r\n" );
+    uint64_t key;
+    if ( !row_key( index, row, length, &key ) ) {
+        return;
+    }
+    for ( int at = lower_bound( index, key ); at < index->count && index->entries[at].key == key;
+          at++ ) {
+        const char *text = index->entries[at].row;
+        if ( strncmp( text, row, length ) == 0 && text[length] == '\0' ) {
+            free( index->entries[at].row );
+            memmove( &index->entries[at], &index->entries[at + 1],
+                     ( index->count - at - 1 ) * sizeof( DueEntry ) );
+            index->count--;
+            return;
+        }
+    }
+}
+
+/** Frees an index's entries and marks it to be built again. */
+static void clear_index( DueIndex *index ) {
+    for ( int i = 0; i < index->count; i++ ) {
+        free( index->entries[i].row );
+    }
+    free( index->entries );
+    index->entries = NULL;
+    index->count = 0;
+    index->capacity = 0;
+    index->built = false;
+}
+
+/**
+   Builds an index with one scan of its table, if it is not built. The table's write lock is held
+   so no change is missed.
+*/
+static void build_index( DueIndex *index ) {
+    pthread_mutex_lock( &index->lock );
+    bool built = index->built;
+    pthread_mutex_unlock( &index->lock );
+    if ( built ) {
+        return;
+    }
+
+    TableLock *lock = write_lock_table( index->table_name );
+    pthread_mutex_lock( &index->lock );
+    if ( !index->built ) {
+        index->schema = find_table( index->table_name );
+        index->id_column = find_column( index->schema, "id" );
+        index->date_column = find_column( index->schema, "return_date" );
+        index->returned_column = index->returned_name != NULL ?
+                                 find_column( index->schema, index->returned_name ) : -1;
+
+        // Rows are collected in table order, then sorted once.
+        PartitionList list;
+        list_partitions( index->table_name, "", "", "", &list );
+        uint64_t start = stats_clock();
+        for ( int i = 0; i < list.count; i++ ) {
+            char path[MAX_STR_LENGTH];
+            snprintf( path, sizeof( path ), "%s/%s", folder, list.names[i] );
+            bool compressed;
+            FILE *file = open_table_file( path, &compressed );
+            if ( file == NULL ) {
+                continue;
+            }
+            char line[MAX_STR_LENGTH];
+            uint64_t scanned = 0;
+            while ( fgets( line, sizeof( line ), file ) ) {
+                size_t length = strcspn( line, "\r\n" );
+                uint64_t key;
+                if ( row_key( index, line, length, &key ) ) {
+                    reserve_entry( index );
+                    index->entries[index->count++] = ( DueEntry ){ key, copy_row( line, length ) };
+                }
+                scanned++;
+            }
+            fclose( file );
+            stats_add( ROWS_SCANNED, scanned );
+        }
+        free_partition_list( &list );
+        stats_phase( PHASE_SCAN, start );
+        qsort( index->entries, index->count, sizeof( DueEntry ), compare_entries );
+        index->built = true;
+    }
+    pthread_mutex_unlock( &index->lock );
+    write_unlock_table( lock );
+}
+
+/**
+   Reads a date as DD-MM-YYYY, or today's date if text is empty, and moves it forward a number of
+   days. Returns EXIT_FAILURE if the date is invalid.
+*/
+static int find_date( const char *text, int days, Date *date ) {
+    struct tm day = { 0 };
+    if ( text[0] == '\0' ) {
+        time_t now = time( NULL );
+        localtime_r( &now, &day );
+    }
+    else {
+        Value value = { 0 };
+        parse_value( DATE_COLUMN, text, &value );
+        if ( value.date.day < 1 || value.date.day > 31 || value.date.month < 1 ||
+             value.date.month > 12 || strlen( text ) != 10 ) {
+            out_printf( "Date %s invalid, use DD-MM-YYYY\n", text );
+            return EXIT_FAILURE;
+        }
+        day.tm_mday = value.date.day;
+        day.tm_mon = value.date.month - 1;
+        day.tm_year = value.date.year - 1900;
+    }
+
+    // mktime carries days past the end of a month into the next. Noon keeps clock changes from
+    // moving the date.
+    day.tm_mday += days;
+    day.tm_hour = 12;
+    day.tm_min = day.tm_sec = 0;
+    day.tm_isdst = -1;
+    mktime( &day );
+    *date = ( Date ){ day.tm_mday, day.tm_mon + 1, day.tm_year + 1900 };
+    return EXIT_SUCCESS;
+}
+
+/** Prints the rows of an index whose keys are from low up to, but not including, high. */
+static int print_range( const char *table_name, uint64_t low, uint64_t high ) {
+    DueIndex *index = find_index( table_name );
+    if ( index == NULL ) {
+        out_printf( "Due dates are kept for checkout and hold only\n" );
+        return EXIT_FAILURE;
+    }
+    if ( table_exist( table_name ) != EXIT_SUCCESS ) {
+        return EXIT_FAILURE;
+    }
+    build_index( index );
+
+    pthread_mutex_lock( &index->lock );
+    Projection projection;
+    parse_columns( index->schema, "*", &projection );
+    Sink *sink = output_sink();
+    uint64_t matched = 0;
+    for ( int at = lower_bound( index, low ); at < index->count && index->entries[at].key < high;
+          at++ ) {
+        const char *row = index->entries[at].row;
+        Value values[MAX_COLUMNS];
+        if ( decode_row( index->schema, row, row + strlen( row ), values,
+                         projection.mask ) == EXIT_SUCCESS ) {
+            print_row( sink, index->schema, values, &projection );
+            matched++;
+        }
+    }
+    pthread_mutex_unlock( &index->lock );
+    stats_add( ROWS_MATCHED, matched );
+    return EXIT_SUCCESS;
+}
+
+/** Prints the unreturned rows due before a date. */
+int print_overdue( const char *table_name, const char *as_of ) {
+    Date date;
+    if ( find_date( as_of, 0, &date ) != EXIT_SUCCESS ) {
+        return EXIT_FAILURE;
+    }
+    return print_range( table_name, 0, date_order( &date ) << 32 );
+}
+
+/** Prints the unreturned rows due from a date to a number of days after it. */
+int print_due( const char *table_name, int days, const char *as_of ) {
+    Date from, to;
+    if ( days < 0 ) {
+        out_printf( "Days must not be negative\n" );
+        return EXIT_FAILURE;
+    }
+    if ( find_date( as_of, 0, &from ) != EXIT_SUCCESS ||
+         find_date( as_of, days, &to ) != EXIT_SUCCESS ) {
+        return EXIT_FAILURE;
+    }
+    return print_range( table_name, date_order( &from ) << 32, ( date_order( &to ) + 1 ) << 32 );
+}
+
+/** Adds inserted rows to a table's built index. */
+void due_rows_inserted( const char *table_name, const char *const *rows, int count ) {
+    DueIndex *index = find_index( table_name );
+    if ( index == NULL ) {
+        return;
+    }
+    pthread_mutex_lock( &index->lock );
+    for ( int i = 0; i < count && index->built; i++ ) {
+        add_entry( index, rows[i] );
+    }
+    pthread_mutex_unlock( &index->lock );
+}
+
+/** Moves an updated or deleted row in a table's built index. */
+void due_row_changed( const char *table_name, const char *old_row, const char *new_row ) {
+    DueIndex *index = find_index( table_name );
+    if ( index == NULL ) {
+        return;
+    }
+    pthread_mutex_lock( &index->lock );
+    if ( index->built ) {
+        remove_entry( index, old_row );
+        if ( new_row != NULL ) {
+            add_entry( index, new_row );
+        }
+    }
+    pthread_mutex_unlock( &index->lock );
+}
+
+/** Throws away a table's index. */
+void invalidate_due_index( const char *table_name ) {
+    DueIndex *index = find_index( table_name );
+    if ( index == NULL ) {
+        return;
+    }
+    pthread_mutex_lock( &index->lock );
+    clear_index( index );
+    pthread_mutex_unlock( &index->lock );
+}
@@ -0,0 +1,59 @@
+/**
+   @file due.h
+   @author Michael Warstler (mwwarstl)
+   Header file for the due-date index. checkout's rows are kept ordered by (is_returned,
+   return_date, id) and hold's by (return_date, id), so the rows that are overdue or due within a
+   few days are a short run at the front of the order and are found without reading the table.
+   Each index holds its rows' text, so a query prints them as a select would without going back
+   to the table. An index is built with one scan of its table the first time it is queried and is
+   kept up to date as rows are inserted, updated, and deleted after that; an update that flips
+   is_returned moves the row out of (or back into) the unreturned run. Functions that report a
+   change are called with the table's write lock held.
+*/
+#ifndef DUE_H
+#define DUE_H
+
+/**
+   Prints the rows of checkout that are not returned, or the rows of hold, whose return_date is
+   before a date, earliest first.
+   @param table_name is checkout or hold.
+   @param as_of is the date as DD-MM-YYYY, or empty for today.
+   @return is EXIT_FAILURE if the table has no due-date index or the date is invalid, otherwise
+           EXIT_SUCCESS
+*/
+int print_overdue( const char *table_name, const char *as_of );
+
+/**
+   Prints the rows of checkout that are not returned, or the rows of hold, whose return_date is
+   from a date to a number of days after it, earliest first.
+   @param table_name is checkout or hold.
+   @param days is the number of days after as_of that are included.
+   @param as_of is the date as DD-MM-YYYY, or empty for today.
+   @return is EXIT_FAILURE if the table has no due-date index or the date is invalid, otherwise
+           EXIT_SUCCESS
+*/
+int print_due( const char *table_name, int days, const char *as_of );
+
+/**
+   Reports rows added to a table.
+   @param table_name is string name of the table.
+   @param rows is the rows added.
+   @param count is the number of rows.
+*/
+void due_rows_inserted( const char *table_name, const char *const *rows, int count );
+
+/**
+   Reports a row of a table that was updated or deleted.
+   @param table_name is string name of the table.
+   @param old_row is the row as it was, newline optional.
+   @param new_row is the row as it is now, or NULL if it was deleted.
+*/
+void due_row_changed( const char *table_name, const char *old_row, const char *new_row );
+
+/**
+   Throws away a table's index, to be built again when next queried.
+   @param table_name is string name of the table.
+*/
+void invalidate_due_index( const char *table_name );
+
+#endif //DUE_H
@@ -0,0 +1,169 @@
+/**
+   @file fields.h
+   @author Michael Warstler (mwwarstl)
+   Header file of field decoders for the text format tables are stored in. Integers are parsed
+   eight digits at a time inside a 64 bit word (SWAR), dates are decoded from their fixed
+   DD-MM-YYYY shape, and quoted strings are sliced out of the line without being copied. The
+   decoders are small and called for every field of every row, so they are defined inline here.
+*/
+#ifndef FIELDS_H
+#define FIELDS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "database.h"
+
+/** Every byte of a word set to the character '0' */
+#define ZEROS_WORD 0x3030303030303030ULL
+/** Every byte of a word set to 0x76, which carries a byte into its high bit when above 9 */
+#define ABOVE_NINE_WORD 0x7676767676767676ULL
+/** The high bit of every byte of a word */
+#define HIGH_BITS_WORD 0x8080808080808080ULL
+
+/**
+   Counts how many of the first eight characters are digits, using one word for all eight.
+   @param text is at least eight readable characters.
+   @param word is set to the eight characters with '0' subtracted from each byte.
+   @return is the number of leading digits, from 0 to 8.
+*/
+static inline int leading_digits( const char *text, uint64_t *word ) {
+    uint64_t chunk;
+    memcpy( &chunk, text, sizeof( chunk ) );
+    *word = chunk - ZEROS_WORD;
+
+    // A byte is a digit if subtracting '0' left it below 10. Borrows and carries only spill into
+    // bytes after the first non-digit, which are never counted.
+    uint64_t non_digits = ( *word | ( *word + ABOVE_NINE_WORD ) ) & HIGH_BITS_WORD;
+    return non_digits == 0 ? 8 : __builtin_ctzll( non_digits ) / 8;
+}
+
+/**
+   Combines up to eight digits held one per byte (first digit in the lowest byte) into their value,
+   with three multiplies instead of a loop.
+   @param word is the digits with '0' already subtracted.
+   @param count is how many digits the word holds, from 1 to 8.
+   @return is the value of the digits.
+*/
+static inline uint32_t combine_digits( uint64_t word, int count ) {
+    // Shift the digits to the top of the word so missing digits act as leading zeros.
+    word <<= 8 * ( 8 - count );
+    word = ( word * 10 + ( word >> 8 ) ) & 0x00FF00FF00FF00FFULL;
+    word = ( word * 100 + ( word >> 16 ) ) & 0x0000FFFF0000FFFFULL;
+    return ( uint32_t )( word * 10000 + ( word >> 32 ) );
+}
+
+/**
+   Parses an integer the way atoi does: an optional sign followed by digits. Up to eight digits
+   are handled at once when eight characters can be read before end.
+   @param text is the first character of the field.
+   @param end is the end of readable memory.
+   @param number is set to the value parsed, 0 if the field does not start with a number.
+   @return is pointer to the first character after the number.
+*/
+static inline const char *parse_int_field( const char *text, const char *end, int *number ) {
+    bool negative = text < end && *text == '-';
+    text += text < end && ( *text == '-' || *text == '+' );
+
+    uint32_t value = 0;
+#if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if ( end - text >= 8 ) {
+        uint64_t word;
+        int count = leading_digits( text, &word );
+        if ( count > 0 ) {
+            value = combine_digits( word, count );
+        }
+        text += count;
+        if ( count < 8 ) {
+            *number = negative ? -( int )value : ( int )value;
+            return text;
+        }
+    }
+#endif
+    // Digits past the first eight, or near the end of memory, one at a time.
+    while ( text < end && ( unsigned )( *text - '0' ) < 10 ) {
+        value = value * 10 + ( *text - '0' );
+        text++;
+    }
+    *number = negative ? -( int )value : ( int )value;
+    return text;
+}
+
+/**
+   Decodes a date stored as DD-MM-YYYY. The fixed shape is checked with one comparison per
+   character and decoded without a loop, anything else falls back to reading each part as an
+   integer separated by '-'.
+   @param text is the first character of the field.
+   @param end is the end of readable memory.
+   @param date is set to the date decoded, missing parts are 0.
+   @return is pointer to the first character after the date.
+*/
+static inline const char *parse_date_field( const char *text, const char *end, Date *date ) {
+    if ( end - text >= 10 ) {
+        unsigned d0 = text[0] - '0', d1 = text[1] - '0', m0 = text[3] - '0', m1 = text[4] - '0';
+        unsigned y0 = text[6] - '0', y1 = text[7] - '0', y2 = text[8] - '0', y3 = text[9] - '0';
+        bool digits = ( d0 < 10 ) & ( d1 < 10 ) & ( m0 < 10 ) & ( m1 < 10 ) & ( y0 < 10 ) &
+                      ( y1 < 10 ) & ( y2 < 10 ) & ( y3 < 10 );
+        bool dashes = text[2] == '-' && text[5] == '-';
+        bool ends = end - text == 10 || ( unsigned )( text[10] - '0' ) >= 10;
+        if ( digits & dashes & ends ) {
+            date->day = d0 * 10 + d1;
+            date->month = m0 * 10 + m1;
+            date->year = y0 * 1000 + y1 * 100 + y2 * 10 + y3;
+            return text + 10;
+        }
+    }
+
+    // Not the usual shape, i.e "1-2-2024".
+    date->month = 0;
+    date->year = 0;
+    text = parse_int_field( text, end, &date->day );
+    if ( text < end && *text == '-' ) {
+        text = parse_int_field( text + 1, end, &date->month );
+        if ( text < end && *text == '-' ) {
+            text = parse_int_field( text + 1, end, &date->year );
+        }
+    }
+    return text;
+}
+
+/**
+   Finds the characters of a string field. Quoted strings run to the closing quote, so they may
+   contain spaces, others run to the next space. Nothing is copied.
+   @param text is the first character of the field.
+   @param end is the end of the line.
+   @param start is set to the first character of the string.
+   @param length is set to the number of characters in the string.
+   @return is pointer to the first character after the field, past any closing quote.
+*/
+static inline const char *slice_string_field( const char *text, const char *end,
+                                              const char **start, int *length ) {
+    const char *stop;
+    if ( text < end && *text == '"' ) {
+        text++;
+        stop = memchr( text, '"', end - text );
+        if ( stop != NULL ) {
+            *start = text;
+            *length = stop - text;
+            return stop + 1;
+        }
+        stop = end;
+    }
+    else {
+        stop = text;
+        while ( stop < end && *stop != ' ' && *stop != '\t' ) {
+            stop++;
+        }
+    }
+
+    // Leave any line ending out of the string.
+    const char *last = stop;
+    while ( last > text && ( last[-1] == '\n' || last[-1] == '\r' ) ) {
+        last--;
+    }
+    *start = text;
+    *length = last - text;
+    return stop;
+}
+
+#endif //FIELDS_H
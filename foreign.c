@@ -0,0 +1,473 @@
+/**
+   @file foreign.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for foreign keys. Each parent table's index is an open addressing hash
+   table of its ids with the number of rows that have each one, so a check is one probe and a
+   deleted id leaves its slot behind with a count of 0 until the table is grown again. Every key
+   and index is guarded by one lock.
+*/
+#include <pthread.h>
+#include "block.h"
+#include "database.h"
+#include "foreign.h"
+#include "lock.h"
+#include "partition.h"
+#include "schema.h"
+#include "sink.h"
+#include "stats.h"
+#include "txn.h"
+
+/** Name of the file foreign keys are kept in, inside the tables folder */
+#define FOREIGN_KEYS_FILE ".foreign_keys"
+/** Slots an index starts with, a power of 2 */
+#define INDEX_CAPACITY 1024
+
+/** A KeySlot is an id in an index and the number of rows with it. */
+typedef struct {
+    int id;
+    int rows;
+} KeySlot;
+
+/**
+   A KeyIndex is the index of a parent table's ids. used counts the slots ever filled, which
+   stay filled when their count drops to 0.
+*/
+typedef struct KeyIndex {
+    char table_name[MAX_TABLE_NAME_LENGTH];
+    bool built;
+    KeySlot *slots;
+    int capacity;
+    int used;
+    struct KeyIndex *next;
+} KeyIndex;
+
+/** A ForeignKey is a column of a table whose values are ids of a parent table. */
+typedef struct ForeignKey {
+    char table_name[MAX_TABLE_NAME_LENGTH];
+    const TableSchema *schema;
+    int column;
+    KeyIndex *parent;
+    struct ForeignKey *next;
+} ForeignKey;
+
+/** Every foreign key */
+static ForeignKey *keys;
+/** Every parent table's index */
+static KeyIndex *indexes;
+/** Guards every key and index */
+static pthread_mutex_t keys_lock = PTHREAD_MUTEX_INITIALIZER;
+/** Loads the keys the first time they are used */
+static pthread_once_t keys_once = PTHREAD_ONCE_INIT;
+/**
+   Held for reading while rows are checked and written, and for writing while rows are deleted
+   from a parent, so no parent row is deleted between a check and its write
+*/
+static pthread_rwlock_t writes_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/** Finds a table's index, or NULL if no key refers to it. Called with the lock held. */
+static KeyIndex *find_index( const char *table_name ) {
+    KeyIndex *index = indexes;
+    while ( index != NULL && strcmp( index->table_name, table_name ) != 0 ) {
+        index = index->next;
+    }
+    return index;
+}
+
+/** Finds the slot of an id, or the empty slot it would go in. Called with the lock held. */
+static KeySlot *find_slot( const KeyIndex *index, int id ) {
+    unsigned mask = index->capacity - 1;
+    unsigned at = ( ( unsigned )id * 2654435761u ) & mask;
+    while ( index->slots[at].rows >= 0 && index->slots[at].id != id ) {
+        at = ( at + 1 ) & mask;
+    }
+    return &index->slots[at];
+}
+
+/** Makes an index empty with room for capacity ids. Called with the lock held. */
+static void reset_index( KeyIndex *index, int capacity ) {
+    free( index->slots );
+    index->slots = ( KeySlot * )malloc( capacity * sizeof( KeySlot ) );
+    if ( index->slots == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    for ( int i = 0; i < capacity; i++ ) {
+        index->slots[i] = ( KeySlot ){ 0, -1 };
+    }
+    index->capacity = capacity;
+    index->used = 0;
+}
+
+/** Adds a row's id to an index, growing it once it is 3/4 full. Called with the lock held. */
+static void add_id( KeyIndex *index, int id ) {
+    if ( ( index->used + 1 ) * 4 > index->capacity * 3 ) {
+        KeySlot *old = index->slots;
+        int old_capacity = index->capacity;
+        index->slots = NULL;
+        reset_index( index, old_capacity * 2 );
+        for ( int i = 0; i < old_capacity; i++ ) {
+            if ( old[i].rows > 0 ) {
+                *find_slot( index, old[i].id ) = old[i];
+                index->used++;
+            }
+        }
+        free( old );
+    }
+    KeySlot *slot = find_slot( index, id );
+    if ( slot->rows < 0 ) {
+        *slot = ( KeySlot ){ id, 0 };
+        index->used++;
+    }
+    slot->rows++;
+}
+
+/** Takes a row's id off an index. Called with the lock held. */
+static void remove_id( KeyIndex *index, int id ) {
+    KeySlot *slot = find_slot( index, id );
+    if ( slot->rows > 0 ) {
+        slot->rows--;
+    }
+}
+
+/** Throws away an index's ids until it is built again. Called with the lock held. */
+static void clear_index( KeyIndex *index ) {
+    free( index->slots );
+    index->slots = NULL;
+    index->built = false;
+}
+
+/** Reads the id a row starts with. Returns false if it has none. */
+static bool row_id( const char *row, int *id ) {
+    return sscanf( row, "%d", id ) == 1;
+}
+
+/** Finds a table's index, adding an unbuilt one if it has none. Called with the lock held. */
+static KeyIndex *use_index( const char *table_name ) {
+    KeyIndex *index = find_index( table_name );
+    if ( index == NULL ) {
+        index = ( KeyIndex * )calloc( 1, sizeof( KeyIndex ) );
+        if ( index == NULL ) {
+            err_printf( "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+        snprintf( index->table_name, sizeof( index->table_name ), "%s", table_name );
+        index->next = indexes;
+        indexes = index;
+    }
+    return index;
+}
+
+/**
+   Reads a definition, "<table>.<column> -> <parent>.id", into a new key. Prints why and returns
+   NULL if it is invalid. Called with the lock held.
+*/
+static ForeignKey *parse_key( const char *definition ) {
+    char table_name[MAX_STRING_LENGTH], column[MAX_STRING_LENGTH];
+    char parent_name[MAX_STRING_LENGTH], parent_column[MAX_STRING_LENGTH];
+    int used = 0;
+    int fields = sscanf( definition, " %254[a-z_] . %254[a-z_] -> %254[a-z_] . %254[a-z_] %n",
+                         table_name, column, parent_name, parent_column, &used );
+    if ( fields != 4 || definition[used] != '\0' ) {
+        out_printf( "Foreign key invalid, use <table>.<column> -> <parent>.id\n" );
+        return NULL;
+    }
+    const TableSchema *schema = find_table( table_name );
+    const TableSchema *parent = find_table( parent_name );
+    int column_index = schema != NULL ? find_column( schema, column ) : -1;
+    if ( column_index < 0 || schema->columns[column_index].type != INT_COLUMN ||
+         parent == NULL || strcmp( parent_column, "id" ) != 0 ||
+         find_column( parent, "id" ) < 0 ) {
+        out_printf( "Foreign key invalid, the column must hold numbers and refer to an id\n" );
+        return NULL;
+    }
+
+    ForeignKey *key = ( ForeignKey * )calloc( 1, sizeof( ForeignKey ) );
+    if ( key == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    snprintf( key->table_name, sizeof( key->table_name ), "%s", table_name );
+    key->schema = schema;
+    key->column = column_index;
+    key->parent = use_index( parent_name );
+    return key;
+}
+
+/** Loads the saved keys, one definition a line. */
+static void load_keys( void ) {
+    char path[MAX_STR_LENGTH];
+    snprintf( path, sizeof( path ), "%s/%s", folder, FOREIGN_KEYS_FILE );
+    FILE *file = fopen( path, "r" );
+    if ( file == NULL ) {
+        return;
+    }
+    char line[MAX_STR_LENGTH];
+    while ( fgets( line, sizeof( line ), file ) ) {
+        line[ strcspn( line, "\r\n" ) ] = '\0';
+        ForeignKey *key = parse_key( line );
+        if ( key != NULL ) {
+            key->next = keys;
+            keys = key;
+        }
+    }
+    fclose( file );
+}
+
+/** Writes every key to the keys file. Called with the lock held. */
+static int save_keys( void ) {
+    char path[MAX_STR_LENGTH], temp[MAX_STR_LENGTH];
+    snprintf( path, sizeof( path ), "%s/%s", folder, FOREIGN_KEYS_FILE );
+    snprintf( temp, sizeof( temp ), "%s/%s.tmp", folder, FOREIGN_KEYS_FILE );
+    FILE *file = fopen( temp, "w" );
+    if ( file == NULL ) {
+        return EXIT_FAILURE;
+    }
+    for ( ForeignKey *key = keys; key != NULL; key = key->next ) {
+        fprintf( file, "%s.%s -> %s.id\n", key->table_name, key->schema->columns[key->column].name,
+                 key->parent->table_name );
+    }
+    if ( fclose( file ) != 0 || rename( temp, path ) != 0 ) {
+        remove( temp );
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Declares a foreign key. */
+int create_foreign_key( const char *definition ) {
+    pthread_once( &keys_once, load_keys );
+    pthread_mutex_lock( &keys_lock );
+    ForeignKey *key = parse_key( definition );
+    if ( key == NULL ) {
+        pthread_mutex_unlock( &keys_lock );
+        return EXIT_FAILURE;
+    }
+    for ( ForeignKey *other = keys; other != NULL; other = other->next ) {
+        if ( strcmp( other->table_name, key->table_name ) == 0 && other->column == key->column ) {
+            out_printf( "Foreign key on %s.%s already exists.\n", key->table_name,
+                        key->schema->columns[key->column].name );
+            free( key );
+            pthread_mutex_unlock( &keys_lock );
+            return EXIT_FAILURE;
+        }
+    }
+    key->next = keys;
+    keys = key;
+    int status = save_keys();
+    if ( status == EXIT_SUCCESS ) {
+        out_printf( "Foreign key %s.%s -> %s.id created successfully.\n", key->table_name,
+                    key->schema->columns[key->column].name, key->parent->table_name );
+    }
+    pthread_mutex_unlock( &keys_lock );
+    return status;
+}
+
+/** Forgets the foreign keys of a table and those that refer to it. */
+void drop_foreign_keys( const char *table_name ) {
+    pthread_once( &keys_once, load_keys );
+    pthread_mutex_lock( &keys_lock );
+    bool dropped = false;
+    ForeignKey **link = &keys;
+    while ( *link != NULL ) {
+        ForeignKey *key = *link;
+        if ( strcmp( key->table_name, table_name ) == 0 ||
+             strcmp( key->parent->table_name, table_name ) == 0 ) {
+            *link = key->next;
+            free( key );
+            dropped = true;
+        }
+        else {
+            link = &key->next;
+        }
+    }
+    KeyIndex *index = find_index( table_name );
+    if ( index != NULL ) {
+        clear_index( index );
+    }
+    if ( dropped ) {
+        save_keys();
+    }
+    pthread_mutex_unlock( &keys_lock );
+}
+
+/** Checks whether a table has foreign keys. */
+bool has_foreign_keys( const char *table_name ) {
+    pthread_once( &keys_once, load_keys );
+    pthread_mutex_lock( &keys_lock );
+    ForeignKey *key = keys;
+    while ( key != NULL && strcmp( key->table_name, table_name ) != 0 ) {
+        key = key->next;
+    }
+    pthread_mutex_unlock( &keys_lock );
+    return key != NULL;
+}
+
+/** Checks whether a table is the parent of a foreign key. */
+bool is_foreign_parent( const char *table_name ) {
+    pthread_once( &keys_once, load_keys );
+    pthread_mutex_lock( &keys_lock );
+    ForeignKey *key = keys;
+    while ( key != NULL && strcmp( key->parent->table_name, table_name ) != 0 ) {
+        key = key->next;
+    }
+    pthread_mutex_unlock( &keys_lock );
+    return key != NULL;
+}
+
+/** Holds off deletes from parents, or takes the hold alone to delete from a parent. */
+void hold_foreign_keys( bool deleting ) {
+    if ( deleting ) {
+        pthread_rwlock_wrlock( &writes_lock );
+    }
+    else {
+        pthread_rwlock_rdlock( &writes_lock );
+    }
+}
+
+/** Releases a hold. */
+void release_foreign_keys( void ) {
+    pthread_rwlock_unlock( &writes_lock );
+}
+
+/**
+   Builds a parent table's index with one scan of each of its files, under the table's write lock
+   so no change is missed.
+*/
+static void build_index( const char *table_name ) {
+    TableLock *lock = write_lock_table( table_name );
+    pthread_mutex_lock( &keys_lock );
+    KeyIndex *index = find_index( table_name );
+    if ( index != NULL && !index->built ) {
+        reset_index( index, INDEX_CAPACITY );
+        PartitionList list;
+        list_partitions( table_name, "", "", "", &list );
+        uint64_t start = stats_clock();
+        for ( int i = 0; i < list.count; i++ ) {
+            char path[MAX_STR_LENGTH];
+            snprintf( path, sizeof( path ), "%s/%s", folder, list.names[i] );
+            bool compressed;
+            FILE *file = open_table_file( path, &compressed );
+            if ( file == NULL ) {
+                continue;
+            }
+            char line[MAX_STR_LENGTH];
+            uint64_t scanned = 0;
+            int id;
+            while ( fgets( line, sizeof( line ), file ) ) {
+                if ( row_id( line, &id ) ) {
+                    add_id( index, id );
+                }
+                scanned++;
+            }
+            fclose( file );
+            stats_add( ROWS_SCANNED, scanned );
+        }
+        free_partition_list( &list );
+        stats_phase( PHASE_SCAN, start );
+        index->built = true;
+    }
+    pthread_mutex_unlock( &keys_lock );
+    write_unlock_table( lock );
+}
+
+/**
+   Finds a key of a table whose parent's index is not built, or NULL if there is none. Called with
+   the lock held.
+*/
+static ForeignKey *unbuilt_key( const char *table_name ) {
+    ForeignKey *key = keys;
+    while ( key != NULL &&
+            ( strcmp( key->table_name, table_name ) != 0 || key->parent->built ) ) {
+        key = key->next;
+    }
+    return key;
+}
+
+/** Checks that a row's foreign keys name rows of their parents. */
+bool foreign_keys_met( const char *table_name, const char *row, bool report ) {
+    pthread_once( &keys_once, load_keys );
+    pthread_mutex_lock( &keys_lock );
+
+    // Indexes are built without the lock, so keys may be dropped meanwhile; the keys are looked
+    // at from the start again after each one.
+    ForeignKey *unbuilt;
+    while ( ( unbuilt = unbuilt_key( table_name ) ) != NULL ) {
+        char parent_name[MAX_TABLE_NAME_LENGTH];
+        snprintf( parent_name, sizeof( parent_name ), "%s", unbuilt->parent->table_name );
+        pthread_mutex_unlock( &keys_lock );
+        build_index( parent_name );
+        pthread_mutex_lock( &keys_lock );
+    }
+    for ( ForeignKey *key = keys; key != NULL; key = key->next ) {
+        if ( strcmp( key->table_name, table_name ) != 0 ) {
+            continue;
+        }
+        Value values[MAX_COLUMNS];
+        if ( decode_row( key->schema, row, row + strcspn( row, "\r\n" ), values,
+                         1u << key->column ) != EXIT_SUCCESS ) {
+            if ( report ) {
+                out_printf( "Foreign key %s.%s: value can not be read!\n", table_name,
+                            key->schema->columns[key->column].name );
+            }
+            pthread_mutex_unlock( &keys_lock );
+            return false;
+        }
+        int id = values[key->column].number;
+        const char *parent_name = key->parent->table_name;
+        const char *column = key->schema->columns[key->column].name;
+        bool stored = find_slot( key->parent, id )->rows > 0 &&
+                      !transaction_deletes( parent_name, id );
+        if ( !stored && !transaction_inserts( parent_name, id ) ) {
+            if ( report ) {
+                out_printf( "Foreign key %s.%s: %s has no id %d!\n", table_name, column,
+                            parent_name, id );
+            }
+            pthread_mutex_unlock( &keys_lock );
+            return false;
+        }
+    }
+    pthread_mutex_unlock( &keys_lock );
+    return true;
+}
+
+/** Adds inserted rows to a table's built index. */
+void foreign_rows_inserted( const char *table_name, const char *const *rows, int count ) {
+    pthread_once( &keys_once, load_keys );
+    pthread_mutex_lock( &keys_lock );
+    KeyIndex *index = find_index( table_name );
+    int id;
+    for ( int i = 0; index != NULL && index->built && i < count; i++ ) {
+        if ( row_id( rows[i], &id ) ) {
+            add_id( index, id );
+        }
+    }
+    pthread_mutex_unlock( &keys_lock );
+}
+
+/** Moves an updated or deleted row in a table's built index. */
+void foreign_row_changed( const char *table_name, const char *old_row, const char *new_row ) {
+    pthread_once( &keys_once, load_keys );
+    pthread_mutex_lock( &keys_lock );
+    KeyIndex *index = find_index( table_name );
+    int id;
+    if ( index != NULL && index->built ) {
+        if ( row_id( old_row, &id ) ) {
+            remove_id( index, id );
+        }
+        if ( new_row != NULL && row_id( new_row, &id ) ) {
+            add_id( index, id );
+        }
+    }
+    pthread_mutex_unlock( &keys_lock );
+}
+
+/** Throws away a table's index. */
+void invalidate_foreign_index( const char *table_name ) {
+    pthread_once( &keys_once, load_keys );
+    pthread_mutex_lock( &keys_lock );
+    KeyIndex *index = find_index( table_name );
+    if ( index != NULL ) {
+        clear_index( index );
+    }
+    pthread_mutex_unlock( &keys_lock );
+}
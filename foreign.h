@@ -0,0 +1,90 @@
+/**
+   @file foreign.h
+   @author Michael Warstler (mwwarstl)
+   Header file for foreign keys. "create foreign key <table>.<column> -> <parent>.id" requires
+   every row inserted into or updated in the table to have a value in the column that is the id
+   of a row of the parent table. Each check is one probe of a hash index of the parent's ids,
+   built with one scan of the parent the first time a row is checked against it and kept up to
+   date as the parent's rows are inserted, updated, and deleted after that. Keys are saved in
+   folder/.foreign_keys, and the keys of a table are forgotten when it or its parent is dropped.
+   Functions that report a change are called with the table's write lock held; checks are made
+   without any table lock held. A check and the write of the rows it passes are made under a hold
+   that deletes from parent tables wait for, taken before any table lock.
+*/
+#ifndef FOREIGN_H
+#define FOREIGN_H
+
+#include <stdbool.h>
+
+/**
+   Declares and saves a foreign key. Prints why if it is invalid.
+   @param definition is "<table>.<column> -> <parent>.id", where the column holds numbers.
+   @return is EXIT_FAILURE if the key is invalid or could not be saved, otherwise EXIT_SUCCESS
+*/
+int create_foreign_key( const char *definition );
+
+/**
+   Forgets the foreign keys of a table and those that refer to it.
+   @param table_name is string name of the table.
+*/
+void drop_foreign_keys( const char *table_name );
+
+/**
+   Checks whether a table has foreign keys.
+   @param table_name is string name of the table.
+   @return is true if it has.
+*/
+bool has_foreign_keys( const char *table_name );
+
+/**
+   Checks whether a table is the parent of a foreign key.
+   @param table_name is string name of the table.
+   @return is true if it is.
+*/
+bool is_foreign_parent( const char *table_name );
+
+/**
+   Takes the hold checks and deletes from parents are made under. Many checks and their writes
+   may hold it at once; a delete from a parent holds it alone. It is taken before any table lock.
+   @param deleting is true to delete rows from a parent, false to check rows and write them.
+*/
+void hold_foreign_keys( bool deleting );
+
+/**
+   Releases the hold taken with hold_foreign_keys.
+*/
+void release_foreign_keys( void );
+
+/**
+   Checks that a row's foreign keys each name a row of their parent table that the current
+   transaction does not delete, or a row the transaction inserts into it.
+   @param table_name is string name of the table.
+   @param row is the row, newline optional.
+   @param report is true to print the first key that is not met.
+   @return is true if every key is met, false if one is not or its value cannot be read.
+*/
+bool foreign_keys_met( const char *table_name, const char *row, bool report );
+
+/**
+   Adds rows inserted into a table to its id index, if it has been built.
+   @param table_name is string name of the table.
+   @param rows is the rows inserted.
+   @param count is the number of rows.
+*/
+void foreign_rows_inserted( const char *table_name, const char *const *rows, int count );
+
+/**
+   Moves an updated or deleted row in a table's id index, if it has been built.
+   @param table_name is string name of the table.
+   @param old_row is the row as it was.
+   @param new_row is the row as it is now, or NULL if it was deleted.
+*/
+void foreign_row_changed( const char *table_name, const char *old_row, const char *new_row );
+
+/**
+   Throws away a table's id index, to be built again the next time it is probed.
+   @param table_name is string name of the table.
+*/
+void invalidate_foreign_index( const char *table_name );
+
+#endif //FOREIGN_H
@@ -0,0 +1,219 @@
+/**
+   @file loadclient.c
+   @author Michael Warstler (mwwarstl)
+   Load client for server mode. Opens a number of concurrent connections to a server's Unix domain
+   socket, sends each one a number of commands, and reports throughput and latency percentiles.
+   Each command waits for its RESPONSE_END before the next is sent on that connection.
+
+   usage: loadclient <socket-path> <clients> <requests-per-client> <command | ->
+   With "-" the commands are read from standard input, one per line, and used in turn.
+*/
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+
+/** Max number of characters in a command read from standard input */
+#define MAX_COMMAND_LENGTH 4096
+
+/** A Client holds one connection's thread, its latencies, and how many response bytes it got. */
+typedef struct {
+    pthread_t thread;
+    int index;
+    double *latencies;
+    long bytes;
+    bool failed;
+} Client;
+
+/** Settings shared by every client */
+static const char *socket_path;
+static int requests;
+static char **commands;
+static int command_count;
+
+/** Returns the time on the monotonic clock in seconds. */
+static double now( void ) {
+    struct timespec time;
+    clock_gettime( CLOCK_MONOTONIC, &time );
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/** Connects to the server. Returns the socket, or -1 on error. */
+static int connect_server( void ) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    strncpy( address.sun_path, socket_path, sizeof( address.sun_path ) - 1 );
+    int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if ( fd < 0 ) {
+        return -1;
+    }
+    if ( connect( fd, ( struct sockaddr * )&address, sizeof( address ) ) < 0 ) {
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+/** Writes all of a buffer to a socket. */
+static bool send_all( int fd, const char *data, size_t length ) {
+    while ( length > 0 ) {
+        ssize_t written = write( fd, data, length );
+        if ( written < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+/** Client thread. Sends its commands one at a time and times each response. */
+static void *client_main( void *argument ) {
+    Client *client = ( Client * )argument;
+    int fd = connect_server();
+    if ( fd < 0 ) {
+        client->failed = true;
+        return NULL;
+    }
+
+    char response[64 * 1024];
+    for ( int i = 0; i < requests; i++ ) {
+        const char *command = commands[ ( client->index + i ) % command_count ];
+        double start = now();
+        if ( !send_all( fd, command, strlen( command ) ) || !send_all( fd, "\n", 1 ) ) {
+            client->failed = true;
+            break;
+        }
+
+        // Read until the end of the response.
+        bool complete = false;
+        while ( !complete ) {
+            ssize_t got = read( fd, response, sizeof( response ) );
+            if ( got <= 0 ) {
+                if ( got < 0 && errno == EINTR ) {
+                    continue;
+                }
+                client->failed = true;
+                break;
+            }
+            client->bytes += got;
+            complete = response[got - 1] == RESPONSE_END;
+        }
+        if ( !complete ) {
+            break;
+        }
+        client->latencies[i] = now() - start;
+    }
+    close( fd );
+    return NULL;
+}
+
+/** Orders latencies for sorting. */
+static int compare_latency( const void *a, const void *b ) {
+    double x = *( const double * )a, y = *( const double * )b;
+    return ( x > y ) - ( x < y );
+}
+
+/** Reads commands from standard input, one per line. */
+static void read_commands( void ) {
+    int capacity = 16;
+    commands = ( char ** )malloc( capacity * sizeof( char * ) );
+    char line[MAX_COMMAND_LENGTH];
+    while ( commands != NULL && fgets( line, sizeof( line ), stdin ) ) {
+        line[ strcspn( line, "\r\n" ) ] = '\0';
+        if ( line[0] == '\0' ) {
+            continue;
+        }
+        if ( command_count == capacity ) {
+            capacity *= 2;
+            commands = ( char ** )realloc( commands, capacity * sizeof( char * ) );
+            if ( commands == NULL ) {
+                break;
+            }
+        }
+        commands[ command_count++ ] = strdup( line );
+    }
+    if ( commands == NULL ) {
+        fprintf( stderr, "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+}
+
+/**
+   Starts the clients, waits for them to finish, and prints the results.
+   @param argc is number of command line arguments.
+   @param argv is the command line arguments.
+   @return is exit status.
+*/
+int main( int argc, char *argv[] ) {
+    if ( argc != 5 ) {
+        fprintf( stderr, "usage: %s <socket-path> <clients> <requests-per-client> <command | ->\n",
+                 argv[0] );
+        return EXIT_FAILURE;
+    }
+    socket_path = argv[1];
+    int client_count = atoi( argv[2] );
+    requests = atoi( argv[3] );
+    if ( client_count < 1 || requests < 1 ) {
+        fprintf( stderr, "clients and requests must be at least 1\n" );
+        return EXIT_FAILURE;
+    }
+    if ( strcmp( argv[4], "-" ) == 0 ) {
+        read_commands();
+    }
+    else {
+        commands = &argv[4];
+        command_count = 1;
+    }
+    if ( command_count == 0 ) {
+        fprintf( stderr, "No commands to send\n" );
+        return EXIT_FAILURE;
+    }
+
+    // Run every client at once.
+    Client *clients = ( Client * )calloc( client_count, sizeof( Client ) );
+    double *latencies = ( double * )calloc( ( size_t )client_count * requests, sizeof( double ) );
+    if ( clients == NULL || latencies == NULL ) {
+        fprintf( stderr, "Memory allocation error\n" );
+        return EXIT_FAILURE;
+    }
+    double start = now();
+    for ( int i = 0; i < client_count; i++ ) {
+        clients[i].index = i;
+        clients[i].latencies = latencies + ( size_t )i * requests;
+        pthread_create( &clients[i].thread, NULL, client_main, &clients[i] );
+    }
+    long bytes = 0;
+    int failed = 0;
+    for ( int i = 0; i < client_count; i++ ) {
+        pthread_join( clients[i].thread, NULL );
+        bytes += clients[i].bytes;
+        failed += clients[i].failed;
+    }
+    double seconds = now() - start;
+
+    // Only completed requests count toward the results.
+    size_t completed = 0;
+    for ( size_t i = 0; i < ( size_t )client_count * requests; i++ ) {
+        if ( latencies[i] > 0 ) {
+            latencies[ completed++ ] = latencies[i];
+        }
+    }
+    qsort( latencies, completed, sizeof( double ), compare_latency );
+    double p50 = completed > 0 ? latencies[ completed / 2 ] : 0;
+    double p99 = completed > 0 ? latencies[ completed * 99 / 100 ] : 0;
+    printf( "clients %d, requests %zu, failed clients %d\n", client_count, completed, failed );
+    printf( "%.3f seconds, %.0f requests/second, %.1f MB/second received\n", seconds,
+            completed / seconds, bytes / seconds / 1e6 );
+    printf( "latency p50 %.1f us, p99 %.1f us\n", p50 * 1e6, p99 * 1e6 );
+    return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
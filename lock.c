@@ -0,0 +1,173 @@
+/**
+   @file lock.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for per-table concurrency control. Each table name gets a TableLock the
+   first time it is used, kept in a small hash table for the life of the program. A TableLock has
+   a write mutex held for the whole of a change, an append mutex held only around the write that
+   adds rows, and counters of how many times each was taken and how long callers waited.
+*/
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "lock.h"
+#include "database.h"
+#include "sink.h"
+
+/** Number of buckets in the table of locks */
+#define LOCK_BUCKETS 64
+
+/** A TableLock holds a table's locks and contention counters, chained in its hash bucket. */
+struct TableLock {
+    char name[MAX_STR_LENGTH];
+    pthread_mutex_t write;
+    pthread_mutex_t append;
+
+    unsigned long writes;           // write locks taken
+    unsigned long write_waits;      // write locks that had to wait for another writer
+    uint64_t write_wait_ns;         // total time spent waiting for write locks
+    uint64_t max_write_wait_ns;     // longest wait for a write lock
+    unsigned long snapshots;        // snapshot reads taken
+    unsigned long snapshot_waits;   // snapshots that had to wait for an append to finish
+
+    struct TableLock *next;
+};
+
+/** Every TableLock made so far, by hash of the table name */
+static TableLock *buckets[LOCK_BUCKETS];
+/** Guards buckets and the counters of every TableLock */
+static pthread_mutex_t registry = PTHREAD_MUTEX_INITIALIZER;
+
+/** Returns the time on the monotonic clock in nanoseconds. */
+static uint64_t now_ns( void ) {
+    struct timespec time;
+    clock_gettime( CLOCK_MONOTONIC, &time );
+    return ( uint64_t )time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+/** Hashes a table name (FNV-1a). */
+static unsigned hash_name( const char *name ) {
+    unsigned hash = 2166136261u;
+    for ( ; *name != '\0'; name++ ) {
+        hash = ( hash ^ ( unsigned char )*name ) * 16777619u;
+    }
+    return hash;
+}
+
+/** Finds a table's lock, making it the first time the table is used. */
+static TableLock *find_lock( const char *table_name ) {
+    unsigned bucket = hash_name( table_name ) % LOCK_BUCKETS;
+    pthread_mutex_lock( &registry );
+    TableLock *lock = buckets[bucket];
+    while ( lock != NULL && strcmp( lock->name, table_name ) != 0 ) {
+        lock = lock->next;
+    }
+    if ( lock == NULL ) {
+        lock = ( TableLock * )calloc( 1, sizeof( TableLock ) );
+        if ( lock == NULL ) {
+            pthread_mutex_unlock( &registry );
+            err_printf( "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+        strncpy( lock->name, table_name, sizeof( lock->name ) - 1 );
+        pthread_mutex_init( &lock->write, NULL );
+        pthread_mutex_init( &lock->append, NULL );
+        lock->next = buckets[bucket];
+        buckets[bucket] = lock;
+    }
+    pthread_mutex_unlock( &registry );
+    return lock;
+}
+
+/** Takes a table's write lock, counting the wait if another writer holds it. */
+TableLock *write_lock_table( const char *table_name ) {
+    TableLock *lock = find_lock( table_name );
+    uint64_t waited = 0;
+    bool contended = pthread_mutex_trylock( &lock->write ) != 0;
+    if ( contended ) {
+        uint64_t start = now_ns();
+        pthread_mutex_lock( &lock->write );
+        waited = now_ns() - start;
+    }
+
+    pthread_mutex_lock( &registry );
+    lock->writes++;
+    if ( contended ) {
+        lock->write_waits++;
+        lock->write_wait_ns += waited;
+        if ( waited > lock->max_write_wait_ns ) {
+            lock->max_write_wait_ns = waited;
+        }
+    }
+    pthread_mutex_unlock( &registry );
+    return lock;
+}
+
+/** Releases a table's write lock. */
+void write_unlock_table( TableLock *lock ) {
+    pthread_mutex_unlock( &lock->write );
+}
+
+/** Takes a table's append lock. */
+void begin_append( TableLock *lock ) {
+    pthread_mutex_lock( &lock->append );
+}
+
+/** Releases a table's append lock. */
+void end_append( TableLock *lock ) {
+    pthread_mutex_unlock( &lock->append );
+}
+
+/** Takes the size of an open table while no append is in progress. */
+off_t snapshot_table( const char *table_name, int fd ) {
+    TableLock *lock = find_lock( table_name );
+    bool contended = pthread_mutex_trylock( &lock->append ) != 0;
+    if ( contended ) {
+        pthread_mutex_lock( &lock->append );
+    }
+    struct stat status;
+    int result = fstat( fd, &status );
+    pthread_mutex_unlock( &lock->append );
+
+    pthread_mutex_lock( &registry );
+    lock->snapshots++;
+    lock->snapshot_waits += contended;
+    pthread_mutex_unlock( &registry );
+    return result == 0 ? status.st_size : -1;
+}
+
+/** Builds the path of a table's temporary file. */
+void temp_table_path( char *path, size_t size, const char *table_name ) {
+    snprintf( path, size, "%s/.%s.tmp", folder, table_name );
+}
+
+/** Prints every table's lock counters. */
+void print_lock_stats( void ) {
+    pthread_mutex_lock( &registry );
+    out_printf( "%-16s %10s %10s %12s %12s %10s %10s\n", "table", "writes", "waits",
+                "wait_ms", "max_wait_ms", "snapshots", "snap_waits" );
+    for ( int i = 0; i < LOCK_BUCKETS; i++ ) {
+        for ( TableLock *lock = buckets[i]; lock != NULL; lock = lock->next ) {
+            out_printf( "%-16s %10lu %10lu %12.3f %12.3f %10lu %10lu\n", lock->name, lock->writes,
+                        lock->write_waits, lock->write_wait_ns / 1e6,
+                        lock->max_write_wait_ns / 1e6, lock->snapshots, lock->snapshot_waits );
+        }
+    }
+    pthread_mutex_unlock( &registry );
+}
+
+/** Clears every table's lock counters. */
+void reset_lock_stats( void ) {
+    pthread_mutex_lock( &registry );
+    for ( int i = 0; i < LOCK_BUCKETS; i++ ) {
+        for ( TableLock *lock = buckets[i]; lock != NULL; lock = lock->next ) {
+            lock->writes = 0;
+            lock->write_waits = 0;
+            lock->write_wait_ns = 0;
+            lock->max_write_wait_ns = 0;
+            lock->snapshots = 0;
+            lock->snapshot_waits = 0;
+        }
+    }
+    pthread_mutex_unlock( &registry );
+}
@@ -0,0 +1,74 @@
+/**
+   @file lock.h
+   @author Michael Warstler (mwwarstl)
+   Header file for per-table concurrency control. Writers to a table (insert, update, delete,
+   create, drop, write_file) hold the table's write lock, so only one changes it at a time. Readers
+   never wait for writers: update and delete write a new copy of the table and rename it over the
+   old one, so a reader keeps reading the version it opened. Inserts append in place, so a reader
+   takes the table's size when it opens the file and reads only that much, and appends are made
+   with a single write under a short append lock so that size never ends partway through a row.
+   Counters record how often and how long writers and readers waited.
+*/
+#ifndef LOCK_H
+#define LOCK_H
+
+#include <sys/types.h>
+
+/** A TableLock holds the locks and contention counters of one table. Defined in lock.c. */
+typedef struct TableLock TableLock;
+
+/**
+   Takes a table's write lock, waiting for any other writer of the table to finish.
+   @param table_name is string name of the table/file.
+   @return is the table's lock, to be passed to write_unlock_table.
+*/
+TableLock *write_lock_table( const char *table_name );
+
+/**
+   Releases a table's write lock.
+   @param lock is the lock returned by write_lock_table.
+*/
+void write_unlock_table( TableLock *lock );
+
+/**
+   Takes a table's append lock. Held only for the single write that adds rows to the end of the
+   table, while the write lock is also held.
+   @param lock is the table's lock.
+*/
+void begin_append( TableLock *lock );
+
+/**
+   Releases a table's append lock.
+   @param lock is the table's lock.
+*/
+void end_append( TableLock *lock );
+
+/**
+   Takes a snapshot of a table opened for reading. The snapshot is the number of bytes of complete
+   rows in the file, which is all a reader should read from it.
+   @param table_name is string name of the table/file.
+   @param fd is the open file's descriptor.
+   @return is the number of bytes in the snapshot, or -1 if the file could not be checked.
+*/
+off_t snapshot_table( const char *table_name, int fd );
+
+/**
+   Builds the path of the temporary file a table is rewritten into before it is renamed over the
+   table. Each table has its own, so writers of different tables never share one.
+   @param path is where the path is stored.
+   @param size is the size of path.
+   @param table_name is string name of the table/file.
+*/
+void temp_table_path( char *path, size_t size, const char *table_name );
+
+/**
+   Prints the lock counters of every table that has been used to the current output sink.
+*/
+void print_lock_stats( void );
+
+/**
+   Sets every table's lock counters back to 0.
+*/
+void reset_lock_stats( void );
+
+#endif //LOCK_H
@@ -0,0 +1,173 @@
+/**
+   @file lz.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for the LZ codec. The compressor hashes every four bytes it passes into a
+   table of recent positions and takes the first candidate that matches, skipping ahead faster the
+   longer it goes without finding one. It favours speed over ratio, which suits table rows full of
+   repeated words, dates, and digits.
+*/
+#include <stdint.h>
+#include <string.h>
+#include "lz.h"
+
+/** Number of bits in a position table index */
+#define HASH_BITS 14
+
+/** Reads four bytes. */
+static uint32_t read32( const char *p ) {
+    uint32_t value;
+    memcpy( &value, p, sizeof( value ) );
+    return value;
+}
+
+/** Hashes four bytes to a position table index. */
+static unsigned hash32( uint32_t value ) {
+    return ( value * 2654435761u ) >> ( 32 - HASH_BITS );
+}
+
+/** Writes the rest of a length over 15 as a run of 255s and a final byte. */
+static char *write_length( char *out, size_t length ) {
+    for ( ; length >= 255; length -= 255 ) {
+        *out++ = ( char )255;
+    }
+    *out++ = ( char )length;
+    return out;
+}
+
+/**
+   Writes one sequence: literals from anchor, then a match of match_length at offset back (no
+   match when match_length is 0). Returns the new end of the output, or NULL if it would not fit.
+*/
+static char *write_sequence( char *out, char *end, const char *anchor, size_t literals,
+                             size_t offset, size_t match_length ) {
+    if ( ( size_t )( end - out ) < 1 + literals / 255 + 1 + literals + 2 + match_length / 255 + 1 ) {
+        return NULL;
+    }
+    char *token = out++;
+    size_t match_code = match_length > 0 ? match_length - LZ_MIN_MATCH : 0;
+    *token = ( char )( ( literals < 15 ? literals : 15 ) << 4 | ( match_code < 15 ? match_code : 15 ) );
+    if ( literals >= 15 ) {
+        out = write_length( out, literals - 15 );
+    }
+    memcpy( out, anchor, literals );
+    out += literals;
+    if ( match_length > 0 ) {
+        *out++ = ( char )( offset & 0xFF );
+        *out++ = ( char )( offset >> 8 );
+        if ( match_code >= 15 ) {
+            out = write_length( out, match_code - 15 );
+        }
+    }
+    return out;
+}
+
+/** Compresses bytes. */
+size_t lz_compress( const char *source, size_t length, char *destination, size_t capacity ) {
+    // Positions are stored plus one so that 0 means empty.
+    uint32_t positions[1 << HASH_BITS];
+    memset( positions, 0, sizeof( positions ) );
+
+    const char *in = source, *anchor = source;
+    const char *end = source + length;
+    char *out = destination, *out_end = destination + capacity;
+    if ( length >= LZ_MIN_MATCH + 1 ) {
+        const char *last = end - LZ_MIN_MATCH;
+        while ( in < last ) {
+            uint32_t value = read32( in );
+            unsigned slot = hash32( value );
+            uint32_t position = positions[slot];
+            positions[slot] = in - source + 1;
+            const char *candidate = source + ( position > 0 ? position - 1 : 0 );
+            if ( position == 0 || in - candidate > LZ_MAX_OFFSET || read32( candidate ) != value ) {
+                in += 1 + ( ( in - anchor ) >> 6 );
+                continue;
+            }
+
+            // Extend the match forward, and backward over literals that also match.
+            size_t match = LZ_MIN_MATCH;
+            while ( in + match < end && in[match] == candidate[match] ) {
+                match++;
+            }
+            while ( in > anchor && candidate > source && in[-1] == candidate[-1] ) {
+                in--;
+                candidate--;
+                match++;
+            }
+            out = write_sequence( out, out_end, anchor, in - anchor, in - candidate, match );
+            if ( out == NULL ) {
+                return 0;
+            }
+            in += match;
+            anchor = in;
+        }
+    }
+
+    // The rest is literals.
+    out = write_sequence( out, out_end, anchor, end - anchor, 0, 0 );
+    return out == NULL ? 0 : ( size_t )( out - destination );
+}
+
+/** Reads the rest of a length over 15. Returns false if the input ends first. */
+static int read_length( const unsigned char **in, const unsigned char *end, size_t *length ) {
+    unsigned char byte;
+    do {
+        if ( *in >= end ) {
+            return 0;
+        }
+        byte = *( *in )++;
+        *length += byte;
+    } while ( byte == 255 );
+    return 1;
+}
+
+/** Decompresses bytes, checking every length and offset. */
+long lz_decompress( const char *source, size_t length, char *destination, size_t capacity ) {
+    const unsigned char *in = ( const unsigned char * )source;
+    const unsigned char *end = in + length;
+    char *out = destination, *out_end = destination + capacity;
+
+    while ( in < end ) {
+        unsigned token = *in++;
+        size_t literals = token >> 4;
+        if ( literals == 15 && !read_length( &in, end, &literals ) ) {
+            return -1;
+        }
+        if ( literals > ( size_t )( end - in ) || literals > ( size_t )( out_end - out ) ) {
+            return -1;
+        }
+        memcpy( out, in, literals );
+        in += literals;
+        out += literals;
+        if ( in == end ) {
+            break;  // The last sequence has no match.
+        }
+
+        if ( end - in < 2 ) {
+            return -1;
+        }
+        size_t offset = in[0] | ( size_t )in[1] << 8;
+        in += 2;
+        size_t match = token & 15;
+        if ( match == 15 && !read_length( &in, end, &match ) ) {
+            return -1;
+        }
+        match += LZ_MIN_MATCH;
+        if ( offset == 0 || offset > ( size_t )( out - destination ) ||
+             match > ( size_t )( out_end - out ) ) {
+            return -1;
+        }
+
+        // Matches may overlap what they copy, so short offsets are copied a byte at a time.
+        const char *from = out - offset;
+        if ( offset >= match ) {
+            memcpy( out, from, match );
+            out += match;
+        }
+        else {
+            for ( size_t i = 0; i < match; i++ ) {
+                *out++ = from[i];
+            }
+        }
+    }
+    return out - destination;
+}
@@ -0,0 +1,42 @@
+/**
+   @file lz.h
+   @author Michael Warstler (mwwarstl)
+   Header file for a small LZ77 codec in the style of LZ4, used to compress table blocks. A
+   compressed block is a list of sequences. Each sequence is a token byte (literal count in the
+   high four bits, match length minus LZ_MIN_MATCH in the low four, 15 meaning more length bytes
+   follow), the literals, then a two byte little-endian offset back to the match. The last
+   sequence has literals only.
+*/
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+
+/** Shortest match the codec encodes */
+#define LZ_MIN_MATCH 4
+/** Farthest back a match may be */
+#define LZ_MAX_OFFSET 65535
+
+/**
+   Compresses bytes.
+   @param source is the bytes to compress.
+   @param length is the number of bytes to compress.
+   @param destination is where compressed bytes are stored.
+   @param capacity is the size of destination.
+   @return is the number of compressed bytes, or 0 if they did not fit in capacity. A capacity
+           smaller than length asks for compression that saves space or nothing.
+*/
+size_t lz_compress( const char *source, size_t length, char *destination, size_t capacity );
+
+/**
+   Decompresses bytes. Every length and offset is checked, so damaged input fails rather than
+   reading or writing out of bounds.
+   @param source is the compressed bytes.
+   @param length is the number of compressed bytes.
+   @param destination is where decompressed bytes are stored.
+   @param capacity is the number of bytes the input decompresses to.
+   @return is the number of bytes decompressed, or -1 if the input is damaged.
+*/
+long lz_decompress( const char *source, size_t length, char *destination, size_t capacity );
+
+#endif //LZ_H
@@ -4,12 +4,67 @@
    @author Teaching Staff
    Continuously loops while taking user input for commands. Commands are entered to the terminal
    and are then processed by parser.c. After being parsed, the commands are executed if possible.
+   Started with "--serve <socket-path>", commands are instead taken from clients of a Unix domain
+   socket and run on a pool of worker threads (see server.c).
 */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include "parser.h"
 #include "database.h"
+#include "due.h"
+#include "foreign.h"
+#include "partition.h"
+#include "scan.h"
+#include "server.h"
+#include "sink.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "storage.h"
+#include "trace.h"
+#include "txn.h"
+#include "view.h"
+#include "waitlist.h"
+
+/**
+   Stages a change if a transaction is open. A partitioned table's changes can move rows between
+   its files, which a transaction's one rewrite per table cannot, so they are rejected instead, as
+   are rows whose foreign keys name no row of their parent or of the transaction's inserts.
+   Returns false if there is no transaction and the change is to be made now.
+*/
+static bool staged( ChangeType type, const Query *query, const char *attributes ) {
+    if ( !in_transaction() ) {
+        return false;
+    }
+    char row[MAX_STR_LENGTH];
+    snprintf( row, sizeof( row ), "%s%s%s", query->table_row, attributes != NULL ? " " : "",
+              attributes != NULL ? attributes : "" );
+    if ( is_partitioned( query->table_name ) ) {
+        out_printf( "Partitioned table %s can not be changed in a transaction!\n",
+                    query->table_name );
+    }
+    else if ( type != CHANGE_DELETE && !foreign_keys_met( query->table_name, row, true ) ) {
+        out_printf( "Change not staged!\n" );
+    }
+    else {
+        stage_change( type, query->table_name, query->table_row, attributes );
+    }
+    return true;
+}
+
+/**
+   Refuses a query on the waitlist table once its rows are kept in the queues, which the table no
+   longer matches. Returns false if the query is to be run.
+*/
+static bool queued( const Query *query ) {
+    if ( !waitlist_queued( query->table_name ) ) {
+        return false;
+    }
+    out_printf( "The waitlist is kept in its queues: use enqueue, peek, dequeue or leave!\n" );
+    return true;
+}
 
 /**
    The execute_query takes a parsed query as input and execute the specific function based on the
@@ -17,30 +72,63 @@
    EXIT_FAILURE otherwise. See parser.h for detail about the Query objects. 
 */
 int execute_query( Query query ){
+    uint64_t start = stats_clock();
+    const char *name = query_type_name( query.type );
+    trace_begin( name );
+    int status = EXIT_SUCCESS;
     switch ( query.type ) {
         case CREATE_TABLE:
-            create_table( query.table_name );
+            if ( query.set_clause[0] != '\0' ) {
+                create_partitioned_table( query.table_name, query.set_clause );
+            }
+            else {
+                create_table( query.table_name );
+            }
             break;
             
         case INSERT:
-            insert_into_table( query.table_name, query.table_row );
+            if ( !queued( &query ) && !staged( CHANGE_INSERT, &query, NULL ) ) {
+                insert_into_table( query.table_name, query.table_row );
+            }
             break;
             
         case SELECT:
-            select_from_table( query.table_name, query.condition_variable, query.condition_type,
-                               query.condition_value );
+            if ( queued( &query ) ) {
+                status = EXIT_FAILURE;
+            }
+            else if ( query.explain != EXPLAIN_NONE ) {
+                explain_select( query.table_name, query.columns, query.condition_variable,
+                                query.condition_type, query.condition_value,
+                                query.explain == EXPLAIN_ANALYZE );
+            }
+            else {
+                select_from_table( query.table_name, query.columns, query.condition_variable,
+                                   query.condition_type, query.condition_value );
+            }
             break;
             
         case UPDATE:  
-            update( query.table_name, query.table_row, query.set_clause );
+            if ( !queued( &query ) && !staged( CHANGE_UPDATE, &query, query.set_clause ) ) {
+                update( query.table_name, query.table_row, query.set_clause );
+            }
             break;
             
         case DELETE:
-            delete_row( query.table_name, query.table_row );
+            if ( !queued( &query ) && !staged( CHANGE_DELETE, &query, NULL ) ) {
+                delete_row( query.table_name, query.table_row );
+            }
             break;
             
         case DROP:
-            drop_database_file( query.table_name );
+            if ( view_exists( query.table_name ) ) {
+                drop_view( query.table_name );
+            }
+            else {
+                status = drop_database_file( query.table_name );
+                if ( status == EXIT_SUCCESS && strcmp( query.table_name, "waitlist" ) == 0 ) {
+                    drop_waitlist();
+                }
+            }
             break;
             
         case READ_FILE:
@@ -51,52 +139,347 @@ int execute_query( Query query ){
             write_database_file( query.table_name );    //table name is technically just a filename
             break;
             
+        case SNAPSHOT:
+            snapshot_database();
+            break;
+            
+        case COMPRESS:
+            compress_table( query.table_name, true );
+            break;
+            
+        case DECOMPRESS:
+            compress_table( query.table_name, false );
+            break;
+            
+        case BEGIN:
+            begin_transaction();
+            break;
+            
+        case COMMIT:
+            commit_transaction();
+            break;
+            
+        case ROLLBACK:
+            rollback_transaction();
+            break;
+            
+        case STATS:
+            print_stats();
+            break;
+            
+        case RESET_STATS:
+            reset_stats();
+            out_printf( "Statistics reset.\n" );
+            break;
+            
+        case TRACE:
+            if ( strcmp( query.table_name, "on" ) == 0 || strcmp( query.table_name, "off" ) == 0 ) {
+                set_tracing( query.table_name[1] == 'n' );
+                out_printf( "Tracing %s.\n", query.table_name );
+            }
+            else {
+                const char *path = query.table_name[0] != '\0' ? query.table_name
+                                                                : DEFAULT_TRACE_FILE;
+                if ( write_trace( path ) != EXIT_SUCCESS ) {
+                    out_printf( "Unable to write trace to %s\n", path );
+                    status = EXIT_FAILURE;
+                }
+                else {
+                    out_printf( "Trace written to %s\n", path );
+                }
+            }
+            break;
+            
+        case CREATE_FOREIGN_KEY:
+            create_foreign_key( query.set_clause );
+            break;
+
+        case CREATE_VIEW:
+            status = create_view( query.table_name, query.set_clause );
+            break;
+
+        case OVERDUE:
+            status = print_overdue( query.table_name, query.condition_value );
+            break;
+
+        case DUE:
+            status = print_due( query.table_name, atoi( query.set_clause ), query.condition_value );
+            break;
+
+        case ENQUEUE:
+        case PEEK:
+        case DEQUEUE:
+        case LEAVE: {
+            // The queues are not part of a transaction, so a rollback could not undo a change.
+            int book_id = 0, member_id = 0;
+            sscanf( query.table_row, "%d %d", &book_id, &member_id );
+            if ( query.type != PEEK && in_transaction() ) {
+                out_printf( "The waitlist can not be changed in a transaction!\n" );
+                status = EXIT_FAILURE;
+            }
+            else if ( query.type == ENQUEUE ) {
+                char row[MAX_STR_LENGTH];
+                snprintf( row, sizeof( row ), "%d %d", book_id, member_id );
+                status = foreign_keys_met( "waitlist", row, true )
+                         ? enqueue_waitlist( book_id, member_id ) : EXIT_FAILURE;
+            }
+            else if ( query.type == PEEK ) {
+                status = peek_waitlist( book_id );
+            }
+            else if ( query.type == DEQUEUE ) {
+                status = dequeue_waitlist( book_id );
+            }
+            else {
+                status = leave_waitlist( book_id, member_id );
+            }
+            break;
+        }
+
         case HELP:
             break;
             
         default:
-            printf( "Unrecognized query.\n" );
-            return EXIT_FAILURE;
+            out_printf( "Unrecognized query.\n" );
+            status = EXIT_FAILURE;
+            break;
     }
-    return EXIT_SUCCESS;
+    trace_end( name );
+    stats_query( query.type, start );
+    return status;
+}
+
+/**
+   Parses a command, timing it as the parse phase.
+   @param command is the command line.
+   @return is the parsed query.
+*/
+static Query parse_command( const char *command ) {
+    uint64_t start = stats_clock();
+    trace_begin( "parse" );
+    Query query = parse_query( command );
+    trace_end( "parse" );
+    stats_phase( PHASE_PARSE, start );
+    return query;
 }
 
 
 /**
-   The main fuction takes user input in natural language, parse the input into command or database 
-   query, and then execute the query. THe main function do this repeatedly until an exit command
-   is executed.
-   @return is exit status.
+   Parses and executes a single command for a server client. Output goes to the client's sink.
+   @param command is the command line entered by the client.
+*/
+static void run_command( const char *command ) {
+    Query query = parse_command( command );
+    execute_query( query );
+}
+
+/** Number of consecutive inserts into one table written as a single append in batch mode */
+#define BATCH_ROWS 4096
+
+/** An InsertBatch is consecutive inserts into one table waiting to be written together. */
+typedef struct {
+    char table_name[MAX_TABLE_NAME_LENGTH];
+    char *rows[BATCH_ROWS];
+    int count;
+} InsertBatch;
+
+/**
+   Writes a batch's inserts as one append. The append is traced as one insert, and each row is
+   counted as an insert that took an equal share of its time.
+*/
+static void flush_inserts( InsertBatch *batch ) {
+    if ( batch->count == 0 ) {
+        return;
+    }
+    uint64_t start = stats_clock();
+    const char *name = query_type_name( INSERT );
+    trace_begin( name );
+    insert_rows( batch->table_name, ( const char *const * )batch->rows, batch->count );
+    trace_end( name );
+    uint64_t share = ( stats_clock() - start ) / batch->count;
+    for ( int i = 0; i < batch->count; i++ ) {
+        stats_query_time( INSERT, share );
+        free( batch->rows[i] );
+    }
+    batch->count = 0;
+}
+
+/** Adds an insert to a batch, writing the batch first if it is full or for another table. */
+static void batch_insert( InsertBatch *batch, const Query *query ) {
+    if ( batch->count > 0 && ( batch->count == BATCH_ROWS ||
+                               strcmp( batch->table_name, query->table_name ) != 0 ) ) {
+        flush_inserts( batch );
+    }
+    if ( batch->count == 0 ) {
+        strcpy( batch->table_name, query->table_name );
+    }
+    batch->rows[batch->count] = strdup( query->table_row );
+    if ( batch->rows[batch->count] == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    batch->count++;
+}
+
+/**
+   Runs commands read from a file until it ends or "exit" is read. Lines may be any length.
+   Interactively, a prompt is printed before each command and its output is flushed after. In
+   batch mode there are no prompts, blank lines are skipped, output is written only when the
+   output buffer fills, consecutive inserts into one table outside a transaction are written as a
+   single append, commits are synced to the commit log in groups, and the number of commands run
+   per second is printed to stderr at the end.
 */
-int main() {
-    char command[256];  // Buffer to store the command - 256 listed by teaching staff.
+static void run_commands( FILE *input, bool batch ) {
+    InsertBatch *inserts = NULL;
+    if ( batch ) {
+        inserts = ( InsertBatch * )calloc( 1, sizeof( InsertBatch ) );
+        if ( inserts == NULL ) {
+            err_printf( "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+    char *command = NULL;
+    size_t capacity = 0;
+    long count = 0;
+    struct timespec start, end;
+    clock_gettime( CLOCK_MONOTONIC, &start );
 
     while (1) {
-        printf( "cmd> " );  // Display the prompt
-        if ( fgets(command, sizeof(command), stdin) == NULL ) {
-            printf( "\n" );
+        if ( !batch ) {
+            printf( "cmd> " );  // Display the prompt
+        }
+        ssize_t length = getline( &command, &capacity, input );
+        if ( length < 0 ) {
+            if ( !batch ) {
+                printf( "\n" );
+            }
             break;  // Exit on EOF (Ctrl+D)
         }
 
-        // Remove the newline character at the end
-        size_t length = strlen( command );
-        if ( length > 0 && command[length - 1] == '\n' ) {
-            command[length - 1] = '\0';
+        // Remove the line ending
+        while ( length > 0 && ( command[length - 1] == '\n' || command[length - 1] == '\r' ) ) {
+            command[--length] = '\0';
         }
 
         // Exit the shell on "exit" command
         if ( strcmp(command, "exit") == 0 ) {
             break;
         }
+        if ( batch && strspn( command, " \t" ) == ( size_t )length ) {
+            continue;
+        }
 
-        // Parse the command 
-        Query query = parse_query( command );
-
-        // Execute the command 
+        // Parse the command, then execute it (or hold it if it is an insert in a batch)
+        Query query = parse_command( command );
+        count++;
+        if ( batch && query.type == INSERT && !in_transaction() &&
+             !waitlist_queued( query.table_name ) ) {
+            batch_insert( inserts, &query );
+            continue;
+        }
+        if ( batch ) {
+            flush_inserts( inserts );
+        }
         execute_query( query );
-        
-        //printf( "\n" ); ///////// Commented out in order to get test 1 to pass...
+        if ( !batch ) {
+            sink_flush( stdout_sink() );
+        }
+    }
+
+    if ( batch ) {
+        flush_inserts( inserts );
+        sync_log();
+    }
+    sink_flush( stdout_sink() );
+    free( command );
+    free( inserts );
+    if ( batch ) {
+        clock_gettime( CLOCK_MONOTONIC, &end );
+        double seconds = ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) / 1e9;
+        fprintf( stderr, "%ld commands in %.3f seconds, %.0f commands/second\n", count, seconds,
+                 seconds > 0 ? count / seconds : 0.0 );
     }
-    return 0;
 }
 
+/**
+   The main fuction takes user input in natural language, parse the input into command or database 
+   query, and then execute the query. THe main function do this repeatedly until an exit command
+   is executed. With "--serve <socket-path> [--workers <count>]" the program serves clients over a
+   Unix domain socket instead, using one worker per processor unless a count is given.
+   "--scan-threads <count>" sets how many threads scan large tables (one per processor by
+   default), "--unordered-scan" lets their rows be printed in the order they are found, and
+   "--no-io-uring" reads and writes tables with plain pread and writev. "--batch <file>" runs the
+   commands in a file without prompts, as is done for stdin when it is not a terminal unless
+   "--interactive" is given. "--trace <file>" traces the whole run and writes the trace to the
+   file at exit.
+   @param argc is number of command line arguments.
+   @param argv is the command line arguments.
+   @return is exit status.
+*/
+int main( int argc, char *argv[] ) {
+    // Check for server mode.
+    const char *socket_path = NULL;
+    int workers = ( int )sysconf( _SC_NPROCESSORS_ONLN );
+    int scan_count = 0;
+    bool ordered = true;
+    const char *batch_path = NULL;
+    bool interactive = false;
+    for ( int i = 1; i < argc; i++ ) {
+        if ( strcmp( argv[i], "--serve" ) == 0 && i + 1 < argc ) {
+            socket_path = argv[++i];
+        }
+        else if ( strcmp( argv[i], "--workers" ) == 0 && i + 1 < argc ) {
+            workers = atoi( argv[++i] );
+        }
+        else if ( strcmp( argv[i], "--scan-threads" ) == 0 && i + 1 < argc ) {
+            scan_count = atoi( argv[++i] );
+        }
+        else if ( strcmp( argv[i], "--unordered-scan" ) == 0 ) {
+            ordered = false;
+        }
+        else if ( strcmp( argv[i], "--no-io-uring" ) == 0 ) {
+            set_io_uring( false );
+        }
+        else if ( strcmp( argv[i], "--batch" ) == 0 && i + 1 < argc ) {
+            batch_path = argv[++i];
+        }
+        else if ( strcmp( argv[i], "--interactive" ) == 0 ) {
+            interactive = true;
+        }
+        else if ( strcmp( argv[i], "--trace" ) == 0 && i + 1 < argc ) {
+            trace_at_exit( argv[++i] );
+        }
+        else {
+            fprintf( stderr, "usage: %s [--serve <socket-path> [--workers <count>]] "
+                     "[--batch <file> | --interactive] [--scan-threads <count>] "
+                     "[--unordered-scan] [--no-io-uring] [--trace <file>]\n", argv[0] );
+            return EXIT_FAILURE;
+        }
+    }
+    set_scan_options( scan_count, ordered );
+    recover_log();
+    if ( socket_path != NULL ) {
+        int status = serve( socket_path, workers, run_command );
+        close_log();
+        finish_tracing();
+        return status;
+    }
+
+    // Commands come from a batch file, or from stdin with prompts unless it is a pipe or file.
+    FILE *input = stdin;
+    if ( batch_path != NULL ) {
+        input = fopen( batch_path, "r" );
+        if ( input == NULL ) {
+            fprintf( stderr, "Unable to open %s\n", batch_path );
+            return EXIT_FAILURE;
+        }
+    }
+    bool batch = batch_path != NULL || ( !interactive && !isatty( STDIN_FILENO ) );
+    set_deferred_sync( batch );
+    run_commands( input, batch );
+    close_log();
+    finish_tracing();
+    if ( input != stdin ) {
+        fclose( input );
+    }
+    return 0;
+}
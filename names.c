@@ -0,0 +1,66 @@
+/**
+   @file names.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for perfect hash tables of names. Names are hashed with FNV-1a started from
+   the table's seed and finished with a multiply, and the top bits of the result pick the slot.
+   A table starts with the smallest power of 2 slots that is at least twice the number of names,
+   and grows if no seed among the first few hundred places every name in a slot of its own.
+*/
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "names.h"
+
+/** Number of seeds tried at each table size before the table is made larger */
+#define SEEDS_PER_SIZE 256
+
+/** Hashes a NUL terminated name with a seed. */
+static uint32_t hash_name( const char *name, uint32_t seed ) {
+    uint32_t hash = 2166136261u ^ seed;
+    for ( const unsigned char *c = ( const unsigned char * )name; *c != '\0'; c++ ) {
+        hash = ( hash ^ *c ) * 16777619u;
+    }
+    hash ^= hash >> 15;
+    return hash * 0x2C1B3C6Du;
+}
+
+/** Tries to place every name with the table's seed. Returns whether none collided. */
+static bool place_names( NameTable *table ) {
+    memset( table->slots, -1, sizeof( table->slots ) );
+    for ( int i = 0; i < table->count; i++ ) {
+        uint32_t slot = hash_name( table->names[i], table->seed ) >> table->shift;
+        if ( table->slots[slot] >= 0 ) {
+            return false;
+        }
+        table->slots[slot] = ( signed char )i;
+    }
+    return true;
+}
+
+/** Builds a table, trying seeds until every name has a slot of its own. */
+void build_name_table( NameTable *table, const char *const *names, int count ) {
+    table->names = names;
+    table->count = count;
+    int bits = 1;
+    while ( ( 1 << bits ) < 2 * count ) {
+        bits++;
+    }
+    for ( ; ( 1 << bits ) <= MAX_NAME_SLOTS; bits++ ) {
+        table->shift = 32 - bits;
+        for ( uint32_t seed = 0; seed < SEEDS_PER_SIZE; seed++ ) {
+            table->seed = seed * 0x9E3779B9u;
+            if ( place_names( table ) ) {
+                return;
+            }
+        }
+    }
+    fprintf( stderr, "Unable to build a name table for %d names\n", count );
+    exit( EXIT_FAILURE );
+}
+
+/** Finds a name with one hash and one comparison. */
+int lookup_name( const NameTable *table, const char *name ) {
+    int position = table->slots[ hash_name( name, table->seed ) >> table->shift ];
+    return position >= 0 && strcmp( table->names[position], name ) == 0 ? position : -1;
+}
@@ -0,0 +1,50 @@
+/**
+   @file names.h
+   @author Michael Warstler (mwwarstl)
+   Header file for perfect hash tables of names. A NameTable maps each of a fixed list of names
+   (command keywords, table names, a table's column names) to its position in the list with one
+   hash and one comparison, instead of comparing against every name in turn. The table is built
+   from the list by trying hash seeds until no two names land in the same slot, which for lists of
+   a few dozen names takes a handful of tries. Each list is built once, the first time it is used,
+   and is read-only after that, so any thread may look names up without locking.
+*/
+#ifndef NAMES_H
+#define NAMES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Most slots a name table may have, which limits a list to half as many names */
+#define MAX_NAME_SLOTS 128
+
+/**
+   A NameTable holds a list of names and the slot of each, found by hashing a name with the
+   table's seed and keeping the top bits. Each slot holds the position of the name that hashes
+   to it, or -1.
+*/
+typedef struct {
+    const char *const *names;
+    int count;
+    uint32_t seed;
+    int shift;
+    signed char slots[MAX_NAME_SLOTS];
+} NameTable;
+
+/**
+   Builds a perfect hash table for a list of distinct names. Exits if the names cannot be placed,
+   which only happens if a name is listed twice or the list has more than MAX_NAME_SLOTS / 2.
+   @param table is the table to build.
+   @param names is the names, which must outlive the table.
+   @param count is the number of names.
+*/
+void build_name_table( NameTable *table, const char *const *names, int count );
+
+/**
+   Finds a name's position in a table's list.
+   @param table is the table to search.
+   @param name is the NUL terminated name to find.
+   @return is the name's position in the list, or -1 if it is not in the list.
+*/
+int lookup_name( const NameTable *table, const char *name );
+
+#endif //NAMES_H
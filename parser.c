@@ -9,7 +9,60 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "names.h"
 #include "parser.h"
+#include "sink.h"
+
+/** Marks the explain keyword, which is not a query type of its own */
+#define EXPLAIN_KEYWORD -1
+
+/** Keywords a command can start with */
+static const char *const keywords[] = {
+    "create_table", "insert", "select", "update", "delete", "read_file", "write_file", "drop",
+    "snapshot", "compress", "decompress", "begin", "commit", "rollback", "stats", "trace",
+    "create", "overdue", "due", "enqueue", "peek", "dequeue", "leave", "explain", "help"
+};
+
+/** The query type each keyword starts */
+static const int keyword_types[] = {
+    CREATE_TABLE, INSERT, SELECT, UPDATE, DELETE, READ_FILE, WRITE_FILE, DROP,
+    SNAPSHOT, COMPRESS, DECOMPRESS, BEGIN, COMMIT, ROLLBACK, STATS, TRACE,
+    CREATE_VIEW, OVERDUE, DUE, ENQUEUE, PEEK, DEQUEUE, LEAVE, EXPLAIN_KEYWORD, HELP
+};
+
+_Static_assert( sizeof( keywords ) / sizeof( keywords[0] ) ==
+                sizeof( keyword_types ) / sizeof( keyword_types[0] ),
+                "every keyword needs a query type" );
+
+/** Perfect hash table of the keywords, built the first time a query is parsed */
+static NameTable keyword_lookup;
+static pthread_once_t keyword_once = PTHREAD_ONCE_INIT;
+
+/** Builds the keyword table. */
+static void build_keywords( void ) {
+    build_name_table( &keyword_lookup, keywords, sizeof( keywords ) / sizeof( keywords[0] ) );
+}
+
+/**
+   Finds a keyword that appears as a whole word in text.
+   @param text is the string to search.
+   @param keyword is the word to find.
+   @return is pointer to the start of the keyword in text, or NULL if it is not found.
+*/
+static char *find_keyword( char *text, const char *keyword ) {
+    size_t length = strlen( keyword );
+    for ( char *found = strstr( text, keyword ); found != NULL; found = strstr( found + 1, keyword ) ) {
+        bool starts_word = found == text || found[-1] == ' ' || found[-1] == '\t';
+        bool ends_word = found[length] == '\0' || found[length] == ' ' || found[length] == '\t' ||
+                         found[length] == '\n';
+        if ( starts_word && ends_word ) {
+            return found;
+        }
+    }
+    return NULL;
+}
 
 /**
    This function receives a query string, parse it into some information fields 
@@ -17,81 +70,106 @@
    to call necessary function to do the job asked in the query string. 
 */
 Query parse_query( const char *query_string ) {
-    Query parsed_query;
-    parsed_query.type = INVALID_QUERY;
+    // Every field starts empty, so nothing is left over from the query parsed before.
+    Query parsed_query = { .type = INVALID_QUERY, .explain = EXPLAIN_NONE };
 
     // make a copy of the query string
     char *query_copy = (char *) strdup(query_string);
     if ( query_copy == NULL ) {
-        fprintf( stderr, "Memory allocation error\n" );
+        err_printf( "Memory allocation error\n" );
         exit( EXIT_FAILURE );
     }
 
-    // Tokenize the string
-    char *token = strtok( query_copy, " \t\n" );
+    // Tokenize the string. strtok_r keeps its place in save, so queries can be parsed by several
+    // threads at once.
+    char *save;
+    char *token = strtok_r( query_copy, " \t\n", &save );
     if ( token == NULL ) {
-        fprintf( stderr, "Empty query\n" );
+        err_printf( "Empty query\n" );
         free( query_copy) ;
         exit( EXIT_FAILURE );
     }
 
-    // find type of query 
-    if ( strcmp(token, "create_table") == 0 ) {
-        parsed_query.type = CREATE_TABLE;
-    } 
-    else if ( strcmp(token, "insert") == 0 ) {
-        parsed_query.type = INSERT;
-    } 
-    else if ( strcmp(token, "select") == 0 ) {
-        parsed_query.type = SELECT;
-    } 
-    else if ( strcmp(token, "update") == 0 ) {
-        parsed_query.type = UPDATE;
-    } 
-    else if ( strcmp(token, "delete") == 0 ) {
-        parsed_query.type = DELETE;
-    } 
-    else if ( strcmp(token, "read_file") == 0 ) {
-        parsed_query.type = READ_FILE;
-    } 
-    else if ( strcmp(token, "write_file") == 0 ) {
-        parsed_query.type = WRITE_FILE;
-    } 
-    else if ( strcmp(token, "drop") == 0 ) {
-        parsed_query.type = DROP;
+    // find type of query with one lookup in the keyword table
+    pthread_once( &keyword_once, build_keywords );
+    int keyword = lookup_name( &keyword_lookup, token );
+    int type = keyword >= 0 ? keyword_types[keyword] : INVALID_QUERY;
+    if ( type == EXPLAIN_KEYWORD ) {
+        // "explain [analyze] <select>" parses the select after it and marks it to be explained.
+        ExplainMode mode = EXPLAIN_PLAN;
+        token = strtok_r( NULL, " \t\n", &save );
+        if ( token != NULL && strcmp( token, "analyze" ) == 0 ) {
+            mode = EXPLAIN_ANALYZE;
+            token = strtok_r( NULL, " \t\n", &save );
+        }
+        if ( token == NULL ) {
+            err_printf( "Query to explain missing\n" );
+            free( query_copy );
+            return parsed_query;
+        }
+        parsed_query = parse_query( query_string + ( token - query_copy ) );
+        free( query_copy );
+        if ( parsed_query.type != SELECT ) {
+            if ( parsed_query.type != INVALID_QUERY ) {
+                err_printf( "Only select queries can be explained\n" );
+            }
+            parsed_query.type = INVALID_QUERY;
+            return parsed_query;
+        }
+        parsed_query.explain = mode;
+        return parsed_query;
     }
-    else if ( strcmp(token, "help") == 0 ) {
-        parsed_query.type = HELP;
-    } 
-    else {
-        fprintf( stderr, "Invalid query type\n" );
+    else if ( type == INVALID_QUERY ) {
+        err_printf( "Invalid query type\n" );
         free( query_copy );
         return parsed_query;
     }
+    parsed_query.type = ( QueryType )type;
 
     // Based on the query type, parse rest of the string
     switch ( parsed_query.type ) {
         case HELP:
             // Print out commands possible.
-            printf( "Following are the valid query commands: \n" );
-            printf( "help                             \n" );
-            printf( "create_table [table_name]        \n" );
-            printf( "insert [table_name] [row Values] \n" );
-            printf( "select [table_name] [condition]  \n" );
-            printf( "delete [table_name] [condition]  \n" );
-            printf( "read_file [table_name]           \n" );
-            printf( "update [row_id] [row Values] \n" );
-            printf( "drop [table_name]                \n" );
-            printf( "write_file [file_name]           " );
+            out_printf( "Following are the valid query commands: \n" );
+            out_printf( "help                             \n" );
+            out_printf( "create_table [table_name]        \n" );
+            out_printf( "create_table [table_name] partition by [day | month | year]([column]) "
+                        "[retain count] [archive count] \n" );
+            out_printf( "insert [table_name] [row Values] \n" );
+            out_printf( "select [table_name] [condition]  \n" );
+            out_printf( "select [columns] from [table_name] where [condition] \n" );
+            out_printf( "delete [table_name] [condition]  \n" );
+            out_printf( "read_file [table_name]           \n" );
+            out_printf( "update [row_id] [row Values] \n" );
+            out_printf( "drop [table_name]                \n" );
+            out_printf( "snapshot                         \n" );
+            out_printf( "compress [table_name]            \n" );
+            out_printf( "decompress [table_name]          \n" );
+            out_printf( "begin                            \n" );
+            out_printf( "commit                           \n" );
+            out_printf( "rollback                         \n" );
+            out_printf( "stats [reset]                    \n" );
+            out_printf( "explain [analyze] [select query] \n" );
+            out_printf( "trace [on | off | file_name]     \n" );
+            out_printf( "create view [view_name] as [select query] [group by column] \n" );
+            out_printf( "create foreign key [table_name].[column] -> [table_name].id \n" );
+            out_printf( "overdue [table_name] [date]      \n" );
+            out_printf( "due [table_name] [days] [date]   \n" );
+            out_printf( "enqueue [book_id] [member_id]    \n" );
+            out_printf( "peek [book_id]                   \n" );
+            out_printf( "dequeue [book_id]                \n" );
+            out_printf( "leave [book_id] [member_id]      \n" );
+            out_printf( "write_file [file_name]           " );
 
             parsed_query.type = HELP;
+            free( query_copy );
             return parsed_query;
             
         case CREATE_TABLE:
         	// Parse table name
-            token = strtok(NULL, " \t\n");
+            token = strtok_r( NULL, " \t\n", &save );
             if ( token == NULL ) {
-                fprintf( stderr, "Table name missing\n" );
+                err_printf( "Table name missing\n" );
                 free( query_copy );
                 parsed_query.type = INVALID_QUERY;
                 return parsed_query;
@@ -99,13 +177,31 @@ Query parse_query( const char *query_string ) {
             strncpy( parsed_query.table_name, token, MAX_TABLE_NAME_LENGTH - 1 );
             parsed_query.table_name[MAX_TABLE_NAME_LENGTH - 1] = '\0';
 
+            // "partition by [unit]([column]) [retain count]" is kept in set_clause.
+            token = strtok_r( NULL, " \t\n", &save );
+            if ( token != NULL ) {
+                char *by = strtok_r( NULL, " \t\n", &save );
+                char *partitioning = by != NULL ? strtok_r( NULL, "\n", &save ) : NULL;
+                if ( strcmp( token, "partition" ) != 0 || by == NULL || strcmp( by, "by" ) != 0 ||
+                     partitioning == NULL ) {
+                    err_printf( "Expected partition by [unit]([column]) after the table name\n" );
+                    free( query_copy );
+                    parsed_query.type = INVALID_QUERY;
+                    return parsed_query;
+                }
+                partitioning += strspn( partitioning, " \t" );
+                strncpy( parsed_query.set_clause, partitioning, MAX_SET_CLAUSE_LENGTH - 1 );
+                parsed_query.set_clause[MAX_SET_CLAUSE_LENGTH - 1] = '\0';
+            }
+
+            free( query_copy );
             return parsed_query;
 
         case INSERT:
         	// Parse table name
-            token = strtok( NULL, " \t\n" );
+            token = strtok_r( NULL, " \t\n", &save );
             if ( token == NULL ) {
-                fprintf( stderr, "Table name missing\n" );
+                err_printf( "Table name missing\n" );
                 free( query_copy );
                 parsed_query.type = INVALID_QUERY;
                 return parsed_query;
@@ -114,9 +210,15 @@ Query parse_query( const char *query_string ) {
             parsed_query.table_name[MAX_TABLE_NAME_LENGTH - 1] = '\0';
             
             // Parse row values
-            token = strtok( NULL, "" );
+            token = strtok_r( NULL, "", &save );
             if ( token == NULL ) {
-                fprintf( stderr, "Row values missing\n" );
+                err_printf( "Row values missing\n" );
+                free( query_copy );
+                parsed_query.type = INVALID_QUERY;
+                return parsed_query;
+            }
+            if ( strlen( token ) >= MAX_TABLE_VALUE_LENGTH ) {
+                err_printf( "Row values too long\n" );
                 free( query_copy );
                 parsed_query.type = INVALID_QUERY;
                 return parsed_query;
@@ -124,14 +226,55 @@ Query parse_query( const char *query_string ) {
             strncpy( parsed_query.table_row, token, MAX_TABLE_VALUE_LENGTH - 1 );
             parsed_query.table_row[MAX_TABLE_VALUE_LENGTH - 1] = '\0';
 
+            free( query_copy );
             return parsed_query;
         	break;
 
         case SELECT:
+            // A select either lists columns, "select [columns] from [table_name] where [condition]",
+            // or prints every column, "select [table_name] [condition]".
+            parsed_query.columns[0] = '\0';
+            parsed_query.condition_variable[0] = '\0';
+            parsed_query.condition_type[0] = '\0';
+            parsed_query.condition_value[0] = '\0';
+            
+            // The rest of the copy after "select" is untouched by strtok_r so far.
+            char *rest = token + strlen( token );
+            if ( rest < query_copy + strlen( query_string ) ) {
+                rest++;
+            }
+            char *from = find_keyword( rest, "from" );
+            char *equals = strstr( rest, "==" );
+            char *not_equals = strstr( rest, "!=" );
+            if ( from != NULL && ( equals == NULL || from < equals ) &&
+                 ( not_equals == NULL || from < not_equals ) ) {
+                // Copy the column list without surrounding spaces.
+                char *end = from;
+                while ( end > rest && ( end[-1] == ' ' || end[-1] == '\t' ) ) {
+                    end--;
+                }
+                while ( rest < end && ( *rest == ' ' || *rest == '\t' ) ) {
+                    rest++;
+                }
+                size_t length = end - rest;
+                if ( length == 0 || length >= MAX_COLUMNS_LENGTH ) {
+                    err_printf( "Columns missing\n" );
+                    free( query_copy );
+                    parsed_query.type = INVALID_QUERY;
+                    return parsed_query;
+                }
+                memcpy( parsed_query.columns, rest, length );
+                parsed_query.columns[length] = '\0';
+                token = strtok_r( from + strlen( "from" ), " \t\n", &save );
+            }
+            else {
+                from = NULL;
+                token = strtok_r( rest, " \t\n", &save );
+            }
+
             // Parse table name
-            token = strtok( NULL, " \t\n" );
             if ( token == NULL ) {
-                fprintf( stderr, "Table name missing\n" );
+                err_printf( "Table name missing\n" );
                 free( query_copy );
                 parsed_query.type = INVALID_QUERY;
                 return parsed_query;
@@ -139,10 +282,25 @@ Query parse_query( const char *query_string ) {
             strncpy( parsed_query.table_name, token, MAX_TABLE_NAME_LENGTH - 1 );
             parsed_query.table_name[MAX_TABLE_NAME_LENGTH - 1] = '\0';
 
+            // Listing columns makes the where clause optional, every row is selected without it.
+            token = strtok_r( NULL, " \t\n", &save );
+            if ( from != NULL ) {
+                if ( token == NULL ) {
+                    free( query_copy );
+                    return parsed_query;
+                }
+                if ( strcmp( token, "where" ) != 0 ) {
+                    err_printf( "Conditions missing\n" );
+                    free( query_copy );
+                    parsed_query.type = INVALID_QUERY;
+                    return parsed_query;
+                }
+                token = strtok_r( NULL, " \t\n", &save );
+            }
+
             // Parse query condition (any column name from the table) 
-            token = strtok( NULL, " \t\n" );
             if ( token == NULL ) {
-                fprintf( stderr, "Conditions missing\n" );
+                err_printf( "Conditions missing\n" );
                 free( query_copy );
                 parsed_query.type = INVALID_QUERY;
                 return parsed_query;
@@ -151,9 +309,9 @@ Query parse_query( const char *query_string ) {
             parsed_query.condition_variable[MAX_CONDITIONS_LENGTH - 1] = '\0';
             
             // Parse condition type (== or !=)
-            token = strtok( NULL, " \t\n" );
+            token = strtok_r( NULL, " \t\n", &save );
             if ( token == NULL ) {
-                fprintf( stderr, "Conditions incomplete\n" );
+                err_printf( "Conditions incomplete\n" );
                 free( query_copy );
                 parsed_query.type = INVALID_QUERY;
                 return parsed_query;
@@ -162,9 +320,9 @@ Query parse_query( const char *query_string ) {
             parsed_query.condition_type[MAX_CONDITIONS_LENGTH - 1] = '\0';
             
             // Parse condition value.
-            token = strtok( NULL, "\t\n" );
+            token = strtok_r( NULL, "\t\n", &save );
             if ( token == NULL ) {
-                fprintf( stderr, "Conditions incomplete\n" );
+                err_printf( "Conditions incomplete\n" );
                 free( query_copy );
                 parsed_query.type = INVALID_QUERY;
                 return parsed_query;
@@ -172,14 +330,15 @@ Query parse_query( const char *query_string ) {
             strncpy( parsed_query.condition_value, token, MAX_CONDITIONS_LENGTH - 1 );
             parsed_query.condition_value[MAX_CONDITIONS_LENGTH - 1] = '\0';
 
+            free( query_copy );
             return parsed_query;
             break;
 
         case DELETE:
         	 // Parse table name
-            token = strtok( NULL, " \t\n" );
+            token = strtok_r( NULL, " \t\n", &save );
             if ( token == NULL ) {
-                fprintf( stderr, "Table name missing\n" );
+                err_printf( "Table name missing\n" );
                 free( query_copy );
                 parsed_query.type = INVALID_QUERY;
                 return parsed_query;
@@ -188,9 +347,9 @@ Query parse_query( const char *query_string ) {
             parsed_query.table_name[MAX_TABLE_NAME_LENGTH - 1] = '\0';
             
             // Parse row values - should only be an id value.
-            token = strtok( NULL, " \t\n" );
+            token = strtok_r( NULL, " \t\n", &save );
             if ( token == NULL ) {
-                fprintf( stderr, "Record id not found!\n" );
+                err_printf( "Record id not found!\n" );
                 free( query_copy );
                 parsed_query.type = INVALID_QUERY;
                 return parsed_query;
@@ -199,14 +358,15 @@ Query parse_query( const char *query_string ) {
             parsed_query.table_row[MAX_TABLE_VALUE_LENGTH - 1] = '\0';
             
 
+            free( query_copy );
             return parsed_query;
             break;
 
         case UPDATE:
         	// Parse table name
-            token = strtok( NULL, " \t\n" );
+            token = strtok_r( NULL, " \t\n", &save );
             if ( token == NULL ) {
-                fprintf( stderr, "Table name missing\n" );
+                err_printf( "Table name missing\n" );
                 free( query_copy );
                 parsed_query.type = INVALID_QUERY;
                 return parsed_query;
@@ -215,9 +375,9 @@ Query parse_query( const char *query_string ) {
             parsed_query.table_name[MAX_TABLE_NAME_LENGTH - 1] = '\0';
             
             // Parse row value
-            token = strtok( NULL, " \t\n" );
+            token = strtok_r( NULL, " \t\n", &save );
             if ( token == NULL ) {
-                fprintf( stderr, "Record id not found!\n" );
+                err_printf( "Record id not found!\n" );
                 free( query_copy );
                 parsed_query.type = INVALID_QUERY;
                 return parsed_query;
@@ -226,9 +386,15 @@ Query parse_query( const char *query_string ) {
             parsed_query.table_row[MAX_TABLE_VALUE_LENGTH - 1] = '\0';
 
             // Parse update attributes (set_clause)
-            token = strtok( NULL, "\t\n" );
+            token = strtok_r( NULL, "\t\n", &save );
             if ( token == NULL ) {
-                fprintf( stderr, "Record value not found!\n" );
+                err_printf( "Record value not found!\n" );
+                free( query_copy );
+                parsed_query.type = INVALID_QUERY;
+                return parsed_query;
+            }
+            if ( strlen( token ) >= MAX_SET_CLAUSE_LENGTH ) {
+                err_printf( "Record value too long\n" );
                 free( query_copy );
                 parsed_query.type = INVALID_QUERY;
                 return parsed_query;
@@ -239,9 +405,9 @@ Query parse_query( const char *query_string ) {
             
         case DROP:
             // Parse table name.
-            token = strtok( NULL, " \t\n" );
+            token = strtok_r( NULL, " \t\n", &save );
             if ( token == NULL ) {
-                fprintf( stderr, "Table name missing\n" );
+                err_printf( "Table name missing\n" );
                 free( query_copy );
                 parsed_query.type = INVALID_QUERY;
                 return parsed_query;
@@ -249,14 +415,15 @@ Query parse_query( const char *query_string ) {
             strncpy( parsed_query.table_name, token, MAX_TABLE_NAME_LENGTH - 1 );
             parsed_query.table_name[MAX_TABLE_NAME_LENGTH - 1] = '\0';
 
+            free( query_copy );
             return parsed_query;
             break;
 
         case READ_FILE:
             // Parse table name.
-            token = strtok( NULL, " \t\n" );
+            token = strtok_r( NULL, " \t\n", &save );
             if ( token == NULL ) {
-                fprintf( stderr, "Table name missing\n" );
+                err_printf( "Table name missing\n" );
                 free( query_copy );
                 parsed_query.type = INVALID_QUERY;
                 return parsed_query;
@@ -264,14 +431,15 @@ Query parse_query( const char *query_string ) {
             strncpy( parsed_query.table_name, token, MAX_TABLE_NAME_LENGTH - 1 );
             parsed_query.table_name[MAX_TABLE_NAME_LENGTH - 1] = '\0';
             
+            free( query_copy );
             return parsed_query;
             break;
 
         case WRITE_FILE:
             // Parse table name. - Technically just a "filename" to write to.
-            token = strtok( NULL, " \t\n" );
+            token = strtok_r( NULL, " \t\n", &save );
             if ( token == NULL ) {
-                fprintf( stderr, "Table name missing\n" );
+                err_printf( "Table name missing\n" );
                 free( query_copy );
                 parsed_query.type = INVALID_QUERY;
                 return parsed_query;
@@ -279,12 +447,172 @@ Query parse_query( const char *query_string ) {
             strncpy( parsed_query.table_name, token, MAX_TABLE_NAME_LENGTH - 1 );
             parsed_query.table_name[MAX_TABLE_NAME_LENGTH - 1] = '\0';
 
+            free( query_copy );
             return parsed_query;
             break;
 
+        case SNAPSHOT:
+        case BEGIN:
+        case COMMIT:
+        case ROLLBACK:
+            // Takes no arguments.
+            free( query_copy );
+            return parsed_query;
+
+        case STATS:
+            // "stats reset" clears the statistics instead of printing them.
+            token = strtok_r( NULL, " \t\n", &save );
+            if ( token != NULL ) {
+                if ( strcmp( token, "reset" ) == 0 ) {
+                    parsed_query.type = RESET_STATS;
+                }
+                else {
+                    err_printf( "Invalid stats option\n" );
+                    parsed_query.type = INVALID_QUERY;
+                }
+            }
+            free( query_copy );
+            return parsed_query;
+
+        case TRACE:
+            // "trace on" and "trace off" start and stop tracing, "trace [file_name]" writes the
+            // trace. The argument is kept in table_name, empty for the default file.
+            token = strtok_r( NULL, " \t\n", &save );
+            parsed_query.table_name[0] = '\0';
+            if ( token != NULL ) {
+                strncpy( parsed_query.table_name, token, MAX_TABLE_NAME_LENGTH - 1 );
+                parsed_query.table_name[MAX_TABLE_NAME_LENGTH - 1] = '\0';
+            }
+            free( query_copy );
+            return parsed_query;
+
+        case CREATE_VIEW:
+            // "create view [view_name] as [select query]" keeps the view's name in table_name and
+            // the rest of the query, its definition, in set_clause. "create foreign key
+            // [table].[column] -> [parent].id" keeps the key in set_clause.
+            token = strtok_r( NULL, " \t\n", &save );
+            if ( token != NULL && strcmp( token, "foreign" ) == 0 ) {
+                token = strtok_r( NULL, " \t\n", &save );
+                char *key = token != NULL ? strtok_r( NULL, "\n", &save ) : NULL;
+                if ( token == NULL || strcmp( token, "key" ) != 0 || key == NULL ) {
+                    err_printf( "Foreign key missing\n" );
+                    free( query_copy );
+                    parsed_query.type = INVALID_QUERY;
+                    return parsed_query;
+                }
+                key += strspn( key, " \t" );
+                strncpy( parsed_query.set_clause, key, MAX_SET_CLAUSE_LENGTH - 1 );
+                parsed_query.set_clause[MAX_SET_CLAUSE_LENGTH - 1] = '\0';
+                parsed_query.type = CREATE_FOREIGN_KEY;
+                free( query_copy );
+                return parsed_query;
+            }
+            if ( token == NULL || strcmp( token, "view" ) != 0 ) {
+                err_printf( "Only views and foreign keys can be created this way, use "
+                            "create_table\n" );
+                free( query_copy );
+                parsed_query.type = INVALID_QUERY;
+                return parsed_query;
+            }
+            token = strtok_r( NULL, " \t\n", &save );
+            if ( token == NULL ) {
+                err_printf( "View name missing\n" );
+                free( query_copy );
+                parsed_query.type = INVALID_QUERY;
+                return parsed_query;
+            }
+            strncpy( parsed_query.table_name, token, MAX_TABLE_NAME_LENGTH - 1 );
+            parsed_query.table_name[MAX_TABLE_NAME_LENGTH - 1] = '\0';
+            token = strtok_r( NULL, " \t\n", &save );
+            char *definition = token != NULL ? strtok_r( NULL, "\n", &save ) : NULL;
+            if ( token == NULL || strcmp( token, "as" ) != 0 || definition == NULL ) {
+                err_printf( "View definition missing\n" );
+                free( query_copy );
+                parsed_query.type = INVALID_QUERY;
+                return parsed_query;
+            }
+            definition += strspn( definition, " \t" );
+            strncpy( parsed_query.set_clause, definition, MAX_SET_CLAUSE_LENGTH - 1 );
+            parsed_query.set_clause[MAX_SET_CLAUSE_LENGTH - 1] = '\0';
+            free( query_copy );
+            return parsed_query;
+
+        case OVERDUE:
+        case DUE:
+            // "overdue [table_name] [date]" and "due [table_name] [days] [date]" keep the table
+            // in table_name, the days in set_clause, and the date, empty for today, in
+            // condition_value.
+            token = strtok_r( NULL, " \t\n", &save );
+            if ( token == NULL ) {
+                err_printf( "Table name missing\n" );
+                free( query_copy );
+                parsed_query.type = INVALID_QUERY;
+                return parsed_query;
+            }
+            strncpy( parsed_query.table_name, token, MAX_TABLE_NAME_LENGTH - 1 );
+            parsed_query.table_name[MAX_TABLE_NAME_LENGTH - 1] = '\0';
+            token = strtok_r( NULL, " \t\n", &save );
+            if ( parsed_query.type == DUE ) {
+                if ( token == NULL || token[ strspn( token, "0123456789" ) ] != '\0' ) {
+                    err_printf( "Number of days missing\n" );
+                    free( query_copy );
+                    parsed_query.type = INVALID_QUERY;
+                    return parsed_query;
+                }
+                strncpy( parsed_query.set_clause, token, MAX_SET_CLAUSE_LENGTH - 1 );
+                parsed_query.set_clause[MAX_SET_CLAUSE_LENGTH - 1] = '\0';
+                token = strtok_r( NULL, " \t\n", &save );
+            }
+            parsed_query.condition_value[0] = '\0';
+            if ( token != NULL ) {
+                strncpy( parsed_query.condition_value, token, MAX_CONDITIONS_LENGTH - 1 );
+                parsed_query.condition_value[MAX_CONDITIONS_LENGTH - 1] = '\0';
+            }
+            free( query_copy );
+            return parsed_query;
+
+        case ENQUEUE:
+        case PEEK:
+        case DEQUEUE:
+        case LEAVE:
+            // The waitlist commands take a book id, and enqueue and leave a member id after it.
+            // The ids are kept in table_row as "<book_id> <member_id>".
+            token = strtok_r( NULL, " \t\n", &save );
+            char *member = strtok_r( NULL, " \t\n", &save );
+            bool wants_member = parsed_query.type == ENQUEUE || parsed_query.type == LEAVE;
+            if ( token == NULL || token[ strspn( token, "0123456789" ) ] != '\0' ||
+                 ( wants_member && ( member == NULL ||
+                                     member[ strspn( member, "0123456789" ) ] != '\0' ) ) ) {
+                err_printf( wants_member ? "Book id and member id missing\n"
+                                         : "Book id missing\n" );
+                free( query_copy );
+                parsed_query.type = INVALID_QUERY;
+                return parsed_query;
+            }
+            snprintf( parsed_query.table_row, MAX_TABLE_VALUE_LENGTH, "%s %s", token,
+                      wants_member ? member : "0" );
+            free( query_copy );
+            return parsed_query;
+
+        case COMPRESS:
+        case DECOMPRESS:
+            // Parse table name.
+            token = strtok_r( NULL, " \t\n", &save );
+            if ( token == NULL ) {
+                err_printf( "Table name missing\n" );
+                free( query_copy );
+                parsed_query.type = INVALID_QUERY;
+                return parsed_query;
+            }
+            strncpy( parsed_query.table_name, token, MAX_TABLE_NAME_LENGTH - 1 );
+            parsed_query.table_name[MAX_TABLE_NAME_LENGTH - 1] = '\0';
+
+            free( query_copy );
+            return parsed_query;
+
         default:
             // Should never reach here
-            fprintf( stderr, "Invalid query type\n" );
+            err_printf( "Invalid query type\n" );
             free( query_copy );
             return parsed_query;
     }
@@ -16,9 +16,11 @@
 /** Max number of characters for a condition */
 #define MAX_CONDITIONS_LENGTH 1023
 /** Max number of characters for a set clause */
-#define MAX_SET_CLAUSE_LENGTH 1023
+#define MAX_SET_CLAUSE_LENGTH 2047
 /** Max number of characters for a table's value length */
 #define MAX_TABLE_VALUE_LENGTH 2047
+/** Max number of characters for a list of selected columns */
+#define MAX_COLUMNS_LENGTH 255
 
 /**
    Enumeration values a Query type can be.
@@ -32,21 +34,50 @@ typedef enum {
     DROP,
     READ_FILE,
     WRITE_FILE,
+    SNAPSHOT,
+    COMPRESS,
+    DECOMPRESS,
+    BEGIN,
+    COMMIT,
+    ROLLBACK,
+    STATS,
+    RESET_STATS,
+    TRACE,
+    CREATE_VIEW,
+    OVERDUE,
+    DUE,
+    ENQUEUE,
+    PEEK,
+    DEQUEUE,
+    LEAVE,
+    CREATE_FOREIGN_KEY,
     INVALID_QUERY, 
     HELP
 } QueryType;
 
+/**
+   Whether a query is run, explained, or explained and run (explain and explain analyze).
+*/
+typedef enum {
+    EXPLAIN_NONE,
+    EXPLAIN_PLAN,
+    EXPLAIN_ANALYZE
+} ExplainMode;
+
 /**
    This structure defines datatype for Query. A variable of Query holds necessary information about
    the query. This includes a table's name, a QueryType, condition vartiable, condition type
-   (!= or ==), a condition value, and a table's row.
+   (!= or ==), a condition value, a table's row, the columns a select prints, and whether the
+   query is to be explained.
 */
 typedef struct {
     QueryType type;                             // holds different type of query
+    ExplainMode explain;                        // holds whether to explain the query
     char table_name[MAX_TABLE_NAME_LENGTH];     // holds table name 
+    char columns[MAX_COLUMNS_LENGTH];           // holds columns to select, empty for all
 
     char condition_variable[MAX_CONDITIONS_LENGTH]; // holds condition variable of a query
-    char condition_type[MAX_CONDITIONS_LENGTH];     // holds condition type, either == or !=
+    char condition_type[MAX_CONDITIONS_LENGTH];     // holds condition type: ==, !=, <, <=, > or >=
     char condition_value[MAX_CONDITIONS_LENGTH];    // holds condition value
 
     char set_clause[MAX_SET_CLAUSE_LENGTH];         // researved, you may use to hold any other information
@@ -0,0 +1,584 @@
+/**
+   @file partition.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for partitioned tables. Each partitioned table keeps the keys of its
+   partitions sorted. Keys are zero padded dates, so sorting them as strings sorts them by date,
+   and a condition is turned into the range of keys it can match with a key built from its value.
+   Every partitioned table is guarded by one lock. Whether a partition is an archive follows from
+   its key and the newest key, so it is not saved anywhere.
+*/
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include "database.h"
+#include "partition.h"
+#include "schema.h"
+#include "sink.h"
+
+/** Name of the file partitioning definitions are kept in, inside the tables folder */
+#define PARTITIONS_FILE ".partitions"
+/** Longest partition key, with its NUL */
+#define PARTITION_KEY_LENGTH 16
+
+/** The periods a table can be partitioned by */
+typedef enum {
+    PARTITION_DAY,
+    PARTITION_MONTH,
+    PARTITION_YEAR
+} PartitionUnit;
+
+/** Names of the periods, in PartitionUnit order */
+static const char *const unit_names[] = { "day", "month", "year" };
+
+/** Number of periods */
+#define UNIT_COUNT ( ( int )( sizeof( unit_names ) / sizeof( unit_names[0] ) ) )
+
+/**
+   A Partitioned is a partitioned table: the date column and period it is split by, how many
+   periods it retains and how many it keeps writable (0 for all), and its partitions' keys, sorted.
+*/
+typedef struct Partitioned {
+    char table_name[MAX_TABLE_NAME_LENGTH];
+    const TableSchema *schema;
+    int column;
+    PartitionUnit unit;
+    int retain;
+    int archive;
+    char ( *keys )[PARTITION_KEY_LENGTH];
+    int count;
+    int capacity;
+    struct Partitioned *next;
+} Partitioned;
+
+/** Every partitioned table */
+static Partitioned *partitioned;
+/** Guards every partitioned table */
+static pthread_mutex_t partitions_lock = PTHREAD_MUTEX_INITIALIZER;
+/** Loads the definitions and lists the partitions the first time they are used */
+static pthread_once_t partitions_once = PTHREAD_ONCE_INIT;
+
+/** Finds a partitioned table. Called with the lock held. */
+static Partitioned *find_partitioned( const char *table_name ) {
+    Partitioned *table = partitioned;
+    while ( table != NULL && strcmp( table->table_name, table_name ) != 0 ) {
+        table = table->next;
+    }
+    return table;
+}
+
+/** Builds the key of the partition a date is in. Returns false if the date is not valid. */
+static bool date_key( PartitionUnit unit, const Date *date, char *key ) {
+    if ( date->month < 1 || date->month > 12 || date->day < 1 || date->day > 31 ||
+         date->year < 0 || date->year > 9999 ) {
+        return false;
+    }
+    if ( unit == PARTITION_DAY ) {
+        snprintf( key, PARTITION_KEY_LENGTH, "%04d-%02d-%02d", date->year, date->month,
+                  date->day );
+    }
+    else if ( unit == PARTITION_YEAR ) {
+        snprintf( key, PARTITION_KEY_LENGTH, "%04d", date->year );
+    }
+    else {
+        snprintf( key, PARTITION_KEY_LENGTH, "%04d-%02d", date->year, date->month );
+    }
+    return true;
+}
+
+/** Reads a partition key back into a date. Returns false if it is not a key of the unit. */
+static bool key_date( PartitionUnit unit, const char *key, Date *date ) {
+    char expected[PARTITION_KEY_LENGTH];
+    *date = ( Date ){ 1, 1, 0 };
+    static const int key_fields[] = { 3, 2, 1 };
+    int fields = sscanf( key, "%4d-%2d-%2d", &date->year, &date->month, &date->day );
+    return fields == key_fields[unit] && date_key( unit, date, expected ) &&
+           strcmp( expected, key ) == 0;
+}
+
+/** Numbers periods so that consecutive periods differ by 1. */
+static long period_number( PartitionUnit unit, const Date *date ) {
+    if ( unit == PARTITION_YEAR ) {
+        return date->year;
+    }
+    if ( unit == PARTITION_MONTH ) {
+        return date->year * 12L + date->month - 1;
+    }
+
+    // Days since 1 March of year 0, counting from March so leap days come last.
+    long year = date->year - ( date->month <= 2 );
+    long month = date->month > 2 ? date->month - 3 : date->month + 9;
+    return year * 365 + year / 4 - year / 100 + year / 400 + ( 153 * month + 2 ) / 5 + date->day;
+}
+
+/** Adds a key to a table's sorted keys if it is not there. Called with the lock held. */
+static void insert_key( Partitioned *table, const char *key ) {
+    int at = 0;
+    while ( at < table->count && strcmp( table->keys[at], key ) < 0 ) {
+        at++;
+    }
+    if ( at < table->count && strcmp( table->keys[at], key ) == 0 ) {
+        return;
+    }
+    if ( table->count == table->capacity ) {
+        table->capacity = table->capacity > 0 ? table->capacity * 2 : 16;
+        table->keys = realloc( table->keys, table->capacity * sizeof( *table->keys ) );
+        if ( table->keys == NULL ) {
+            err_printf( "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+    memmove( &table->keys[at + 1], &table->keys[at],
+             ( table->count - at ) * sizeof( *table->keys ) );
+    snprintf( table->keys[at], PARTITION_KEY_LENGTH, "%s", key );
+    table->count++;
+}
+
+/**
+   Reads the options after a definition's column, "[retain <count>] [archive <count>]" in either
+   order. Returns false if they are invalid.
+*/
+static bool parse_options( const char *options, int *retain, int *archive ) {
+    *retain = 0;
+    *archive = 0;
+    char word[MAX_STRING_LENGTH];
+    int count, used;
+    while ( sscanf( options, " %254[a-z] %d%n", word, &count, &used ) == 2 ) {
+        int *option = strcmp( word, "retain" ) == 0 ? retain :
+                      strcmp( word, "archive" ) == 0 ? archive : NULL;
+        if ( option == NULL || *option != 0 || count < 1 ) {
+            return false;
+        }
+        *option = count;
+        options += used;
+    }
+    return options[ strspn( options, " \t" ) ] == '\0';
+}
+
+/**
+   Reads a definition, "<unit>(<column>) [retain <count>] [archive <count>]", into a new
+   partitioned table. Prints why and returns NULL if it is invalid.
+*/
+static Partitioned *parse_definition( const char *table_name, const char *definition ) {
+    const TableSchema *schema = find_table( table_name );
+    char unit[MAX_STRING_LENGTH], column[MAX_STRING_LENGTH];
+    int retain = 0, archive = 0, used = 0;
+    int fields = sscanf( definition, " %254[a-z] ( %254[a-z_] )%n", unit, column, &used );
+    if ( schema == NULL || fields != 2 || used == 0 ||
+         !parse_options( definition + used, &retain, &archive ) ) {
+        out_printf( "Partitioning invalid, use partition by <unit>(<date column>) "
+                    "[retain <count>] [archive <count>]\n" );
+        return NULL;
+    }
+    int unit_index = 0;
+    while ( unit_index < UNIT_COUNT && strcmp( unit_names[unit_index], unit ) != 0 ) {
+        unit_index++;
+    }
+    int column_index = find_column( schema, column );
+    if ( unit_index == UNIT_COUNT || column_index < 0 ||
+         schema->columns[column_index].type != DATE_COLUMN ) {
+        out_printf( "Partitioning invalid, use day, month or year of a date column\n" );
+        return NULL;
+    }
+
+    Partitioned *table = ( Partitioned * )calloc( 1, sizeof( Partitioned ) );
+    if ( table == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    snprintf( table->table_name, sizeof( table->table_name ), "%s", table_name );
+    table->schema = schema;
+    table->column = column_index;
+    table->unit = ( PartitionUnit )unit_index;
+    table->retain = retain;
+    table->archive = archive;
+    return table;
+}
+
+/** Frees a partitioned table. */
+static void free_partitioned( Partitioned *table ) {
+    free( table->keys );
+    free( table );
+}
+
+/** Loads the saved definitions, "<table_name> <definition>" a line, and lists each partition. */
+static void load_partitions( void ) {
+    char path[MAX_STR_LENGTH];
+    snprintf( path, sizeof( path ), "%s/%s", folder, PARTITIONS_FILE );
+    FILE *file = fopen( path, "r" );
+    if ( file == NULL ) {
+        return;
+    }
+    char line[MAX_STR_LENGTH];
+    while ( fgets( line, sizeof( line ), file ) ) {
+        line[ strcspn( line, "\r\n" ) ] = '\0';
+        char *definition = strchr( line, ' ' );
+        if ( definition == NULL ) {
+            continue;
+        }
+        *definition++ = '\0';
+        Partitioned *table = parse_definition( line, definition );
+        if ( table != NULL ) {
+            table->next = partitioned;
+            partitioned = table;
+        }
+    }
+    fclose( file );
+
+    // Partitions are the files named "<table_name>.<key>".
+    DIR *tables = opendir( folder );
+    if ( tables == NULL ) {
+        return;
+    }
+    struct dirent *entry;
+    while ( ( entry = readdir( tables ) ) != NULL ) {
+        char *dot = strchr( entry->d_name, '.' );
+        if ( dot == NULL || dot == entry->d_name ) {
+            continue;
+        }
+        *dot = '\0';
+        Partitioned *table = find_partitioned( entry->d_name );
+        Date date;
+        if ( table != NULL && key_date( table->unit, dot + 1, &date ) ) {
+            insert_key( table, dot + 1 );
+        }
+    }
+    closedir( tables );
+}
+
+/** Writes every definition to the definitions file. Called with the lock held. */
+static int save_partitions( void ) {
+    char path[MAX_STR_LENGTH], temp[MAX_STR_LENGTH];
+    snprintf( path, sizeof( path ), "%s/%s", folder, PARTITIONS_FILE );
+    snprintf( temp, sizeof( temp ), "%s/%s.tmp", folder, PARTITIONS_FILE );
+    FILE *file = fopen( temp, "w" );
+    if ( file == NULL ) {
+        return EXIT_FAILURE;
+    }
+    for ( Partitioned *table = partitioned; table != NULL; table = table->next ) {
+        fprintf( file, "%s %s(%s)", table->table_name, unit_names[table->unit],
+                 table->schema->columns[table->column].name );
+        if ( table->retain > 0 ) {
+            fprintf( file, " retain %d", table->retain );
+        }
+        if ( table->archive > 0 ) {
+            fprintf( file, " archive %d", table->archive );
+        }
+        fputc( '\n', file );
+    }
+    if ( fclose( file ) != 0 || rename( temp, path ) != 0 ) {
+        remove( temp );
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Takes a table off the list of partitioned tables. Called with the lock held. */
+static void unlink_partitioned( const char *table_name ) {
+    Partitioned **link = &partitioned;
+    while ( *link != NULL && strcmp( ( *link )->table_name, table_name ) != 0 ) {
+        link = &( *link )->next;
+    }
+    if ( *link != NULL ) {
+        Partitioned *table = *link;
+        *link = table->next;
+        free_partitioned( table );
+    }
+}
+
+/** Saves how a table is partitioned. */
+int define_partitioning( const char *table_name, const char *definition ) {
+    pthread_once( &partitions_once, load_partitions );
+    Partitioned *table = parse_definition( table_name, definition );
+    if ( table == NULL ) {
+        return EXIT_FAILURE;
+    }
+    pthread_mutex_lock( &partitions_lock );
+    Partitioned *old = find_partitioned( table_name );
+    if ( old != NULL ) {
+        table->keys = old->keys;
+        table->count = old->count;
+        table->capacity = old->capacity;
+        old->keys = NULL;
+    }
+    unlink_partitioned( table_name );
+    table->next = partitioned;
+    partitioned = table;
+    int status = save_partitions();
+    pthread_mutex_unlock( &partitions_lock );
+    return status;
+}
+
+/** Forgets how a table is partitioned. */
+void drop_partitioning( const char *table_name ) {
+    pthread_once( &partitions_once, load_partitions );
+    pthread_mutex_lock( &partitions_lock );
+    if ( find_partitioned( table_name ) != NULL ) {
+        unlink_partitioned( table_name );
+        save_partitions();
+    }
+    pthread_mutex_unlock( &partitions_lock );
+}
+
+/** Checks whether a table is partitioned. */
+bool is_partitioned( const char *table_name ) {
+    pthread_once( &partitions_once, load_partitions );
+    pthread_mutex_lock( &partitions_lock );
+    bool found = find_partitioned( table_name ) != NULL;
+    pthread_mutex_unlock( &partitions_lock );
+    return found;
+}
+
+/** Finds the file a row of a table belongs in. */
+void partition_of_row( const char *table_name, const char *row, char *name, size_t size ) {
+    pthread_once( &partitions_once, load_partitions );
+    snprintf( name, size, "%s", table_name );
+    pthread_mutex_lock( &partitions_lock );
+    Partitioned *table = find_partitioned( table_name );
+    Value values[MAX_COLUMNS];
+    char key[PARTITION_KEY_LENGTH];
+    if ( table != NULL &&
+         decode_row( table->schema, row, row + strcspn( row, "\r\n" ), values,
+                     1u << table->column ) == EXIT_SUCCESS &&
+         date_key( table->unit, &values[table->column].date, key ) ) {
+        snprintf( name, size, "%.200s.%.15s", table_name, key );
+    }
+    pthread_mutex_unlock( &partitions_lock );
+}
+
+/** Finds the table a file belongs to. */
+void table_of_partition( const char *name, char *table_name, size_t size ) {
+    snprintf( table_name, size, "%s", name );
+    char *dot = strchr( table_name, '.' );
+    if ( dot != NULL ) {
+        *dot = '\0';
+        if ( !is_partitioned( table_name ) ) {
+            *dot = '.';
+        }
+    }
+}
+
+/**
+   Checks whether a partition's key can meet a condition whose value's key is operand. starts is
+   true if the value is the first day of its partition, which then holds no earlier dates.
+*/
+static bool key_meets( const char *key, Comparison comparison, const char *operand,
+                       bool starts ) {
+    int order = strcmp( key, operand );
+    switch ( comparison ) {
+        case COMPARE_EQUAL:
+            return order == 0;
+        case COMPARE_LESS:
+            return order < 0 || ( order == 0 && !starts );
+        case COMPARE_LESS_EQUAL:
+            return order <= 0;
+        case COMPARE_GREATER:
+        case COMPARE_GREATER_EQUAL:
+            return order >= 0;
+        case COMPARE_NOT_EQUAL:
+        default:
+            return true;
+    }
+}
+
+/** Finds how many periods before today's a partition is. Called with the lock held. */
+static long periods_ago( const Partitioned *table, const char *key ) {
+    time_t now = time( NULL );
+    struct tm day;
+    localtime_r( &now, &day );
+    Date today = { day.tm_mday, day.tm_mon + 1, day.tm_year + 1900 }, date;
+    key_date( table->unit, key, &date );
+    return period_number( table->unit, &today ) - period_number( table->unit, &date );
+}
+
+/**
+   Lists a table's files, its own first. Partitions whose dates cannot meet a condition on the
+   partition column are left out, as are those past the retention unless expired is true.
+*/
+static void list_files( const char *table_name, const char *condition_var, const char *condition,
+                        const char *condition_val, bool expired, PartitionList *list ) {
+    pthread_once( &partitions_once, load_partitions );
+    pthread_mutex_lock( &partitions_lock );
+    Partitioned *table = find_partitioned( table_name );
+    int count = table != NULL ? table->count : 0;
+    *list = ( PartitionList ){ 0, 0, NULL };
+    list->names = malloc( ( count + 1 ) * sizeof( *list->names ) );
+    if ( list->names == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    snprintf( list->names[list->count++], MAX_TABLE_NAME_LENGTH, "%s", table_name );
+
+    // A condition on the partition column rules out the partitions it cannot match.
+    Comparison comparison = COMPARE_NOT_EQUAL;
+    char operand[PARTITION_KEY_LENGTH] = "";
+    bool starts = false;
+    if ( table != NULL && condition_var[0] != '\0' &&
+         find_column( table->schema, condition_var ) == table->column &&
+         parse_comparison( condition, &comparison ) == EXIT_SUCCESS ) {
+        Value value = { 0 };
+        parse_value( DATE_COLUMN, condition_val, &value );
+        if ( !date_key( table->unit, &value.date, operand ) ) {
+            comparison = COMPARE_NOT_EQUAL;
+        }
+        starts = table->unit == PARTITION_DAY ||
+                 ( value.date.day == 1 &&
+                   ( table->unit == PARTITION_MONTH || value.date.month == 1 ) );
+    }
+    // Partitions past the retention are left out even before their files are removed.
+    for ( int i = 0; i < count; i++ ) {
+        if ( !expired && table->retain > 0 &&
+             periods_ago( table, table->keys[i] ) >= table->retain ) {
+            continue;
+        }
+        list->total++;
+        if ( key_meets( table->keys[i], comparison, operand, starts ) ) {
+            snprintf( list->names[list->count++], MAX_TABLE_NAME_LENGTH, "%.200s.%.15s",
+                      table_name, table->keys[i] );
+        }
+    }
+    pthread_mutex_unlock( &partitions_lock );
+}
+
+/** Lists the files a select reads. */
+void list_partitions( const char *table_name, const char *condition_var, const char *condition,
+                      const char *condition_val, PartitionList *list ) {
+    list_files( table_name, condition_var, condition, condition_val, false, list );
+}
+
+/** Lists every file of a table. */
+void list_partition_files( const char *table_name, PartitionList *list ) {
+    list_files( table_name, "", "", "", true, list );
+}
+
+/** Frees a list of files. */
+void free_partition_list( PartitionList *list ) {
+    free( list->names );
+    list->names = NULL;
+    list->count = 0;
+}
+
+/**
+   Finds how many periods older than its table's newest partition a partition is, given the key of
+   the newest. Called with the lock held.
+*/
+static long periods_behind( const Partitioned *table, const char *key, const char *newest ) {
+    Date date, last;
+    key_date( table->unit, key, &date );
+    key_date( table->unit, newest, &last );
+    return period_number( table->unit, &last ) - period_number( table->unit, &date );
+}
+
+/**
+   Splits a partition's name into its table's name and its key. Returns NULL if it has no key.
+*/
+static const char *split_name( const char *name, char *table_name, size_t size ) {
+    snprintf( table_name, size, "%s", name );
+    char *dot = strchr( table_name, '.' );
+    if ( dot == NULL ) {
+        return NULL;
+    }
+    *dot = '\0';
+    return dot + 1;
+}
+
+/** Checks whether a partition is past its table's retention. */
+bool is_expired( const char *name ) {
+    pthread_once( &partitions_once, load_partitions );
+    char table_name[MAX_TABLE_NAME_LENGTH];
+    const char *key = split_name( name, table_name, sizeof( table_name ) );
+    if ( key == NULL ) {
+        return false;
+    }
+    pthread_mutex_lock( &partitions_lock );
+    Partitioned *table = find_partitioned( table_name );
+    Date date;
+    bool expired = table != NULL && table->retain > 0 && key_date( table->unit, key, &date ) &&
+                   periods_ago( table, key ) >= table->retain;
+    pthread_mutex_unlock( &partitions_lock );
+    return expired;
+}
+
+/** Checks whether a partition is an archive. */
+bool is_archived( const char *name ) {
+    pthread_once( &partitions_once, load_partitions );
+    char table_name[MAX_TABLE_NAME_LENGTH];
+    snprintf( table_name, sizeof( table_name ), "%s", name );
+    char *dot = strchr( table_name, '.' );
+    if ( dot == NULL ) {
+        return false;
+    }
+    *dot = '\0';
+
+    pthread_mutex_lock( &partitions_lock );
+    Partitioned *table = find_partitioned( table_name );
+    Date date;
+    bool archived = table != NULL && table->archive > 0 && table->count > 0 &&
+                    key_date( table->unit, dot + 1, &date ) &&
+                    periods_behind( table, dot + 1, table->keys[table->count - 1] ) >=
+                    table->archive;
+    pthread_mutex_unlock( &partitions_lock );
+    return archived;
+}
+
+/** Allocates a list with room for count names. */
+static void allocate_list( PartitionList *list, int count ) {
+    *list = ( PartitionList ){ 0, 0, malloc( ( count + 1 ) * sizeof( *list->names ) ) };
+    if ( list->names == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+}
+
+/**
+   Records a new partition, takes those no longer retained off its table's list, and lists those
+   that have just become archives.
+*/
+void add_partition( const char *name, PartitionList *expired, PartitionList *archived ) {
+    pthread_once( &partitions_once, load_partitions );
+    *expired = ( PartitionList ){ 0, 0, NULL };
+    *archived = ( PartitionList ){ 0, 0, NULL };
+    char table_name[MAX_TABLE_NAME_LENGTH];
+    snprintf( table_name, sizeof( table_name ), "%s", name );
+    char *dot = strchr( table_name, '.' );
+    if ( dot == NULL ) {
+        return;
+    }
+    *dot = '\0';
+
+    pthread_mutex_lock( &partitions_lock );
+    Partitioned *table = find_partitioned( table_name );
+    Date date;
+    if ( table == NULL || !key_date( table->unit, dot + 1, &date ) ) {
+        pthread_mutex_unlock( &partitions_lock );
+        return;
+    }
+    char newest[PARTITION_KEY_LENGTH] = "";
+    if ( table->count > 0 ) {
+        snprintf( newest, sizeof( newest ), "%s", table->keys[table->count - 1] );
+    }
+    insert_key( table, dot + 1 );
+    const char *last = table->keys[table->count - 1];
+    allocate_list( expired, table->count );
+    allocate_list( archived, table->count );
+
+    // Partitions retain or more periods before today's are no longer kept, and those archive or
+    // more periods older than the newest become archives unless they already were.
+    int kept = 0;
+    for ( int i = 0; i < table->count; i++ ) {
+        long behind = periods_behind( table, table->keys[i], last );
+        if ( table->retain > 0 && periods_ago( table, table->keys[i] ) >= table->retain ) {
+            snprintf( expired->names[expired->count++], MAX_TABLE_NAME_LENGTH, "%.200s.%.15s",
+                      table_name, table->keys[i] );
+            continue;
+        }
+        if ( table->archive > 0 && behind >= table->archive &&
+             ( newest[0] == '\0' || strcmp( table->keys[i], dot + 1 ) == 0 ||
+               periods_behind( table, table->keys[i], newest ) < table->archive ) ) {
+            snprintf( archived->names[archived->count++], MAX_TABLE_NAME_LENGTH, "%.200s.%.15s",
+                      table_name, table->keys[i] );
+        }
+        memmove( table->keys[kept++], table->keys[i], PARTITION_KEY_LENGTH );
+    }
+    table->count = kept;
+    pthread_mutex_unlock( &partitions_lock );
+}
@@ -0,0 +1,127 @@
+/**
+   @file partition.h
+   @author Michael Warstler (mwwarstl)
+   Header file for partitioned tables. A table created with
+   "create_table <table_name> partition by <unit>(<date column>) [retain <count>] [archive <count>]"
+   keeps its rows in one file per day, month or year of the column, named "<table_name>.<key>"
+   with key YYYY-MM-DD, YYYY-MM or YYYY, so a condition on the column reads only the partitions
+   it can match and each insert goes to the partition of its row's date. The table's own file
+   holds any row whose date cannot be read. With retain, only the period of today's date and the
+   count - 1 before it are kept: creating a partition drops every older one, each by removing one
+   file, and rows for older periods are refused. With
+   archive, partitions count or more periods older than the newest are archives: they are
+   compressed when they become one and are only read from after that. Definitions are saved in
+   folder/.partitions; the partitions of a table are found by listing the folder when first used.
+*/
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "parser.h"
+
+/**
+   A PartitionList holds the names of the files a query on a table reads: the table's own first,
+   then its partitions from oldest to newest. total is the number of partitions the table keeps.
+*/
+typedef struct {
+    int count;
+    int total;
+    char ( *names )[MAX_TABLE_NAME_LENGTH];
+} PartitionList;
+
+/**
+   Saves how a table is partitioned. Prints why if the definition is invalid.
+   @param table_name is string name of the table.
+   @param definition is "<unit>(<column>) [retain <count>] [archive <count>]", where unit is day,
+                     month or year and the column is a date.
+   @return is EXIT_FAILURE if the definition is invalid or could not be saved, otherwise
+           EXIT_SUCCESS
+*/
+int define_partitioning( const char *table_name, const char *definition );
+
+/**
+   Forgets how a table is partitioned, and its partitions.
+   @param table_name is string name of the table.
+*/
+void drop_partitioning( const char *table_name );
+
+/**
+   Checks whether a table is partitioned.
+   @param table_name is string name of the table.
+   @return is true if it is.
+*/
+bool is_partitioned( const char *table_name );
+
+/**
+   Finds the file a row of a table belongs in.
+   @param table_name is string name of the table.
+   @param row is the row, newline optional.
+   @param name is where the file's name is stored: the partition of the row's date, or the
+               table's own name if the table is not partitioned or the date cannot be read.
+   @param size is the size of name.
+*/
+void partition_of_row( const char *table_name, const char *row, char *name, size_t size );
+
+/**
+   Finds the table a file belongs to.
+   @param name is string name of a table or one of its partitions.
+   @param table_name is where the table's name is stored.
+   @param size is the size of table_name.
+*/
+void table_of_partition( const char *name, char *table_name, size_t size );
+
+/**
+   Lists the files a select reads. Partitions whose dates cannot meet a condition on the
+   partition column are left out, as are partitions past the table's retention, whose rows are no
+   longer kept even before the next new partition removes their files.
+   @param table_name is string name of the table.
+   @param condition_var is the condition's column, or empty for none.
+   @param condition is the condition's comparison.
+   @param condition_val is the value the column is compared to.
+   @param list is set to the files, to be freed with free_partition_list.
+*/
+void list_partitions( const char *table_name, const char *condition_var, const char *condition,
+                      const char *condition_val, PartitionList *list );
+
+/**
+   Lists every file of a table, its own first, including partitions past its retention.
+   @param table_name is string name of the table.
+   @param list is set to the files, to be freed with free_partition_list.
+*/
+void list_partition_files( const char *table_name, PartitionList *list );
+
+/**
+   Frees a list of files.
+   @param list is the list.
+*/
+void free_partition_list( PartitionList *list );
+
+/**
+   Checks whether a partition is past its table's retention, so its rows are not kept. A
+   partition that does not exist yet is checked as if it did.
+   @param name is string name of the partition.
+   @return is true if it is.
+*/
+bool is_expired( const char *name );
+
+/**
+   Checks whether a partition is an archive, which is read but not changed. A partition that does
+   not exist yet is one if it would be when created.
+   @param name is string name of the partition.
+   @return is true if it is.
+*/
+bool is_archived( const char *name );
+
+/**
+   Records a partition whose file was just created, and takes the partitions its table no longer
+   retains off its list.
+   @param name is string name of the partition.
+   @param expired is set to the partitions that are no longer retained, whose files are to be
+                  removed, to be freed with free_partition_list.
+   @param archived is set to the partitions that have just become archives, whose files are to be
+                   compressed, to be freed with free_partition_list.
+*/
+void add_partition( const char *name, PartitionList *expired, PartitionList *archived );
+
+#endif //PARTITION_H
@@ -0,0 +1,367 @@
+/**
+   @file scan.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for table scans. Scan threads are started the first time a large table is
+   scanned and wait for scans to help with. Each scan gives every thread a contiguous range of
+   morsels, kept as one 64-bit word (next morsel, end) so that the owner taking a morsel and a
+   thief taking half the range are both a single compare-and-swap. The thread that started the
+   scan copies each finished morsel's buffered output to its sink.
+*/
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "block.h"
+#include "scan.h"
+#include "stats.h"
+#include "trace.h"
+
+/** A MorselRange is one thread's range of morsels to scan, on a cache line of its own. */
+typedef struct {
+    _Alignas( 64 ) _Atomic uint64_t range;
+} MorselRange;
+
+/**
+   A Scan holds a table being scanned in parallel: its morsel ranges, the buffered output of each
+   morsel, which morsels are finished (and in what order), and how many threads are working on it.
+   A morsel is a byte range of the table, or one block if the table is compressed (blocks is then
+   the offset of each block).
+*/
+typedef struct Scan {
+    const ScanQuery *query;
+    const char *data;
+    size_t length;
+    const size_t *blocks;
+    uint64_t file_id;
+    int morsel_count;
+    int slots;
+    bool ordered;
+    MorselRange *ranges;
+    Sink *outputs;
+    bool *done;
+    int *finish_order;
+    int finished;
+    int active;
+    bool exhausted;
+    pthread_cond_t changed;
+    struct Scan *next;
+} Scan;
+
+/** The pool of scan threads and the scans they work on, oldest first. */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    Scan *scans;
+    int threads;
+    int started;
+    bool ordered;
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, 0, true };
+
+/** Sets the number of scan threads and whether output keeps file order. */
+void set_scan_options( int threads, bool ordered ) {
+    pthread_mutex_lock( &pool.lock );
+    pool.threads = threads;
+    pool.ordered = ordered;
+    pthread_mutex_unlock( &pool.lock );
+}
+
+/** Returns the number of scan threads, one per core unless set. */
+int scan_threads( void ) {
+    pthread_mutex_lock( &pool.lock );
+    int threads = pool.threads;
+    pthread_mutex_unlock( &pool.lock );
+    if ( threads < 1 ) {
+        long cores = sysconf( _SC_NPROCESSORS_ONLN );
+        threads = cores > 0 ? ( int )cores : 1;
+    }
+    return threads;
+}
+
+/** Decodes a line and checks the condition. */
+bool row_matches( const ScanQuery *query, const char *line, const char *end, Value *row ) {
+    const TableSchema *schema = query->schema;
+    int column = query->condition_column;
+    return decode_row( schema, line, end, row, query->needed ) == EXIT_SUCCESS &&
+           ( column < 0 || value_meets( schema->columns[column].type, &row[column],
+                                        query->comparison, &query->value ) );
+}
+
+/** Scans every line in a range. */
+void scan_lines( const ScanQuery *query, const char *begin, const char *end, Sink *sink ) {
+    const TableSchema *schema = query->schema;
+    Value row[MAX_COLUMNS];
+    uint64_t scanned = 0, matched = 0, format_ns = 0;
+    bool timed = STATS_ENABLED || query->counts != NULL;
+    trace_begin( "filter" );
+    while ( begin < end ) {
+        const char *newline = ( const char * )memchr( begin, '\n', end - begin );
+        const char *line_end = newline != NULL ? newline + 1 : end;
+        scanned++;
+        if ( row_matches( query, begin, line_end, row ) ) {
+            // Timing every row would cost more than formatting it, so only a sample is timed.
+            if ( matched++ % FORMAT_SAMPLE == 0 && timed ) {
+                uint64_t start = monotonic_ns();
+                print_row( sink, schema, row, query->projection );
+                format_ns += ( monotonic_ns() - start ) * FORMAT_SAMPLE;
+            }
+            else {
+                print_row( sink, schema, row, query->projection );
+            }
+        }
+        begin = line_end;
+    }
+    trace_end( "filter" );
+    stats_add( ROWS_SCANNED, scanned );
+    stats_add( ROWS_MATCHED, matched );
+    if ( matched > 0 ) {
+        stats_time( PHASE_FORMAT, format_ns );
+    }
+    if ( query->counts != NULL ) {
+        atomic_fetch_add( &query->counts->scanned, scanned );
+        atomic_fetch_add( &query->counts->matched, matched );
+        atomic_fetch_add( &query->counts->format_ns, format_ns );
+    }
+}
+
+/** Packs a range of morsels into one word. */
+static uint64_t pack_range( uint32_t next, uint32_t end ) {
+    return ( uint64_t )next << 32 | end;
+}
+
+/** Takes the next morsel of a range. Returns false if the range is empty. */
+static bool pop_morsel( MorselRange *slot, int *morsel ) {
+    uint64_t range = atomic_load( &slot->range );
+    while ( true ) {
+        uint32_t next = range >> 32, end = ( uint32_t )range;
+        if ( next >= end ) {
+            return false;
+        }
+        if ( atomic_compare_exchange_weak( &slot->range, &range, pack_range( next + 1, end ) ) ) {
+            *morsel = next;
+            return true;
+        }
+    }
+}
+
+/** Moves the back half of another thread's range to an empty slot. Returns false if none left. */
+static bool steal_morsels( Scan *scan, int home ) {
+    for ( int i = 1; i < scan->slots; i++ ) {
+        MorselRange *victim = &scan->ranges[ ( home + i ) % scan->slots ];
+        uint64_t range = atomic_load( &victim->range );
+        while ( true ) {
+            uint32_t next = range >> 32, end = ( uint32_t )range;
+            if ( next >= end ) {
+                break;
+            }
+            uint32_t take = ( end - next + 1 ) / 2;
+            if ( atomic_compare_exchange_weak( &victim->range, &range,
+                                               pack_range( next, end - take ) ) ) {
+                atomic_store( &scan->ranges[home].range, pack_range( end - take, end ) );
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/** Takes a morsel to scan, stealing when the thread's own range is empty. */
+static bool take_morsel( Scan *scan, int home, int *morsel ) {
+    while ( !pop_morsel( &scan->ranges[home], morsel ) ) {
+        if ( !steal_morsels( scan, home ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/** Scans one block of a compressed table, decoding it through the block cache. */
+static void scan_block( Scan *scan, int morsel, Sink *output ) {
+    size_t offset = scan->blocks[morsel];
+    DecodedBlock block;
+    if ( decode_block( scan->file_id, offset, scan->data + offset, scan->length - offset,
+                       &block ) == EXIT_SUCCESS ) {
+        scan_lines( scan->query, block.data, block.data + block.length, output );
+        release_block( &block );
+    }
+}
+
+/**
+   Scans one morsel into a buffer of its own. A morsel's rows are the lines that start in its
+   byte range, so the last one may run past the end of the range.
+*/
+static void scan_morsel( Scan *scan, int morsel, Sink *output ) {
+    if ( sink_open_memory( output, MORSEL_SIZE / 4 ) != EXIT_SUCCESS ) {
+        fprintf( stderr, "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    if ( scan->blocks != NULL ) {
+        scan_block( scan, morsel, output );
+        return;
+    }
+
+    const char *data = scan->data;
+    size_t start = ( size_t )morsel * MORSEL_SIZE;
+    size_t end = start + MORSEL_SIZE < scan->length ? start + MORSEL_SIZE : scan->length;
+
+    // Skip the line the previous morsel ends with.
+    const char *begin = data + start;
+    if ( start > 0 && data[start - 1] != '\n' ) {
+        const char *newline = ( const char * )memchr( begin, '\n', scan->length - start );
+        begin = newline != NULL ? newline + 1 : data + scan->length;
+    }
+    const char *stop = data + end;
+    if ( begin >= stop ) {
+        stop = begin;
+    }
+    else if ( data[end - 1] != '\n' ) {
+        const char *newline = ( const char * )memchr( stop, '\n', scan->length - end );
+        stop = newline != NULL ? newline + 1 : data + scan->length;
+    }
+    scan_lines( scan->query, begin, stop, output );
+}
+
+/** Scan thread. Helps with the oldest scan that still has morsels to take. */
+static void *scan_thread( void *argument ) {
+    int id = ( int )( intptr_t )argument;
+    pthread_mutex_lock( &pool.lock );
+    while ( true ) {
+        Scan *scan = pool.scans;
+        while ( scan != NULL && scan->exhausted ) {
+            scan = scan->next;
+        }
+        if ( scan == NULL ) {
+            pthread_cond_wait( &pool.ready, &pool.lock );
+            continue;
+        }
+        scan->active++;
+        pthread_mutex_unlock( &pool.lock );
+
+        int home = id % scan->slots;
+        int morsel;
+        while ( take_morsel( scan, home, &morsel ) ) {
+            scan_morsel( scan, morsel, &scan->outputs[morsel] );
+            pthread_mutex_lock( &pool.lock );
+            scan->done[morsel] = true;
+            scan->finish_order[ scan->finished++ ] = morsel;
+            pthread_cond_signal( &scan->changed );
+            pthread_mutex_unlock( &pool.lock );
+        }
+
+        pthread_mutex_lock( &pool.lock );
+        scan->exhausted = true;
+        scan->active--;
+        pthread_cond_signal( &scan->changed );
+    }
+    return NULL;
+}
+
+/** Starts scan threads until the pool has as many as configured. Called with the pool locked. */
+static void start_threads( int threads ) {
+    while ( pool.started < threads ) {
+        pthread_t thread;
+        if ( pthread_create( &thread, NULL, scan_thread, ( void * )( intptr_t )pool.started ) != 0 ) {
+            break;
+        }
+        pthread_detach( thread );
+        pool.started++;
+    }
+}
+
+/** Runs a scan on the scan threads and prints finished morsels from the calling thread. */
+static void run_scan( Scan scan, Sink *sink ) {
+    int threads = scan_threads();
+    pthread_mutex_lock( &pool.lock );
+    start_threads( threads );
+    scan.slots = pool.started;
+    scan.ordered = pool.ordered;
+    pthread_mutex_unlock( &pool.lock );
+    if ( scan.slots == 0 ) {
+        // No threads could be started, so scan each morsel here.
+        Sink output;
+        for ( int morsel = 0; morsel < scan.morsel_count; morsel++ ) {
+            scan_morsel( &scan, morsel, &output );
+            sink_write( sink, output.buffer, output.length );
+            free( output.buffer );
+        }
+        return;
+    }
+
+    scan.ranges = ( MorselRange * )aligned_alloc( _Alignof( MorselRange ),
+                                                  scan.slots * sizeof( MorselRange ) );
+    scan.outputs = ( Sink * )calloc( scan.morsel_count, sizeof( Sink ) );
+    scan.done = ( bool * )calloc( scan.morsel_count, sizeof( bool ) );
+    scan.finish_order = ( int * )calloc( scan.morsel_count, sizeof( int ) );
+    if ( scan.ranges == NULL || scan.outputs == NULL || scan.done == NULL ||
+         scan.finish_order == NULL ) {
+        fprintf( stderr, "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+
+    // Every thread starts with an equal share of the morsels.
+    for ( int i = 0; i < scan.slots; i++ ) {
+        uint32_t next = ( uint64_t )scan.morsel_count * i / scan.slots;
+        uint32_t end = ( uint64_t )scan.morsel_count * ( i + 1 ) / scan.slots;
+        atomic_init( &scan.ranges[i].range, pack_range( next, end ) );
+    }
+    pthread_cond_init( &scan.changed, NULL );
+
+    // Add the scan after any older ones and wake the pool.
+    pthread_mutex_lock( &pool.lock );
+    Scan **last = &pool.scans;
+    while ( *last != NULL ) {
+        last = &( *last )->next;
+    }
+    *last = &scan;
+    pthread_cond_broadcast( &pool.ready );
+
+    // Print each morsel once it is finished, in file order or in the order they finished.
+    for ( int printed = 0; printed < scan.morsel_count; ) {
+        int morsel = scan.ordered ? printed
+                                  : printed < scan.finished ? scan.finish_order[printed] : -1;
+        if ( morsel < 0 || !scan.done[morsel] ) {
+            pthread_cond_wait( &scan.changed, &pool.lock );
+            continue;
+        }
+        pthread_mutex_unlock( &pool.lock );
+        sink_write( sink, scan.outputs[morsel].buffer, scan.outputs[morsel].length );
+        free( scan.outputs[morsel].buffer );
+        pthread_mutex_lock( &pool.lock );
+        printed++;
+    }
+
+    // Take the scan off the list and wait for threads still looking for morsels to leave it.
+    for ( last = &pool.scans; *last != &scan; last = &( *last )->next ) {
+    }
+    *last = scan.next;
+    while ( scan.active > 0 ) {
+        pthread_cond_wait( &scan.changed, &pool.lock );
+    }
+    pthread_mutex_unlock( &pool.lock );
+
+    pthread_cond_destroy( &scan.changed );
+    free( scan.ranges );
+    free( scan.outputs );
+    free( scan.done );
+    free( scan.finish_order );
+}
+
+/** Scans a table on the scan threads, one morsel per byte range. */
+void parallel_scan( const ScanQuery *query, const char *data, size_t length, Sink *sink ) {
+    Scan scan = { .query = query, .data = data, .length = length,
+                  .morsel_count = ( int )( ( length + MORSEL_SIZE - 1 ) / MORSEL_SIZE ) };
+    run_scan( scan, sink );
+}
+
+/** Scans a compressed table on the scan threads, one morsel per block. */
+int parallel_scan_blocks( const ScanQuery *query, const char *data, size_t length, Sink *sink ) {
+    size_t *blocks;
+    int count;
+    if ( index_blocks( data, length, &blocks, &count ) != EXIT_SUCCESS ) {
+        return EXIT_FAILURE;
+    }
+    Scan scan = { .query = query, .data = data, .length = length, .blocks = blocks,
+                  .file_id = block_file_id( data ), .morsel_count = count };
+    run_scan( scan, sink );
+    free( blocks );
+    return EXIT_SUCCESS;
+}
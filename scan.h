@@ -0,0 +1,106 @@
+/**
+   @file scan.h
+   @author Michael Warstler (mwwarstl)
+   Header file for table scans. A scan decodes each line of a table, keeps the rows that meet a
+   select's condition, and prints their selected columns. Large tables are scanned in parallel:
+   the file is split into fixed-size morsels (byte ranges aligned to line boundaries) that a pool
+   of scan threads work through, each thread taking morsels from its own range and stealing half
+   of another thread's range once its own runs out. Every morsel's output is buffered separately
+   and copied to the output sink in file order, or in the order morsels finish if requested.
+   Compressed tables are split into morsels at their blocks instead.
+*/
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "schema.h"
+#include "sink.h"
+
+/** Number of bytes in a morsel */
+#define MORSEL_SIZE ( 256 * 1024 )
+/** Tables smaller than this many bytes are scanned by the calling thread alone */
+#define PARALLEL_SCAN_THRESHOLD ( 1024 * 1024 )
+
+/**
+   A ScanCounts holds what a scan did, for explain analyze. Every thread that scans part of the
+   table adds to it once per morsel.
+*/
+typedef struct {
+    _Atomic uint64_t scanned;
+    _Atomic uint64_t matched;
+    _Atomic uint64_t format_ns;
+} ScanCounts;
+
+/**
+   A ScanQuery holds what a select asks for: the table, which columns are printed, which columns
+   must be decoded, and the condition rows must meet (condition_column is -1 for every row).
+   counts, if not NULL, is added to as the scan goes.
+*/
+typedef struct {
+    const TableSchema *schema;
+    const Projection *projection;
+    unsigned needed;
+    int condition_column;
+    Comparison comparison;
+    Value value;
+    ScanCounts *counts;
+} ScanQuery;
+
+/**
+   Sets how large scans are run. Takes effect for scans started after the call.
+   @param threads is the number of scan threads, or 1 to scan every table on the calling thread.
+   @param ordered is true if rows are printed in file order, false if morsels are printed in the
+                  order they finish.
+*/
+void set_scan_options( int threads, bool ordered );
+
+/**
+   Returns the number of scan threads parallel scans use.
+   @return is the number of scan threads.
+*/
+int scan_threads( void );
+
+/**
+   Decodes a line of a table and checks it against a select's condition.
+   @param query is the select being run.
+   @param line is the start of the line.
+   @param end is the end of the line.
+   @param row is array of MAX_COLUMNS values the needed columns are decoded into.
+   @return is true if the line could be decoded and meets the condition.
+*/
+bool row_matches( const ScanQuery *query, const char *line, const char *end, Value *row );
+
+/**
+   Scans the lines in a range of a table, printing the selected columns of every row that meets
+   the condition. A trailing line without a newline is scanned too.
+   @param query is the select being run.
+   @param begin is the start of the first line.
+   @param end is the end of the range.
+   @param sink is the sink rows are printed to.
+*/
+void scan_lines( const ScanQuery *query, const char *begin, const char *end, Sink *sink );
+
+/**
+   Scans a whole table held in memory on the pool of scan threads.
+   @param query is the select being run.
+   @param data is the table's contents.
+   @param length is the number of bytes in data.
+   @param sink is the sink rows are printed to, only by the calling thread.
+*/
+void parallel_scan( const ScanQuery *query, const char *data, size_t length, Sink *sink );
+
+/**
+   Scans a whole compressed table held in memory on the pool of scan threads, one block per
+   morsel. Each block is decoded by the thread that scans it.
+   @param query is the select being run.
+   @param data is the table file's contents.
+   @param length is the number of bytes in data.
+   @param sink is the sink rows are printed to, only by the calling thread.
+   @return is EXIT_FAILURE if the table is damaged (nothing is printed), otherwise EXIT_SUCCESS
+*/
+int parallel_scan_blocks( const ScanQuery *query, const char *data, size_t length, Sink *sink );
+
+#endif //SCAN_H
@@ -0,0 +1,339 @@
+/**
+   @file schema.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for the table catalog. Lists the columns of each table defined in
+   database.h and handles decoding a row from a table file, comparing column values, and printing
+   the columns of a row that a query selected.
+*/
+#include <pthread.h>
+#include "schema.h"
+#include "fields.h"
+#include "names.h"
+
+/** Every table defined in database.h, columns listed in the order they are stored in a file. */
+static const TableSchema tables[ TABLE_COUNT ] = {
+    { "book", 3, { { "id", INT_COLUMN }, { "title", STRING_COLUMN },
+                   { "category_id", INT_COLUMN } } },
+    { "category", 2, { { "id", INT_COLUMN }, { "name", STRING_COLUMN } } },
+    { "author", 2, { { "id", INT_COLUMN }, { "name", STRING_COLUMN } } },
+    { "book_author", 2, { { "book_id", INT_COLUMN }, { "author_id", INT_COLUMN } } },
+    { "publisher", 2, { { "id", INT_COLUMN }, { "name", STRING_COLUMN } } },
+    { "book_copy", 4, { { "id", INT_COLUMN }, { "book_id", INT_COLUMN },
+                        { "publisher_id", INT_COLUMN }, { "year_published", INT_COLUMN } } },
+    { "member_account", 4, { { "id", INT_COLUMN }, { "first_name", STRING_COLUMN },
+                             { "last_name", STRING_COLUMN }, { "email", STRING_COLUMN } } },
+    { "checkout", 6, { { "id", INT_COLUMN }, { "checkout_date", DATE_COLUMN },
+                       { "return_date", DATE_COLUMN }, { "book_copy_id", INT_COLUMN },
+                       { "member_id", INT_COLUMN }, { "is_returned", BOOL_COLUMN } } },
+    { "hold", 5, { { "id", INT_COLUMN }, { "checkout_date", DATE_COLUMN },
+                   { "return_date", DATE_COLUMN }, { "book_copy_id", INT_COLUMN },
+                   { "member_id", INT_COLUMN } } },
+    { "waitlist", 2, { { "book_id", INT_COLUMN }, { "member_id", INT_COLUMN } } },
+    { "notification", 4, { { "id", INT_COLUMN }, { "sent_at", DATE_COLUMN },
+                            { "member_id", INT_COLUMN }, { "message", STRING_COLUMN } } }
+};
+
+/** Names of the tables and of each table's columns, in catalog order */
+static const char *table_names[ TABLE_COUNT ];
+static const char *column_names[ TABLE_COUNT ][ MAX_COLUMNS ];
+
+/** Perfect hash tables of the table names and of each table's column names */
+static NameTable table_lookup;
+static NameTable column_lookup[ TABLE_COUNT ];
+static pthread_once_t lookup_once = PTHREAD_ONCE_INIT;
+
+/** Builds the name tables from the catalog. */
+static void build_lookups( void ) {
+    for ( int i = 0; i < TABLE_COUNT; i++ ) {
+        table_names[i] = tables[i].name;
+        for ( int j = 0; j < tables[i].column_count; j++ ) {
+            column_names[i][j] = tables[i].columns[j].name;
+        }
+        build_name_table( &column_lookup[i], column_names[i], tables[i].column_count );
+    }
+    build_name_table( &table_lookup, table_names, TABLE_COUNT );
+}
+
+/** Finds a table's schema by name. */
+const TableSchema *find_table( const char *table_name ) {
+    pthread_once( &lookup_once, build_lookups );
+    int table = lookup_name( &table_lookup, table_name );
+    const char *dot = strchr( table_name, '.' );
+    if ( table < 0 && dot != NULL && dot - table_name < MAX_STR_LENGTH ) {
+        char base[MAX_STR_LENGTH];
+        memcpy( base, table_name, dot - table_name );
+        base[dot - table_name] = '\0';
+        table = lookup_name( &table_lookup, base );
+    }
+    return table >= 0 ? &tables[table] : NULL;
+}
+
+/** Finds a column's position in a table by name. */
+int find_column( const TableSchema *schema, const char *column_name ) {
+    pthread_once( &lookup_once, build_lookups );
+    return lookup_name( &column_lookup[ schema - tables ], column_name );
+}
+
+/** Adds a column to the end of a projection. */
+static int add_column( Projection *projection, int column ) {
+    if ( projection->count == MAX_PROJECTION ) {
+        return EXIT_FAILURE;
+    }
+    projection->columns[ projection->count++ ] = column;
+    projection->mask |= 1u << column;
+    return EXIT_SUCCESS;
+}
+
+/** Builds a projection from a comma separated list of column names. */
+int parse_columns( const TableSchema *schema, const char *columns, Projection *projection ) {
+    projection->count = 0;
+    projection->mask = 0;
+
+    // Walk the list one name at a time, ignoring spaces around commas.
+    const char *cursor = columns;
+    while ( *cursor != '\0' ) {
+        while ( *cursor == ' ' || *cursor == ',' ) {
+            cursor++;
+        }
+        const char *end = cursor;
+        while ( *end != '\0' && *end != ' ' && *end != ',' ) {
+            end++;
+        }
+        size_t length = end - cursor;
+        if ( length == 0 ) {
+            break;
+        }
+
+        // "*" selects everything, otherwise the name must be a column of the table.
+        char name[MAX_STR_LENGTH];
+        if ( length >= sizeof( name ) ) {
+            return EXIT_FAILURE;
+        }
+        memcpy( name, cursor, length );
+        name[length] = '\0';
+        if ( strcmp( name, "*" ) == 0 ) {
+            for ( int i = 0; i < schema->column_count; i++ ) {
+                if ( add_column( projection, i ) != EXIT_SUCCESS ) {
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+        else {
+            int column = find_column( schema, name );
+            if ( column < 0 || add_column( projection, column ) != EXIT_SUCCESS ) {
+                return EXIT_FAILURE;
+            }
+        }
+        cursor = end;
+    }
+
+    // No columns listed means every column.
+    if ( projection->count == 0 ) {
+        for ( int i = 0; i < schema->column_count; i++ ) {
+            add_column( projection, i );
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Skips spaces in a line. Returns NULL once the end of the line is reached. */
+static const char *next_field( const char *cursor, const char *end ) {
+    while ( cursor < end && ( *cursor == ' ' || *cursor == '\t' ) ) {
+        cursor++;
+    }
+    if ( cursor == end || *cursor == '\0' || *cursor == '\n' || *cursor == '\r' ) {
+        return NULL;
+    }
+    return cursor;
+}
+
+/** Skips to the end of an unquoted field. */
+static const char *end_of_field( const char *cursor, const char *end ) {
+    while ( cursor < end && *cursor != ' ' && *cursor != '\t' && *cursor != '\n' &&
+            *cursor != '\r' ) {
+        cursor++;
+    }
+    return cursor;
+}
+
+/** Decodes a line from a table file, converting only the needed columns. */
+int decode_row( const TableSchema *schema, const char *line, const char *end, Value *values,
+                unsigned needed ) {
+    const char *cursor = line;
+    for ( int i = 0; i < schema->column_count; i++ ) {
+        cursor = next_field( cursor, end );
+        if ( cursor == NULL ) {
+            // A row missing columns that are never used is still usable.
+            return ( needed >> i ) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        if ( ( ( needed >> i ) & 1 ) == 0 ) {
+            // Skip the field without converting it. Quoted strings may hold spaces.
+            if ( schema->columns[i].type == STRING_COLUMN ) {
+                cursor = slice_string_field( cursor, end, &values[i].text, &values[i].length );
+            }
+            else {
+                cursor = end_of_field( cursor, end );
+            }
+            continue;
+        }
+
+        switch ( schema->columns[i].type ) {
+            case INT_COLUMN:
+                cursor = parse_int_field( cursor, end, &values[i].number );
+                break;
+
+            case BOOL_COLUMN:
+                cursor = parse_int_field( cursor, end, &values[i].number );
+                values[i].number = values[i].number != 0;
+                break;
+
+            case DATE_COLUMN:
+                cursor = parse_date_field( cursor, end, &values[i].date );
+                break;
+
+            case STRING_COLUMN:
+            default:
+                cursor = slice_string_field( cursor, end, &values[i].text, &values[i].length );
+                break;
+        }
+
+        // Anything trailing a number or date belongs to the same field.
+        cursor = end_of_field( cursor, end );
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Converts a user entered condition value for a column type. */
+void parse_value( ColumnType type, const char *text, Value *value ) {
+    const char *end = text + strlen( text );
+    switch ( type ) {
+        case INT_COLUMN:
+            parse_int_field( text, end, &value->number );
+            break;
+
+        case BOOL_COLUMN:
+            // Convert to just 0 or 1 depending on user input
+            parse_int_field( text, end, &value->number );
+            value->number = value->number > 0 ? 1 : 0;
+            break;
+
+        case DATE_COLUMN:
+            parse_date_field( text, end, &value->date );
+            break;
+
+        case STRING_COLUMN:
+        default:
+            value->text = text;
+            value->length = end - text;
+            break;
+    }
+}
+
+/** Compares two values of the same column type. */
+bool values_equal( ColumnType type, const Value *a, const Value *b ) {
+    switch ( type ) {
+        case INT_COLUMN:
+        case BOOL_COLUMN:
+            return a->number == b->number;
+
+        case DATE_COLUMN:
+            return a->date.day == b->date.day && a->date.month == b->date.month &&
+                   a->date.year == b->date.year;
+
+        case STRING_COLUMN:
+        default:
+            return a->length == b->length && memcmp( a->text, b->text, a->length ) == 0;
+    }
+}
+
+/** Orders two values of the same column type. */
+int compare_values( ColumnType type, const Value *a, const Value *b ) {
+    switch ( type ) {
+        case INT_COLUMN:
+        case BOOL_COLUMN:
+            return ( a->number > b->number ) - ( a->number < b->number );
+
+        case DATE_COLUMN:
+            if ( a->date.year != b->date.year ) {
+                return a->date.year < b->date.year ? -1 : 1;
+            }
+            if ( a->date.month != b->date.month ) {
+                return a->date.month < b->date.month ? -1 : 1;
+            }
+            return ( a->date.day > b->date.day ) - ( a->date.day < b->date.day );
+
+        case STRING_COLUMN:
+        default: {
+            int order = memcmp( a->text, b->text, a->length < b->length ? a->length : b->length );
+            return order != 0 ? order : ( a->length > b->length ) - ( a->length < b->length );
+        }
+    }
+}
+
+/** Operators of the comparisons, in Comparison order */
+static const char *const comparison_names[] = { "==", "!=", "<", "<=", ">", ">=" };
+
+/** Reads a comparison operator. */
+int parse_comparison( const char *text, Comparison *comparison ) {
+    for ( int i = 0; i < ( int )( sizeof( comparison_names ) / sizeof( comparison_names[0] ) );
+          i++ ) {
+        if ( strcmp( text, comparison_names[i] ) == 0 ) {
+            *comparison = ( Comparison )i;
+            return EXIT_SUCCESS;
+        }
+    }
+    return EXIT_FAILURE;
+}
+
+/** Gives a comparison's operator. */
+const char *comparison_name( Comparison comparison ) {
+    return comparison_names[comparison];
+}
+
+/** Checks whether a value meets a condition. Equality skips ordering the values. */
+bool value_meets( ColumnType type, const Value *value, Comparison comparison,
+                  const Value *operand ) {
+    switch ( comparison ) {
+        case COMPARE_EQUAL:
+            return values_equal( type, value, operand );
+        case COMPARE_NOT_EQUAL:
+            return !values_equal( type, value, operand );
+        case COMPARE_LESS:
+            return compare_values( type, value, operand ) < 0;
+        case COMPARE_LESS_EQUAL:
+            return compare_values( type, value, operand ) <= 0;
+        case COMPARE_GREATER:
+            return compare_values( type, value, operand ) > 0;
+        case COMPARE_GREATER_EQUAL:
+        default:
+            return compare_values( type, value, operand ) >= 0;
+    }
+}
+
+/** Prints the selected columns of a row. */
+void print_row( Sink *sink, const TableSchema *schema, const Value *values,
+                const Projection *projection ) {
+    for ( int i = 0; i < projection->count; i++ ) {
+        int column = projection->columns[i];
+        if ( i > 0 ) {
+            sink_putc( sink, ' ' );
+        }
+
+        switch ( schema->columns[column].type ) {
+            case INT_COLUMN:
+            case BOOL_COLUMN:
+                sink_int( sink, values[column].number );
+                break;
+
+            case DATE_COLUMN:
+                sink_date( sink, &values[column].date );
+                break;
+
+            case STRING_COLUMN:
+            default:
+                sink_write( sink, values[column].text, values[column].length );
+                break;
+        }
+    }
+    sink_putc( sink, '\n' );
+}
@@ -0,0 +1,182 @@
+/**
+   @file schema.h
+   @author Michael Warstler (mwwarstl)
+   Header file for the table catalog. Describes the columns of every table defined in database.h
+   so that rows can be decoded, compared, and printed one column at a time. Used by select to
+   decode and print only the columns a query asks for.
+*/
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include <stdbool.h>
+#include "database.h"
+#include "sink.h"
+
+/** Max number of columns any table in database.h has */
+#define MAX_COLUMNS 6
+/** Number of tables defined in database.h */
+#define TABLE_COUNT 11
+/** Max number of columns a select may list */
+#define MAX_PROJECTION 16
+
+/**
+   Enumeration of the types a column can be. Matches how each field is written in a table file.
+*/
+typedef enum {
+    INT_COLUMN,
+    BOOL_COLUMN,
+    DATE_COLUMN,
+    STRING_COLUMN
+} ColumnType;
+
+/** A Column has a name and a type. */
+typedef struct {
+    const char *name;
+    ColumnType type;
+} Column;
+
+/** A TableSchema has a table name and its columns in the order they are stored in the file. */
+typedef struct {
+    const char *name;
+    int column_count;
+    Column columns[MAX_COLUMNS];
+} TableSchema;
+
+/**
+   A Value holds one decoded field of a row. Numbers hold INT and BOOL columns, date holds DATE
+   columns, and text points at the length characters of a STRING column inside the line it was
+   decoded from. Text is not NUL terminated.
+*/
+typedef struct {
+    int number;
+    Date date;
+    const char *text;
+    int length;
+} Value;
+
+/** The ways a condition compares a column to a value */
+typedef enum {
+    COMPARE_EQUAL,
+    COMPARE_NOT_EQUAL,
+    COMPARE_LESS,
+    COMPARE_LESS_EQUAL,
+    COMPARE_GREATER,
+    COMPARE_GREATER_EQUAL
+} Comparison;
+
+/**
+   A Projection is the list of columns a select prints, in the order they are printed. The mask
+   has bit i set when column i is printed, and is used to decode only those columns.
+*/
+typedef struct {
+    int count;
+    int columns[MAX_PROJECTION];
+    unsigned mask;
+} Projection;
+
+/**
+   Finds the schema for a table with one lookup in a perfect hash table of the table names. A
+   partition of a table, named "<table_name>.<key>", has its table's schema.
+   @param table_name is string name of the table.
+   @return is the table's schema, or NULL if table_name is not a table defined in database.h
+*/
+const TableSchema *find_table( const char *table_name );
+
+/**
+   Finds a column of a table by name with one lookup in a perfect hash table of its columns.
+   @param schema is the table to search.
+   @param column_name is string name of the column.
+   @return is the column's position in the table, or -1 if the table has no such column.
+*/
+int find_column( const TableSchema *schema, const char *column_name );
+
+/**
+   Turns a comma separated list of column names into a projection. An empty list or "*" selects
+   every column in table order.
+   @param schema is the table the columns belong to.
+   @param columns is string list of column names (i.e "id,title" or "id, title").
+   @param projection is set to the columns selected.
+   @return is EXIT_FAILURE if a column does not exist in the table or too many are listed,
+           otherwise EXIT_SUCCESS
+*/
+int parse_columns( const TableSchema *schema, const char *columns, Projection *projection );
+
+/**
+   Decodes a line from a table file into values with the decoders in fields.h. Only the columns
+   in the needed mask are converted, the others are skipped over. STRING values are slices of
+   line, so line must outlive the values. The line is not modified.
+   @param schema is the table the line was read from.
+   @param line is the row as read from the file, newline optional.
+   @param end is the end of the line.
+   @param values is array of MAX_COLUMNS values that decoded columns are stored to.
+   @param needed is mask of the columns that must be decoded.
+   @return is EXIT_FAILURE if the line is empty or missing a needed column, otherwise EXIT_SUCCESS
+*/
+int decode_row( const TableSchema *schema, const char *line, const char *end, Value *values,
+                unsigned needed );
+
+/**
+   Converts a condition value entered by a user into a value for the given column type. BOOL
+   values become 1 when greater than 0 and 0 otherwise.
+   @param type is the type of column the value is compared to.
+   @param text is string the user entered.
+   @param value is where the converted value is stored.
+*/
+void parse_value( ColumnType type, const char *text, Value *value );
+
+/**
+   Checks whether two values of a column are equal.
+   @param type is the type of column both values belong to.
+   @param a is the first value.
+   @param b is the second value.
+   @return is true if the values are the same.
+*/
+bool values_equal( ColumnType type, const Value *a, const Value *b );
+
+/**
+   Orders two values of a column. Dates are ordered by year, then month, then day, and strings by
+   their bytes.
+   @param type is the type of column both values belong to.
+   @param a is the first value.
+   @param b is the second value.
+   @return is less than 0 if a comes first, 0 if the values are equal, otherwise greater than 0.
+*/
+int compare_values( ColumnType type, const Value *a, const Value *b );
+
+/**
+   Reads a comparison operator: ==, !=, <, <=, > or >=.
+   @param text is string the user entered.
+   @param comparison is where the comparison is stored.
+   @return is EXIT_FAILURE if text is not a comparison, otherwise EXIT_SUCCESS
+*/
+int parse_comparison( const char *text, Comparison *comparison );
+
+/**
+   Gives the operator a comparison is written with.
+   @param comparison is the comparison.
+   @return is the operator, such as "<=".
+*/
+const char *comparison_name( Comparison comparison );
+
+/**
+   Checks whether a value meets a condition.
+   @param type is the type of column both values belong to.
+   @param value is the column's value.
+   @param comparison is how the value is compared.
+   @param operand is the value it is compared to.
+   @return is true if "value comparison operand" holds.
+*/
+bool value_meets( ColumnType type, const Value *value, Comparison comparison,
+                  const Value *operand );
+
+/**
+   Prints the columns of a decoded row to a sink in projection order, separated by spaces and
+   followed by a newline. Dates are printed as DD-MM-YYYY.
+   @param sink is the sink the row is added to.
+   @param schema is the table the row belongs to.
+   @param values is the decoded row.
+   @param projection is the columns to print.
+*/
+void print_row( Sink *sink, const TableSchema *schema, const Value *values, const Projection *projection );
+
+#endif //SCHEMA_H
@@ -0,0 +1,387 @@
+/**
+   @file server.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for server mode. The main thread runs an epoll loop that accepts clients on
+   a Unix domain socket and reads what they send. Each client's complete lines are queued, and a
+   client with commands waiting is handed to one of a fixed pool of worker threads. A worker runs
+   the client's commands one at a time, so a client's commands always run in the order sent, and
+   collects each command's output in its own sink before writing it to the client.
+*/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "server.h"
+#include "sink.h"
+#include "stats.h"
+#include "txn.h"
+
+/** Max number of epoll events handled per wait */
+#define MAX_EVENTS 64
+/** Number of bytes read from a client at once */
+#define READ_SIZE ( 64 * 1024 )
+
+/**
+   A Connection holds a client's socket and the bytes read from it that have not been run yet.
+   Busy is true while the connection is queued for or being served by a worker. Closed is true once
+   the client has hung up. Whoever finds a connection closed and not busy frees it. Transaction is
+   the client's session, rolled back if the client hangs up before committing.
+*/
+typedef struct Connection {
+    int fd;
+    pthread_mutex_t lock;
+    char *input;
+    size_t length;
+    size_t capacity;
+    bool busy;
+    bool closed;
+    Transaction transaction;
+    struct Connection *next;
+} Connection;
+
+/** Queue of connections with commands waiting for a worker. */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    Connection *head;
+    Connection *tail;
+    bool stopping;
+    CommandRunner run;
+} work = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, false, NULL };
+
+/** Set by the signal handler to stop the server */
+static volatile sig_atomic_t stop_requested = 0;
+
+/** Asks the epoll loop to stop. */
+static void request_stop( int signal_number ) {
+    stop_requested = 1;
+}
+
+/** Closes a client's socket and frees its connection. */
+static void destroy_connection( Connection *connection ) {
+    close( connection->fd );
+    discard_transaction( &connection->transaction );
+    pthread_mutex_destroy( &connection->lock );
+    free( connection->input );
+    free( connection );
+}
+
+/** Adds a connection to the end of the work queue and wakes a worker. */
+static void queue_connection( Connection *connection ) {
+    pthread_mutex_lock( &work.lock );
+    connection->next = NULL;
+    if ( work.tail == NULL ) {
+        work.head = connection;
+    }
+    else {
+        work.tail->next = connection;
+    }
+    work.tail = connection;
+    pthread_cond_signal( &work.ready );
+    pthread_mutex_unlock( &work.lock );
+}
+
+/** Waits for a connection with commands to run. Returns NULL once the server is stopping. */
+static Connection *next_connection( void ) {
+    pthread_mutex_lock( &work.lock );
+    while ( work.head == NULL && !work.stopping ) {
+        pthread_cond_wait( &work.ready, &work.lock );
+    }
+    Connection *connection = work.head;
+    if ( connection != NULL && !work.stopping ) {
+        work.head = connection->next;
+        if ( work.head == NULL ) {
+            work.tail = NULL;
+        }
+    }
+    else {
+        connection = NULL;
+    }
+    pthread_mutex_unlock( &work.lock );
+    return connection;
+}
+
+/** Checks if a command is only spaces. */
+static bool is_blank( const char *command ) {
+    return command[ strspn( command, " \t\r" ) ] == '\0';
+}
+
+/**
+   Runs every complete line a connection has, in order. Each command's output is followed by
+   RESPONSE_END and written to the client in one go.
+*/
+static void serve_connection( Connection *connection, Sink *sink ) {
+    char *command = NULL;
+    size_t command_capacity = 0;
+
+    while ( true ) {
+        // Take the next line out of the input, or give the connection back if there is none.
+        pthread_mutex_lock( &connection->lock );
+        char *newline = memchr( connection->input, '\n', connection->length );
+        if ( newline == NULL ) {
+            connection->busy = false;
+            bool finished = connection->closed;
+            pthread_mutex_unlock( &connection->lock );
+            if ( finished ) {
+                destroy_connection( connection );
+            }
+            free( command );
+            return;
+        }
+        size_t length = newline - connection->input;
+        if ( length + 1 > command_capacity ) {
+            command_capacity = length + 1;
+            char *grown = ( char * )realloc( command, command_capacity );
+            if ( grown == NULL ) {
+                pthread_mutex_unlock( &connection->lock );
+                err_printf( "Memory allocation error\n" );
+                exit( EXIT_FAILURE );
+            }
+            command = grown;
+        }
+        memcpy( command, connection->input, length );
+        command[length] = '\0';
+        connection->length -= length + 1;
+        memmove( connection->input, newline + 1, connection->length );
+        pthread_mutex_unlock( &connection->lock );
+
+        // Remove a carriage return left by clients that send "\r\n".
+        if ( length > 0 && command[length - 1] == '\r' ) {
+            command[length - 1] = '\0';
+        }
+
+        // "exit" ends the client's session, anything sent after it is dropped.
+        sink->fd = connection->fd;
+        if ( strcmp( command, "exit" ) == 0 ) {
+            pthread_mutex_lock( &connection->lock );
+            connection->length = 0;
+            pthread_mutex_unlock( &connection->lock );
+            shutdown( connection->fd, SHUT_RD );
+        }
+        else if ( !is_blank( command ) ) {
+            set_transaction( &connection->transaction );
+            work.run( command );
+            set_transaction( NULL );
+        }
+        sink_putc( sink, RESPONSE_END );
+        sink_flush( sink );
+    }
+}
+
+/** Worker thread. Serves connections from the work queue until the server stops. */
+static void *worker_main( void *argument ) {
+    // Every worker has its own output buffer, pointed at whichever client it is serving.
+    Sink sink;
+    if ( sink_open( &sink, -1 ) != EXIT_SUCCESS ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    set_output_sink( &sink );
+
+    Connection *connection;
+    while ( ( connection = next_connection() ) != NULL ) {
+        serve_connection( connection, &sink );
+    }
+
+    set_output_sink( NULL );
+    free( sink.buffer );
+    return NULL;
+}
+
+/** Accepts every client waiting on the listening socket and watches them for input. */
+static void accept_clients( int listener, int epoll_fd ) {
+    while ( true ) {
+        int fd = accept4( listener, NULL, NULL, SOCK_CLOEXEC );
+        if ( fd < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return;     // EAGAIN once every waiting client was accepted.
+        }
+
+        Connection *connection = ( Connection * )calloc( 1, sizeof( Connection ) );
+        if ( connection == NULL ) {
+            close( fd );
+            continue;
+        }
+        connection->fd = fd;
+        pthread_mutex_init( &connection->lock, NULL );
+
+        struct epoll_event event = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = connection };
+        if ( epoll_ctl( epoll_fd, EPOLL_CTL_ADD, fd, &event ) < 0 ) {
+            destroy_connection( connection );
+        }
+    }
+}
+
+/** Adds bytes to a connection's input. Returns EXIT_FAILURE if the input grew too large. */
+static int append_input( Connection *connection, const char *data, size_t length ) {
+    if ( connection->length + length > connection->capacity ) {
+        size_t capacity = connection->capacity == 0 ? READ_SIZE : connection->capacity;
+        while ( capacity < connection->length + length ) {
+            capacity *= 2;
+        }
+        if ( capacity > MAX_REQUEST_LENGTH + READ_SIZE ) {
+            return EXIT_FAILURE;
+        }
+        char *grown = ( char * )realloc( connection->input, capacity );
+        if ( grown == NULL ) {
+            return EXIT_FAILURE;
+        }
+        connection->input = grown;
+        connection->capacity = capacity;
+    }
+    memcpy( connection->input + connection->length, data, length );
+    connection->length += length;
+    return EXIT_SUCCESS;
+}
+
+/** Reads what a client sent and queues the connection if it now has a complete command. */
+static void read_client( Connection *connection, int epoll_fd ) {
+    char block[READ_SIZE];
+    ssize_t got = read( connection->fd, block, sizeof( block ) );
+    if ( got < 0 && ( errno == EINTR || errno == EAGAIN ) ) {
+        return;
+    }
+
+    pthread_mutex_lock( &connection->lock );
+    bool queue = false;
+    bool finished = false;
+    if ( got > 0 && append_input( connection, block, got ) == EXIT_SUCCESS ) {
+        // A connection that is not busy has no complete line yet, so only new bytes can add one.
+        queue = !connection->busy && memchr( block, '\n', got ) != NULL;
+    }
+    else {
+        // Client hung up (or sent too much). Run a last command sent without a newline.
+        epoll_ctl( epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL );
+        connection->closed = true;
+        if ( got == 0 && connection->length > 0 &&
+             connection->input[ connection->length - 1 ] != '\n' &&
+             append_input( connection, "\n", 1 ) == EXIT_SUCCESS ) {
+            queue = !connection->busy;
+        }
+        else if ( got != 0 ) {
+            connection->length = 0;
+        }
+        finished = !connection->busy && !queue;
+    }
+    if ( queue ) {
+        connection->busy = true;
+    }
+    pthread_mutex_unlock( &connection->lock );
+
+    if ( queue ) {
+        queue_connection( connection );
+    }
+    else if ( finished ) {
+        destroy_connection( connection );
+    }
+}
+
+/** Creates the listening socket, replacing a stale socket left at the path. */
+static int open_listener( const char *socket_path ) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if ( strlen( socket_path ) >= sizeof( address.sun_path ) ) {
+        err_printf( "Socket path too long: %s\n", socket_path );
+        return -1;
+    }
+    strcpy( address.sun_path, socket_path );
+
+    struct stat status;
+    if ( stat( socket_path, &status ) == 0 && S_ISSOCK( status.st_mode ) ) {
+        unlink( socket_path );
+    }
+
+    int listener = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    if ( listener < 0 ) {
+        err_printf( "Unable to create socket: %s\n", strerror( errno ) );
+        return -1;
+    }
+    if ( bind( listener, ( struct sockaddr * )&address, sizeof( address ) ) < 0 ||
+         listen( listener, SOMAXCONN ) < 0 ) {
+        err_printf( "Unable to listen on %s: %s\n", socket_path, strerror( errno ) );
+        close( listener );
+        return -1;
+    }
+    return listener;
+}
+
+/** Serves clients on a Unix domain socket. */
+int serve( const char *socket_path, int workers, CommandRunner run ) {
+    // Clients that hang up mid-response must not kill the server.
+    signal( SIGPIPE, SIG_IGN );
+    struct sigaction stop_action = { .sa_handler = request_stop };
+    sigemptyset( &stop_action.sa_mask );
+    sigaction( SIGINT, &stop_action, NULL );
+    sigaction( SIGTERM, &stop_action, NULL );
+
+    int listener = open_listener( socket_path );
+    if ( listener < 0 ) {
+        return EXIT_FAILURE;
+    }
+    int epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    if ( epoll_fd < 0 || epoll_ctl( epoll_fd, EPOLL_CTL_ADD, listener, &event ) < 0 ) {
+        err_printf( "Unable to set up epoll: %s\n", strerror( errno ) );
+        close( listener );
+        unlink( socket_path );
+        return EXIT_FAILURE;
+    }
+
+    // Start the worker pool.
+    work.run = run;
+    if ( workers < 1 ) {
+        workers = 1;
+    }
+    pthread_t *threads = ( pthread_t * )malloc( workers * sizeof( pthread_t ) );
+    if ( threads == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    for ( int i = 0; i < workers; i++ ) {
+        pthread_create( &threads[i], NULL, worker_main, NULL );
+    }
+    printf( "Serving on %s with %d workers\n", socket_path, workers );
+    fflush( stdout );
+
+    // Accept clients and read their commands until asked to stop.
+    struct epoll_event events[MAX_EVENTS];
+    while ( !stop_requested ) {
+        int count = epoll_wait( epoll_fd, events, MAX_EVENTS, -1 );
+        for ( int i = 0; i < count; i++ ) {
+            if ( events[i].data.ptr == NULL ) {
+                accept_clients( listener, epoll_fd );
+            }
+            else {
+                read_client( ( Connection * )events[i].data.ptr, epoll_fd );
+            }
+        }
+    }
+
+    // Let workers finish the command they are running, then clean up.
+    pthread_mutex_lock( &work.lock );
+    work.stopping = true;
+    pthread_cond_broadcast( &work.ready );
+    pthread_mutex_unlock( &work.lock );
+    for ( int i = 0; i < workers; i++ ) {
+        pthread_join( threads[i], NULL );
+    }
+    free( threads );
+    close( epoll_fd );
+    close( listener );
+    unlink( socket_path );
+
+    // Report where the time went, as the stats command would.
+    print_stats();
+    sink_flush( stdout_sink() );
+    return EXIT_SUCCESS;
+}
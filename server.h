@@ -0,0 +1,33 @@
+/**
+   @file server.h
+   @author Michael Warstler (mwwarstl)
+   Header file for server mode. The server accepts many clients over a Unix domain socket and runs
+   their commands on a fixed pool of worker threads. A client sends one command per line, and
+   each command's output is sent back followed by a RESPONSE_END byte.
+*/
+#ifndef SERVER_H
+#define SERVER_H
+
+/** Byte sent after the output of every command */
+#define RESPONSE_END '\0'
+/** Max number of bytes a client may send without a newline */
+#define MAX_REQUEST_LENGTH ( 1024 * 1024 )
+
+/**
+   Function that runs one command. Anything it prints goes to the current output sink.
+   @param command is the command line without its newline.
+*/
+typedef void ( *CommandRunner )( const char *command );
+
+/**
+   Serves clients on a Unix domain socket until SIGINT or SIGTERM is received. An epoll loop accepts
+   clients and reads their commands. Complete lines are handed to a pool of worker threads, which
+   run a client's commands in order and buffer each command's output before writing it back.
+   @param socket_path is the path of the socket to listen on. A stale socket at the path is removed.
+   @param workers is the number of worker threads to run commands on.
+   @param run is the function that runs each command.
+   @return is EXIT_FAILURE if the socket could not be set up, otherwise EXIT_SUCCESS
+*/
+int serve( const char *socket_path, int workers, CommandRunner run );
+
+#endif //SERVER_H
@@ -0,0 +1,277 @@
+/**
+   @file sink.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for a result sink. Results are collected in a buffer and written with one
+   write (or writev for large strings) per buffer. Integers and dates are formatted by hand with a
+   table of two digit pairs rather than by parsing a printf format for every row.
+*/
+#include <errno.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "sink.h"
+#include "stats.h"
+#include "trace.h"
+
+/** Every number from 00 to 99 as two characters, used to format two digits at a time. */
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/** The standard output sink, set up the first time it is used. */
+static Sink standard_output;
+
+/** The sink each thread prints query output to, NULL for standard output. */
+static _Thread_local Sink *current_sink;
+
+/** Sets up a sink for a file descriptor. */
+int sink_open( Sink *sink, int fd ) {
+    sink->fd = fd;
+    sink->length = 0;
+    sink->capacity = SINK_BUFFER_SIZE;
+    sink->in_memory = false;
+    sink->buffer = ( char * )malloc( SINK_BUFFER_SIZE );
+    if ( sink->buffer == NULL ) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Sets up a sink that collects its contents in memory. */
+int sink_open_memory( Sink *sink, size_t capacity ) {
+    sink->fd = -1;
+    sink->length = 0;
+    sink->capacity = capacity > 0 ? capacity : 1;
+    sink->in_memory = true;
+    sink->buffer = ( char * )malloc( sink->capacity );
+    if ( sink->buffer == NULL ) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Grows a memory sink's buffer to hold at least length more bytes. */
+static void grow_sink( Sink *sink, size_t length ) {
+    size_t capacity = sink->capacity;
+    while ( capacity - sink->length < length ) {
+        capacity *= 2;
+    }
+    char *buffer = ( char * )realloc( sink->buffer, capacity );
+    if ( buffer == NULL ) {
+        fprintf( stderr, "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    sink->buffer = buffer;
+    sink->capacity = capacity;
+}
+
+/** Flushes and frees a sink. */
+void sink_close( Sink *sink ) {
+    sink_flush( sink );
+    free( sink->buffer );
+    sink->buffer = NULL;
+}
+
+/** Returns the standard output sink. */
+Sink *stdout_sink( void ) {
+    if ( standard_output.buffer == NULL &&
+         sink_open( &standard_output, STDOUT_FILENO ) != EXIT_SUCCESS ) {
+        fprintf( stderr, "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    return &standard_output;
+}
+
+/** Returns the current thread's output sink. */
+Sink *output_sink( void ) {
+    return current_sink != NULL ? current_sink : stdout_sink();
+}
+
+/** Sets the current thread's output sink. */
+void set_output_sink( Sink *sink ) {
+    current_sink = sink;
+}
+
+/** Formats a message into a sink. */
+static void sink_vprintf( Sink *sink, const char *format, va_list args ) {
+    char text[MAX_STR_LENGTH];
+    va_list copy;
+    va_copy( copy, args );
+    int length = vsnprintf( text, sizeof( text ), format, args );
+    if ( length < 0 ) {
+        va_end( copy );
+        return;
+    }
+    if ( ( size_t )length < sizeof( text ) ) {
+        sink_write( sink, text, length );
+    }
+    else {
+        // Longer than usual, format it again into a buffer large enough.
+        char *long_text = ( char * )malloc( length + 1 );
+        if ( long_text != NULL ) {
+            vsnprintf( long_text, length + 1, format, copy );
+            sink_write( sink, long_text, length );
+            free( long_text );
+        }
+    }
+    va_end( copy );
+}
+
+/** Prints a message to the current output sink. */
+void out_printf( const char *format, ... ) {
+    va_list args;
+    va_start( args, format );
+    sink_vprintf( output_sink(), format, args );
+    va_end( args );
+}
+
+/** Prints an error to standard error, or to the current output sink when it is not stdout. */
+void err_printf( const char *format, ... ) {
+    va_list args;
+    va_start( args, format );
+    if ( current_sink == NULL ) {
+        sink_flush( stdout_sink() );
+        vfprintf( stderr, format, args );
+    }
+    else {
+        sink_vprintf( current_sink, format, args );
+    }
+    va_end( args );
+}
+
+/** Writes every iovec fully, retrying after partial writes and interrupts. */
+static int write_all( int fd, struct iovec *parts, int count ) {
+    while ( count > 0 ) {
+        trace_begin( "output" );
+        ssize_t written = writev( fd, parts, count );
+        trace_end( "output" );
+        if ( written < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return EXIT_FAILURE;
+        }
+        stats_add( SYSCALLS, 1 );
+        stats_add( BYTES_OUTPUT, written );
+
+        // Skip past whatever was written.
+        while ( count > 0 && ( size_t )written >= parts->iov_len ) {
+            written -= parts->iov_len;
+            parts++;
+            count--;
+        }
+        if ( count > 0 ) {
+            parts->iov_base = ( char * )parts->iov_base + written;
+            parts->iov_len -= written;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Writes out a sink's buffer. */
+int sink_flush( Sink *sink ) {
+    if ( sink->in_memory ) {
+        return EXIT_SUCCESS;
+    }
+    // Messages printed with printf before these results must come out first.
+    if ( sink->fd == STDOUT_FILENO ) {
+        fflush( stdout );
+    }
+    if ( sink->length == 0 ) {
+        return EXIT_SUCCESS;
+    }
+    struct iovec part = { sink->buffer, sink->length };
+    sink->length = 0;
+    return write_all( sink->fd, &part, 1 );
+}
+
+/** Adds bytes to a sink. */
+void sink_write( Sink *sink, const char *data, size_t length ) {
+    if ( length > sink->capacity - sink->length && sink->in_memory ) {
+        grow_sink( sink, length );
+    }
+    if ( length <= sink->capacity - sink->length ) {
+        memcpy( sink->buffer + sink->length, data, length );
+        sink->length += length;
+        return;
+    }
+
+    // Too large to fit, write the buffer and the data together.
+    if ( sink->fd == STDOUT_FILENO ) {
+        fflush( stdout );
+    }
+    struct iovec parts[2] = { { sink->buffer, sink->length }, { ( char * )data, length } };
+    sink->length = 0;
+    write_all( sink->fd, parts, 2 );
+}
+
+/** Adds a string to a sink. */
+void sink_puts( Sink *sink, const char *text ) {
+    sink_write( sink, text, strlen( text ) );
+}
+
+/** Adds a character to a sink. */
+void sink_putc( Sink *sink, char c ) {
+    if ( sink->length == sink->capacity ) {
+        if ( sink->in_memory ) {
+            grow_sink( sink, 1 );
+        }
+        else {
+            sink_flush( sink );
+        }
+    }
+    sink->buffer[ sink->length++ ] = c;
+}
+
+/** Adds an integer to a sink. */
+void sink_int( Sink *sink, int number ) {
+    // Enough room for "-2147483648".
+    char digits[12];
+    char *end = digits + sizeof( digits );
+    char *start = end;
+
+    // Work with the magnitude as unsigned so INT_MIN does not overflow.
+    unsigned magnitude = number < 0 ? 0u - ( unsigned )number : ( unsigned )number;
+    while ( magnitude >= 100 ) {
+        unsigned pair = ( magnitude % 100 ) * 2;
+        magnitude /= 100;
+        start -= 2;
+        start[0] = digit_pairs[pair];
+        start[1] = digit_pairs[pair + 1];
+    }
+    if ( magnitude >= 10 ) {
+        start -= 2;
+        start[0] = digit_pairs[magnitude * 2];
+        start[1] = digit_pairs[magnitude * 2 + 1];
+    }
+    else {
+        *--start = '0' + magnitude;
+    }
+    if ( number < 0 ) {
+        *--start = '-';
+    }
+    sink_write( sink, start, end - start );
+}
+
+/** Adds a DD-MM-YYYY date to a sink. */
+void sink_date( Sink *sink, const Date *date ) {
+    // Any date outside the fixed shape is left to snprintf so the output matches printf exactly.
+    if ( date->day < 0 || date->day > 99 || date->month < 0 || date->month > 99 ||
+         date->year < 1000 || date->year > 9999 ) {
+        char text[40];
+        int length = snprintf( text, sizeof( text ), "%02d-%02d-%4d", date->day, date->month,
+                               date->year );
+        sink_write( sink, text, length );
+        return;
+    }
+
+    char text[10];
+    memcpy( text, digit_pairs + date->day * 2, 2 );
+    text[2] = '-';
+    memcpy( text + 3, digit_pairs + date->month * 2, 2 );
+    text[5] = '-';
+    memcpy( text + 6, digit_pairs + ( date->year / 100 ) * 2, 2 );
+    memcpy( text + 8, digit_pairs + ( date->year % 100 ) * 2, 2 );
+    sink_write( sink, text, sizeof( text ) );
+}
@@ -0,0 +1,131 @@
+/**
+   @file sink.h
+   @author Michael Warstler (mwwarstl)
+   Header file for a result sink. A sink collects query results in a large buffer and writes the
+   whole buffer to a file descriptor at once, instead of one printf per row. Contains functions
+   for adding strings, integers, and DD-MM-YYYY dates to a sink and for flushing it.
+*/
+#ifndef SINK_H
+#define SINK_H
+
+#include <stddef.h>
+#include "database.h"
+
+/** Number of bytes a sink buffers before writing */
+#define SINK_BUFFER_SIZE ( 256 * 1024 )
+
+/**
+   A Sink holds the file descriptor results are written to, the buffer results are collected in,
+   how many bytes of the buffer are used, and the buffer's size. A memory sink has no file
+   descriptor; its buffer grows to hold everything added until the owner takes the contents.
+*/
+typedef struct {
+    int fd;
+    size_t length;
+    size_t capacity;
+    bool in_memory;
+    char *buffer;
+} Sink;
+
+/**
+   Sets up a sink that writes to a file descriptor.
+   @param sink is the sink to set up.
+   @param fd is the file descriptor results are written to.
+   @return is EXIT_FAILURE if the buffer could not be allocated, otherwise EXIT_SUCCESS
+*/
+int sink_open( Sink *sink, int fd );
+
+/**
+   Sets up a memory sink, which keeps everything added to it in a growing buffer. Parallel scans
+   use memory sinks to collect each part of a result before it is copied to the output sink.
+   @param sink is the sink to set up.
+   @param capacity is the starting size of the buffer.
+   @return is EXIT_FAILURE if the buffer could not be allocated, otherwise EXIT_SUCCESS
+*/
+int sink_open_memory( Sink *sink, size_t capacity );
+
+/**
+   Flushes a sink and frees its buffer.
+   @param sink is the sink to close.
+*/
+void sink_close( Sink *sink );
+
+/**
+   Returns the sink that writes to standard output. It is created the first time it is used.
+   @return is the standard output sink.
+*/
+Sink *stdout_sink( void );
+
+/**
+   Returns the sink the current thread prints query output to. This is the standard output sink
+   unless the thread has set its own, as server workers do for each client.
+   @return is the current thread's output sink.
+*/
+Sink *output_sink( void );
+
+/**
+   Sets the sink the current thread prints query output to.
+   @param sink is the sink to use, or NULL to go back to standard output.
+*/
+void set_output_sink( Sink *sink );
+
+/**
+   Prints a formatted message to the current thread's output sink.
+   @param format is a printf format string, followed by its arguments.
+*/
+void out_printf( const char *format, ... );
+
+/**
+   Prints a formatted error message. Errors go to standard error when the current thread prints to
+   standard output, otherwise they go to the thread's output sink with the rest of the query's
+   output so that a client sees them.
+   @param format is a printf format string, followed by its arguments.
+*/
+void err_printf( const char *format, ... );
+
+/**
+   Writes everything buffered in a sink to its file descriptor. Output already buffered by printf
+   is flushed first so that results and messages stay in order. A memory sink keeps its contents.
+   @param sink is the sink to flush.
+   @return is EXIT_FAILURE if writing failed, otherwise EXIT_SUCCESS
+*/
+int sink_flush( Sink *sink );
+
+/**
+   Adds bytes to a sink. Data larger than the space left is written together with the buffer in
+   a single writev.
+   @param sink is the sink to add to.
+   @param data is the bytes to add.
+   @param length is the number of bytes to add.
+*/
+void sink_write( Sink *sink, const char *data, size_t length );
+
+/**
+   Adds a string to a sink.
+   @param sink is the sink to add to.
+   @param text is the NUL terminated string to add.
+*/
+void sink_puts( Sink *sink, const char *text );
+
+/**
+   Adds a single character to a sink.
+   @param sink is the sink to add to.
+   @param c is the character to add.
+*/
+void sink_putc( Sink *sink, char c );
+
+/**
+   Adds an integer to a sink, formatted the same as printf's %d.
+   @param sink is the sink to add to.
+   @param number is the integer to add.
+*/
+void sink_int( Sink *sink, int number );
+
+/**
+   Adds a date to a sink, formatted the same as printf's "%02d-%02d-%4d".
+   @param sink is the sink to add to.
+   @param date is the date to add.
+*/
+void sink_date( Sink *sink, const Date *date );
+
+#endif //SINK_H
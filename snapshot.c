@@ -0,0 +1,341 @@
+/**
+   @file snapshot.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for incremental snapshots. A MANIFEST line is
+   "table size mtime_seconds mtime_nanoseconds inode checksum snapshot", where snapshot is the
+   number of the folder the table's data is in. The manifest is written before LATEST is changed
+   to the new number, so a snapshot that was cut short is never used as the base of the next.
+*/
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "database.h"
+#include "lock.h"
+#include "sink.h"
+#include "snapshot.h"
+#include "storage.h"
+
+/** A ManifestEntry is one table in a snapshot's manifest. */
+typedef struct {
+    char name[MAX_STR_LENGTH];
+    long long size;
+    long long mtime_seconds;
+    long mtime_nanoseconds;
+    unsigned long long inode;
+    unsigned long long checksum;
+    int snapshot;
+} ManifestEntry;
+
+/** A Manifest is the list of tables in a snapshot. */
+typedef struct {
+    ManifestEntry *entries;
+    int count;
+    int capacity;
+} Manifest;
+
+/** Checksum being computed over a table's contents, with the bytes of an unfinished word. */
+typedef struct {
+    uint64_t hash;
+    uint64_t length;
+    unsigned char pending[8];
+    int pending_length;
+} Checksum;
+
+/** Keeps two snapshots from being written at once */
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Mixes one 8-byte word into a checksum. */
+static uint64_t mix_word( uint64_t hash, uint64_t word ) {
+    hash = ( hash ^ word ) * 0x9E3779B97F4A7C15ull;
+    return hash ^ ( hash >> 32 );
+}
+
+/** Adds a chunk of a table to a checksum, a word at a time. */
+static void checksum_chunk( void *context, const char *data, size_t length ) {
+    Checksum *checksum = ( Checksum * )context;
+    checksum->length += length;
+
+    // Finish a word left over from the last chunk. A pending word is never full, but saying so
+    // lets the compiler see the writes stay inside it.
+    while ( checksum->pending_length > 0 && checksum->pending_length < 8 && length > 0 ) {
+        checksum->pending[ checksum->pending_length++ ] = *data++;
+        length--;
+        if ( checksum->pending_length == 8 ) {
+            uint64_t word;
+            memcpy( &word, checksum->pending, 8 );
+            checksum->hash = mix_word( checksum->hash, word );
+            checksum->pending_length = 0;
+        }
+    }
+    for ( ; length >= 8; data += 8, length -= 8 ) {
+        uint64_t word;
+        memcpy( &word, data, 8 );
+        checksum->hash = mix_word( checksum->hash, word );
+    }
+    memcpy( checksum->pending + checksum->pending_length, data, length );
+    checksum->pending_length += length;
+}
+
+/** Computes the checksum of the first length bytes of a table. Returns 0 on error. */
+static unsigned long long checksum_table( int fd, off_t length ) {
+    Checksum checksum = { .hash = 0xCBF29CE484222325ull };
+    if ( storage_stream( fd, length, checksum_chunk, &checksum ) != EXIT_SUCCESS ) {
+        return 0;
+    }
+    uint64_t word = 0;
+    memcpy( &word, checksum.pending, checksum.pending_length );
+    return mix_word( mix_word( checksum.hash, word ), checksum.length );
+}
+
+/** Adds an entry to a manifest. */
+static ManifestEntry *add_entry( Manifest *manifest ) {
+    if ( manifest->count == manifest->capacity ) {
+        manifest->capacity = manifest->capacity > 0 ? manifest->capacity * 2 : 16;
+        size_t size = manifest->capacity * sizeof( ManifestEntry );
+        manifest->entries = ( ManifestEntry * )realloc( manifest->entries, size );
+        if ( manifest->entries == NULL ) {
+            err_printf( "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+    ManifestEntry *entry = &manifest->entries[ manifest->count++ ];
+    memset( entry, 0, sizeof( *entry ) );
+    return entry;
+}
+
+/** Finds a table in a manifest. Returns NULL if it is not there. */
+static const ManifestEntry *find_entry( const Manifest *manifest, const char *name ) {
+    for ( int i = 0; i < manifest->count; i++ ) {
+        if ( strcmp( manifest->entries[i].name, name ) == 0 ) {
+            return &manifest->entries[i];
+        }
+    }
+    return NULL;
+}
+
+/** Returns the number of the latest complete snapshot, or 0 if there is none. */
+static int latest_snapshot( void ) {
+    FILE *file = fopen( SNAPSHOT_FOLDER "/" LATEST_NAME, "r" );
+    int id = 0;
+    if ( file != NULL ) {
+        if ( fscanf( file, "%d", &id ) != 1 ) {
+            id = 0;
+        }
+        fclose( file );
+    }
+    return id;
+}
+
+/** Reads a snapshot's manifest. A missing manifest is an empty one. */
+static void read_manifest( int id, Manifest *manifest ) {
+    char path[MAX_STR_LENGTH];
+    snprintf( path, sizeof( path ), "%s/%d/%s", SNAPSHOT_FOLDER, id, MANIFEST_NAME );
+    FILE *file = fopen( path, "r" );
+    if ( file == NULL ) {
+        return;
+    }
+    char line[MAX_STR_LENGTH * 2];
+    while ( fgets( line, sizeof( line ), file ) ) {
+        ManifestEntry entry;
+        if ( sscanf( line, "%2047s %lld %lld %ld %llu %llx %d", entry.name, &entry.size,
+                     &entry.mtime_seconds, &entry.mtime_nanoseconds, &entry.inode,
+                     &entry.checksum, &entry.snapshot ) == 7 ) {
+            *add_entry( manifest ) = entry;
+        }
+    }
+    fclose( file );
+}
+
+/** Writes a file by writing a temporary one and renaming it over the old. */
+static int replace_file( const char *path, const char *text, size_t length ) {
+    char temp[MAX_STR_LENGTH];
+    snprintf( temp, sizeof( temp ), "%s.tmp", path );
+    int fd = open( temp, O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+    if ( fd < 0 ) {
+        return EXIT_FAILURE;
+    }
+    int status = storage_write_at( fd, text, length, 0 );
+    if ( fsync( fd ) != 0 ) {
+        status = EXIT_FAILURE;
+    }
+    if ( close( fd ) != 0 || status != EXIT_SUCCESS || rename( temp, path ) != 0 ) {
+        remove( temp );
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Writes a snapshot's manifest and makes it the latest snapshot. */
+static int write_manifest( int id, const Manifest *manifest ) {
+    Sink text;
+    if ( sink_open_memory( &text, 4096 ) != EXIT_SUCCESS ) {
+        return EXIT_FAILURE;
+    }
+    for ( int i = 0; i < manifest->count; i++ ) {
+        const ManifestEntry *entry = &manifest->entries[i];
+        char line[MAX_STR_LENGTH + 128];
+        int length = snprintf( line, sizeof( line ), "%s %lld %lld %ld %llu %016llx %d\n",
+                               entry->name, entry->size, entry->mtime_seconds,
+                               entry->mtime_nanoseconds, entry->inode, entry->checksum,
+                               entry->snapshot );
+        sink_write( &text, line, length );
+    }
+
+    char path[MAX_STR_LENGTH];
+    snprintf( path, sizeof( path ), "%s/%d/%s", SNAPSHOT_FOLDER, id, MANIFEST_NAME );
+    int status = replace_file( path, text.buffer, text.length );
+    free( text.buffer );
+    if ( status != EXIT_SUCCESS ) {
+        return EXIT_FAILURE;
+    }
+    char number[32];
+    int length = snprintf( number, sizeof( number ), "%d\n", id );
+    return replace_file( SNAPSHOT_FOLDER "/" LATEST_NAME, number, length );
+}
+
+/**
+   Checks whether a file in the tables folder is left out of snapshots: temporary files, id
+   filters, which are rebuilt from their tables, and the commit log, whose changes are already in
+   the tables. Other files starting with '.' describe the tables and are kept.
+*/
+static bool skipped_file( const char *name ) {
+    size_t length = strlen( name );
+    if ( name[0] != '.' ) {
+        return false;
+    }
+    return strcmp( name, "." ) == 0 || strcmp( name, ".." ) == 0 || strcmp( name, ".wal" ) == 0 ||
+           ( length > 4 && strcmp( name + length - 4, ".tmp" ) == 0 ) ||
+           ( length > 6 && strcmp( name + length - 6, ".bloom" ) == 0 );
+}
+
+/** Writes a snapshot of every table, copying only those that changed. */
+int snapshot_database( void ) {
+    pthread_mutex_lock( &snapshot_lock );
+    Manifest previous = { 0 }, current = { 0 };
+    int base = latest_snapshot();
+    if ( base > 0 ) {
+        read_manifest( base, &previous );
+    }
+    int id = base + 1;
+
+    // Set up the new snapshot's folder.
+    char folder_path[MAX_STR_LENGTH];
+    snprintf( folder_path, sizeof( folder_path ), "%s/%d", SNAPSHOT_FOLDER, id );
+    DIR *tables = opendir( folder );
+    if ( ( mkdir( SNAPSHOT_FOLDER, 0777 ) != 0 && errno != EEXIST ) ||
+         ( mkdir( folder_path, 0777 ) != 0 && errno != EEXIST ) || tables == NULL ) {
+        out_printf( "Unable to create snapshot: %s\n", strerror( errno ) );
+        if ( tables != NULL ) {
+            closedir( tables );
+        }
+        free( previous.entries );
+        pthread_mutex_unlock( &snapshot_lock );
+        return EXIT_FAILURE;
+    }
+
+    // Look at every table and the files that describe them.
+    CopyRange *copies = NULL;
+    int copy_count = 0, unchanged = 0;
+    int status = EXIT_SUCCESS;
+    struct dirent *file;
+    while ( status == EXIT_SUCCESS && ( file = readdir( tables ) ) != NULL ) {
+        if ( skipped_file( file->d_name ) ) {
+            continue;
+        }
+        char path[MAX_STR_LENGTH];
+        snprintf( path, sizeof( path ), "%s/%s", folder, file->d_name );
+        int fd = open( path, O_RDONLY );
+        if ( fd < 0 ) {
+            continue;
+        }
+
+        // The snapshot's size is what gets copied. If rows were added since, the recorded time is
+        // left at 0 so the next snapshot looks at the contents again.
+        off_t size = snapshot_table( file->d_name, fd );
+        struct stat info;
+        if ( size < 0 || fstat( fd, &info ) != 0 || !S_ISREG( info.st_mode ) ) {
+            close( fd );
+            continue;
+        }
+        ManifestEntry *entry = add_entry( &current );
+        strncpy( entry->name, file->d_name, sizeof( entry->name ) - 1 );
+        entry->size = size;
+        entry->inode = info.st_ino;
+        if ( info.st_size == size ) {
+            entry->mtime_seconds = info.st_mtim.tv_sec;
+            entry->mtime_nanoseconds = info.st_mtim.tv_nsec;
+        }
+
+        const ManifestEntry *prior = find_entry( &previous, entry->name );
+        if ( prior != NULL && prior->size == entry->size && prior->inode == entry->inode &&
+             prior->mtime_seconds == entry->mtime_seconds &&
+             prior->mtime_nanoseconds == entry->mtime_nanoseconds && entry->mtime_seconds != 0 ) {
+            // Same file, untouched since the last snapshot.
+            entry->checksum = prior->checksum;
+            entry->snapshot = prior->snapshot;
+            unchanged++;
+            close( fd );
+            continue;
+        }
+        entry->checksum = checksum_table( fd, size );
+        if ( prior != NULL && prior->size == entry->size && prior->checksum == entry->checksum ) {
+            // Rewritten, but to the same contents.
+            entry->snapshot = prior->snapshot;
+            unchanged++;
+            close( fd );
+            continue;
+        }
+
+        // Changed, so it is copied into this snapshot.
+        char copy_path[MAX_STR_LENGTH * 2];
+        snprintf( copy_path, sizeof( copy_path ), "%s/%s", folder_path, entry->name );
+        int copy = open( copy_path, O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+        size_t bytes = ( copy_count + 1 ) * sizeof( CopyRange );
+        CopyRange *grown = ( CopyRange * )realloc( copies, bytes );
+        if ( grown != NULL ) {
+            copies = grown;
+        }
+        if ( copy < 0 || grown == NULL ) {
+            status = EXIT_FAILURE;
+            close( fd );
+            if ( copy >= 0 ) {
+                close( copy );
+            }
+            break;
+        }
+        copies[ copy_count++ ] = ( CopyRange ){ fd, 0, copy, 0, size };
+        entry->snapshot = id;
+    }
+    closedir( tables );
+
+    // Copy the changed tables, several at once, then record the snapshot.
+    if ( status == EXIT_SUCCESS ) {
+        status = storage_copy( copies, copy_count );
+    }
+    for ( int i = 0; i < copy_count; i++ ) {
+        close( copies[i].in_fd );
+        if ( fsync( copies[i].out_fd ) != 0 ) {
+            status = EXIT_FAILURE;
+        }
+        close( copies[i].out_fd );
+    }
+    if ( status == EXIT_SUCCESS ) {
+        status = write_manifest( id, &current );
+    }
+    if ( status == EXIT_SUCCESS ) {
+        out_printf( "Snapshot %d written: %d tables copied, %d unchanged\n", id, copy_count,
+                    unchanged );
+    }
+    else {
+        out_printf( "Unable to write snapshot %d\n", id );
+    }
+    free( copies );
+    free( previous.entries );
+    free( current.entries );
+    pthread_mutex_unlock( &snapshot_lock );
+    return status;
+}
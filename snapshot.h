@@ -0,0 +1,29 @@
+/**
+   @file snapshot.h
+   @author Michael Warstler (mwwarstl)
+   Header file for incremental snapshots. Each snapshot is a numbered folder under SNAPSHOT_FOLDER
+   holding a copy of every table that changed since the previous snapshot, and a MANIFEST that
+   lists every table with the number of the snapshot its data is kept in. Tables that did not
+   change are not copied again; the manifest points at the earlier copy. The files that describe
+   the tables (views, partitions, foreign keys, and the waitlist queue) are kept the same way.
+*/
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/** Folder snapshots are written to */
+#define SNAPSHOT_FOLDER "./snapshots"
+/** Name of the manifest in each snapshot folder */
+#define MANIFEST_NAME "MANIFEST"
+/** Name of the file holding the number of the latest complete snapshot */
+#define LATEST_NAME "LATEST"
+
+/**
+   Writes a snapshot of every table. A table is unchanged if its size, modification time, and
+   inode match the previous manifest, or else if its contents have the same checksum. Each table
+   is copied as of one moment, but different tables may be copied at slightly different times
+   while other clients change them.
+   @return is EXIT_FAILURE if the snapshot could not be written, otherwise EXIT_SUCCESS
+*/
+int snapshot_database( void );
+
+#endif //SNAPSHOT_H
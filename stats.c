@@ -0,0 +1,201 @@
+/**
+   @file stats.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for query statistics. Each thread's counters are allocated the first time
+   it counts something and kept for as long as the process runs, since the threads that count are
+   pooled. Reset does not touch them: it records the current totals, and printing subtracts them.
+*/
+#include <pthread.h>
+#include "block.h"
+#include "bloom.h"
+#include "database.h"
+#include "lock.h"
+#include "parser.h"
+#include "sink.h"
+#include "stats.h"
+#include "storage.h"
+#include "txn.h"
+
+/** Totals of every thread's counters */
+typedef struct {
+    uint64_t phase_ns[PHASE_COUNT];
+    uint64_t phase_calls[PHASE_COUNT];
+    uint64_t counters[COUNTER_COUNT];
+    uint64_t query_ns[QUERY_KINDS];
+    uint64_t query_calls[QUERY_KINDS];
+    uint64_t query_max_ns[QUERY_KINDS];
+} Totals;
+
+_Thread_local ThreadStats *thread_stats;
+
+/** Every thread's counters */
+static ThreadStats *threads;
+/** Totals at the last reset */
+static Totals baseline;
+/** Guards threads and baseline */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Adds up every thread's counters. Called with stats_lock held. */
+static void add_up( Totals *totals ) {
+    *totals = ( Totals ){ 0 };
+    for ( ThreadStats *stats = threads; stats != NULL; stats = stats->next ) {
+        for ( int i = 0; i < PHASE_COUNT; i++ ) {
+            totals->phase_ns[i] += atomic_load_explicit( &stats->phase_ns[i], memory_order_relaxed );
+            totals->phase_calls[i] += atomic_load_explicit( &stats->phase_calls[i],
+                                                            memory_order_relaxed );
+        }
+        for ( int i = 0; i < COUNTER_COUNT; i++ ) {
+            totals->counters[i] += atomic_load_explicit( &stats->counters[i], memory_order_relaxed );
+        }
+        for ( int i = 0; i < QUERY_KINDS; i++ ) {
+            totals->query_ns[i] += atomic_load_explicit( &stats->query_ns[i], memory_order_relaxed );
+            totals->query_calls[i] += atomic_load_explicit( &stats->query_calls[i],
+                                                            memory_order_relaxed );
+            uint64_t max = atomic_load_explicit( &stats->query_max_ns[i], memory_order_relaxed );
+            if ( max > totals->query_max_ns[i] ) {
+                totals->query_max_ns[i] = max;
+            }
+        }
+    }
+}
+
+/** Adds the current thread's counters to the list. */
+ThreadStats *register_thread_stats( void ) {
+    ThreadStats *stats = ( ThreadStats * )calloc( 1, sizeof( ThreadStats ) );
+    if ( stats == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    pthread_mutex_lock( &stats_lock );
+    stats->next = threads;
+    threads = stats;
+    pthread_mutex_unlock( &stats_lock );
+    thread_stats = stats;
+    return stats;
+}
+
+_Static_assert( HELP < QUERY_KINDS, "QUERY_KINDS must cover every QueryType" );
+
+/** Names of the query types */
+static const char *query_names[QUERY_KINDS] = {
+    [CREATE_TABLE] = "create_table",
+    [INSERT] = "insert",
+    [SELECT] = "select",
+    [UPDATE] = "update",
+    [DELETE] = "delete",
+    [DROP] = "drop",
+    [READ_FILE] = "read_file",
+    [WRITE_FILE] = "write_file",
+    [SNAPSHOT] = "snapshot",
+    [COMPRESS] = "compress",
+    [DECOMPRESS] = "decompress",
+    [BEGIN] = "begin",
+    [COMMIT] = "commit",
+    [ROLLBACK] = "rollback",
+    [STATS] = "stats",
+    [RESET_STATS] = "stats reset",
+    [TRACE] = "trace",
+    [CREATE_VIEW] = "create_view",
+    [OVERDUE] = "overdue",
+    [DUE] = "due",
+    [ENQUEUE] = "enqueue",
+    [PEEK] = "peek",
+    [DEQUEUE] = "dequeue",
+    [LEAVE] = "leave",
+    [CREATE_FOREIGN_KEY] = "foreign_key",
+    [INVALID_QUERY] = "invalid",
+    [HELP] = "help"
+};
+
+/** Names a query type. */
+const char *query_type_name( int type ) {
+    return type >= 0 && type < QUERY_KINDS && query_names[type] != NULL ? query_names[type]
+                                                                        : "invalid";
+}
+
+#ifndef NO_STATS
+/** Names of the phases */
+static const char *phase_names[PHASE_COUNT] = {
+    [PHASE_PARSE] = "parse",
+    [PHASE_OPEN] = "open",
+    [PHASE_SCAN] = "scan",
+    [PHASE_FORMAT] = "format",
+    [PHASE_WRITE] = "write"
+};
+
+/** Names of the counters */
+static const char *counter_names[COUNTER_COUNT] = {
+    [ROWS_SCANNED] = "rows_scanned",
+    [ROWS_MATCHED] = "rows_matched",
+    [BYTES_READ] = "bytes_read",
+    [BYTES_WRITTEN] = "bytes_written",
+    [BYTES_OUTPUT] = "bytes_output",
+    [SYSCALLS] = "syscalls"
+};
+
+/** Prints the query, phase, and counter totals since the last reset. */
+static void print_totals( void ) {
+    Totals totals, base;
+    pthread_mutex_lock( &stats_lock );
+    add_up( &totals );
+    base = baseline;
+    pthread_mutex_unlock( &stats_lock );
+
+    out_printf( "%-16s %10s %12s %10s %10s\n", "query", "count", "total_ms", "avg_us", "max_us" );
+    for ( int i = 0; i < QUERY_KINDS; i++ ) {
+        uint64_t calls = totals.query_calls[i] - base.query_calls[i];
+        if ( calls > 0 && query_names[i] != NULL ) {
+            uint64_t ns = totals.query_ns[i] - base.query_ns[i];
+            out_printf( "%-16s %10llu %12.3f %10.1f %10.1f\n", query_names[i],
+                        ( unsigned long long )calls, ns / 1e6, ns / 1e3 / calls,
+                        totals.query_max_ns[i] / 1e3 );
+        }
+    }
+
+    out_printf( "%-16s %10s %12s %10s\n", "phase", "count", "total_ms", "avg_us" );
+    for ( int i = 0; i < PHASE_COUNT; i++ ) {
+        uint64_t calls = totals.phase_calls[i] - base.phase_calls[i];
+        uint64_t ns = totals.phase_ns[i] - base.phase_ns[i];
+        out_printf( "%-16s %10llu %12.3f %10.1f\n", phase_names[i], ( unsigned long long )calls,
+                    ns / 1e6, calls > 0 ? ns / 1e3 / calls : 0.0 );
+    }
+
+    out_printf( "%-16s %10s\n", "counter", "value" );
+    for ( int i = 0; i < COUNTER_COUNT; i++ ) {
+        out_printf( "%-16s %10llu\n", counter_names[i],
+                    ( unsigned long long )( totals.counters[i] - base.counters[i] ) );
+    }
+}
+#endif
+
+/** Prints every statistic. */
+void print_stats( void ) {
+#ifdef NO_STATS
+    out_printf( "Query statistics were disabled at compile time.\n" );
+#else
+    print_totals();
+#endif
+    out_printf( "%-16s %10s\n", "storage", storage_backend() );
+    print_block_cache_stats();
+    print_lock_stats();
+    print_bloom_stats();
+    print_log_stats();
+}
+
+/** Sets every statistic back to 0. */
+void reset_stats( void ) {
+    pthread_mutex_lock( &stats_lock );
+    add_up( &baseline );
+    // A maximum cannot be subtracted, so it is cleared. Only a query finishing at the same moment
+    // can put back the maximum from before.
+    for ( ThreadStats *stats = threads; stats != NULL; stats = stats->next ) {
+        for ( int i = 0; i < QUERY_KINDS; i++ ) {
+            atomic_store_explicit( &stats->query_max_ns[i], 0, memory_order_relaxed );
+        }
+    }
+    pthread_mutex_unlock( &stats_lock );
+    reset_block_cache_stats();
+    reset_lock_stats();
+    reset_bloom_stats();
+    reset_log_stats();
+}
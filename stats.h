@@ -0,0 +1,207 @@
+/**
+   @file stats.h
+   @author Michael Warstler (mwwarstl)
+   Header file for query statistics. Queries are timed by type, the phases of running them
+   (parsing, opening tables, scanning rows, formatting output, writing tables) are timed on the
+   monotonic clock, and counters record rows scanned and matched, bytes read, written, and sent
+   as output, and system calls made. Every thread adds to counters of its own, which only it
+   writes, so counting takes no locks; the stats command adds up every thread's counters. Built
+   with NO_STATS defined (make STATS=0) the counting functions are empty and compile away.
+*/
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+
+/** Number of query types counters are kept for, at least the number of QueryType values */
+#define QUERY_KINDS 32
+/** One matched row in this many has its formatting timed, and the time is scaled up to match */
+#define FORMAT_SAMPLE 16
+
+#ifdef NO_STATS
+/** Whether the counting functions count */
+#define STATS_ENABLED 0
+#else
+#define STATS_ENABLED 1
+#endif
+
+/** Phases of running a query that are timed */
+typedef enum {
+    PHASE_PARSE,
+    PHASE_OPEN,
+    PHASE_SCAN,
+    PHASE_FORMAT,
+    PHASE_WRITE,
+    PHASE_COUNT
+} Phase;
+
+/** Things that are counted */
+typedef enum {
+    ROWS_SCANNED,
+    ROWS_MATCHED,
+    BYTES_READ,
+    BYTES_WRITTEN,
+    BYTES_OUTPUT,
+    SYSCALLS,
+    COUNTER_COUNT
+} Counter;
+
+/**
+   A ThreadStats holds one thread's counters, chained in a list of every thread's. Only its own
+   thread writes it, with relaxed atomic loads and stores that compile to plain moves.
+*/
+typedef struct ThreadStats {
+    _Atomic uint64_t phase_ns[PHASE_COUNT];
+    _Atomic uint64_t phase_calls[PHASE_COUNT];
+    _Atomic uint64_t counters[COUNTER_COUNT];
+    _Atomic uint64_t query_ns[QUERY_KINDS];
+    _Atomic uint64_t query_calls[QUERY_KINDS];
+    _Atomic uint64_t query_max_ns[QUERY_KINDS];
+    struct ThreadStats *next;
+} ThreadStats;
+
+/** The current thread's counters, NULL until it first counts something */
+extern _Thread_local ThreadStats *thread_stats;
+
+/**
+   Adds the current thread's counters to the list of every thread's.
+   @return is the current thread's counters.
+*/
+ThreadStats *register_thread_stats( void );
+
+/**
+   Prints every statistic: queries by type, phases, counters, the storage backend, the block
+   cache, table locks, id filters, and the commit log.
+*/
+void print_stats( void );
+
+/**
+   Sets every statistic back to 0.
+*/
+void reset_stats( void );
+
+/**
+   Names a query type, as the stats command prints it.
+   @param type is the QueryType.
+   @return is the type's name.
+*/
+const char *query_type_name( int type );
+
+/**
+   Returns the time on the monotonic clock, even when statistics are compiled out. Explain analyze
+   times queries with it.
+   @return is the time in nanoseconds.
+*/
+static inline uint64_t monotonic_ns( void ) {
+    struct timespec time;
+    clock_gettime( CLOCK_MONOTONIC, &time );
+    return ( uint64_t )time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+#ifdef NO_STATS
+
+static inline uint64_t stats_clock( void ) {
+    return 0;
+}
+static inline void stats_phase( Phase phase, uint64_t start ) {
+}
+static inline void stats_time( Phase phase, uint64_t elapsed ) {
+}
+static inline void stats_add( Counter counter, uint64_t amount ) {
+}
+static inline uint64_t stats_counter( Counter counter ) {
+    return 0;
+}
+static inline void stats_query_time( int type, uint64_t elapsed ) {
+}
+static inline void stats_query( int type, uint64_t start ) {
+}
+
+#else
+
+/**
+   Returns the time on the monotonic clock, to start timing something.
+   @return is the time in nanoseconds.
+*/
+static inline uint64_t stats_clock( void ) {
+    return monotonic_ns();
+}
+
+/** Adds to one of the current thread's counters. */
+static inline void stats_bump( _Atomic uint64_t *counter, uint64_t amount ) {
+    atomic_store_explicit( counter, atomic_load_explicit( counter, memory_order_relaxed ) + amount,
+                           memory_order_relaxed );
+}
+
+/** Returns the current thread's counters. */
+static inline ThreadStats *my_stats( void ) {
+    return thread_stats != NULL ? thread_stats : register_thread_stats();
+}
+
+/**
+   Counts a phase that took a length of time.
+   @param phase is the phase.
+   @param elapsed is the time the phase took in nanoseconds.
+*/
+static inline void stats_time( Phase phase, uint64_t elapsed ) {
+    ThreadStats *stats = my_stats();
+    stats_bump( &stats->phase_ns[phase], elapsed );
+    stats_bump( &stats->phase_calls[phase], 1 );
+}
+
+/**
+   Counts a phase that started at a time and ends now.
+   @param phase is the phase.
+   @param start is the time from stats_clock when the phase started.
+*/
+static inline void stats_phase( Phase phase, uint64_t start ) {
+    stats_time( phase, stats_clock() - start );
+}
+
+/**
+   Adds to a counter.
+   @param counter is the counter.
+   @param amount is the amount to add.
+*/
+static inline void stats_add( Counter counter, uint64_t amount ) {
+    stats_bump( &my_stats()->counters[counter], amount );
+}
+
+/**
+   Returns how much the current thread has added to a counter, to measure what a piece of work
+   adds to it.
+   @param counter is the counter.
+   @return is the current thread's total for the counter.
+*/
+static inline uint64_t stats_counter( Counter counter ) {
+    return atomic_load_explicit( &my_stats()->counters[counter], memory_order_relaxed );
+}
+
+/**
+   Counts a query of a type that took a length of time.
+   @param type is the query's QueryType.
+   @param elapsed is the time the query took in nanoseconds.
+*/
+static inline void stats_query_time( int type, uint64_t elapsed ) {
+    ThreadStats *stats = my_stats();
+    stats_bump( &stats->query_ns[type], elapsed );
+    stats_bump( &stats->query_calls[type], 1 );
+    if ( elapsed > atomic_load_explicit( &stats->query_max_ns[type], memory_order_relaxed ) ) {
+        atomic_store_explicit( &stats->query_max_ns[type], elapsed, memory_order_relaxed );
+    }
+}
+
+/**
+   Counts a query of a type that started at a time and ends now.
+   @param type is the query's QueryType.
+   @param start is the time from stats_clock when the query started.
+*/
+static inline void stats_query( int type, uint64_t start ) {
+    stats_query_time( type, stats_clock() - start );
+}
+
+#endif //NO_STATS
+
+#endif //STATS_H
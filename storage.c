@@ -0,0 +1,575 @@
+/**
+   @file storage.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for table file I/O. The io_uring is driven with raw system calls and the
+   ring layout from linux/io_uring.h, so no library is needed. Each thread sets up its own ring
+   the first time it does I/O and registers IO_DEPTH read buffers with it, so chunk reads use
+   IORING_OP_READ_FIXED and the kernel does not map the buffers on every read.
+*/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "database.h"
+#include "stats.h"
+#include "storage.h"
+#include "trace.h"
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+
+#if defined( __linux__ ) && defined( __NR_io_uring_setup )
+/** io_uring is available to build */
+#define HAVE_IO_URING 1
+#endif
+
+/** Whether new threads set up an io_uring */
+static atomic_bool use_io_uring = true;
+
+/** Turns io_uring on or off for threads that have not set up a ring. */
+void set_io_uring( bool enabled ) {
+    atomic_store( &use_io_uring, enabled );
+}
+
+/** Reads a range of a file with pread, retrying after partial reads. Returns bytes read or -1. */
+static ssize_t read_range( int fd, char *buffer, size_t length, off_t offset ) {
+    size_t total = 0;
+    while ( total < length ) {
+        trace_begin( "io" );
+        ssize_t got = pread( fd, buffer + total, length - total, offset + total );
+        trace_end( "io" );
+        stats_add( SYSCALLS, 1 );
+        if ( got < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return -1;
+        }
+        if ( got == 0 ) {
+            break;
+        }
+        total += got;
+    }
+    stats_add( BYTES_READ, total );
+    return total;
+}
+
+/** Writes the rest of a set of buffers with writev, starting skip bytes in. */
+static int write_rest( int fd, const struct iovec *parts, int count, size_t skip ) {
+    struct iovec rest[count];
+    memcpy( rest, parts, count * sizeof( struct iovec ) );
+    struct iovec *part = rest;
+    while ( count > 0 ) {
+        // Skip past whatever was written.
+        while ( count > 0 && skip >= part->iov_len ) {
+            skip -= part->iov_len;
+            part++;
+            count--;
+        }
+        if ( count == 0 ) {
+            break;
+        }
+        part->iov_base = ( char * )part->iov_base + skip;
+        part->iov_len -= skip;
+        trace_begin( "io" );
+        ssize_t written = writev( fd, part, count );
+        trace_end( "io" );
+        stats_add( SYSCALLS, 1 );
+        if ( written < 0 ) {
+            if ( errno == EINTR ) {
+                written = 0;
+            }
+            else {
+                return EXIT_FAILURE;
+            }
+        }
+        stats_add( BYTES_WRITTEN, written );
+        skip = written;
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Reads a file a chunk at a time with pread, starting at an offset. */
+static int stream_pread( int fd, off_t offset, off_t length, ChunkConsumer consume,
+                         void *context ) {
+    char *buffer = ( char * )malloc( IO_CHUNK_SIZE );
+    if ( buffer == NULL ) {
+        return EXIT_FAILURE;
+    }
+    while ( offset < length ) {
+        size_t want = length - offset < IO_CHUNK_SIZE ? length - offset : IO_CHUNK_SIZE;
+        ssize_t got = read_range( fd, buffer, want, offset );
+        if ( got < 0 ) {
+            free( buffer );
+            return EXIT_FAILURE;
+        }
+        if ( got > 0 ) {
+            consume( context, buffer, got );
+        }
+        if ( ( size_t )got < want ) {
+            break;
+        }
+        offset += got;
+    }
+    free( buffer );
+    return EXIT_SUCCESS;
+}
+
+#ifdef HAVE_IO_URING
+
+/** A Ring holds one thread's io_uring: its mapped queues and its registered read buffers. */
+typedef struct {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    bool registered;
+    char *buffers;
+} Ring;
+
+/** The current thread's ring, and whether setting one up failed */
+static _Thread_local Ring *thread_ring;
+static _Thread_local bool ring_failed;
+
+/** Sets up an io_uring and registers its read buffers. Returns NULL if io_uring is unavailable. */
+static Ring *open_ring( void ) {
+    struct io_uring_params params;
+    memset( &params, 0, sizeof( params ) );
+    int fd = syscall( __NR_io_uring_setup, IO_DEPTH * 2, &params );
+    if ( fd < 0 ) {
+        return NULL;
+    }
+
+    // Map the submission and completion queues (one mapping on kernels that share it) and the
+    // submission entries.
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if ( single && cq_size > sq_size ) {
+        sq_size = cq_size;
+    }
+    char *sq = ( char * )mmap( NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                               fd, IORING_OFF_SQ_RING );
+    char *cq = sq;
+    if ( sq != MAP_FAILED && !single ) {
+        cq = ( char * )mmap( NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             fd, IORING_OFF_CQ_RING );
+    }
+    size_t sqes_size = params.sq_entries * sizeof( struct io_uring_sqe );
+    void *sqes = mmap( NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                       IORING_OFF_SQES );
+    Ring *ring = ( Ring * )calloc( 1, sizeof( Ring ) );
+    char *buffers = ( char * )aligned_alloc( 4096, IO_DEPTH * IO_CHUNK_SIZE );
+    if ( sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED || ring == NULL ||
+         buffers == NULL ) {
+        if ( sq != MAP_FAILED ) {
+            munmap( sq, sq_size );
+        }
+        if ( cq != MAP_FAILED && cq != sq ) {
+            munmap( cq, cq_size );
+        }
+        if ( sqes != MAP_FAILED ) {
+            munmap( sqes, sqes_size );
+        }
+        close( fd );
+        free( ring );
+        free( buffers );
+        return NULL;
+    }
+
+    ring->fd = fd;
+    ring->sq_head = ( unsigned * )( sq + params.sq_off.head );
+    ring->sq_tail = ( unsigned * )( sq + params.sq_off.tail );
+    ring->sq_mask = ( unsigned * )( sq + params.sq_off.ring_mask );
+    ring->sq_array = ( unsigned * )( sq + params.sq_off.array );
+    ring->cq_head = ( unsigned * )( cq + params.cq_off.head );
+    ring->cq_tail = ( unsigned * )( cq + params.cq_off.tail );
+    ring->cq_mask = ( unsigned * )( cq + params.cq_off.ring_mask );
+    ring->sqes = ( struct io_uring_sqe * )sqes;
+    ring->cqes = ( struct io_uring_cqe * )( cq + params.cq_off.cqes );
+    ring->buffers = buffers;
+
+    // Register the read buffers. Without them reads still work, just not as fixed reads.
+    struct iovec registered[IO_DEPTH];
+    for ( int i = 0; i < IO_DEPTH; i++ ) {
+        registered[i].iov_base = buffers + i * IO_CHUNK_SIZE;
+        registered[i].iov_len = IO_CHUNK_SIZE;
+    }
+    ring->registered = syscall( __NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, registered,
+                                IO_DEPTH ) == 0;
+    return ring;
+}
+
+/** Returns the current thread's ring, setting it up the first time. NULL means use pread. */
+static Ring *get_ring( void ) {
+    if ( thread_ring == NULL && !ring_failed ) {
+        if ( atomic_load( &use_io_uring ) ) {
+            thread_ring = open_ring();
+        }
+        ring_failed = thread_ring == NULL;
+    }
+    return thread_ring;
+}
+
+/** Returns the next free submission entry, cleared. The ring has room for every caller's use. */
+static struct io_uring_sqe *next_sqe( Ring *ring ) {
+    unsigned index = *ring->sq_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset( sqe, 0, sizeof( *sqe ) );
+    return sqe;
+}
+
+/** Queues the entry returned by next_sqe once it is filled in. */
+static void queue_sqe( Ring *ring ) {
+    unsigned tail = *ring->sq_tail;
+    ring->sq_array[ tail & *ring->sq_mask ] = tail & *ring->sq_mask;
+    atomic_store_explicit( ( _Atomic unsigned * )ring->sq_tail, tail + 1, memory_order_release );
+}
+
+/**
+   Submits every queued entry and waits for a completion. The kernel only waits if it submitted
+   as many entries as it was asked to, so it is asked for exactly the ones it has not taken yet,
+   which also picks up any left over from an interrupted call.
+*/
+static int enter_ring( Ring *ring ) {
+    while ( true ) {
+        unsigned queued = *ring->sq_tail - atomic_load_explicit( ( _Atomic unsigned * )ring->sq_head,
+                                                                 memory_order_acquire );
+        trace_begin( "io" );
+        int result = syscall( __NR_io_uring_enter, ring->fd, queued, 1, IORING_ENTER_GETEVENTS,
+                              NULL, 0 );
+        trace_end( "io" );
+        stats_add( SYSCALLS, 1 );
+        if ( result >= 0 || errno != EINTR ) {
+            return result;
+        }
+    }
+}
+
+/**
+   Stops using the current thread's ring after an error, and uses pread from then on. Its buffers
+   are not freed, since reads the kernel still has could land in them.
+*/
+static void abandon_ring( void ) {
+    close( thread_ring->fd );
+    thread_ring = NULL;
+    ring_failed = true;
+}
+
+/** Takes the next completion if there is one. */
+static bool next_cqe( Ring *ring, uint64_t *user_data, int *result ) {
+    unsigned head = *ring->cq_head;
+    unsigned tail = atomic_load_explicit( ( _Atomic unsigned * )ring->cq_tail,
+                                          memory_order_acquire );
+    if ( head == tail ) {
+        return false;
+    }
+    struct io_uring_cqe *cqe = &ring->cqes[ head & *ring->cq_mask ];
+    *user_data = cqe->user_data;
+    *result = cqe->res;
+    atomic_store_explicit( ( _Atomic unsigned * )ring->cq_head, head + 1, memory_order_release );
+    return true;
+}
+
+/**
+   Reads a file with up to IO_DEPTH chunk reads in flight. Chunk i is read into buffer i % IO_DEPTH
+   and given to the consumer once every chunk before it has been.
+*/
+static int stream_ring( Ring *ring, int fd, off_t length, ChunkConsumer consume, void *context ) {
+    long chunks = ( length + IO_CHUNK_SIZE - 1 ) / IO_CHUNK_SIZE;
+    int results[IO_DEPTH];
+    long submitted = 0, consumed = 0;
+    int in_flight = 0;
+    int status = EXIT_SUCCESS;
+
+    while ( consumed < chunks ) {
+        // Queue reads for the chunks ahead until every buffer is busy.
+        while ( submitted < chunks && submitted - consumed < IO_DEPTH ) {
+            int slot = submitted % IO_DEPTH;
+            off_t offset = ( off_t )submitted * IO_CHUNK_SIZE;
+            size_t want = length - offset < IO_CHUNK_SIZE ? length - offset : IO_CHUNK_SIZE;
+            struct io_uring_sqe *sqe = next_sqe( ring );
+            sqe->opcode = ring->registered ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            sqe->fd = fd;
+            sqe->addr = ( uint64_t )( uintptr_t )( ring->buffers + slot * IO_CHUNK_SIZE );
+            sqe->len = want;
+            sqe->off = offset;
+            sqe->buf_index = ring->registered ? slot : 0;
+            sqe->user_data = submitted;
+            queue_sqe( ring );
+            results[slot] = INT32_MIN;
+            submitted++;
+            in_flight++;
+        }
+        if ( enter_ring( ring ) < 0 ) {
+            // The ring is unusable, so finish with pread from the first chunk not consumed.
+            abandon_ring();
+            return stream_pread( fd, ( off_t )consumed * IO_CHUNK_SIZE, length, consume, context );
+        }
+
+        uint64_t chunk;
+        int result;
+        while ( next_cqe( ring, &chunk, &result ) ) {
+            results[ chunk % IO_DEPTH ] = result;
+            in_flight--;
+        }
+
+        // Hand over finished chunks in order. A short or failed read is finished with pread.
+        while ( status == EXIT_SUCCESS && consumed < submitted &&
+                results[ consumed % IO_DEPTH ] != INT32_MIN ) {
+            int slot = consumed % IO_DEPTH;
+            char *buffer = ring->buffers + slot * IO_CHUNK_SIZE;
+            off_t offset = ( off_t )consumed * IO_CHUNK_SIZE;
+            size_t want = length - offset < IO_CHUNK_SIZE ? length - offset : IO_CHUNK_SIZE;
+            ssize_t got = results[slot] < 0 ? 0 : results[slot];
+            stats_add( BYTES_READ, got );
+            if ( ( size_t )got < want ) {
+                ssize_t rest = read_range( fd, buffer + got, want - got, offset + got );
+                got = rest < 0 ? -1 : got + rest;
+            }
+            if ( got < 0 ) {
+                status = EXIT_FAILURE;
+                break;
+            }
+            if ( got > 0 ) {
+                consume( context, buffer, got );
+            }
+            consumed++;
+            if ( ( size_t )got < want ) {
+                chunks = consumed;  // The file ended early.
+            }
+        }
+        if ( status != EXIT_SUCCESS ) {
+            break;
+        }
+    }
+
+    // Buffers cannot be reused while reads into them are still in flight.
+    while ( in_flight > 0 ) {
+        if ( enter_ring( ring ) < 0 ) {
+            abandon_ring();
+            break;
+        }
+        uint64_t chunk;
+        int result;
+        while ( next_cqe( ring, &chunk, &result ) ) {
+            in_flight--;
+        }
+    }
+    return status;
+}
+
+/** Writes buffers with one IORING_OP_WRITEV, finishing a short write with writev. */
+static int write_ring( Ring *ring, int fd, const struct iovec *parts, int count ) {
+    struct io_uring_sqe *sqe = next_sqe( ring );
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = ( uint64_t )( uintptr_t )parts;
+    sqe->len = count;
+    sqe->off = ( uint64_t )-1;     // At the file position, or the end for O_APPEND.
+    queue_sqe( ring );
+    uint64_t user_data;
+    int result;
+    do {
+        if ( enter_ring( ring ) < 0 ) {
+            // The write was not submitted.
+            abandon_ring();
+            return write_rest( fd, parts, count, 0 );
+        }
+    } while ( !next_cqe( ring, &user_data, &result ) );
+    if ( result > 0 ) {
+        stats_add( BYTES_WRITTEN, result );
+    }
+    if ( result < 0 ) {
+        return result == -EINTR || result == -EAGAIN ? write_rest( fd, parts, count, 0 )
+                                                     : EXIT_FAILURE;
+    }
+    return write_rest( fd, parts, count, result );
+}
+
+#endif //HAVE_IO_URING
+
+/** Names the current thread's backend. */
+const char *storage_backend( void ) {
+#ifdef HAVE_IO_URING
+    if ( get_ring() != NULL ) {
+        return "io_uring";
+    }
+#endif
+    return "pread";
+}
+
+/** Reads a file a chunk at a time. */
+int storage_stream( int fd, off_t length, ChunkConsumer consume, void *context ) {
+#ifdef HAVE_IO_URING
+    Ring *ring = get_ring();
+    if ( ring != NULL ) {
+        return stream_ring( ring, fd, length, consume, context );
+    }
+#endif
+    return stream_pread( fd, 0, length, consume, context );
+}
+
+/** Writes buffers as one write. */
+int storage_write( int fd, const struct iovec *parts, int count ) {
+#ifdef HAVE_IO_URING
+    Ring *ring = get_ring();
+    if ( ring != NULL ) {
+        return write_ring( ring, fd, parts, count );
+    }
+#endif
+    return write_rest( fd, parts, count, 0 );
+}
+
+/** Reads bytes at an offset. */
+ssize_t storage_read_at( int fd, char *buffer, size_t length, off_t offset ) {
+    return read_range( fd, buffer, length, offset );
+}
+
+/** Maps the start of a file for reading, counting it as read. */
+void *storage_map( int fd, off_t length ) {
+    void *data = mmap( NULL, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+    stats_add( SYSCALLS, 1 );
+    if ( data == MAP_FAILED ) {
+        return NULL;
+    }
+    stats_add( BYTES_READ, length );
+    return data;
+}
+
+/** Unmaps a file mapped with storage_map. */
+void storage_unmap( void *data, off_t length ) {
+    munmap( data, length );
+    stats_add( SYSCALLS, 1 );
+}
+
+/** Writes bytes at an offset. */
+int storage_write_at( int fd, const char *data, size_t length, off_t offset ) {
+    while ( length > 0 ) {
+        ssize_t written = pwrite( fd, data, length, offset );
+        stats_add( SYSCALLS, 1 );
+        if ( written < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return EXIT_FAILURE;
+        }
+        stats_add( BYTES_WRITTEN, written );
+        data += written;
+        length -= written;
+        offset += written;
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Copies the rest of a range with pread and pwrite. */
+static int copy_through_buffer( int in_fd, off_t in_offset, int out_fd, off_t out_offset,
+                                off_t length ) {
+    char *buffer = ( char * )malloc( IO_CHUNK_SIZE );
+    if ( buffer == NULL ) {
+        return EXIT_FAILURE;
+    }
+    while ( length > 0 ) {
+        size_t want = length < IO_CHUNK_SIZE ? length : IO_CHUNK_SIZE;
+        ssize_t got = read_range( in_fd, buffer, want, in_offset );
+        if ( got <= 0 || storage_write_at( out_fd, buffer, got, out_offset ) != EXIT_SUCCESS ) {
+            free( buffer );
+            return got == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        in_offset += got;
+        out_offset += got;
+        length -= got;
+    }
+    free( buffer );
+    return EXIT_SUCCESS;
+}
+
+/** Copies one range inside the kernel, falling back to a buffer if the files do not allow it. */
+static int copy_range( const CopyRange *range ) {
+    off_t in_offset = range->in_offset, out_offset = range->out_offset;
+    off_t length = range->length;
+    while ( length > 0 ) {
+        ssize_t copied = copy_file_range( range->in_fd, &in_offset, range->out_fd, &out_offset,
+                                          length, 0 );
+        stats_add( SYSCALLS, 1 );
+        if ( copied < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            if ( errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP ) {
+                return copy_through_buffer( range->in_fd, in_offset, range->out_fd, out_offset,
+                                            length );
+            }
+            return EXIT_FAILURE;
+        }
+        if ( copied == 0 ) {
+            break;  // The input ended early.
+        }
+        stats_add( BYTES_READ, copied );
+        stats_add( BYTES_WRITTEN, copied );
+        length -= copied;
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Ranges being copied by storage_copy's threads, and the next one to take. */
+typedef struct {
+    const CopyRange *ranges;
+    int count;
+    atomic_int next;
+    atomic_int status;
+} CopyJob;
+
+/** Copy thread. Takes ranges until there are none left. */
+static void *copy_thread( void *argument ) {
+    CopyJob *job = ( CopyJob * )argument;
+    int index;
+    while ( ( index = atomic_fetch_add( &job->next, 1 ) ) < job->count ) {
+        if ( copy_range( &job->ranges[index] ) != EXIT_SUCCESS ) {
+            atomic_store( &job->status, EXIT_FAILURE );
+        }
+    }
+    return NULL;
+}
+
+/** Copies ranges, several at once when there is enough to copy. */
+int storage_copy( const CopyRange *ranges, int count ) {
+    off_t total = 0;
+    for ( int i = 0; i < count; i++ ) {
+        total += ranges[i].length;
+    }
+    long cores = sysconf( _SC_NPROCESSORS_ONLN );
+    int threads = cores > 1 && count > 1 ? ( count < cores ? count : ( int )cores ) : 1;
+    if ( total < PARALLEL_COPY_THRESHOLD ) {
+        threads = 1;
+    }
+
+    CopyJob job = { .ranges = ranges, .count = count };
+    atomic_init( &job.next, 0 );
+    atomic_init( &job.status, EXIT_SUCCESS );
+
+    // The calling thread copies too, alongside threads - 1 helpers.
+    pthread_t helpers[threads > 1 ? threads - 1 : 1];
+    int started = 0;
+    for ( int i = 0; i < threads - 1; i++ ) {
+        if ( pthread_create( &helpers[started], NULL, copy_thread, &job ) == 0 ) {
+            started++;
+        }
+    }
+    copy_thread( &job );
+    for ( int i = 0; i < started; i++ ) {
+        pthread_join( helpers[i], NULL );
+    }
+    return atomic_load( &job.status );
+}
@@ -0,0 +1,120 @@
+/**
+   @file storage.h
+   @author Michael Warstler (mwwarstl)
+   Header file for table file I/O. Files are read as a stream of chunks with several reads in
+   flight at once, and rows are written with one batched write. On Linux the reads and writes go
+   through an io_uring owned by each thread, reading into buffers registered with the kernel; if
+   io_uring is unavailable (or turned off) plain pread and writev are used instead. Whole ranges of
+   one file are copied into another inside the kernel with copy_file_range, several at once.
+*/
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/** Number of bytes read at a time */
+#define IO_CHUNK_SIZE ( 128 * 1024 )
+/** Max number of reads in flight at once */
+#define IO_DEPTH 8
+/** Copies totalling fewer bytes than this are done one after another on the calling thread */
+#define PARALLEL_COPY_THRESHOLD ( 1024 * 1024 )
+
+/** A CopyRange is length bytes of one file to copy to an offset of another. */
+typedef struct {
+    int in_fd;
+    off_t in_offset;
+    int out_fd;
+    off_t out_offset;
+    off_t length;
+} CopyRange;
+
+/**
+   Function given each chunk of a file in order.
+   @param context is the pointer passed to storage_stream.
+   @param data is the chunk's bytes. They are only valid until the function returns.
+   @param length is the number of bytes in the chunk.
+*/
+typedef void ( *ChunkConsumer )( void *context, const char *data, size_t length );
+
+/**
+   Sets whether io_uring is used. Threads that already set up a ring keep using it.
+   @param enabled is false to use pread and writev only.
+*/
+void set_io_uring( bool enabled );
+
+/**
+   Returns the name of the I/O backend the current thread uses, setting it up if needed.
+   @return is "io_uring" or "pread".
+*/
+const char *storage_backend( void );
+
+/**
+   Reads the first length bytes of a file and gives them to a consumer a chunk at a time, in
+   order. Up to IO_DEPTH chunks are read ahead while earlier ones are consumed.
+   @param fd is the file to read.
+   @param length is the number of bytes to read.
+   @param consume is the function each chunk is given to.
+   @param context is passed to consume.
+   @return is EXIT_FAILURE if a read failed, otherwise EXIT_SUCCESS
+*/
+int storage_stream( int fd, off_t length, ChunkConsumer consume, void *context );
+
+/**
+   Writes buffers to a file one after another as a single write. A file opened with O_APPEND gets
+   all of them added to its end at once.
+   @param fd is the file to write.
+   @param parts is the buffers to write, in order.
+   @param count is the number of buffers.
+   @return is EXIT_FAILURE if the write failed, otherwise EXIT_SUCCESS
+*/
+int storage_write( int fd, const struct iovec *parts, int count );
+
+/**
+   Reads bytes from a file at an offset, without moving the file position. Stops early only at
+   the end of the file.
+   @param fd is the file to read.
+   @param buffer is where the bytes are stored.
+   @param length is the number of bytes to read.
+   @param offset is where in the file to read them from.
+   @return is the number of bytes read, or -1 if the read failed.
+*/
+ssize_t storage_read_at( int fd, char *buffer, size_t length, off_t offset );
+
+/**
+   Maps the start of a file into memory for reading. The mapped bytes are counted as read.
+   @param fd is the file to map.
+   @param length is the number of bytes to map, more than 0.
+   @return is the mapping, or NULL if the file could not be mapped.
+*/
+void *storage_map( int fd, off_t length );
+
+/**
+   Unmaps a file mapped with storage_map.
+   @param data is the mapping.
+   @param length is the number of bytes mapped.
+*/
+void storage_unmap( void *data, off_t length );
+
+/**
+   Writes bytes to a file at an offset, without moving the file position.
+   @param fd is the file to write.
+   @param data is the bytes to write.
+   @param length is the number of bytes.
+   @param offset is where in the file to write them.
+   @return is EXIT_FAILURE if the write failed, otherwise EXIT_SUCCESS
+*/
+int storage_write_at( int fd, const char *data, size_t length, off_t offset );
+
+/**
+   Copies ranges between files. Each range is copied inside the kernel with copy_file_range, or
+   with pread and pwrite where that is not supported. Ranges are copied on up to one thread per
+   processor at once, so the ranges must not overlap in any output file.
+   @param ranges is the ranges to copy.
+   @param count is the number of ranges.
+   @return is EXIT_FAILURE if any copy failed, otherwise EXIT_SUCCESS
+*/
+int storage_copy( const CopyRange *ranges, int count );
+
+#endif //STORAGE_H
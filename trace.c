@@ -0,0 +1,129 @@
+/**
+   @file trace.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for event tracing. Each thread's ring is allocated the first time it
+   records an event and kept for as long as the process runs, like its statistics. Writing the
+   trace copies each ring's events without stopping its thread, then checks how far the thread
+   got in the meantime and drops the events it may have overwritten during the copy.
+*/
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "database.h"
+#include "sink.h"
+#include "trace.h"
+
+atomic_bool tracing;
+
+_Thread_local TraceRing *thread_trace;
+
+/** Every thread's ring */
+static TraceRing *rings;
+/** Guards rings and exit_path */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+/** File the trace is written to at exit, if any */
+static char exit_path[MAX_STR_LENGTH];
+
+/** Adds the current thread's ring to the list. */
+TraceRing *register_thread_trace( void ) {
+    TraceRing *ring = ( TraceRing * )calloc( 1, sizeof( TraceRing ) );
+    if ( ring == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    ring->tid = ( int )syscall( SYS_gettid );
+    pthread_mutex_lock( &trace_lock );
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock( &trace_lock );
+    thread_trace = ring;
+    return ring;
+}
+
+/** Turns tracing on or off. */
+void set_tracing( bool enabled ) {
+    atomic_store( &tracing, enabled );
+}
+
+/** Traces the whole run, writing the trace to a file at exit. */
+void trace_at_exit( const char *path ) {
+    pthread_mutex_lock( &trace_lock );
+    snprintf( exit_path, sizeof( exit_path ), "%s", path );
+    pthread_mutex_unlock( &trace_lock );
+    set_tracing( true );
+}
+
+/**
+   Copies the events of a ring that are still intact into events, oldest first.
+   @return is the number of events copied.
+*/
+static size_t copy_ring( TraceRing *ring, TraceEvent *events ) {
+    uint64_t head = atomic_load_explicit( &ring->head, memory_order_acquire );
+    uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    for ( uint64_t i = first; i < head; i++ ) {
+        events[i - first] = ring->events[ i & ( TRACE_RING_SIZE - 1 ) ];
+    }
+
+    // The thread may have gone on to record over the oldest slots while they were copied. The
+    // slot of the event after the last one seen may be half written, so it is dropped too.
+    atomic_thread_fence( memory_order_acquire );
+    uint64_t now = atomic_load_explicit( &ring->head, memory_order_relaxed );
+    uint64_t intact = now + 1 > TRACE_RING_SIZE ? now + 1 - TRACE_RING_SIZE : 0;
+    if ( intact <= first ) {
+        return head - first;
+    }
+    if ( intact >= head ) {
+        return 0;
+    }
+    memmove( events, events + ( intact - first ), ( head - intact ) * sizeof( TraceEvent ) );
+    return head - intact;
+}
+
+/** Writes every thread's events as Chrome trace_event JSON. */
+int write_trace( const char *path ) {
+    FILE *file = fopen( path, "w" );
+    if ( file == NULL ) {
+        return EXIT_FAILURE;
+    }
+    TraceEvent *events = ( TraceEvent * )malloc( TRACE_RING_SIZE * sizeof( TraceEvent ) );
+    if ( events == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+
+    // Times are written in microseconds, the unit trace_event uses.
+    int pid = ( int )getpid();
+    bool first = true;
+    fprintf( file, "{\"traceEvents\":[\n" );
+    pthread_mutex_lock( &trace_lock );
+    for ( TraceRing *ring = rings; ring != NULL; ring = ring->next ) {
+        size_t count = copy_ring( ring, events );
+        for ( size_t i = 0; i < count; i++ ) {
+            fprintf( file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%d}",
+                     first ? "" : ",\n", events[i].name, events[i].phase,
+                     ( unsigned long long )( events[i].ns / 1000 ),
+                     ( unsigned )( events[i].ns % 1000 ), pid, ring->tid );
+            first = false;
+        }
+    }
+    pthread_mutex_unlock( &trace_lock );
+    fprintf( file, "\n],\"displayTimeUnit\":\"ns\"}\n" );
+    free( events );
+    bool failed = ferror( file ) != 0;
+    if ( fclose( file ) != 0 || failed ) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Writes the trace asked for at exit. */
+void finish_tracing( void ) {
+    pthread_mutex_lock( &trace_lock );
+    char path[MAX_STR_LENGTH];
+    snprintf( path, sizeof( path ), "%s", exit_path );
+    pthread_mutex_unlock( &trace_lock );
+    if ( path[0] != '\0' && write_trace( path ) != EXIT_SUCCESS ) {
+        fprintf( stderr, "Unable to write trace to %s\n", path );
+    }
+}
@@ -0,0 +1,146 @@
+/**
+   @file trace.h
+   @author Michael Warstler (mwwarstl)
+   Header file for event tracing. While tracing is on, the stages of running a query (the query
+   itself, parsing, planning, I/O waits, block decoding, filtering rows, and writing output) record
+   begin and end events with the time and the recording thread's id. Each thread records into a
+   ring of its own that only it writes, so recording takes no locks; once a ring is full the oldest
+   events are overwritten. The events are written out as Chrome trace_event JSON, which
+   chrome://tracing and Perfetto load, by the trace command or when the program exits. Built with
+   NO_TRACE defined (make TRACE=0) the recording functions are empty and compile away.
+
+   select_from_table, update, and delete_row also have static probe points (provider "database",
+   probes <function>__start and <function>__done) that perf and bpftrace can attach to while the
+   program runs, whether or not tracing is on. They are built when <sys/sdt.h> is installed.
+*/
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "stats.h"
+
+/** Number of events each thread's ring holds, a power of 2 */
+#define TRACE_RING_SIZE 16384
+/** File the trace is written to when no file is named */
+#define DEFAULT_TRACE_FILE "trace.json"
+
+#if defined( __has_include )
+#if __has_include( <sys/sdt.h> )
+#include <sys/sdt.h>
+/** Static probe points are built */
+#define HAVE_SDT 1
+#endif
+#endif
+
+#ifdef HAVE_SDT
+/** Static probe point with one argument */
+#define TRACE_PROBE1( name, a ) DTRACE_PROBE1( database, name, a )
+/** Static probe point with two arguments */
+#define TRACE_PROBE2( name, a, b ) DTRACE_PROBE2( database, name, a, b )
+#else
+#define TRACE_PROBE1( name, a ) ( ( void )( a ) )
+#define TRACE_PROBE2( name, a, b ) ( ( void )( a ), ( void )( b ) )
+#endif
+
+/** One begin or end event. Names are string literals, so only the pointer is kept. */
+typedef struct {
+    const char *name;
+    uint64_t ns;
+    char phase;
+} TraceEvent;
+
+/**
+   A TraceRing holds one thread's events, chained in a list of every thread's. head counts every
+   event the thread has recorded; event i is kept in events[i % TRACE_RING_SIZE] until it is
+   overwritten TRACE_RING_SIZE events later.
+*/
+typedef struct TraceRing {
+    _Atomic uint64_t head;
+    int tid;
+    TraceEvent events[TRACE_RING_SIZE];
+    struct TraceRing *next;
+} TraceRing;
+
+/** Whether events are being recorded */
+extern atomic_bool tracing;
+
+/** The current thread's ring, NULL until it first records an event */
+extern _Thread_local TraceRing *thread_trace;
+
+/**
+   Adds the current thread's ring to the list of every thread's.
+   @return is the current thread's ring.
+*/
+TraceRing *register_thread_trace( void );
+
+/**
+   Turns tracing on or off. Events already recorded are kept.
+   @param enabled is true to record events.
+*/
+void set_tracing( bool enabled );
+
+/**
+   Turns tracing on for the whole run and writes the trace to a file when finish_tracing is called.
+   @param path is the file to write the trace to at exit.
+*/
+void trace_at_exit( const char *path );
+
+/**
+   Writes every thread's events as Chrome trace_event JSON. Threads keep recording while this
+   runs; events overwritten while they were being copied are left out.
+   @param path is the file to write.
+   @return is EXIT_FAILURE if the file could not be written, otherwise EXIT_SUCCESS
+*/
+int write_trace( const char *path );
+
+/**
+   Writes the trace to the file given to trace_at_exit, if there was one. Called at exit.
+*/
+void finish_tracing( void );
+
+#ifdef NO_TRACE
+
+static inline void trace_begin( const char *name ) {
+}
+static inline void trace_end( const char *name ) {
+}
+
+#else
+
+/** Records an event in the current thread's ring. */
+static inline void trace_record( const char *name, char phase ) {
+    TraceRing *ring = thread_trace != NULL ? thread_trace : register_thread_trace();
+    uint64_t head = atomic_load_explicit( &ring->head, memory_order_relaxed );
+    TraceEvent *event = &ring->events[ head & ( TRACE_RING_SIZE - 1 ) ];
+    event->name = name;
+    event->ns = monotonic_ns();
+    event->phase = phase;
+    // The event is complete before a reader can see the new head.
+    atomic_store_explicit( &ring->head, head + 1, memory_order_release );
+}
+
+/**
+   Records the start of a stage, if tracing is on.
+   @param name is the stage's name, a string literal.
+*/
+static inline void trace_begin( const char *name ) {
+    if ( atomic_load_explicit( &tracing, memory_order_relaxed ) ) {
+        trace_record( name, 'B' );
+    }
+}
+
+/**
+   Records the end of a stage, if tracing is on.
+   @param name is the stage's name, the same as its trace_begin.
+*/
+static inline void trace_end( const char *name ) {
+    if ( atomic_load_explicit( &tracing, memory_order_relaxed ) ) {
+        trace_record( name, 'E' );
+    }
+}
+
+#endif //NO_TRACE
+
+#endif //TRACE_H
@@ -0,0 +1,734 @@
+/**
+   @file txn.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for transactions and the commit log. A log record is its length and an
+   FNV-1a checksum, then text: the number of tables, and for each table a line with the inode,
+   size, and modification time it had before the commit, the number of changes, and its name,
+   followed by one line per change ("I<row>", "U<id>" then the new values, or "D<id>"). A record
+   cut short by a crash fails its checksum and ends the log. Commits hold their tables' write
+   locks while the record is written and applied, so for any table the log's records are in the
+   order they were applied, and the locks are released before waiting for the sync.
+*/
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "txn.h"
+#include "foreign.h"
+#include "sink.h"
+#include "stats.h"
+#include "storage.h"
+
+/** Number of bytes in a log record's header: 32-bit length and checksum */
+#define RECORD_HEADER_SIZE 8
+
+/** A LoggedTable names a table changed since the last checkpoint, chained in a list. */
+typedef struct LoggedTable {
+    char *name;
+    struct LoggedTable *next;
+} LoggedTable;
+
+/**
+   The commit log. Written counts the records appended and durable the records known to be on
+   disk; syncing is true while a committer is syncing on behalf of everyone waiting. Commits hold
+   applying for reading from writing their record until their changes are applied, so a
+   checkpoint, which holds it for writing, sees every logged change in the tables.
+*/
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t synced;
+    pthread_rwlock_t applying;
+    int fd;
+    off_t size;
+    uint64_t written;
+    uint64_t durable;
+    bool syncing;
+    bool deferred;
+    unsigned long commits;
+    unsigned long syncs;
+    LoggedTable *tables;
+} wal = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_RWLOCK_INITIALIZER, -1 };
+
+/** The transaction of each thread's session, NULL for the process's own session */
+static _Thread_local Transaction *current;
+/** The process's own session, used by interactive and batch mode */
+static Transaction own_transaction;
+
+/** Returns the current thread's session. */
+static Transaction *session( void ) {
+    return current != NULL ? current : &own_transaction;
+}
+
+/** Sets the current thread's session. */
+void set_transaction( Transaction *transaction ) {
+    current = transaction;
+}
+
+/** Returns whether the current session is in a transaction. */
+bool in_transaction( void ) {
+    return session()->active;
+}
+
+/** Starts a transaction. */
+void begin_transaction( void ) {
+    Transaction *transaction = session();
+    if ( transaction->active ) {
+        out_printf( "A transaction is already in progress.\n" );
+        return;
+    }
+    transaction->active = true;
+    out_printf( "Transaction started.\n" );
+}
+
+/** Copies a string, exiting if memory runs out. */
+static char *copy_text( const char *text ) {
+    char *copy = strdup( text );
+    if ( copy == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    return copy;
+}
+
+/** Stages a change in the current transaction. */
+void stage_change( ChangeType type, const char *table_name, const char *text,
+                   const char *attributes ) {
+    Transaction *transaction = session();
+    if ( transaction->count == transaction->capacity ) {
+        transaction->capacity = transaction->capacity > 0 ? transaction->capacity * 2 : 64;
+        Change *grown = ( Change * )realloc( transaction->changes,
+                                             transaction->capacity * sizeof( Change ) );
+        if ( grown == NULL ) {
+            err_printf( "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+        transaction->changes = grown;
+    }
+    Change *change = &transaction->changes[ transaction->count++ ];
+    change->type = type;
+    change->table_name = copy_text( table_name );
+    change->text = copy_text( text );
+    change->attributes = attributes != NULL ? copy_text( attributes ) : NULL;
+}
+
+/**
+   Finds the type of the current transaction's last insert or delete of an id in a table, or -1 if
+   it has neither.
+*/
+static int last_row_change( const char *table_name, int id ) {
+    Transaction *transaction = session();
+    for ( int i = transaction->active ? transaction->count - 1 : -1; i >= 0; i-- ) {
+        const Change *change = &transaction->changes[i];
+        int staged;
+        if ( change->type != CHANGE_UPDATE && strcmp( change->table_name, table_name ) == 0 &&
+             sscanf( change->text, "%d", &staged ) == 1 && staged == id ) {
+            return change->type;
+        }
+    }
+    return -1;
+}
+
+/** Checks whether the current transaction inserts an id into a table. */
+bool transaction_inserts( const char *table_name, int id ) {
+    return last_row_change( table_name, id ) == CHANGE_INSERT;
+}
+
+/** Checks whether the current transaction deletes an id from a table. */
+bool transaction_deletes( const char *table_name, int id ) {
+    return last_row_change( table_name, id ) == CHANGE_DELETE;
+}
+
+/** Drops a transaction silently. */
+void discard_transaction( Transaction *transaction ) {
+    for ( int i = 0; i < transaction->count; i++ ) {
+        free( transaction->changes[i].table_name );
+        free( transaction->changes[i].text );
+        free( transaction->changes[i].attributes );
+    }
+    free( transaction->changes );
+    *transaction = ( Transaction ){ false, NULL, 0, 0 };
+}
+
+/** Drops the current transaction. */
+void rollback_transaction( void ) {
+    Transaction *transaction = session();
+    if ( !transaction->active ) {
+        out_printf( "No transaction is in progress.\n" );
+        return;
+    }
+    discard_transaction( transaction );
+    out_printf( "Transaction rolled back.\n" );
+}
+
+/** Builds the path of the commit log. */
+static void log_path( char *path, size_t size ) {
+    snprintf( path, size, "%s/.wal", folder );
+}
+
+/** Checksums a record's text (FNV-1a). */
+static uint32_t checksum( const char *data, size_t length ) {
+    uint32_t hash = 2166136261u;
+    for ( size_t i = 0; i < length; i++ ) {
+        hash = ( hash ^ ( unsigned char )data[i] ) * 16777619u;
+    }
+    return hash;
+}
+
+/** Opens the commit log for appending if it is not open. Called with wal.lock held. */
+static int open_log( void ) {
+    if ( wal.fd >= 0 ) {
+        return EXIT_SUCCESS;
+    }
+    char path[MAX_STR_LENGTH];
+    log_path( path, sizeof( path ) );
+    wal.fd = open( path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666 );
+    struct stat status;
+    if ( wal.fd < 0 || fstat( wal.fd, &status ) != 0 ) {
+        return EXIT_FAILURE;
+    }
+    wal.size = status.st_size;
+    return EXIT_SUCCESS;
+}
+
+/** Remembers that a table was changed since the last checkpoint. Called with wal.lock held. */
+static void remember_table( const char *table_name ) {
+    for ( LoggedTable *table = wal.tables; table != NULL; table = table->next ) {
+        if ( strcmp( table->name, table_name ) == 0 ) {
+            return;
+        }
+    }
+    LoggedTable *table = ( LoggedTable * )calloc( 1, sizeof( LoggedTable ) );
+    if ( table == NULL || ( table->name = strdup( table_name ) ) == NULL ) {
+        pthread_mutex_unlock( &wal.lock );
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    table->next = wal.tables;
+    wal.tables = table;
+}
+
+/**
+   Appends a record to the commit log. Returns the record's number, which commits wait on, or 0
+   if it could not be written, in which case anything partly written is cut off again.
+*/
+static uint64_t write_record( const char *text, size_t length ) {
+    uint32_t header[2] = { ( uint32_t )length, checksum( text, length ) };
+    struct iovec parts[2] = { { header, RECORD_HEADER_SIZE }, { ( char * )text, length } };
+    pthread_mutex_lock( &wal.lock );
+    uint64_t record = 0;
+    if ( open_log() == EXIT_SUCCESS ) {
+        if ( storage_write( wal.fd, parts, 2 ) == EXIT_SUCCESS ) {
+            wal.size += RECORD_HEADER_SIZE + length;
+            record = ++wal.written;
+            wal.commits++;
+        }
+        else if ( ftruncate( wal.fd, wal.size ) != 0 ) {
+            pthread_mutex_unlock( &wal.lock );
+            err_printf( "Unable to repair the commit log\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+    pthread_mutex_unlock( &wal.lock );
+    return record;
+}
+
+/**
+   Waits until a record is on disk. If no one is syncing the log, this committer syncs it for
+   every record written so far; otherwise it waits for that sync, and the next one if its record
+   came too late to be part of it. A log that cannot be synced ends the program, since whether the
+   commits waiting on it are durable can no longer be known.
+*/
+static void wait_durable( uint64_t record ) {
+    pthread_mutex_lock( &wal.lock );
+    while ( wal.durable < record ) {
+        if ( wal.syncing ) {
+            pthread_cond_wait( &wal.synced, &wal.lock );
+            continue;
+        }
+        wal.syncing = true;
+        uint64_t target = wal.written;
+        int fd = wal.fd;
+        pthread_mutex_unlock( &wal.lock );
+        int result = fdatasync( fd );
+        stats_add( SYSCALLS, 1 );
+        pthread_mutex_lock( &wal.lock );
+        if ( result != 0 ) {
+            pthread_mutex_unlock( &wal.lock );
+            err_printf( "Unable to sync the commit log\n" );
+            exit( EXIT_FAILURE );
+        }
+        if ( target > wal.durable ) {
+            wal.durable = target;
+        }
+        wal.syncs++;
+        wal.syncing = false;
+        pthread_cond_broadcast( &wal.synced );
+    }
+    pthread_mutex_unlock( &wal.lock );
+}
+
+/** Sets whether commits wait for their sync. */
+void set_deferred_sync( bool deferred ) {
+    wal.deferred = deferred;
+}
+
+/** Waits until every commit so far is on disk. */
+void sync_log( void ) {
+    pthread_mutex_lock( &wal.lock );
+    uint64_t record = wal.written;
+    pthread_mutex_unlock( &wal.lock );
+    wait_durable( record );
+}
+
+/** Syncs a file or directory by path. A file that no longer exists needs no sync. */
+static bool sync_path( const char *path ) {
+    int fd = open( path, O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 ) {
+        return true;
+    }
+    bool synced = fsync( fd ) == 0;
+    close( fd );
+    return synced;
+}
+
+/**
+   Syncs every table changed since the last checkpoint, and the folder holding them, then empties
+   the commit log. Every commit waiting on the log is durable once the tables are.
+*/
+static void checkpoint( void ) {
+    pthread_rwlock_wrlock( &wal.applying );
+    pthread_mutex_lock( &wal.lock );
+    bool synced = true;
+    while ( wal.tables != NULL ) {
+        LoggedTable *table = wal.tables;
+        char path[MAX_STR_LENGTH];
+        snprintf( path, sizeof( path ), "%s/%s", folder, table->name );
+        synced = sync_path( path ) && synced;
+        wal.tables = table->next;
+        free( table->name );
+        free( table );
+    }
+    synced = synced && sync_path( folder );
+    if ( synced && wal.fd >= 0 && wal.size > 0 && ftruncate( wal.fd, 0 ) == 0 &&
+         fdatasync( wal.fd ) == 0 ) {
+        wal.size = 0;
+        wal.durable = wal.written;
+        pthread_cond_broadcast( &wal.synced );
+    }
+    pthread_mutex_unlock( &wal.lock );
+    pthread_rwlock_unlock( &wal.applying );
+}
+
+/** Orders a transaction's changes by table name, keeping each table's changes in order. */
+static int compare_changes( const void *first, const void *second ) {
+    const Change *a = *( const Change *const * )first;
+    const Change *b = *( const Change *const * )second;
+    int order = strcmp( a->table_name, b->table_name );
+    return order != 0 ? order : ( a > b ) - ( a < b );
+}
+
+/** Adds a table's line to a log record. */
+static void log_table( Sink *record, const struct stat *table, int count, const char *name ) {
+    char line[MAX_STR_LENGTH];
+    snprintf( line, sizeof( line ), "%lld %lld %lld %ld %d %s\n", ( long long )table->st_ino,
+              ( long long )table->st_size, ( long long )table->st_mtim.tv_sec,
+              ( long )table->st_mtim.tv_nsec, count, name );
+    sink_puts( record, line );
+}
+
+/** Adds a change's lines to a log record. */
+static void log_change( Sink *record, const Change *change ) {
+    sink_putc( record, change->type == CHANGE_INSERT ? 'I' :
+                       change->type == CHANGE_UPDATE ? 'U' : 'D' );
+    sink_puts( record, change->text );
+    sink_putc( record, '\n' );
+    if ( change->type == CHANGE_UPDATE ) {
+        sink_puts( record, change->attributes );
+        sink_putc( record, '\n' );
+    }
+}
+
+/** Prints the message a change would have printed had it been run on its own. */
+static void print_change( const Change *change, bool found ) {
+    switch ( change->type ) {
+        case CHANGE_INSERT:
+            out_printf( "Data inserted successfully!\n" );
+            break;
+        case CHANGE_UPDATE:
+            out_printf( found ? "Record updated successfully!\n" : "Record not found!\n" );
+            break;
+        case CHANGE_DELETE:
+            out_printf( found ? "Record deleted successfully!\n" : "Record id not found!\n" );
+            break;
+    }
+}
+
+/**
+   Commits the current transaction. Its changes are grouped by table and the tables locked in name
+   order, so commits changing the same tables wait for each other's locks but never deadlock.
+*/
+int commit_transaction( void ) {
+    Transaction *transaction = session();
+    if ( !transaction->active ) {
+        out_printf( "No transaction is in progress.\n" );
+        return EXIT_FAILURE;
+    }
+    int count = transaction->count;
+    if ( count == 0 ) {
+        discard_transaction( transaction );
+        out_printf( "Transaction committed.\n" );
+        return EXIT_SUCCESS;
+    }
+
+    // A parent row may have been deleted since a change was staged, so the changes' foreign keys
+    // are checked again, with deletes from parents held off until the changes are applied.
+    bool checked = false, deleting = false;
+    for ( int i = 0; i < count; i++ ) {
+        const Change *change = &transaction->changes[i];
+        if ( change->type == CHANGE_DELETE ) {
+            deleting = deleting || is_foreign_parent( change->table_name );
+        }
+        else {
+            checked = checked || has_foreign_keys( change->table_name );
+        }
+    }
+    bool held = checked || deleting;
+    if ( held ) {
+        hold_foreign_keys( deleting );
+    }
+    for ( int i = 0; i < count && checked; i++ ) {
+        const Change *change = &transaction->changes[i];
+        char row[MAX_STR_LENGTH];
+        snprintf( row, sizeof( row ), "%s%s%s", change->text,
+                  change->attributes != NULL ? " " : "",
+                  change->attributes != NULL ? change->attributes : "" );
+        if ( change->type != CHANGE_DELETE && !foreign_keys_met( change->table_name, row, true ) ) {
+            release_foreign_keys();
+            discard_transaction( transaction );
+            out_printf( "Transaction rolled back.\n" );
+            return EXIT_FAILURE;
+        }
+    }
+
+    const Change **order = ( const Change ** )malloc( count * sizeof( const Change * ) );
+    TableLock **locks = ( TableLock ** )malloc( count * sizeof( TableLock * ) );
+    bool *found = ( bool * )malloc( count * sizeof( bool ) );
+    bool *applied = ( bool * )malloc( count * sizeof( bool ) );
+    int *position = ( int * )malloc( count * sizeof( int ) );
+    Sink record;
+    if ( order == NULL || locks == NULL || found == NULL || applied == NULL || position == NULL ||
+         sink_open_memory( &record, 4096 ) != EXIT_SUCCESS ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    for ( int i = 0; i < count; i++ ) {
+        order[i] = &transaction->changes[i];
+    }
+    qsort( order, count, sizeof( const Change * ), compare_changes );
+
+    // The record starts with the number of tables, then each table's status and changes.
+    int table_count = 0;
+    for ( int i = 0; i < count; i++ ) {
+        table_count += i == 0 || strcmp( order[i]->table_name, order[i - 1]->table_name ) != 0;
+    }
+    char header[32];
+    snprintf( header, sizeof( header ), "%d\n", table_count );
+    sink_puts( &record, header );
+
+    // Lock each table once, and check that it exists while noting its status for the log.
+    int tables = 0;
+    bool missing = false;
+    for ( int start = 0, end; start < count && !missing; start = end ) {
+        const char *name = order[start]->table_name;
+        for ( end = start + 1; end < count && strcmp( order[end]->table_name, name ) == 0; end++ );
+        locks[tables++] = write_lock_table( name );
+
+        char filepath[MAX_STR_LENGTH];
+        snprintf( filepath, sizeof( filepath ), "%s/%s", folder, name );
+        struct stat table;
+        if ( stat( filepath, &table ) != 0 ) {
+            table_exist( name );
+            out_printf( "\n" );
+            missing = true;
+            break;
+        }
+        log_table( &record, &table, end - start, name );
+        for ( int i = start; i < end; i++ ) {
+            log_change( &record, order[i] );
+        }
+    }
+
+    // The record is written before any table is changed, and the changes are applied in the
+    // order of the log while the tables are still locked.
+    uint64_t logged = 0;
+    if ( !missing ) {
+        pthread_rwlock_rdlock( &wal.applying );
+        logged = write_record( record.buffer, record.length );
+        if ( logged == 0 ) {
+            pthread_rwlock_unlock( &wal.applying );
+            out_printf( "Unable to write the commit log!\n" );
+        }
+    }
+    if ( logged != 0 ) {
+        for ( int start = 0, end, table = 0; start < count; start = end, table++ ) {
+            for ( end = start + 1;
+                  end < count && strcmp( order[end]->table_name, order[start]->table_name ) == 0;
+                  end++ );
+            bool done = apply_changes( locks[table], order[start]->table_name, order + start,
+                                       end - start, found + start ) == EXIT_SUCCESS;
+            for ( int i = start; i < end; i++ ) {
+                applied[i] = done;
+            }
+        }
+        pthread_mutex_lock( &wal.lock );
+        for ( int start = 0; start < count; start++ ) {
+            if ( start == 0 || strcmp( order[start]->table_name,
+                                       order[start - 1]->table_name ) != 0 ) {
+                remember_table( order[start]->table_name );
+            }
+        }
+        pthread_mutex_unlock( &wal.lock );
+        pthread_rwlock_unlock( &wal.applying );
+    }
+    for ( int i = tables - 1; i >= 0; i-- ) {
+        write_unlock_table( locks[i] );
+    }
+    if ( held ) {
+        release_foreign_keys();
+    }
+    free( record.buffer );
+
+    if ( logged == 0 ) {
+        out_printf( "Transaction rolled back.\n" );
+    }
+    else {
+        // Commits return only once their record is on disk, unless syncs are deferred.
+        pthread_mutex_lock( &wal.lock );
+        bool wait = !wal.deferred || wal.written - wal.durable >= LOG_GROUP_COMMITS;
+        bool full = wal.size > LOG_CHECKPOINT_SIZE;
+        pthread_mutex_unlock( &wal.lock );
+        if ( wait ) {
+            wait_durable( logged );
+        }
+
+        // Print each change's message in the order the changes were made.
+        for ( int at = 0; at < count; at++ ) {
+            position[ order[at] - transaction->changes ] = at;
+        }
+        for ( int i = 0; i < count; i++ ) {
+            int at = position[i];
+            if ( applied[at] ) {
+                print_change( order[at], found[at] );
+            }
+            else if ( at == 0 || strcmp( order[at]->table_name,
+                                         order[at - 1]->table_name ) != 0 ) {
+                out_printf( "Unable to apply the transaction to table %s!\n",
+                            order[at]->table_name );
+            }
+        }
+        out_printf( "Transaction committed.\n" );
+        if ( full ) {
+            checkpoint();
+        }
+    }
+    free( order );
+    free( locks );
+    free( found );
+    free( applied );
+    free( position );
+    discard_transaction( transaction );
+    return logged == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/** Takes the next line of a record, ending it with a NUL. Returns NULL if there is none. */
+static char *next_line( char **cursor, char *end ) {
+    char *line = *cursor;
+    char *newline = memchr( line, '\n', end - line );
+    if ( newline == NULL ) {
+        return NULL;
+    }
+    *newline = '\0';
+    *cursor = newline + 1;
+    return line;
+}
+
+/** Returns whether a name is in a list of names. */
+static bool listed( char **names, int count, const char *name ) {
+    for ( int i = 0; i < count; i++ ) {
+        if ( strcmp( names[i], name ) == 0 ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+   Replays the changes in a log record to every table that does not have them yet: a table that
+   still has the status the record noted, or one already being replayed because an earlier record
+   found it so. Returns how many tables were replayed, or -1 if the record is damaged.
+*/
+static int replay_record( char *text, size_t length, char ***replaying, int *replaying_count ) {
+    char *cursor = text, *end = text + length;
+    char *line = next_line( &cursor, end );
+    int tables;
+    if ( line == NULL || sscanf( line, "%d", &tables ) != 1 ) {
+        return -1;
+    }
+
+    int replayed = 0;
+    for ( int t = 0; t < tables; t++ ) {
+        long long inode, size, seconds;
+        long nanoseconds;
+        int count, name_at;
+        line = next_line( &cursor, end );
+        if ( line == NULL || sscanf( line, "%lld %lld %lld %ld %d %n", &inode, &size, &seconds,
+                                     &nanoseconds, &count, &name_at ) != 5 || count < 1 ) {
+            return -1;
+        }
+        const char *name = line + name_at;
+
+        Change *changes = ( Change * )malloc( count * sizeof( Change ) );
+        const Change **list = ( const Change ** )malloc( count * sizeof( const Change * ) );
+        bool *found = ( bool * )malloc( count * sizeof( bool ) );
+        if ( changes == NULL || list == NULL || found == NULL ) {
+            err_printf( "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+        bool damaged = false;
+        for ( int i = 0; i < count && !damaged; i++ ) {
+            line = next_line( &cursor, end );
+            damaged = line == NULL || ( *line != 'I' && *line != 'U' && *line != 'D' );
+            if ( !damaged ) {
+                changes[i] = ( Change ){ *line == 'I' ? CHANGE_INSERT :
+                                         *line == 'U' ? CHANGE_UPDATE : CHANGE_DELETE,
+                                         ( char * )name, line + 1, NULL };
+                if ( *line == 'U' ) {
+                    changes[i].attributes = next_line( &cursor, end );
+                    damaged = changes[i].attributes == NULL;
+                }
+                list[i] = &changes[i];
+            }
+        }
+
+        if ( !damaged ) {
+            char filepath[MAX_STR_LENGTH];
+            snprintf( filepath, sizeof( filepath ), "%s/%s", folder, name );
+            struct stat table;
+            bool unchanged = stat( filepath, &table ) == 0 && table.st_ino == inode &&
+                             table.st_size == size && table.st_mtim.tv_sec == seconds &&
+                             table.st_mtim.tv_nsec == nanoseconds;
+            bool again = listed( *replaying, *replaying_count, name );
+            if ( unchanged || again ) {
+                TableLock *lock = write_lock_table( name );
+                apply_changes( lock, name, list, count, found );
+                write_unlock_table( lock );
+                replayed++;
+            }
+            if ( unchanged && !again ) {
+                char **grown = ( char ** )realloc( *replaying,
+                                                   ( *replaying_count + 1 ) * sizeof( char * ) );
+                if ( grown == NULL ) {
+                    err_printf( "Memory allocation error\n" );
+                    exit( EXIT_FAILURE );
+                }
+                *replaying = grown;
+                ( *replaying )[ ( *replaying_count )++ ] = copy_text( name );
+            }
+            pthread_mutex_lock( &wal.lock );
+            remember_table( name );
+            pthread_mutex_unlock( &wal.lock );
+        }
+        free( changes );
+        free( list );
+        free( found );
+        if ( damaged ) {
+            return -1;
+        }
+    }
+    return replayed;
+}
+
+/** Replays the commit log left by a crash, then empties it. */
+void recover_log( void ) {
+    char path[MAX_STR_LENGTH];
+    log_path( path, sizeof( path ) );
+    int fd = open( path, O_RDONLY | O_CLOEXEC );
+    struct stat status;
+    if ( fd < 0 ) {
+        return;
+    }
+    if ( fstat( fd, &status ) != 0 || status.st_size == 0 ) {
+        close( fd );
+        return;
+    }
+    char *log = ( char * )malloc( status.st_size );
+    if ( log == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    ssize_t length = storage_read_at( fd, log, status.st_size, 0 );
+    close( fd );
+
+    // Records are replayed in order, up to the first one that is cut short or damaged.
+    char **replaying = NULL;
+    int replaying_count = 0, transactions = 0;
+    for ( ssize_t at = 0; at + RECORD_HEADER_SIZE <= length; ) {
+        uint32_t header[2];
+        memcpy( header, log + at, RECORD_HEADER_SIZE );
+        char *text = log + at + RECORD_HEADER_SIZE;
+        if ( header[0] > length - at - RECORD_HEADER_SIZE ||
+             checksum( text, header[0] ) != header[1] ) {
+            break;
+        }
+        int replayed = replay_record( text, header[0], &replaying, &replaying_count );
+        if ( replayed < 0 ) {
+            break;
+        }
+        transactions += replayed > 0;
+        at += RECORD_HEADER_SIZE + header[0];
+    }
+    for ( int i = 0; i < replaying_count; i++ ) {
+        free( replaying[i] );
+    }
+    free( replaying );
+    free( log );
+    if ( transactions > 0 ) {
+        err_printf( "Replayed %d committed transactions from the commit log\n", transactions );
+    }
+
+    // The replayed tables are synced before the log they came from is emptied.
+    pthread_mutex_lock( &wal.lock );
+    open_log();
+    pthread_mutex_unlock( &wal.lock );
+    checkpoint();
+}
+
+/** Syncs the tables and empties the commit log. */
+void close_log( void ) {
+    checkpoint();
+    pthread_mutex_lock( &wal.lock );
+    if ( wal.fd >= 0 ) {
+        close( wal.fd );
+        wal.fd = -1;
+    }
+    pthread_mutex_unlock( &wal.lock );
+}
+
+/** Prints the commit and sync counters. */
+void print_log_stats( void ) {
+    pthread_mutex_lock( &wal.lock );
+    out_printf( "%-16s %10s %10s %14s\n", "commit log", "commits", "syncs", "commits/sync" );
+    out_printf( "%-16s %10lu %10lu %14.2f\n", "", wal.commits, wal.syncs,
+                wal.syncs > 0 ? ( double )wal.commits / wal.syncs : 0.0 );
+    pthread_mutex_unlock( &wal.lock );
+}
+
+/** Clears the commit and sync counters. */
+void reset_log_stats( void ) {
+    pthread_mutex_lock( &wal.lock );
+    wal.commits = 0;
+    wal.syncs = 0;
+    pthread_mutex_unlock( &wal.lock );
+}
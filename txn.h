@@ -0,0 +1,129 @@
+/**
+   @file txn.h
+   @author Michael Warstler (mwwarstl)
+   Header file for transactions. Between begin and commit, a session's inserts, updates, and
+   deletes are staged in memory instead of being run. Commit locks every table the transaction
+   changes, appends the whole transaction to the commit log (folder/.wal) as one record, applies
+   the changes with one append or rewrite per table, and returns once the record is on disk.
+   Committers that arrive while the log is being synced wait for the next sync together, so one
+   fdatasync makes a whole group of commits durable. Tables are synced at checkpoints, after which
+   the log is emptied. A log left behind by a crash is replayed at startup: each record holds the
+   status of every table it changes as it was before the change, and a table that still matches
+   gets the change again. Each server client has its own session; interactive and batch mode
+   share one. Writes outside a transaction are not logged.
+*/
+#ifndef TXN_H
+#define TXN_H
+
+#include <stdbool.h>
+#include "database.h"
+
+/** Size the commit log may grow to before the tables are synced and the log emptied */
+#define LOG_CHECKPOINT_SIZE ( 64 * 1024 * 1024 )
+/** Most commits that may wait to be synced when syncs are deferred */
+#define LOG_GROUP_COMMITS 1024
+
+/** A Transaction holds a session's staged changes, in the order they were made. */
+typedef struct {
+    bool active;
+    Change *changes;
+    int count;
+    int capacity;
+} Transaction;
+
+/**
+   Sets the session the current thread's commands belong to.
+   @param transaction is the session's transaction, or NULL for the process's own session.
+*/
+void set_transaction( Transaction *transaction );
+
+/**
+   Returns whether the current session has a transaction in progress.
+   @return is true between begin and commit or rollback.
+*/
+bool in_transaction( void );
+
+/**
+   Starts a transaction in the current session.
+*/
+void begin_transaction( void );
+
+/**
+   Stages a change in the current session's transaction.
+   @param type is the kind of change.
+   @param table_name is string name of the table.
+   @param text is the row of an insert, or the row id of an update or delete.
+   @param attributes is the new values of an update, NULL otherwise.
+*/
+void stage_change( ChangeType type, const char *table_name, const char *text,
+                   const char *attributes );
+
+/**
+   Checks whether the current session's transaction inserts a row with an id into a table.
+   @param table_name is string name of the table.
+   @param id is the row id.
+   @return is true if a staged insert has the id and no delete of it is staged after.
+*/
+bool transaction_inserts( const char *table_name, int id );
+
+/**
+   Checks whether the current session's transaction deletes the row with an id from a table.
+   @param table_name is string name of the table.
+   @param id is the row id.
+   @return is true if a staged delete has the id and no insert of it is staged after.
+*/
+bool transaction_deletes( const char *table_name, int id );
+
+/**
+   Commits the current session's transaction. Every table it changes must exist, otherwise
+   nothing is changed. Prints each change's message, in order, then that the transaction committed.
+   @return is EXIT_FAILURE if the transaction was rolled back, otherwise EXIT_SUCCESS
+*/
+int commit_transaction( void );
+
+/**
+   Drops the current session's transaction and every change staged in it.
+*/
+void rollback_transaction( void );
+
+/**
+   Drops a transaction without printing anything, as when a client hangs up partway through one.
+   @param transaction is the transaction to drop.
+*/
+void discard_transaction( Transaction *transaction );
+
+/**
+   Sets whether commits wait for the log to be synced. Deferred commits are synced together once
+   LOG_GROUP_COMMITS are waiting, or by sync_log. Batch mode defers them, so a commit reported
+   there is not durable until its group is synced.
+   @param deferred is true to let commits return before they are synced.
+*/
+void set_deferred_sync( bool deferred );
+
+/**
+   Waits until every commit made so far is on disk.
+*/
+void sync_log( void );
+
+/**
+   Replays the commit log left by a run that did not shut down cleanly, then empties it.
+   Called once at startup, before any command runs.
+*/
+void recover_log( void );
+
+/**
+   Syncs the tables and empties the commit log, at shutdown.
+*/
+void close_log( void );
+
+/**
+   Prints the number of commits and log syncs to the current output sink.
+*/
+void print_log_stats( void );
+
+/**
+   Clears the number of commits and log syncs.
+*/
+void reset_log_stats( void );
+
+#endif //TXN_H
@@ -0,0 +1,693 @@
+/**
+   @file view.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for materialized views. A view's rows are kept in a hash table keyed by
+   the row's text (or, for a grouped view, the group column's value) with a count of how many
+   times the key is present, so a change to the table adds or removes one key in constant time.
+   The keys are also chained in the order they were added, which is the order they are printed.
+   Every view is guarded by one lock. Code that changes a table holds the table's write lock
+   before it takes the views' lock, and building a view does the same, so the two never wait on
+   each other in opposite orders.
+*/
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "block.h"
+#include "database.h"
+#include "lock.h"
+#include "parser.h"
+#include "partition.h"
+#include "scan.h"
+#include "schema.h"
+#include "sink.h"
+#include "view.h"
+
+/** Name of the file view definitions are kept in, inside the tables folder */
+#define VIEWS_FILE ".views"
+/** Number of hash buckets a view starts with, a power of 2 */
+#define VIEW_BUCKETS 64
+
+/**
+   A ViewEntry is one key of a view and how many times it is present. chain links the entries of
+   a bucket, prev and next the entries in the order they were added; -1 ends each list.
+*/
+typedef struct {
+    char *key;
+    uint64_t hash;
+    long count;
+    int chain;
+    int prev;
+    int next;
+} ViewEntry;
+
+/**
+   A ViewRows holds a view's entries. Freed entries are kept on a free list, linked by chain, and
+   reused before the array grows.
+*/
+typedef struct {
+    ViewEntry *entries;
+    int capacity;
+    int used;
+    int free_list;
+    int *buckets;
+    int bucket_count;
+    int size;
+    long rows;
+    int first;
+    int last;
+} ViewRows;
+
+/**
+   A View holds a view's definition, the select it was compiled into, and its rows. For a grouped
+   view the projection is the group column, which is what each key holds.
+*/
+typedef struct View {
+    char name[MAX_TABLE_NAME_LENGTH];
+    char definition[MAX_SET_CLAUSE_LENGTH];
+    char table_name[MAX_TABLE_NAME_LENGTH];
+    char condition_value[MAX_CONDITIONS_LENGTH];
+    Projection projection;
+    ScanQuery query;
+    int group_column;
+    bool built;
+    ViewRows rows;
+    struct View *next;
+} View;
+
+/** Every view */
+static View *views;
+/** Number of views, so tables without any skip the views' lock */
+static atomic_int view_count;
+/** Guards every view */
+static pthread_mutex_t views_lock = PTHREAD_MUTEX_INITIALIZER;
+/** Loads the saved definitions the first time views are used */
+static pthread_once_t views_once = PTHREAD_ONCE_INIT;
+
+/** Hashes a key with 64-bit FNV-1a. */
+static uint64_t hash_key( const char *key, size_t length ) {
+    uint64_t hash = 14695981039346656037ull;
+    for ( size_t i = 0; i < length; i++ ) {
+        hash = ( hash ^ ( unsigned char )key[i] ) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/** Sets up an empty set of rows. */
+static void rows_init( ViewRows *rows ) {
+    *rows = ( ViewRows ){ .free_list = -1, .first = -1, .last = -1,
+                          .bucket_count = VIEW_BUCKETS };
+    rows->buckets = ( int * )malloc( VIEW_BUCKETS * sizeof( int ) );
+    if ( rows->buckets == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    memset( rows->buckets, -1, VIEW_BUCKETS * sizeof( int ) );
+}
+
+/** Frees a set of rows. */
+static void rows_free( ViewRows *rows ) {
+    for ( int i = rows->first; i >= 0; i = rows->entries[i].next ) {
+        free( rows->entries[i].key );
+    }
+    free( rows->entries );
+    free( rows->buckets );
+}
+
+/** Finds an entry by key. Returns its index, or -1. */
+static int rows_find( const ViewRows *rows, const char *key, size_t length, uint64_t hash ) {
+    int i = rows->buckets[ hash & ( rows->bucket_count - 1 ) ];
+    while ( i >= 0 && ( rows->entries[i].hash != hash ||
+                        strncmp( rows->entries[i].key, key, length ) != 0 ||
+                        rows->entries[i].key[length] != '\0' ) ) {
+        i = rows->entries[i].chain;
+    }
+    return i;
+}
+
+/** Doubles the number of buckets and moves every entry to its new bucket. */
+static void rows_grow_buckets( ViewRows *rows ) {
+    int count = rows->bucket_count * 2;
+    int *buckets = ( int * )malloc( count * sizeof( int ) );
+    if ( buckets == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    memset( buckets, -1, count * sizeof( int ) );
+    for ( int i = rows->first; i >= 0; i = rows->entries[i].next ) {
+        int bucket = rows->entries[i].hash & ( count - 1 );
+        rows->entries[i].chain = buckets[bucket];
+        buckets[bucket] = i;
+    }
+    free( rows->buckets );
+    rows->buckets = buckets;
+    rows->bucket_count = count;
+}
+
+/** Adds a key once, as a new entry at the end of the order if it is not present. */
+static void rows_add( ViewRows *rows, const char *key, size_t length ) {
+    uint64_t hash = hash_key( key, length );
+    int i = rows_find( rows, key, length, hash );
+    rows->rows++;
+    if ( i >= 0 ) {
+        rows->entries[i].count++;
+        return;
+    }
+
+    // Take a free entry, or grow the array.
+    if ( rows->free_list >= 0 ) {
+        i = rows->free_list;
+        rows->free_list = rows->entries[i].chain;
+    }
+    else {
+        if ( rows->used == rows->capacity ) {
+            rows->capacity = rows->capacity > 0 ? rows->capacity * 2 : VIEW_BUCKETS;
+            rows->entries = ( ViewEntry * )realloc( rows->entries,
+                                                    rows->capacity * sizeof( ViewEntry ) );
+            if ( rows->entries == NULL ) {
+                err_printf( "Memory allocation error\n" );
+                exit( EXIT_FAILURE );
+            }
+        }
+        i = rows->used++;
+    }
+    ViewEntry *entry = &rows->entries[i];
+    entry->key = strndup( key, length );
+    if ( entry->key == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    entry->hash = hash;
+    entry->count = 1;
+    int bucket = hash & ( rows->bucket_count - 1 );
+    entry->chain = rows->buckets[bucket];
+    rows->buckets[bucket] = i;
+    entry->prev = rows->last;
+    entry->next = -1;
+    if ( rows->last >= 0 ) {
+        rows->entries[ rows->last ].next = i;
+    }
+    else {
+        rows->first = i;
+    }
+    rows->last = i;
+    if ( ++rows->size > rows->bucket_count ) {
+        rows_grow_buckets( rows );
+    }
+}
+
+/** Removes a key once, freeing its entry when none are left. */
+static void rows_remove( ViewRows *rows, const char *key, size_t length ) {
+    uint64_t hash = hash_key( key, length );
+    int i = rows_find( rows, key, length, hash );
+    if ( i < 0 ) {
+        return;
+    }
+    rows->rows--;
+    ViewEntry *entry = &rows->entries[i];
+    if ( --entry->count > 0 ) {
+        return;
+    }
+
+    // Unlink the entry from its bucket and from the order, then free it.
+    int *link = &rows->buckets[ hash & ( rows->bucket_count - 1 ) ];
+    while ( *link != i ) {
+        link = &rows->entries[ *link ].chain;
+    }
+    *link = entry->chain;
+    if ( entry->prev >= 0 ) {
+        rows->entries[ entry->prev ].next = entry->next;
+    }
+    else {
+        rows->first = entry->next;
+    }
+    if ( entry->next >= 0 ) {
+        rows->entries[ entry->next ].prev = entry->prev;
+    }
+    else {
+        rows->last = entry->prev;
+    }
+    free( entry->key );
+    entry->key = NULL;
+    entry->chain = rows->free_list;
+    rows->free_list = i;
+    rows->size--;
+}
+
+/** Finds a view by name. Called with the views' lock held. */
+static View *find_view( const char *view_name ) {
+    View *view = views;
+    while ( view != NULL && strcmp( view->name, view_name ) != 0 ) {
+        view = view->next;
+    }
+    return view;
+}
+
+/** Finds the last whole word "group" followed by "by" in a definition. */
+static char *find_group_by( char *definition ) {
+    char *found = NULL;
+    for ( char *at = strstr( definition, "group" ); at != NULL; at = strstr( at + 1, "group" ) ) {
+        char *after = at + strlen( "group" );
+        if ( ( at == definition || at[-1] == ' ' || at[-1] == '\t' ) &&
+             ( *after == ' ' || *after == '\t' ) ) {
+            after += strspn( after, " \t" );
+            if ( strncmp( after, "by", 2 ) == 0 && ( after[2] == ' ' || after[2] == '\t' ) ) {
+                found = at;
+            }
+        }
+    }
+    return found;
+}
+
+/**
+   Checks a grouped view's columns: "count(*)", optionally with the group column, in either order.
+   Returns EXIT_FAILURE if anything else is listed.
+*/
+static int check_group_columns( const TableSchema *schema, const char *columns, int group ) {
+    bool counted = false;
+    const char *cursor = columns;
+    while ( *cursor != '\0' ) {
+        cursor += strspn( cursor, " ," );
+        size_t length = strcspn( cursor, " ," );
+        if ( length == 0 ) {
+            break;
+        }
+        const char *name = schema->columns[group].name;
+        if ( length == strlen( "count(*)" ) && strncmp( cursor, "count(*)", length ) == 0 ) {
+            counted = true;
+        }
+        else if ( length != strlen( name ) || strncmp( cursor, name, length ) != 0 ) {
+            return EXIT_FAILURE;
+        }
+        cursor += length;
+    }
+    return counted ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+   Compiles a view's definition into the select its rows are kept by. Prints why if the
+   definition is invalid.
+*/
+static int compile_view( View *view, const char *definition ) {
+    snprintf( view->definition, sizeof( view->definition ), "%s", definition );
+    char select[MAX_SET_CLAUSE_LENGTH];
+    snprintf( select, sizeof( select ), "%s", definition );
+
+    // Split off "group by <column>".
+    char group_name[MAX_STRING_LENGTH] = "";
+    char *group = find_group_by( select );
+    if ( group != NULL ) {
+        char by[3];
+        char extra[2];
+        if ( sscanf( group, "group %2s %254s %1s", by, group_name, extra ) != 2 ) {
+            out_printf( "group by takes one column\n" );
+            return EXIT_FAILURE;
+        }
+        while ( group > select && ( group[-1] == ' ' || group[-1] == '\t' ) ) {
+            group--;
+        }
+        *group = '\0';
+    }
+
+    Query query = parse_query( select );
+    if ( query.type != SELECT || query.explain != EXPLAIN_NONE ) {
+        out_printf( "A view is defined by a select\n" );
+        return EXIT_FAILURE;
+    }
+    // The waitlist's rows move to its queues, whose changes are not reported to views.
+    const TableSchema *schema = find_table( query.table_name );
+    if ( schema == NULL || strcmp( query.table_name, "waitlist" ) == 0 ) {
+        out_printf( "Table %s cannot have views\n", query.table_name );
+        return EXIT_FAILURE;
+    }
+    snprintf( view->table_name, sizeof( view->table_name ), "%s", query.table_name );
+
+    // A grouped view keys its rows by the group column, a filter view by the whole row.
+    view->group_column = -1;
+    if ( group != NULL ) {
+        view->group_column = find_column( schema, group_name );
+        if ( view->group_column < 0 ||
+             check_group_columns( schema, query.columns, view->group_column ) != EXIT_SUCCESS ) {
+            out_printf( "columns invalid\n" );
+            return EXIT_FAILURE;
+        }
+        view->projection = ( Projection ){ 1, { view->group_column }, 1u << view->group_column };
+    }
+    else if ( parse_columns( schema, query.columns, &view->projection ) != EXIT_SUCCESS ) {
+        out_printf( "columns invalid\n" );
+        return EXIT_FAILURE;
+    }
+
+    // The condition is kept the same way a select keeps it.
+    ScanQuery *scan = &view->query;
+    *scan = ( ScanQuery ){ .schema = schema, .projection = &view->projection,
+                           .condition_column = -1, .comparison = COMPARE_EQUAL };
+    if ( query.condition_variable[0] != '\0' ) {
+        scan->condition_column = find_column( schema, query.condition_variable );
+        if ( scan->condition_column < 0 ||
+             parse_comparison( query.condition_type, &scan->comparison ) != EXIT_SUCCESS ) {
+            out_printf( "conditions invalid\n" );
+            return EXIT_FAILURE;
+        }
+        snprintf( view->condition_value, sizeof( view->condition_value ), "%s",
+                  query.condition_value );
+        parse_value( schema->columns[scan->condition_column].type, view->condition_value,
+                     &scan->value );
+    }
+    scan->needed = view->projection.mask;
+    if ( scan->condition_column >= 0 ) {
+        scan->needed |= 1u << scan->condition_column;
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Allocates a view and compiles its definition. Returns NULL if the definition is invalid. */
+static View *new_view( const char *view_name, const char *definition ) {
+    View *view = ( View * )calloc( 1, sizeof( View ) );
+    if ( view == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    snprintf( view->name, sizeof( view->name ), "%s", view_name );
+    if ( compile_view( view, definition ) != EXIT_SUCCESS ) {
+        free( view );
+        return NULL;
+    }
+    rows_init( &view->rows );
+    return view;
+}
+
+/** Frees a view. */
+static void free_view( View *view ) {
+    rows_free( &view->rows );
+    free( view );
+}
+
+/** Loads the saved view definitions, one "<name> <definition>" per line. */
+static void load_views( void ) {
+    char path[MAX_STR_LENGTH];
+    snprintf( path, sizeof( path ), "%s/%s", folder, VIEWS_FILE );
+    FILE *file = fopen( path, "r" );
+    if ( file == NULL ) {
+        return;
+    }
+    char line[MAX_STR_LENGTH + MAX_TABLE_NAME_LENGTH];
+    View **last = &views;
+    while ( fgets( line, sizeof( line ), file ) ) {
+        line[ strcspn( line, "\r\n" ) ] = '\0';
+        char *definition = strchr( line, ' ' );
+        if ( definition == NULL ) {
+            continue;
+        }
+        *definition++ = '\0';
+        View *view = new_view( line, definition );
+        if ( view == NULL ) {
+            err_printf( "Skipping view %s\n", line );
+            continue;
+        }
+        *last = view;
+        last = &view->next;
+        atomic_fetch_add( &view_count, 1 );
+    }
+    fclose( file );
+}
+
+/** Writes every view's definition to the views file. Called with the views' lock held. */
+static int save_views( void ) {
+    char path[MAX_STR_LENGTH], temp[MAX_STR_LENGTH];
+    snprintf( path, sizeof( path ), "%s/%s", folder, VIEWS_FILE );
+    snprintf( temp, sizeof( temp ), "%s/%s.tmp", folder, VIEWS_FILE );
+    FILE *file = fopen( temp, "w" );
+    if ( file == NULL ) {
+        return EXIT_FAILURE;
+    }
+    for ( View *view = views; view != NULL; view = view->next ) {
+        fprintf( file, "%s %s\n", view->name, view->definition );
+    }
+    if ( fclose( file ) != 0 || rename( temp, path ) != 0 ) {
+        remove( temp );
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/** Adds a row to a view, or takes it out (once) if remove is true. */
+static void apply_row( View *view, const char *line, bool remove ) {
+    size_t length = strcspn( line, "\r\n" );
+    Value row[MAX_COLUMNS];
+    if ( !row_matches( &view->query, line, line + length, row ) ) {
+        return;
+    }
+    const char *key = line;
+    Sink formatted = { 0 };
+    if ( view->group_column >= 0 ) {
+        // The key is the group column's value as select prints it.
+        if ( sink_open_memory( &formatted, 64 ) != EXIT_SUCCESS ) {
+            err_printf( "Memory allocation error\n" );
+            exit( EXIT_FAILURE );
+        }
+        print_row( &formatted, view->query.schema, row, &view->projection );
+        key = formatted.buffer;
+        length = formatted.length - 1;
+    }
+    if ( remove ) {
+        rows_remove( &view->rows, key, length );
+    }
+    else {
+        rows_add( &view->rows, key, length );
+    }
+    free( formatted.buffer );
+}
+
+/**
+   Builds a view's rows with one scan of its table, if they are not built. The table's write lock
+   is held so no change is missed; a table that does not exist gives an empty view.
+*/
+static void build_view( const char *view_name ) {
+    char table_name[MAX_TABLE_NAME_LENGTH];
+    pthread_mutex_lock( &views_lock );
+    View *view = find_view( view_name );
+    bool built = view == NULL || view->built;
+    if ( !built ) {
+        snprintf( table_name, sizeof( table_name ), "%s", view->table_name );
+    }
+    pthread_mutex_unlock( &views_lock );
+    if ( built ) {
+        return;
+    }
+
+    TableLock *lock = write_lock_table( table_name );
+    pthread_mutex_lock( &views_lock );
+    view = find_view( view_name );
+    if ( view != NULL && !view->built ) {
+        PartitionList list;
+        list_partitions( table_name, "", "", "", &list );
+        for ( int i = 0; i < list.count; i++ ) {
+            char path[MAX_STR_LENGTH];
+            snprintf( path, sizeof( path ), "%s/%s", folder, list.names[i] );
+            bool compressed;
+            FILE *file = open_table_file( path, &compressed );
+            if ( file != NULL ) {
+                char line[MAX_STR_LENGTH];
+                while ( fgets( line, sizeof( line ), file ) ) {
+                    apply_row( view, line, false );
+                }
+                fclose( file );
+            }
+        }
+        free_partition_list( &list );
+        view->built = true;
+    }
+    pthread_mutex_unlock( &views_lock );
+    write_unlock_table( lock );
+}
+
+/** Creates a view and builds it. */
+int create_view( const char *view_name, const char *definition ) {
+    pthread_once( &views_once, load_views );
+    char path[MAX_STR_LENGTH];
+    snprintf( path, sizeof( path ), "%s/%s", folder, view_name );
+    if ( find_table( view_name ) != NULL || access( path, F_OK ) == 0 ) {
+        out_printf( "Table '%s' already exists.\n", view_name );
+        return EXIT_FAILURE;
+    }
+    View *view = new_view( view_name, definition );
+    if ( view == NULL ) {
+        return EXIT_FAILURE;
+    }
+
+    pthread_mutex_lock( &views_lock );
+    if ( find_view( view_name ) != NULL ) {
+        pthread_mutex_unlock( &views_lock );
+        free_view( view );
+        out_printf( "View '%s' already exists.\n", view_name );
+        return EXIT_FAILURE;
+    }
+    View **last = &views;
+    while ( *last != NULL ) {
+        last = &( *last )->next;
+    }
+    *last = view;
+    if ( save_views() != EXIT_SUCCESS ) {
+        *last = NULL;
+        pthread_mutex_unlock( &views_lock );
+        free_view( view );
+        out_printf( "Failed to create '%s' view.\n", view_name );
+        return EXIT_FAILURE;
+    }
+    atomic_fetch_add( &view_count, 1 );
+    pthread_mutex_unlock( &views_lock );
+
+    build_view( view_name );
+    out_printf( "View '%s' created successfully.\n", view_name );
+    return EXIT_SUCCESS;
+}
+
+/** Drops a view. */
+int drop_view( const char *view_name ) {
+    pthread_once( &views_once, load_views );
+    pthread_mutex_lock( &views_lock );
+    View **link = &views;
+    while ( *link != NULL && strcmp( ( *link )->name, view_name ) != 0 ) {
+        link = &( *link )->next;
+    }
+    View *view = *link;
+    if ( view == NULL ) {
+        pthread_mutex_unlock( &views_lock );
+        out_printf( "View %s does not exist!\n", view_name );
+        return EXIT_FAILURE;
+    }
+    *link = view->next;
+    save_views();
+    atomic_fetch_sub( &view_count, 1 );
+    pthread_mutex_unlock( &views_lock );
+    free_view( view );
+    out_printf( "View dropped successfully!\n" );
+    return EXIT_SUCCESS;
+}
+
+/** Checks for a view. */
+bool view_exists( const char *view_name ) {
+    pthread_once( &views_once, load_views );
+    if ( atomic_load( &view_count ) == 0 ) {
+        return false;
+    }
+    pthread_mutex_lock( &views_lock );
+    bool exists = find_view( view_name ) != NULL;
+    pthread_mutex_unlock( &views_lock );
+    return exists;
+}
+
+/** Prints a view's rows. */
+int select_view( const char *view_name, const char *columns, const char *condition_var ) {
+    if ( ( columns[0] != '\0' && strcmp( columns, "*" ) != 0 ) || condition_var[0] != '\0' ) {
+        out_printf( "A view is read whole: select * from %s\n", view_name );
+        return EXIT_FAILURE;
+    }
+    build_view( view_name );
+
+    pthread_mutex_lock( &views_lock );
+    View *view = find_view( view_name );
+    if ( view == NULL ) {
+        pthread_mutex_unlock( &views_lock );
+        out_printf( "View %s does not exist!\n", view_name );
+        return EXIT_FAILURE;
+    }
+    Sink *sink = output_sink();
+    const ViewRows *rows = &view->rows;
+    for ( int i = rows->first; i >= 0; i = rows->entries[i].next ) {
+        const ViewEntry *entry = &rows->entries[i];
+        if ( view->group_column >= 0 ) {
+            sink_puts( sink, entry->key );
+            sink_putc( sink, ' ' );
+            sink_int( sink, ( int )entry->count );
+            sink_putc( sink, '\n' );
+            continue;
+        }
+        Value row[MAX_COLUMNS];
+        const char *end = entry->key + strlen( entry->key );
+        if ( decode_row( view->query.schema, entry->key, end, row,
+                         view->projection.mask ) == EXIT_SUCCESS ) {
+            for ( long copy = 0; copy < entry->count; copy++ ) {
+                print_row( sink, view->query.schema, row, &view->projection );
+            }
+        }
+    }
+    pthread_mutex_unlock( &views_lock );
+    return EXIT_SUCCESS;
+}
+
+/** Prints how a select on a view is run. */
+int explain_view( const char *view_name ) {
+    build_view( view_name );
+    pthread_mutex_lock( &views_lock );
+    View *view = find_view( view_name );
+    if ( view == NULL ) {
+        pthread_mutex_unlock( &views_lock );
+        out_printf( "View %s does not exist!\n", view_name );
+        return EXIT_FAILURE;
+    }
+    out_printf( "Select on view %s\n", view_name );
+    out_printf( "  definition: %s\n", view->definition );
+    if ( view->group_column >= 0 ) {
+        out_printf( "  access: materialized view, %d groups of %ld rows of %s\n", view->rows.size,
+                    view->rows.rows, view->table_name );
+    }
+    else {
+        out_printf( "  access: materialized view, %ld rows of %s\n", view->rows.rows,
+                    view->table_name );
+    }
+    pthread_mutex_unlock( &views_lock );
+    return EXIT_SUCCESS;
+}
+
+/** Adds inserted rows to a table's built views. */
+void view_rows_inserted( const char *table_name, const char *const *rows, int count ) {
+    pthread_once( &views_once, load_views );
+    if ( atomic_load( &view_count ) == 0 ) {
+        return;
+    }
+    pthread_mutex_lock( &views_lock );
+    for ( View *view = views; view != NULL; view = view->next ) {
+        if ( view->built && strcmp( view->table_name, table_name ) == 0 ) {
+            for ( int i = 0; i < count; i++ ) {
+                apply_row( view, rows[i], false );
+            }
+        }
+    }
+    pthread_mutex_unlock( &views_lock );
+}
+
+/** Moves an updated or deleted row in a table's built views. */
+void view_row_changed( const char *table_name, const char *old_row, const char *new_row ) {
+    pthread_once( &views_once, load_views );
+    if ( atomic_load( &view_count ) == 0 ) {
+        return;
+    }
+    pthread_mutex_lock( &views_lock );
+    for ( View *view = views; view != NULL; view = view->next ) {
+        if ( view->built && strcmp( view->table_name, table_name ) == 0 ) {
+            apply_row( view, old_row, true );
+            if ( new_row != NULL ) {
+                apply_row( view, new_row, false );
+            }
+        }
+    }
+    pthread_mutex_unlock( &views_lock );
+}
+
+/** Throws away the rows of a table's views. */
+void invalidate_views( const char *table_name ) {
+    pthread_once( &views_once, load_views );
+    if ( atomic_load( &view_count ) == 0 ) {
+        return;
+    }
+    pthread_mutex_lock( &views_lock );
+    for ( View *view = views; view != NULL; view = view->next ) {
+        if ( view->built && strcmp( view->table_name, table_name ) == 0 ) {
+            rows_free( &view->rows );
+            rows_init( &view->rows );
+            view->built = false;
+        }
+    }
+    pthread_mutex_unlock( &views_lock );
+}
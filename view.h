@@ -0,0 +1,82 @@
+/**
+   @file view.h
+   @author Michael Warstler (mwwarstl)
+   Header file for materialized views. A view is a select on one table, saved under a name with
+   "create view <name> as <select>". A filter view keeps the rows of the table that meet the
+   select's condition; a grouped view ("... group by <column>") keeps a count of those rows for
+   each value of the column. Views are kept in memory and changed as rows are inserted, updated,
+   and deleted, so reading one costs as much as its rows, not its table. Definitions are saved in
+   folder/.views; each view's rows are built with one scan of its table when it is created or
+   first used after the program starts. Functions that report a change are called with the
+   table's write lock held.
+*/
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <stdbool.h>
+
+/**
+   Creates a view and builds its rows from its table.
+   @param view_name is string name of the view. It cannot be the name of a table.
+   @param definition is the select the view holds the result of, optionally followed by
+                     "group by <column>" with "count(*)" (and the column) as its columns.
+   @return is EXIT_FAILURE if the name is taken or the definition is invalid, otherwise
+           EXIT_SUCCESS
+*/
+int create_view( const char *view_name, const char *definition );
+
+/**
+   Drops a view.
+   @param view_name is string name of the view.
+   @return is EXIT_FAILURE if there is no such view, otherwise EXIT_SUCCESS
+*/
+int drop_view( const char *view_name );
+
+/**
+   Checks whether a view exists.
+   @param view_name is string name of the view.
+   @return is true if the view exists.
+*/
+bool view_exists( const char *view_name );
+
+/**
+   Prints a view's rows: a filter view's selected columns, or a grouped view's values with their
+   counts, in the order they entered the view. A view is read whole.
+   @param view_name is string name of the view.
+   @param columns is the columns asked for, which must be empty or "*".
+   @param condition_var is the condition column asked for, which must be empty.
+   @return is EXIT_FAILURE if the view could not be read, otherwise EXIT_SUCCESS
+*/
+int select_view( const char *view_name, const char *columns, const char *condition_var );
+
+/**
+   Prints how a select on a view is run: its definition and the number of rows it holds.
+   @param view_name is string name of the view.
+   @return is EXIT_FAILURE if there is no such view, otherwise EXIT_SUCCESS
+*/
+int explain_view( const char *view_name );
+
+/**
+   Reports rows added to a table.
+   @param table_name is string name of the table.
+   @param rows is the rows added.
+   @param count is the number of rows.
+*/
+void view_rows_inserted( const char *table_name, const char *const *rows, int count );
+
+/**
+   Reports a row of a table that was updated or deleted.
+   @param table_name is string name of the table.
+   @param old_row is the row as it was, newline optional.
+   @param new_row is the row as it is now, or NULL if it was deleted.
+*/
+void view_row_changed( const char *table_name, const char *old_row, const char *new_row );
+
+/**
+   Throws away the rows of every view of a table, to be built again when next read. Used when the
+   table is created, dropped, or changed in a way its views could not follow.
+   @param table_name is string name of the table.
+*/
+void invalidate_views( const char *table_name );
+
+#endif //VIEW_H
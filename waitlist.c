@@ -0,0 +1,464 @@
+/**
+   @file waitlist.c
+   @author Michael Warstler (mwwarstl)
+   Implementation file for the waitlist queues. Members waiting are kept in an array, each linked
+   to the members before and after it in its book's queue, and found by (book_id, member_id) in a
+   chained hash table. Books are kept the same way, each holding the first and last member of its
+   queue. Members who leave are put on a free list and their places reused. Every queue is guarded
+   by one lock, which is also held while a change is appended to the log, so the log's order is
+   the order the changes were made in.
+*/
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "block.h"
+#include "database.h"
+#include "lock.h"
+#include "sink.h"
+#include "storage.h"
+#include "waitlist.h"
+
+/** Name of the log the queues are saved in, inside the tables folder */
+#define WAITLIST_LOG ".waitlist.queue"
+/** Number of hash buckets each table starts with, a power of 2 */
+#define WAITLIST_BUCKETS 64
+/** Lines for members who have left that the log may hold before it is rewritten */
+#define COMPACT_SLACK 1024
+
+/** A Waiter is a member in a book's queue. prev, next, and chain are -1 at the end of a list. */
+typedef struct {
+    int book_id;
+    int member_id;
+    int prev;
+    int next;
+    int chain;
+} Waiter;
+
+/** A BookQueue is the queue of one book, from the first member waiting to the last. */
+typedef struct {
+    int book_id;
+    int head;
+    int tail;
+    int length;
+    int chain;
+} BookQueue;
+
+/** Members waiting, with a hash table on (book_id, member_id) and a list of free places */
+static Waiter *waiters;
+static int waiter_count;
+static int waiter_capacity;
+static int free_waiter = -1;
+static int *waiter_buckets;
+static int waiter_bucket_count;
+static int live_waiters;
+
+/** Books with a queue, with a hash table on book_id */
+static BookQueue *books;
+static int book_count;
+static int book_capacity;
+static int *book_buckets;
+static int book_bucket_count;
+
+/** Log the queues are appended to, and the number of lines in it */
+static int log_fd = -1;
+static long log_lines;
+
+/** Guards every queue and the log */
+static pthread_mutex_t waitlist_lock = PTHREAD_MUTEX_INITIALIZER;
+/** Whether the queues have been loaded since the program started or they were dropped */
+static bool loaded;
+
+/** Hashes one or two ids. */
+static unsigned hash_ids( int first, int second ) {
+    uint64_t hash = ( ( uint64_t )( unsigned )first << 32 | ( unsigned )second ) *
+                    0x9E3779B97F4A7C15ull;
+    return ( unsigned )( hash >> 32 );
+}
+
+/** Allocates a table of empty buckets. */
+static int *new_buckets( int count ) {
+    int *buckets = ( int * )malloc( count * sizeof( int ) );
+    if ( buckets == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    memset( buckets, -1, count * sizeof( int ) );
+    return buckets;
+}
+
+/** Makes room in an array for one more element. */
+static void *reserve( void *array, int count, int *capacity, size_t size ) {
+    if ( count < *capacity ) {
+        return array;
+    }
+    *capacity = *capacity > 0 ? *capacity * 2 : WAITLIST_BUCKETS;
+    array = realloc( array, *capacity * size );
+    if ( array == NULL ) {
+        err_printf( "Memory allocation error\n" );
+        exit( EXIT_FAILURE );
+    }
+    return array;
+}
+
+/** Finds a book's queue, adding an empty one if create is true. Returns -1 if there is none. */
+static int find_book( int book_id, bool create ) {
+    int i = book_buckets[ hash_ids( book_id, 0 ) & ( book_bucket_count - 1 ) ];
+    while ( i >= 0 && books[i].book_id != book_id ) {
+        i = books[i].chain;
+    }
+    if ( i >= 0 || !create ) {
+        return i;
+    }
+
+    // Add the book, doubling the buckets once there are more books than buckets.
+    books = ( BookQueue * )reserve( books, book_count, &book_capacity, sizeof( BookQueue ) );
+    i = book_count++;
+    int bucket = hash_ids( book_id, 0 ) & ( book_bucket_count - 1 );
+    books[i] = ( BookQueue ){ book_id, -1, -1, 0, book_buckets[bucket] };
+    book_buckets[bucket] = i;
+    if ( book_count > book_bucket_count ) {
+        free( book_buckets );
+        book_bucket_count *= 2;
+        book_buckets = new_buckets( book_bucket_count );
+        for ( int j = 0; j < book_count; j++ ) {
+            bucket = hash_ids( books[j].book_id, 0 ) & ( book_bucket_count - 1 );
+            books[j].chain = book_buckets[bucket];
+            book_buckets[bucket] = j;
+        }
+    }
+    return i;
+}
+
+/** Finds the bucket link that leads to a member waiting for a book, which is -1 if none does. */
+static int *find_waiter( int book_id, int member_id ) {
+    int *link = &waiter_buckets[ hash_ids( book_id, member_id ) & ( waiter_bucket_count - 1 ) ];
+    while ( *link >= 0 &&
+            ( waiters[ *link ].book_id != book_id || waiters[ *link ].member_id != member_id ) ) {
+        link = &waiters[ *link ].chain;
+    }
+    return link;
+}
+
+/** Moves every waiter to a table of twice as many buckets. */
+static void grow_waiter_buckets( void ) {
+    free( waiter_buckets );
+    waiter_bucket_count *= 2;
+    waiter_buckets = new_buckets( waiter_bucket_count );
+    for ( int b = 0; b < book_count; b++ ) {
+        for ( int i = books[b].head; i >= 0; i = waiters[i].next ) {
+            int bucket = hash_ids( waiters[i].book_id, waiters[i].member_id ) &
+                         ( waiter_bucket_count - 1 );
+            waiters[i].chain = waiter_buckets[bucket];
+            waiter_buckets[bucket] = i;
+        }
+    }
+}
+
+/**
+   Adds a member to the end of a book's queue. Returns the member's position in the queue, or 0
+   if they are already waiting.
+*/
+static int push_waiter( int book_id, int member_id ) {
+    int *link = find_waiter( book_id, member_id );
+    if ( *link >= 0 ) {
+        return 0;
+    }
+    int i = free_waiter;
+    if ( i >= 0 ) {
+        free_waiter = waiters[i].chain;
+    }
+    else {
+        waiters = ( Waiter * )reserve( waiters, waiter_count, &waiter_capacity, sizeof( Waiter ) );
+        link = find_waiter( book_id, member_id );
+        i = waiter_count++;
+    }
+    int book = find_book( book_id, true );
+    BookQueue *queue = &books[book];
+    waiters[i] = ( Waiter ){ book_id, member_id, queue->tail, -1, -1 };
+    *link = i;
+    if ( queue->tail >= 0 ) {
+        waiters[ queue->tail ].next = i;
+    }
+    else {
+        queue->head = i;
+    }
+    queue->tail = i;
+    queue->length++;
+    if ( ++live_waiters > waiter_bucket_count ) {
+        grow_waiter_buckets();
+    }
+    return queue->length;
+}
+
+/** Takes a member off a book's queue. Returns false if they are not waiting. */
+static bool pop_waiter( int book_id, int member_id ) {
+    int *link = find_waiter( book_id, member_id );
+    int i = *link;
+    if ( i < 0 ) {
+        return false;
+    }
+    *link = waiters[i].chain;
+    BookQueue *queue = &books[ find_book( book_id, false ) ];
+    if ( waiters[i].prev >= 0 ) {
+        waiters[ waiters[i].prev ].next = waiters[i].next;
+    }
+    else {
+        queue->head = waiters[i].next;
+    }
+    if ( waiters[i].next >= 0 ) {
+        waiters[ waiters[i].next ].prev = waiters[i].prev;
+    }
+    else {
+        queue->tail = waiters[i].prev;
+    }
+    queue->length--;
+    waiters[i].chain = free_waiter;
+    free_waiter = i;
+    live_waiters--;
+    return true;
+}
+
+/** Builds the path of the log, or of the file it is rewritten into. */
+static void log_path( char *path, size_t size, const char *suffix ) {
+    snprintf( path, size, "%s/%s%s", folder, WAITLIST_LOG, suffix );
+}
+
+/**
+   Rewrites the log with a line for each member still waiting and opens it for appending.
+   Returns EXIT_FAILURE if it could not be written; the old log is then kept.
+*/
+static int compact_log( void ) {
+    char path[MAX_STR_LENGTH], temp[MAX_STR_LENGTH];
+    log_path( path, sizeof( path ), "" );
+    log_path( temp, sizeof( temp ), ".tmp" );
+    FILE *file = fopen( temp, "w" );
+    if ( file == NULL ) {
+        return EXIT_FAILURE;
+    }
+    for ( int b = 0; b < book_count; b++ ) {
+        for ( int i = books[b].head; i >= 0; i = waiters[i].next ) {
+            fprintf( file, "+ %d %d\n", waiters[i].book_id, waiters[i].member_id );
+        }
+    }
+    bool failed = ferror( file ) != 0;
+    if ( fclose( file ) != 0 || failed || rename( temp, path ) != 0 ) {
+        remove( temp );
+        return EXIT_FAILURE;
+    }
+    if ( log_fd >= 0 ) {
+        close( log_fd );
+    }
+    log_fd = open( path, O_WRONLY | O_APPEND | O_CLOEXEC );
+    log_lines = live_waiters;
+    return log_fd >= 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/** Replays the log, or starts the queues from the waitlist table if there is no log. */
+static void load_waitlist( void ) {
+    waiter_bucket_count = book_bucket_count = WAITLIST_BUCKETS;
+    waiter_buckets = new_buckets( waiter_bucket_count );
+    book_buckets = new_buckets( book_bucket_count );
+
+    char path[MAX_STR_LENGTH];
+    log_path( path, sizeof( path ), "" );
+    FILE *file = fopen( path, "r" );
+    if ( file != NULL ) {
+        char line[MAX_STR_LENGTH];
+        char change;
+        int book_id, member_id;
+        while ( fgets( line, sizeof( line ), file ) ) {
+            if ( sscanf( line, "%c %d %d", &change, &book_id, &member_id ) != 3 ) {
+                continue;
+            }
+            if ( change == '+' ) {
+                push_waiter( book_id, member_id );
+            }
+            else if ( change == '-' ) {
+                pop_waiter( book_id, member_id );
+            }
+            log_lines++;
+        }
+        fclose( file );
+        log_fd = open( path, O_WRONLY | O_APPEND | O_CLOEXEC );
+        return;
+    }
+
+    // The rows of the waitlist table, in the order they were inserted, start the queues.
+    char table[MAX_STR_LENGTH];
+    snprintf( table, sizeof( table ), "%s/waitlist", folder );
+    TableLock *lock = write_lock_table( "waitlist" );
+    bool compressed;
+    file = open_table_file( table, &compressed );
+    if ( file != NULL ) {
+        char line[MAX_STR_LENGTH];
+        int book_id, member_id;
+        while ( fgets( line, sizeof( line ), file ) ) {
+            if ( sscanf( line, "%d %d", &book_id, &member_id ) == 2 ) {
+                push_waiter( book_id, member_id );
+            }
+        }
+        fclose( file );
+    }
+    write_unlock_table( lock );
+    compact_log();
+}
+
+/** Takes the lock, loading the queues first if they have not been. */
+static void lock_waitlist( void ) {
+    pthread_mutex_lock( &waitlist_lock );
+    if ( !loaded ) {
+        load_waitlist();
+        loaded = true;
+    }
+}
+
+/**
+   Appends a change to the log, rewriting it first if most of its lines are for members who have
+   left. Called with the lock held.
+*/
+static int append_log( char change, int book_id, int member_id ) {
+    if ( log_fd < 0 || log_lines > 2L * live_waiters + COMPACT_SLACK ) {
+        compact_log();
+    }
+    if ( log_fd < 0 ) {
+        return EXIT_FAILURE;
+    }
+    char line[64];
+    int length = snprintf( line, sizeof( line ), "%c %d %d\n", change, book_id, member_id );
+    struct iovec part = { line, length };
+    if ( storage_write( log_fd, &part, 1 ) != EXIT_SUCCESS ) {
+        return EXIT_FAILURE;
+    }
+    log_lines++;
+    return EXIT_SUCCESS;
+}
+
+/** Adds a waiter to a sink as a waitlist row. */
+static void print_waiter( Sink *sink, const Waiter *waiter ) {
+    sink_int( sink, waiter->book_id );
+    sink_putc( sink, ' ' );
+    sink_int( sink, waiter->member_id );
+    sink_putc( sink, '\n' );
+}
+
+/** Adds a member to the end of a book's queue. */
+int enqueue_waitlist( int book_id, int member_id ) {
+    lock_waitlist();
+    int position = push_waiter( book_id, member_id );
+    if ( position == 0 ) {
+        pthread_mutex_unlock( &waitlist_lock );
+        out_printf( "Member %d is already waiting for book %d.\n", member_id, book_id );
+        return EXIT_FAILURE;
+    }
+    if ( append_log( '+', book_id, member_id ) != EXIT_SUCCESS ) {
+        pop_waiter( book_id, member_id );
+        pthread_mutex_unlock( &waitlist_lock );
+        out_printf( "Unable to save the waitlist\n" );
+        return EXIT_FAILURE;
+    }
+    pthread_mutex_unlock( &waitlist_lock );
+    out_printf( "Member %d is number %d in line for book %d.\n", member_id, position, book_id );
+    return EXIT_SUCCESS;
+}
+
+/** Prints the member at the front of a book's queue. */
+int peek_waitlist( int book_id ) {
+    lock_waitlist();
+    int book = find_book( book_id, false );
+    if ( book < 0 || books[book].head < 0 ) {
+        pthread_mutex_unlock( &waitlist_lock );
+        out_printf( "No one is waiting for book %d.\n", book_id );
+        return EXIT_FAILURE;
+    }
+    print_waiter( output_sink(), &waiters[ books[book].head ] );
+    pthread_mutex_unlock( &waitlist_lock );
+    return EXIT_SUCCESS;
+}
+
+/** Takes the member at the front of a book's queue off it. */
+int dequeue_waitlist( int book_id ) {
+    lock_waitlist();
+    int book = find_book( book_id, false );
+    if ( book < 0 || books[book].head < 0 ) {
+        pthread_mutex_unlock( &waitlist_lock );
+        out_printf( "No one is waiting for book %d.\n", book_id );
+        return EXIT_FAILURE;
+    }
+    Waiter first = waiters[ books[book].head ];
+    if ( append_log( '-', book_id, first.member_id ) != EXIT_SUCCESS ) {
+        pthread_mutex_unlock( &waitlist_lock );
+        out_printf( "Unable to save the waitlist\n" );
+        return EXIT_FAILURE;
+    }
+    pop_waiter( book_id, first.member_id );
+    print_waiter( output_sink(), &first );
+    pthread_mutex_unlock( &waitlist_lock );
+    return EXIT_SUCCESS;
+}
+
+/** Takes a member off a book's queue wherever they are in it. */
+int leave_waitlist( int book_id, int member_id ) {
+    lock_waitlist();
+    if ( *find_waiter( book_id, member_id ) < 0 ) {
+        pthread_mutex_unlock( &waitlist_lock );
+        out_printf( "Member %d is not waiting for book %d.\n", member_id, book_id );
+        return EXIT_FAILURE;
+    }
+    if ( append_log( '-', book_id, member_id ) != EXIT_SUCCESS ) {
+        pthread_mutex_unlock( &waitlist_lock );
+        out_printf( "Unable to save the waitlist\n" );
+        return EXIT_FAILURE;
+    }
+    pop_waiter( book_id, member_id );
+    pthread_mutex_unlock( &waitlist_lock );
+    out_printf( "Member %d left the line for book %d.\n", member_id, book_id );
+    return EXIT_SUCCESS;
+}
+
+/** Adds every member waiting to a sink, each book's queue from its front. */
+void sink_waitlist( Sink *sink ) {
+    lock_waitlist();
+    for ( int b = 0; b < book_count; b++ ) {
+        for ( int i = books[b].head; i >= 0; i = waiters[i].next ) {
+            print_waiter( sink, &waiters[i] );
+        }
+    }
+    pthread_mutex_unlock( &waitlist_lock );
+}
+
+/** Checks whether a table is the waitlist and its rows are kept in the queues. */
+bool waitlist_queued( const char *table_name ) {
+    if ( strcmp( table_name, "waitlist" ) != 0 ) {
+        return false;
+    }
+    char path[MAX_STR_LENGTH];
+    log_path( path, sizeof( path ), "" );
+    return access( path, F_OK ) == 0;
+}
+
+/** Forgets every queue and removes the log. */
+void drop_waitlist( void ) {
+    pthread_mutex_lock( &waitlist_lock );
+    free( waiters );
+    free( waiter_buckets );
+    free( books );
+    free( book_buckets );
+    waiters = NULL;
+    waiter_buckets = NULL;
+    books = NULL;
+    book_buckets = NULL;
+    waiter_count = waiter_capacity = live_waiters = 0;
+    book_count = book_capacity = 0;
+    free_waiter = -1;
+    if ( log_fd >= 0 ) {
+        close( log_fd );
+        log_fd = -1;
+    }
+    log_lines = 0;
+    char path[MAX_STR_LENGTH];
+    log_path( path, sizeof( path ), "" );
+    remove( path );
+    loaded = false;
+    pthread_mutex_unlock( &waitlist_lock );
+}
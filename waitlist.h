@@ -0,0 +1,75 @@
+/**
+   @file waitlist.h
+   @author Michael Warstler (mwwarstl)
+   Header file for the waitlist queues. Each book has a first in, first out queue of the members
+   waiting for it, so adding a member, seeing who is next, and taking them off the queue each take
+   constant time, as does checking whether a member is already waiting. The queues are kept in
+   memory and saved in folder/.waitlist.queue as a log that is only appended to: "+ <book_id>
+   <member_id>" when a member joins a queue and "- <book_id> <member_id>" when they leave it. The
+   log is replayed when the queues are first used and rewritten with only the members still
+   waiting once most of its lines are for members who have left. If there is no log yet, the
+   queues start from the rows of the waitlist table, in the order they were inserted. From then
+   on the queues are the waitlist: the table is not changed or read again until it is dropped,
+   which drops the queues with it, and read_file and write_file print the queues in its place.
+*/
+#ifndef WAITLIST_H
+#define WAITLIST_H
+
+#include <stdbool.h>
+#include "sink.h"
+
+/**
+   Adds a member to the end of a book's queue.
+   @param book_id is the book waited for.
+   @param member_id is the member waiting.
+   @return is EXIT_FAILURE if the member is already waiting for the book or the change could not
+           be saved, otherwise EXIT_SUCCESS
+*/
+int enqueue_waitlist( int book_id, int member_id );
+
+/**
+   Prints the member at the front of a book's queue as a waitlist row.
+   @param book_id is the book waited for.
+   @return is EXIT_FAILURE if no one is waiting for the book, otherwise EXIT_SUCCESS
+*/
+int peek_waitlist( int book_id );
+
+/**
+   Takes the member at the front of a book's queue off it and prints them as a waitlist row.
+   @param book_id is the book waited for.
+   @return is EXIT_FAILURE if no one is waiting for the book or the change could not be saved,
+           otherwise EXIT_SUCCESS
+*/
+int dequeue_waitlist( int book_id );
+
+/**
+   Takes a member off a book's queue wherever they are in it.
+   @param book_id is the book waited for.
+   @param member_id is the member waiting.
+   @return is EXIT_FAILURE if the member is not waiting for the book or the change could not be
+           saved, otherwise EXIT_SUCCESS
+*/
+int leave_waitlist( int book_id, int member_id );
+
+/**
+   Adds every member waiting to a sink as waitlist rows, each book's queue from its front. Once
+   the queues are in use these are the waitlist table's rows.
+   @param sink is the sink the rows are added to.
+*/
+void sink_waitlist( Sink *sink );
+
+/**
+   Checks whether a table is the waitlist and its rows are kept in the queues, so it is not to be
+   changed or read directly.
+   @param table_name is string name of the table.
+   @return is true if it is.
+*/
+bool waitlist_queued( const char *table_name );
+
+/**
+   Forgets every queue and removes the log, so the queues start from the waitlist table again
+   the next time they are used. Called when the waitlist table is dropped.
+*/
+void drop_waitlist( void );
+
+#endif //WAITLIST_H